@@ -0,0 +1,110 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "bench.h"
+
+static atomic_ulong alloc_count;
+static atomic_ulong alloc_bytes;
+static unsigned long target_ns = 500 * 1000000UL;
+static const char *filter;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, size, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, nmemb * size, memory_order_relaxed);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, size, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s)
+{
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, strlen(s) + 1, memory_order_relaxed);
+    return __real_strdup(s);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int bench_parse_args(int argc, char *argv[])
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "t:f:h")) != -1) {
+        switch (c) {
+            case 't':
+                target_ns = strtoul(optarg, NULL, 0) * 1000000UL;
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-t <ms per benchmark>] [-f <name filter>]\n", argv[0]);
+                return -1;
+        }
+    }
+    return 0;
+}
+
+void bench_run(const char *name, bench_fn fn, void *arg)
+{
+    unsigned long iters = 1, count, bytes;
+    uint64_t start, elapsed;
+
+    if (filter && !strstr(name, filter))
+        return;
+
+    /* warm up and find an iteration count that takes ~1/10 of the target */
+    for (;;) {
+        start = now_ns();
+        fn(arg, iters);
+        elapsed = now_ns() - start;
+        if (elapsed >= target_ns / 10 || iters >= (1UL << 40))
+            break;
+        iters *= elapsed < target_ns / 1000 ? 16 : 2;
+    }
+    if (elapsed && elapsed < target_ns)
+        iters = (unsigned long)((double)iters * target_ns / elapsed);
+    if (iters == 0)
+        iters = 1;
+
+    count = atomic_load(&alloc_count);
+    bytes = atomic_load(&alloc_bytes);
+    start = now_ns();
+    fn(arg, iters);
+    elapsed = now_ns() - start;
+    count = atomic_load(&alloc_count) - count;
+    bytes = atomic_load(&alloc_bytes) - bytes;
+
+    printf("%-32s %12lu %12.1f ns/op %8.2f allocs/op %8.1f B/op\n", name, iters,
+           (double)elapsed / iters, (double)count / iters, (double)bytes / iters);
+    fflush(stdout);
+}
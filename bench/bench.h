@@ -0,0 +1,27 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stddef.h>
+
+/*
+ * Minimal benchmark harness.
+ *
+ * Each benchmark body runs `iters` times per call, the harness grows iters
+ * until one call takes long enough, then reports ns/op plus heap allocations
+ * and bytes per op. Allocations are counted through the linker's --wrap of
+ * malloc/calloc/realloc/strdup, so only calls made from devctl code are seen,
+ * allocations inside libc (fopen, getline, ...) are not.
+ */
+typedef void (*bench_fn)(void *arg, unsigned long iters);
+
+/* -t <ms> target time per benchmark, -f <substr> run matching names only */
+int bench_parse_args(int argc, char *argv[]);
+void bench_run(const char *name, bench_fn fn, void *arg);
+
+/* Keep the compiler from optimizing away results */
+static inline void bench_keep(const void *p)
+{
+    __asm__ __volatile__("" : : "g"(p) : "memory");
+}
+
+#endif
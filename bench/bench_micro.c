@@ -0,0 +1,257 @@
+/*
+ * Microbenchmarks for codec, buffer, string and config hot paths.
+ *
+ * devctl-bench-micro [-t <ms>] [-f <filter>]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "codec.h"
+#include "iobuf.h"
+#include "stdstring.h"
+#include "ini.h"
+#include "confdb.h"
+#include "log.h"
+
+static const char conf_text[] =
+    "[shell]\n"
+    "prompt=devctl> \n"
+    "history=100\n"
+    "\n"
+    "[serial/0]\n"
+    "path=/dev/ttyS0\n"
+    "baudrate=115200\n"
+    "\n"
+    "[serial/1]\n"
+    "path=/dev/ttyS1\n"
+    "baudrate=57600\n"
+    "\n"
+    "[usb/0]\n"
+    "vid=0x25a7\n"
+    "pid=0x5830\n"
+    "\n"
+    "[aw5808/0]\n"
+    "serial=/dev/ttyS2\n"
+    "usb=usb-0000:00:14.0-1/input0\n"
+    "mode=0\n";
+
+static char conf_file[] = "/tmp/devctl-bench-XXXXXX";
+
+static void bench_encode(void *arg, unsigned long iters)
+{
+    codec_t *codec = arg;
+    uint8_t frame[64], data[2] = {0x54};
+    size_t len = 0;
+
+    while (iters--) {
+        data[1] = iters & 1;
+        len += codec_encode(codec, data, sizeof(data), frame, sizeof(frame));
+        bench_keep(frame);
+    }
+    bench_keep(&len);
+}
+
+/* a read burst: 8 replies back to back, decoded the way on_serial_receive does */
+static void bench_decode(void *arg, unsigned long iters)
+{
+    codec_t *codec = arg;
+    static const uint8_t burst[] = {
+        0x55, 0xAA, 0x06, 0xD0, 0x01, 0x02, 0x03, 0x00, 0x01, 0x08, 0x00,
+        0x55, 0xAA, 0x01, 0xD1, 0x01, 0x00,
+        0x55, 0xAA, 0x01, 0x52, 0x03, 0x00,
+        0x55, 0xAA, 0x00, 0xD3, 0x00,
+        0x55, 0xAA, 0x01, 0xD4, 0x01, 0x00,
+        0x55, 0xAA, 0x01, 0xD5, 0x00, 0x00,
+        0x55, 0xAA, 0x01, 0xD7, 0x05, 0x00,
+        0x55, 0xAA, 0x01, 0xD8, 0x08, 0x00,
+    };
+    const uint8_t *data;
+    size_t data_len, sum = 0;
+
+    while (iters) {
+        const uint8_t *buf = burst;
+        size_t len = sizeof(burst), ret;
+
+        for (;;) {
+            ret = codec_decode(codec, buf, len, &data, &data_len);
+            if (!data)
+                break;
+            sum += data[0];
+            buf += ret;
+            len -= ret;
+            if (--iters == 0)
+                break;
+        }
+    }
+    bench_keep(&sum);
+}
+
+static void on_bench_frame(void *arg, const uint8_t *data, size_t len)
+{
+    *(size_t *)arg += len;
+}
+
+/* encode a 32 byte payload with escapable bytes and feed it back */
+static void bench_codec_roundtrip(void *arg, unsigned long iters)
+{
+    codec_t *codec = arg;
+    uint8_t data[32], frame[128];
+    size_t len, sum = 0;
+    int i;
+
+    for (i=0; i<sizeof(data); i++)
+        data[i] = i * 37;
+    data[0] = 0x54;
+    while (iters--) {
+        len = codec_encode(codec, data, sizeof(data), frame, sizeof(frame));
+        codec_feed(codec, frame, len, on_bench_frame, &sum);
+    }
+    bench_keep(&sum);
+}
+
+/* serial read path: append a read, consume a frame from the front */
+static void bench_iobuf(void *arg, unsigned long iters)
+{
+    struct iobuf io = {0};
+    uint8_t chunk[64];
+
+    memset(chunk, 0x55, sizeof(chunk));
+    iobuf_init(&io, 1024);
+    while (iters--) {
+        iobuf_add(&io, io.len, chunk, sizeof(chunk));
+        iobuf_del(&io, 0, 48);
+        if (io.len > 512)
+            iobuf_del(&io, 0, io.len);
+    }
+    bench_keep(io.buf);
+    iobuf_free(&io);
+}
+
+static void bench_iobuf_grow(void *arg, unsigned long iters)
+{
+    struct iobuf io = {0};
+    uint8_t chunk[256];
+
+    memset(chunk, 0xAA, sizeof(chunk));
+    while (iters--) {
+        int i;
+        iobuf_init(&io, IOBUF_CHUNK_SIZE);
+        for (i=0; i<64; i++)
+            iobuf_add(&io, io.len, chunk, sizeof(chunk));
+        bench_keep(io.buf);
+        iobuf_free(&io);
+    }
+}
+
+static void bench_string_split(void *arg, unsigned long iters)
+{
+    char *parts[8];
+    int i, n;
+
+    while (iters--) {
+        n = string_split("aw5808 0 set rfchannel 5", " ", parts, 8);
+        for (i=0; i<n; i++)
+            free(parts[i]);
+        bench_keep(parts);
+    }
+}
+
+static void bench_ini_gets(void *arg, unsigned long iters)
+{
+    char value[128];
+
+    while (iters--) {
+        ini_gets("aw5808/0", "usb", "", value, sizeof(value), conf_file);
+        bench_keep(value);
+    }
+}
+
+static void bench_ini_getl(void *arg, unsigned long iters)
+{
+    long sum = 0;
+
+    while (iters--)
+        sum += ini_getl("serial/1", "baudrate", 0, conf_file);
+    bench_keep(&sum);
+}
+
+static void bench_ini_getsection(void *arg, unsigned long iters)
+{
+    char section[64];
+    int i;
+
+    while (iters--) {
+        for (i=0; ini_getsection(i, section, sizeof(section), conf_file) > 0; i++)
+            bench_keep(section);
+    }
+}
+
+static void bench_confdb_get(void *arg, unsigned long iters)
+{
+    confdb_t *db = arg;
+    long sum = 0;
+
+    while (iters--) {
+        bench_keep(confdb_get(db, "aw5808/0", "usb"));
+        sum += confdb_getl(db, "serial/1", "baudrate", 0);
+    }
+    bench_keep(&sum);
+}
+
+int main(int argc, char *argv[])
+{
+    char snapshot[sizeof(conf_file) + 3], name[64];
+    const codec_ops_t *ops;
+    codec_t *codec;
+    confdb_t *db;
+    FILE *fp;
+    int fd;
+
+    if (bench_parse_args(argc, argv) != 0)
+        return 1;
+    log_set_quiet(true);
+
+    if ((fd = mkstemp(conf_file)) < 0 || !(fp = fdopen(fd, "w"))) {
+        perror(conf_file);
+        return 1;
+    }
+    fputs(conf_text, fp);
+    fclose(fp);
+    snprintf(snapshot, sizeof(snapshot), "%s.db", conf_file);
+
+    if ((codec = codec_new("aw5808_serial")) != NULL) {
+        bench_run("codec.aw5808_serial.encode", bench_encode, codec);
+        bench_run("codec.aw5808_serial.decode", bench_decode, codec);
+        codec_free(codec);
+    }
+    for (ops = codec_next(NULL); ops; ops = codec_next(ops)) {
+        if ((codec = codec_new(ops->name)) == NULL)
+            continue;
+        snprintf(name, sizeof(name), "codec.%s.roundtrip", ops->name);
+        bench_run(name, bench_codec_roundtrip, codec);
+        codec_free(codec);
+    }
+    bench_run("iobuf.add_del", bench_iobuf, NULL);
+    bench_run("iobuf.grow_16k", bench_iobuf_grow, NULL);
+    bench_run("string.split", bench_string_split, NULL);
+    bench_run("ini.gets", bench_ini_gets, NULL);
+    bench_run("ini.getl", bench_ini_getl, NULL);
+    bench_run("ini.getsection.all", bench_ini_getsection, NULL);
+
+    if (confdb_compile(conf_file, snapshot) == 0 && (db = confdb_open(conf_file, snapshot))) {
+        bench_run("confdb.get", bench_confdb_get, db);
+        confdb_close(db);
+    }
+    if ((db = confdb_open(conf_file, NULL))) {
+        bench_run("confdb.get.ini_image", bench_confdb_get, db);
+        confdb_close(db);
+    }
+
+    unlink(snapshot);
+    unlink(conf_file);
+    return 0;
+}
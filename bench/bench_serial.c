@@ -0,0 +1,206 @@
+/*
+ * aw5808 serial path benchmarks over a pseudo terminal.
+ *
+ * devctl-bench-serial [-t <ms>] [-f <filter>]
+ *
+ * serial.dispatch: reply frames are written to the PTY master in bursts and
+ * pumped through serial.c's read callback, on_serial_receive and the aw5808
+ * client callbacks, reported per frame.
+ * serial.roundtrip: aw5808_get_config() until on_get_config() fires, with a
+ * responder thread answering on the PTY master, reported per round trip.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <termios.h>
+#include <ev.h>
+
+#include "bench.h"
+#include "codec.h"
+#include "aw5808.h"
+#include "log.h"
+
+#define DISPATCH_BURST  64
+
+static int master = -1;
+static unsigned long callbacks;
+
+static size_t put_frame(codec_t *codec, uint8_t *frame, size_t size, uint8_t cmd, uint8_t arg)
+{
+    uint8_t data[2] = {cmd, arg};
+
+    return codec_encode(codec, data, sizeof(data), frame, size);
+}
+
+/* answer whatever the host sends, like the MCU would, with its own codec */
+static void *responder(void *arg)
+{
+    codec_t *codec = arg;
+    uint8_t rbuf[256], frame[16], reply[8];
+    size_t rlen = 0, used, ret, n;
+    const uint8_t *data;
+    size_t data_len;
+    ssize_t len;
+
+    while ((len = read(master, rbuf + rlen, sizeof(rbuf) - rlen)) > 0) {
+        rlen += len;
+        used = 0;
+        while ((ret = codec_decode(codec, rbuf + used, rlen - used, &data, &data_len)) != 0) {
+            used += ret;
+            if (!data)
+                continue;
+            if (data[0] == 0x50) {
+                static const uint8_t config[] = {0x01, 0x02, 0x03, 0x00, 0x01, 0x08};
+                reply[0] = 0xD0;
+                memcpy(&reply[1], config, sizeof(config));
+                n = codec_encode(codec, reply, 1 + sizeof(config), frame, sizeof(frame));
+            } else if (data[0] & 0x80) {
+                continue;
+            } else {
+                n = put_frame(codec, frame, sizeof(frame), data[0] | 0x80, data_len > 1 ? data[1] : 0);
+            }
+            if (write(master, frame, n) != n)
+                goto out;
+        }
+        memmove(rbuf, rbuf + used, rlen - used);
+        rlen -= used;
+    }
+out:
+    codec_free(codec);
+    return NULL;
+}
+
+static void on_get_config(aw5808_t *aw, uint16_t firmware_ver, uint8_t mcu_ver, aw5808_mode_t mode,
+                          uint8_t rf_channel, uint8_t rf_power)
+{
+    callbacks++;
+}
+
+static void on_rfstatus(aw5808_t *aw, uint8_t is_connected, uint8_t pair_status)
+{
+    callbacks++;
+}
+
+static void on_set_rfchannel(aw5808_t *aw, uint8_t channel)
+{
+    callbacks++;
+}
+
+static void on_set_rfpower(aw5808_t *aw, uint8_t power)
+{
+    callbacks++;
+}
+
+static struct aw5808_client_ops bench_ops = {
+    .on_get_config = on_get_config,
+    .on_get_rfstatus = on_rfstatus,
+    .on_notify_rfstatus = on_rfstatus,
+    .on_set_rfchannel = on_set_rfchannel,
+    .on_set_rfpower = on_set_rfpower,
+};
+
+static struct aw5808_client bench_client = {
+    .name = "bench",
+    .ops = &bench_ops,
+};
+
+struct bench_ctx {
+    struct ev_loop *loop;
+    aw5808_t *aw;
+    uint8_t burst[DISPATCH_BURST * 8];
+    size_t burst_len;
+};
+
+static void bench_dispatch(void *arg, unsigned long iters)
+{
+    struct bench_ctx *ctx = arg;
+    unsigned long done = 0, want;
+
+    while (done < iters) {
+        size_t len = ctx->burst_len;
+        want = callbacks + DISPATCH_BURST;
+        if (iters - done < DISPATCH_BURST) {
+            /* frames are 6 bytes each */
+            len = (iters - done) * 6;
+            want = callbacks + (iters - done);
+        }
+        if (write(master, ctx->burst, len) != len)
+            return;
+        while (callbacks < want)
+            ev_run(ctx->loop, EVRUN_ONCE);
+        done += DISPATCH_BURST;
+    }
+}
+
+static void bench_roundtrip(void *arg, unsigned long iters)
+{
+    struct bench_ctx *ctx = arg;
+
+    while (iters--) {
+        unsigned long want = callbacks + 1;
+        if (aw5808_get_config(ctx->aw) != 0)
+            return;
+        while (callbacks < want)
+            ev_run(ctx->loop, EVRUN_ONCE);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint8_t replies[][2] = {
+        {0xD1, 0x01}, {0x52, 0x03}, {0xD7, 0x05}, {0xD8, 0x08},
+    };
+    struct bench_ctx ctx = {0};
+    aw5808_options_t opt = {0};
+    codec_t *codec, *peer;
+    struct termios tio;
+    pthread_t tid;
+    const char *name;
+    int i;
+
+    if (bench_parse_args(argc, argv) != 0)
+        return 1;
+    log_set_quiet(true);
+    if ((codec = codec_new("aw5808_serial")) == NULL || (peer = codec_new("aw5808_serial")) == NULL)
+        return 1;
+
+    if ((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) < 0 ||
+        unlockpt(master) < 0 || !(name = ptsname(master))) {
+        perror("posix_openpt");
+        return 1;
+    }
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+    pthread_create(&tid, NULL, responder, peer);
+
+    ctx.loop = EV_DEFAULT;
+    snprintf(opt.serial, sizeof(opt.serial), "%s", name);
+    opt.mode = AW5808_MODE_I2S;
+    opt.loop = ctx.loop;
+    if (!(ctx.aw = aw5808_new()) || aw5808_open(ctx.aw, &opt) != 0) {
+        fprintf(stderr, "aw5808 on %s: %s\n", name, ctx.aw ? aw5808_errmsg(ctx.aw) : "no memory");
+        return 1;
+    }
+    aw5808_add_client(ctx.aw, &bench_client);
+
+    for (i=0; i<DISPATCH_BURST; i++)
+        ctx.burst_len += put_frame(codec, ctx.burst + ctx.burst_len, sizeof(ctx.burst) - ctx.burst_len, replies[i % 4][0], replies[i % 4][1]);
+
+    bench_run("serial.dispatch", bench_dispatch, &ctx);
+    bench_run("serial.roundtrip", bench_roundtrip, &ctx);
+
+    aw5808_close(ctx.aw);
+    aw5808_free(ctx.aw);
+    /* the master reads EIO once the slave is closed */
+    pthread_join(tid, NULL);
+    close(master);
+    codec_free(codec);
+    return 0;
+}
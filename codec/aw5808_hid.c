@@ -2,19 +2,36 @@
 #include <string.h>
 #include "codec.h"
 
-static size_t aw5808_hid_encode(uint8_t *frame, size_t data_len)
+/* hidraw hands over one 64 bytes report per read, a report is a frame */
+#define AW5808_HID_REPORT_SIZE  (64)
+
+static size_t aw5808_hid_bound(codec_t *codec, size_t data_len)
 {
-    return 0;
+    return AW5808_HID_REPORT_SIZE;
 }
 
-static size_t aw5808_hid_decode(const uint8_t *frame, size_t length, const uint8_t **data, size_t *data_len)
+static size_t aw5808_hid_encode(codec_t *codec, const uint8_t *data, size_t data_len, uint8_t *frame, size_t size)
 {
+    if (data_len > AW5808_HID_REPORT_SIZE || size < AW5808_HID_REPORT_SIZE)
+        return 0;
+    memmove(frame, data, data_len);
+    memset(frame + data_len, 0, AW5808_HID_REPORT_SIZE - data_len);
+    return AW5808_HID_REPORT_SIZE;
+}
 
-    return 0;
+static size_t aw5808_hid_decode(codec_t *codec, const uint8_t *frame, size_t length, const uint8_t **data, size_t *data_len)
+{
+    if (length < AW5808_HID_REPORT_SIZE)
+        return 0;
+    *data = frame;
+    *data_len = AW5808_HID_REPORT_SIZE;
+    return AW5808_HID_REPORT_SIZE;
 }
 
-aw5808_codec_t codec_aw5808_hid = {
-   .ident = "aw5808_hid",
+const codec_ops_t codec_aw5808_hid = {
+   .name = "aw5808_hid",
+   .stateless = true,
+   .bound = aw5808_hid_bound,
    .encode = aw5808_hid_encode,
    .decode = aw5808_hid_decode,
-};
\ No newline at end of file
+};
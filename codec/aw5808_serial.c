@@ -14,34 +14,54 @@ struct protocol_head_aw5080_serial {
     uint8_t data[0];
 };
 
-static size_t aw5808_serial_encode(uint8_t *frame, size_t data_len)
+static size_t aw5808_serial_bound(codec_t *codec, size_t data_len)
 {
-    if(data_len < 1)
+    return sizeof(struct protocol_head_aw5080_serial) + data_len + 1;
+}
+
+/* data is [1 byte cmd] [n byte payload] */
+static size_t aw5808_serial_encode(codec_t *codec, const uint8_t *data, size_t data_len, uint8_t *frame, size_t size)
+{
+    if (data_len < 1 || data_len - 1 > 0xFF)
         return 0;
-    
+
+    size_t checksum_len = 1;    /* 1 byte CheckSum */
+    size_t frame_len = sizeof(struct protocol_head_aw5080_serial) + data_len + checksum_len;
+    if (frame_len > size)
+        return 0;
+
     struct protocol_head_aw5080_serial *header = (struct protocol_head_aw5080_serial *)frame;
     header->preamble = PREAMBLE_AW5808_SERIAL;
     header->delimiter = DELIMITER_AW5808_SERIAL;
     header->payload_length = data_len - 1;
+    memmove(header->data, data, data_len);
     
-    size_t cmd_len = 1;         /* 1 byte CommandID */
-    size_t checksum_len = 1;    /* 1 byte CheckSum */
-    size_t frame_len = sizeof(struct protocol_head_aw5080_serial) + cmd_len + header->payload_length + checksum_len;
     uint8_t *checksum = (uint8_t*)header + frame_len -1;
     *checksum = 0x0;
     return frame_len;
 }
 
-/* 0x55 0xAA [1 byte datalen] [1 byte cmd] [ n byte pyaload] [1 byte checksum] */
-static size_t aw5808_serial_decode(const uint8_t *frame, size_t length, const uint8_t **data, size_t *data_len)
+/*
+ * 0x55 0xAA [1 byte datalen] [1 byte cmd] [ n byte pyaload] [1 byte checksum]
+ *
+ * Returns the bytes consumed: a whole frame with *data set, 0 when more
+ * input is needed, or the garbage up to the next preamble with *data NULL.
+ */
+static size_t aw5808_serial_decode(codec_t *codec, const uint8_t *frame, size_t length, const uint8_t **data, size_t *data_len)
 {
+    const struct protocol_head_aw5080_serial *header = (struct protocol_head_aw5080_serial *)frame;
+
     *data = NULL;
-    if (length < 4)
+    if (length < 1)
         return 0;
 
-    const struct protocol_head_aw5080_serial *header = (struct protocol_head_aw5080_serial *)frame;
-    if (header->preamble != PREAMBLE_AW5808_SERIAL || header->delimiter != DELIMITER_AW5808_SERIAL)
-        return 2;
+    if (header->preamble != PREAMBLE_AW5808_SERIAL ||
+        (length > 1 && header->delimiter != DELIMITER_AW5808_SERIAL)) {
+        const uint8_t *next = memchr(frame + 1, PREAMBLE_AW5808_SERIAL, length - 1);
+        return next ? (size_t)(next - frame) : length;
+    }
+    if (length < 4)
+        return 0;
 
     size_t cmd_len = 1;         /* 1 byte CommandID */
     size_t checksum_len = 1;    /* 1 byte CheckSum */
@@ -54,8 +74,10 @@ static size_t aw5808_serial_decode(const uint8_t *frame, size_t length, const ui
     return frame_len;
 }
 
-aw5808_codec_t codec_aw5808_serial = {
-   .ident = "aw5808_serial",
+const codec_ops_t codec_aw5808_serial = {
+   .name = "aw5808_serial",
+   .stateless = true,
+   .bound = aw5808_serial_bound,
    .encode = aw5808_serial_encode,
    .decode = aw5808_serial_decode,
 };
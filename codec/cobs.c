@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <string.h>
+#include "codec.h"
+
+/* Consistent Overhead Byte Stuffing, frames end with 0x00 */
+static size_t cobs_bound(codec_t *codec, size_t len)
+{
+    return len + len / 254 + 2;
+}
+
+static size_t cobs_encode(codec_t *codec, const uint8_t *data, size_t len, uint8_t *out, size_t size)
+{
+    size_t i, n = 1, code_at = 0;
+    uint8_t code = 1;
+
+    if (len == 0 || size < cobs_bound(codec, len))
+        return 0;
+    for (i=0; i<len; i++) {
+        if (data[i] == 0) {
+            out[code_at] = code;
+            code_at = n++;
+            code = 1;
+            continue;
+        }
+        out[n++] = data[i];
+        if (++code == 0xFF) {
+            out[code_at] = code;
+            code_at = n++;
+            code = 1;
+        }
+    }
+    out[code_at] = code;
+    out[n++] = 0x00;
+    return n;
+}
+
+/* decode in place, decoded data is never longer than the encoded */
+static bool cobs_unstuff(uint8_t *buf, size_t len, size_t *out_len)
+{
+    size_t in = 0, out = 0;
+
+    while (in < len) {
+        uint8_t code = buf[in++];
+        size_t i;
+
+        if (code == 0 || in + code - 1 > len)
+            return false;
+        for (i=1; i<code; i++)
+            buf[out++] = buf[in++];
+        if (code != 0xFF && in < len)
+            buf[out++] = 0;
+    }
+    *out_len = out;
+    return true;
+}
+
+static size_t cobs_decode(codec_t *codec, const uint8_t *buf, size_t len, const uint8_t **data, size_t *data_len)
+{
+    size_t i, n;
+
+    for (i=0; i<len; i++) {
+        if (buf[i] != 0x00) {
+            codec_frame_put(codec, buf[i]);
+            continue;
+        }
+        bool ok = codec->frame_len && !codec->overflow &&
+                  cobs_unstuff(codec->frame, codec->frame_len, &n) && n;
+        codec->frame_len = 0;
+        codec->overflow = false;
+        if (ok) {
+            *data = codec->frame;
+            *data_len = n;
+            return i + 1;
+        }
+    }
+    return len;
+}
+
+const codec_ops_t codec_cobs = {
+    .name = "cobs",
+    .bound = cobs_bound,
+    .encode = cobs_encode,
+    .decode = cobs_decode,
+};
@@ -3,14 +3,78 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 
-typedef struct aw5808_codec
-{
-    const char *ident;
-    size_t (*encode)(uint8_t *header, size_t data_length);
-    size_t (*decode)(const uint8_t *header, size_t length, const uint8_t **data, size_t *data_length);
-} aw5808_codec_t;
+/*
+ * Frame codecs.
+ *
+ * A codec turns a byte stream into frames (decode) and a payload into a
+ * frame (encode). Codecs are registered by name and instantiated from a
+ * spec string such as "slip", "delimiter:0x0a" or "lenprefix:2,be", so a
+ * device picks its framing from config (codec=...) instead of carrying its
+ * own read loop.
+ *
+ * decode() returns the bytes consumed from buf. When a frame completes,
+ * *data and *data_len describe its payload, valid until the next call:
+ * stateless framers point into buf, escaping framers (SLIP, COBS) into
+ * their own reassembly buffer. 0 consumed with *data NULL means more input
+ * is needed. Stateless codecs can double as serial port frame detectors.
+ */
+typedef struct codec codec_t;
 
-extern aw5808_codec_t codec_aw5808_serial;
-extern aw5808_codec_t codec_aw5808_hid;
-#endif
\ No newline at end of file
+typedef void (*codec_frame_fn)(void *arg, const uint8_t *data, size_t len);
+
+typedef struct codec_ops {
+    const char *name;
+    size_t priv_size;           /* allocated zeroed with the codec */
+    bool stateless;             /* decode() keeps no state between calls */
+    /* parse the part of the spec after ':', NULL if none */
+    int (*init)(codec_t *codec, const char *args);
+    void (*reset)(codec_t *codec);
+    /* worst case frame length for len bytes payload */
+    size_t (*bound)(codec_t *codec, size_t len);
+    /* returns frame length, 0 if it does not fit into size */
+    size_t (*encode)(codec_t *codec, const uint8_t *data, size_t len, uint8_t *out, size_t size);
+    size_t (*decode)(codec_t *codec, const uint8_t *buf, size_t len, const uint8_t **data, size_t *data_len);
+} codec_ops_t;
+
+struct codec {
+    const codec_ops_t *ops;
+    char spec[64];
+    /* reassembly buffer for framers that rewrite the payload */
+    uint8_t *frame;
+    size_t frame_len;
+    size_t frame_cap;
+    bool overflow;              /* dropping until the next frame boundary */
+    /* codec_feed() statistics */
+    size_t frames;
+    size_t dropped;             /* bytes a stateless framer skipped */
+    void *priv;
+};
+
+#define CODEC_FRAME_MAX     (4096)
+
+int codec_register(const codec_ops_t *ops);
+const codec_ops_t *codec_find(const char *name);
+const codec_ops_t *codec_next(const codec_ops_t *prev);
+
+codec_t *codec_new(const char *spec);
+void codec_free(codec_t *codec);
+void codec_reset(codec_t *codec);
+const char *codec_name(codec_t *codec);
+size_t codec_bound(codec_t *codec, size_t len);
+size_t codec_encode(codec_t *codec, const uint8_t *data, size_t len, uint8_t *out, size_t size);
+size_t codec_decode(codec_t *codec, const uint8_t *buf, size_t len, const uint8_t **data, size_t *data_len);
+/* decode all of buf, call fn per frame, returns bytes consumed */
+size_t codec_feed(codec_t *codec, const uint8_t *buf, size_t len, codec_frame_fn fn, void *arg);
+/* for escaping framers: append to / take the reassembly buffer */
+bool codec_frame_put(codec_t *codec, uint8_t byte);
+
+extern const codec_ops_t codec_aw5808_serial;
+extern const codec_ops_t codec_aw5808_hid;
+extern const codec_ops_t codec_lenprefix;
+extern const codec_ops_t codec_slip;
+extern const codec_ops_t codec_cobs;
+extern const codec_ops_t codec_delimiter;
+extern const codec_ops_t codec_uband;
+#endif
@@ -1,4 +1,168 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "codec.h"
-#include "log.h"
\ No newline at end of file
+#include "log.h"
+
+#define CODEC_OPS_MAX   (32)
+
+static const codec_ops_t *codec_ops[CODEC_OPS_MAX] = {
+    &codec_aw5808_serial,
+    &codec_aw5808_hid,
+    &codec_lenprefix,
+    &codec_slip,
+    &codec_cobs,
+    &codec_delimiter,
+    &codec_uband,
+};
+static int codec_ops_num = 7;
+
+/* Not locked, register from init code before devices are opened */
+int codec_register(const codec_ops_t *ops)
+{
+    if (!ops || !ops->name || !ops->encode || !ops->decode)
+        return -1;
+    if (codec_find(ops->name))
+        return -1;
+    if (codec_ops_num >= CODEC_OPS_MAX)
+        return -1;
+    codec_ops[codec_ops_num++] = ops;
+    return 0;
+}
+
+const codec_ops_t *codec_find(const char *name)
+{
+    int i;
+
+    for (i=0; i<codec_ops_num; i++) {
+        if (!strcmp(codec_ops[i]->name, name))
+            return codec_ops[i];
+    }
+    return NULL;
+}
+
+const codec_ops_t *codec_next(const codec_ops_t *prev)
+{
+    int i;
+
+    if (!prev)
+        return codec_ops[0];
+    for (i=0; i<codec_ops_num-1; i++) {
+        if (codec_ops[i] == prev)
+            return codec_ops[i+1];
+    }
+    return NULL;
+}
+
+/* spec is "<name>[:<args>]" */
+codec_t *codec_new(const char *spec)
+{
+    const codec_ops_t *ops;
+    const char *args;
+    char name[32];
+    codec_t *codec;
+    size_t n;
+
+    args = strchr(spec, ':');
+    n = args ? (size_t)(args - spec) : strlen(spec);
+    if (n >= sizeof(name)) {
+        log_error("Invalid codec %s", spec);
+        return NULL;
+    }
+    memcpy(name, spec, n);
+    name[n] = '\0';
+    if ((ops = codec_find(name)) == NULL) {
+        log_error("Unknown codec %s", name);
+        return NULL;
+    }
+
+    if ((codec = calloc(1, sizeof(*codec) + ops->priv_size)) == NULL)
+        return NULL;
+    codec->ops = ops;
+    codec->priv = ops->priv_size ? codec + 1 : NULL;
+    snprintf(codec->spec, sizeof(codec->spec), "%s", spec);
+    if (ops->init && ops->init(codec, args ? args + 1 : NULL) != 0) {
+        log_error("Invalid codec arguments %s", spec);
+        free(codec);
+        return NULL;
+    }
+    return codec;
+}
+
+void codec_free(codec_t *codec)
+{
+    if (!codec)
+        return;
+    free(codec->frame);
+    free(codec);
+}
+
+void codec_reset(codec_t *codec)
+{
+    codec->frame_len = 0;
+    codec->overflow = false;
+    if (codec->ops->reset)
+        codec->ops->reset(codec);
+}
+
+const char *codec_name(codec_t *codec)
+{
+    return codec->spec;
+}
+
+size_t codec_bound(codec_t *codec, size_t len)
+{
+    return codec->ops->bound ? codec->ops->bound(codec, len) : len;
+}
+
+size_t codec_encode(codec_t *codec, const uint8_t *data, size_t len, uint8_t *out, size_t size)
+{
+    return codec->ops->encode(codec, data, len, out, size);
+}
+
+size_t codec_decode(codec_t *codec, const uint8_t *buf, size_t len, const uint8_t **data, size_t *data_len)
+{
+    *data = NULL;
+    *data_len = 0;
+    return codec->ops->decode(codec, buf, len, data, data_len);
+}
+
+size_t codec_feed(codec_t *codec, const uint8_t *buf, size_t len, codec_frame_fn fn, void *arg)
+{
+    const uint8_t *data;
+    size_t used = 0, data_len, n;
+
+    while (used < len) {
+        n = codec_decode(codec, buf + used, len - used, &data, &data_len);
+        used += n;
+        if (data) {
+            codec->frames++;
+            fn(arg, data, data_len);
+        } else if (n == 0) {
+            break;
+        } else if (codec->ops->stateless) {
+            codec->dropped += n;
+        }
+    }
+    return used;
+}
+
+bool codec_frame_put(codec_t *codec, uint8_t byte)
+{
+    if (codec->overflow)
+        return false;
+
+    if (codec->frame_len == codec->frame_cap) {
+        size_t cap = codec->frame_cap ? codec->frame_cap * 2 : 64;
+        uint8_t *p;
+
+        if (cap > CODEC_FRAME_MAX || (p = realloc(codec->frame, cap)) == NULL) {
+            codec->overflow = true;
+            return false;
+        }
+        codec->frame = p;
+        codec->frame_cap = cap;
+    }
+    codec->frame[codec->frame_len++] = byte;
+    return true;
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "codec.h"
+
+/*
+ * Frames end with a delimiter byte, which is not part of the payload.
+ * spec: delimiter[:<byte>], default '\n'. Empty frames are skipped.
+ */
+struct delimiter {
+    uint8_t delim;
+};
+
+static int delimiter_init(codec_t *codec, const char *args)
+{
+    struct delimiter *d = codec->priv;
+    unsigned long v;
+    char *end;
+
+    d->delim = '\n';
+    if (!args)
+        return 0;
+    v = strtoul(args, &end, 0);
+    if (*end != '\0' || end == args || v > 0xFF)
+        return -1;
+    d->delim = v;
+    return 0;
+}
+
+static size_t delimiter_bound(codec_t *codec, size_t len)
+{
+    return len + 1;
+}
+
+static size_t delimiter_encode(codec_t *codec, const uint8_t *data, size_t len, uint8_t *out, size_t size)
+{
+    struct delimiter *d = codec->priv;
+
+    if (len == 0 || len + 1 > size || memchr(data, d->delim, len))
+        return 0;
+    memmove(out, data, len);
+    out[len] = d->delim;
+    return len + 1;
+}
+
+static size_t delimiter_decode(codec_t *codec, const uint8_t *buf, size_t len, const uint8_t **data, size_t *data_len)
+{
+    struct delimiter *d = codec->priv;
+    const uint8_t *end = memchr(buf, d->delim, len);
+
+    if (!end) {
+        /* never going to fit a frame, drop it */
+        return len > CODEC_FRAME_MAX ? len : 0;
+    }
+    if (end == buf)
+        return 1;
+    *data = buf;
+    *data_len = end - buf;
+    return end - buf + 1;
+}
+
+const codec_ops_t codec_delimiter = {
+    .name = "delimiter",
+    .priv_size = sizeof(struct delimiter),
+    .stateless = true,
+    .init = delimiter_init,
+    .bound = delimiter_bound,
+    .encode = delimiter_encode,
+    .decode = delimiter_decode,
+};
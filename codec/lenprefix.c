@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "codec.h"
+
+/*
+ * [length][payload], length is 1, 2 or 4 bytes, big endian unless ",le".
+ * spec: lenprefix[:<width>[,be|,le]], default lenprefix:2,be
+ */
+struct lenprefix {
+    unsigned int width;
+    bool le;
+};
+
+static int lenprefix_init(codec_t *codec, const char *args)
+{
+    struct lenprefix *lp = codec->priv;
+    char *end;
+
+    lp->width = 2;
+    if (!args)
+        return 0;
+    lp->width = strtoul(args, &end, 10);
+    if (lp->width != 1 && lp->width != 2 && lp->width != 4)
+        return -1;
+    if (*end == '\0' || !strcmp(end, ",be"))
+        return 0;
+    if (!strcmp(end, ",le")) {
+        lp->le = true;
+        return 0;
+    }
+    return -1;
+}
+
+static size_t lenprefix_bound(codec_t *codec, size_t len)
+{
+    struct lenprefix *lp = codec->priv;
+    return lp->width + len;
+}
+
+static size_t lenprefix_encode(codec_t *codec, const uint8_t *data, size_t len, uint8_t *out, size_t size)
+{
+    struct lenprefix *lp = codec->priv;
+    unsigned int i;
+
+    if (len == 0 || len > CODEC_FRAME_MAX || lp->width + len > size)
+        return 0;
+    if (lp->width == 1 && len > 0xFF)
+        return 0;
+    for (i=0; i<lp->width; i++) {
+        unsigned int shift = 8 * (lp->le ? i : lp->width - 1 - i);
+        out[i] = (len >> shift) & 0xFF;
+    }
+    memmove(out + lp->width, data, len);
+    return lp->width + len;
+}
+
+static size_t lenprefix_decode(codec_t *codec, const uint8_t *buf, size_t len, const uint8_t **data, size_t *data_len)
+{
+    struct lenprefix *lp = codec->priv;
+    size_t frame_len = 0;
+    unsigned int i;
+
+    if (len < lp->width)
+        return 0;
+    for (i=0; i<lp->width; i++) {
+        unsigned int shift = 8 * (lp->le ? i : lp->width - 1 - i);
+        frame_len |= (size_t)buf[i] << shift;
+    }
+    /* no way to resync on a corrupted length, slide by one byte */
+    if (frame_len == 0 || frame_len > CODEC_FRAME_MAX)
+        return 1;
+    if (len < lp->width + frame_len)
+        return 0;
+    *data = buf + lp->width;
+    *data_len = frame_len;
+    return lp->width + frame_len;
+}
+
+const codec_ops_t codec_lenprefix = {
+    .name = "lenprefix",
+    .priv_size = sizeof(struct lenprefix),
+    .stateless = true,
+    .init = lenprefix_init,
+    .bound = lenprefix_bound,
+    .encode = lenprefix_encode,
+    .decode = lenprefix_decode,
+};
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <string.h>
+#include "codec.h"
+
+/* RFC 1055 */
+enum {
+    SLIP_END = 0xC0,
+    SLIP_ESC = 0xDB,
+    SLIP_ESC_END = 0xDC,
+    SLIP_ESC_ESC = 0xDD,
+};
+
+struct slip {
+    bool esc;
+};
+
+static void slip_reset(codec_t *codec)
+{
+    struct slip *slip = codec->priv;
+    slip->esc = false;
+}
+
+static size_t slip_bound(codec_t *codec, size_t len)
+{
+    return 2 * len + 2;
+}
+
+static size_t slip_encode(codec_t *codec, const uint8_t *data, size_t len, uint8_t *out, size_t size)
+{
+    size_t i, n = 0;
+
+    if (len == 0 || size < 2)
+        return 0;
+    /* leading END flushes line noise on the receiver */
+    out[n++] = SLIP_END;
+    for (i=0; i<len; i++) {
+        if (n + 3 > size)
+            return 0;
+        if (data[i] == SLIP_END) {
+            out[n++] = SLIP_ESC;
+            out[n++] = SLIP_ESC_END;
+        } else if (data[i] == SLIP_ESC) {
+            out[n++] = SLIP_ESC;
+            out[n++] = SLIP_ESC_ESC;
+        } else {
+            out[n++] = data[i];
+        }
+    }
+    out[n++] = SLIP_END;
+    return n;
+}
+
+static size_t slip_decode(codec_t *codec, const uint8_t *buf, size_t len, const uint8_t **data, size_t *data_len)
+{
+    struct slip *slip = codec->priv;
+    size_t i;
+
+    for (i=0; i<len; i++) {
+        uint8_t c = buf[i];
+
+        if (c == SLIP_END) {
+            bool ok = codec->frame_len && !codec->overflow && !slip->esc;
+            if (ok) {
+                *data = codec->frame;
+                *data_len = codec->frame_len;
+            }
+            codec->frame_len = 0;
+            codec->overflow = false;
+            slip->esc = false;
+            if (ok)
+                return i + 1;
+            continue;
+        }
+        if (slip->esc) {
+            slip->esc = false;
+            if (c == SLIP_ESC_END)
+                c = SLIP_END;
+            else if (c == SLIP_ESC_ESC)
+                c = SLIP_ESC;
+            else
+                codec->overflow = true;     /* protocol violation, drop frame */
+        } else if (c == SLIP_ESC) {
+            slip->esc = true;
+            continue;
+        }
+        codec_frame_put(codec, c);
+    }
+    return len;
+}
+
+const codec_ops_t codec_slip = {
+    .name = "slip",
+    .priv_size = sizeof(struct slip),
+    .reset = slip_reset,
+    .bound = slip_bound,
+    .encode = slip_encode,
+    .decode = slip_decode,
+};
@@ -2,19 +2,89 @@
 #include <string.h>
 #include "codec.h"
 
-static size_t uband_encode(uint8_t *frame, size_t data_len)
+/*
+ * PROVISIONAL: no uband wire spec is available to this tree. The format
+ * below is a placeholder that exercises the codec/serial/device stack; it
+ * is not the field protocol and must be replaced (with enum uband_cmd in
+ * device/uband.h) before talking to uband hardware.
+ *
+ * 0xA5 [2 byte len, le] [1 byte seq] [1 byte cmd] [n byte payload] [1 byte crc8]
+ *
+ * len counts seq, cmd and payload. crc8 (poly 0x07, init 0) covers len up
+ * to the end of the payload. Codec data is [seq] [cmd] [payload].
+ */
+enum {
+    PREAMBLE_UBAND = 0xA5,
+};
+
+#define UBAND_HEAD_LEN      (3)
+#define UBAND_DATA_MIN      (2)
+
+static uint8_t uband_crc8(uint8_t crc, const uint8_t *buf, size_t len)
+{
+    int i;
+
+    while (len--) {
+        crc ^= *buf++;
+        for (i=0; i<8; i++)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+static size_t uband_bound(codec_t *codec, size_t data_len)
 {
-    return 0;
+    return UBAND_HEAD_LEN + data_len + 1;
 }
 
-static size_t uband_decode(const uint8_t *frame, size_t length, const uint8_t **data, size_t *data_len)
+static size_t uband_encode(codec_t *codec, const uint8_t *data, size_t data_len, uint8_t *frame, size_t size)
 {
+    size_t frame_len = UBAND_HEAD_LEN + data_len + 1;
+
+    if (data_len < UBAND_DATA_MIN || data_len > CODEC_FRAME_MAX || frame_len > size)
+        return 0;
+    memmove(frame + UBAND_HEAD_LEN, data, data_len);
+    frame[0] = PREAMBLE_UBAND;
+    frame[1] = data_len & 0xFF;
+    frame[2] = data_len >> 8;
+    frame[frame_len - 1] = uband_crc8(0, frame + 1, frame_len - 2);
+    return frame_len;
+}
+
+/* a bad header or checksum resyncs to the next preamble */
+static size_t uband_decode(codec_t *codec, const uint8_t *frame, size_t length, const uint8_t **data, size_t *data_len)
+{
+    const uint8_t *next;
+    size_t len;
+
+    if (length < 1)
+        return 0;
+    if (frame[0] != PREAMBLE_UBAND)
+        goto resync;
+    if (length < UBAND_HEAD_LEN)
+        return 0;
+
+    len = frame[1] | frame[2] << 8;
+    if (len < UBAND_DATA_MIN || len > CODEC_FRAME_MAX)
+        goto resync;
+    if (length < UBAND_HEAD_LEN + len + 1)
+        return 0;
+    if (uband_crc8(0, frame + 1, UBAND_HEAD_LEN - 1 + len) != frame[UBAND_HEAD_LEN + len])
+        goto resync;
+
+    *data = frame + UBAND_HEAD_LEN;
+    *data_len = len;
+    return UBAND_HEAD_LEN + len + 1;
 
-    return 0;
+resync:
+    next = memchr(frame + 1, PREAMBLE_UBAND, length - 1);
+    return next ? (size_t)(next - frame) : length;
 }
 
-codec_t codec_uband = {
-   .ident = "uband",
+const codec_ops_t codec_uband = {
+   .name = "uband",
+   .stateless = true,
+   .bound = uband_bound,
    .encode = uband_encode,
    .decode = uband_decode,
 };
@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "confdb.h"
+#include "crc32.h"
+#include "ini.h"
+#include "iobuf.h"
+#include "log.h"
+
+#define CONFDB_MAGIC        "DCDB"
+#define CONFDB_VERSION      1
+#define CONFDB_BYTE_ORDER   0x01020304
+#define CONFDB_LINE_SIZE    512
+
+/* Layout: header | sections[] | entries[] | string table */
+struct confdb_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t byte_order;
+    uint32_t image_size;        /* whole image, header included */
+    uint32_t crc;               /* crc32 of everything after the header */
+    uint32_t src_size;          /* INI file the image was compiled from */
+    uint32_t src_crc;
+    uint32_t reserved;
+    int64_t src_mtime_sec;
+    int64_t src_mtime_nsec;
+    uint32_t nsections;
+    uint32_t nentries;
+    uint32_t strings_size;
+    uint32_t pad;
+};
+
+struct confdb_section {
+    uint32_t name;              /* offset in string table */
+    uint32_t first;             /* index of first entry */
+    uint32_t count;
+};
+
+struct confdb_entry {
+    uint32_t key;
+    uint32_t value;
+};
+
+struct confdb {
+    const uint8_t *image;
+    size_t size;
+    bool mapped;
+    const struct confdb_header *hdr;
+    const struct confdb_section *sections;
+    const struct confdb_entry *entries;
+    const char *strings;
+};
+
+struct confdb_builder {
+    struct iobuf sections;
+    struct iobuf entries;
+    struct iobuf strings;
+    uint32_t nsections;
+    uint32_t nentries;
+    uint32_t cur;
+};
+
+static uint32_t builder_add_string(struct confdb_builder *b, const char *s)
+{
+    uint32_t off = b->strings.len;
+
+    if (*s == '\0')
+        return 0;
+    if (iobuf_add(&b->strings, b->strings.len, s, strlen(s) + 1) == 0)
+        return 0;
+    return off;
+}
+
+/*
+ * ini_browse() does not report sections without keys, so collect the
+ * section names with the same rules minIni uses for its section lines.
+ */
+static int builder_scan_sections(struct confdb_builder *b, FILE *fp)
+{
+    char line[CONFDB_LINE_SIZE];
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *sp = line, *ep;
+        struct confdb_section sec;
+
+        while (*sp != '\0' && isspace((unsigned char)*sp))
+            sp++;
+        ep = strrchr(sp, ']');
+        if (*sp != '[' || ep == NULL)
+            continue;
+        sp++;
+        while (*sp != '\0' && isspace((unsigned char)*sp))
+            sp++;
+        while (ep > sp && isspace((unsigned char)ep[-1]))
+            ep--;
+        *ep = '\0';
+
+        memset(&sec, 0, sizeof(sec));
+        sec.name = builder_add_string(b, sp);
+        if (iobuf_add(&b->sections, b->sections.len, &sec, sizeof(sec)) == 0)
+            return -1;
+        b->nsections++;
+    }
+    return 0;
+}
+
+static int builder_browse_cb(const char *section, const char *key, const char *value, void *userdata)
+{
+    struct confdb_builder *b = userdata;
+    struct confdb_section *sections = (struct confdb_section *)b->sections.buf;
+    struct confdb_entry entry;
+    const char *strings = (const char *)b->strings.buf;
+
+    /* keys above the first section are not used by devctl */
+    if (*section == '\0')
+        return 1;
+
+    /* sections come in file order, entries are grouped behind the cursor */
+    while (b->cur < b->nsections && strcmp(strings + sections[b->cur].name, section) != 0)
+        b->cur++;
+    if (b->cur >= b->nsections)
+        return 0;
+
+    if (sections[b->cur].count == 0)
+        sections[b->cur].first = b->nentries;
+    entry.key = builder_add_string(b, key);
+    entry.value = builder_add_string(b, value);
+    if (iobuf_add(&b->entries, b->entries.len, &entry, sizeof(entry)) == 0)
+        return 0;
+    sections[b->cur].count++;
+    b->nentries++;
+    return 1;
+}
+
+static uint32_t file_crc(FILE *fp)
+{
+    uint8_t buf[4096];
+    uint32_t crc = 0;
+    size_t n;
+
+    rewind(fp);
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        crc = crc32(crc, buf, n);
+    return crc;
+}
+
+/* Compile INI file into a malloc'ed image */
+static uint8_t *confdb_build(const char *conf_file, size_t *size)
+{
+    struct confdb_builder b;
+    struct confdb_header hdr;
+    struct stat st;
+    uint8_t *image = NULL;
+    size_t off;
+    FILE *fp;
+
+    if ((fp = fopen(conf_file, "rb")) == NULL) {
+        log_error("Opening config %s: %s", conf_file, strerror(errno));
+        return NULL;
+    }
+
+    memset(&b, 0, sizeof(b));
+    memset(&hdr, 0, sizeof(hdr));
+    fstat(fileno(fp), &st);
+    hdr.src_size = st.st_size;
+    hdr.src_mtime_sec = st.st_mtim.tv_sec;
+    hdr.src_mtime_nsec = st.st_mtim.tv_nsec;
+    hdr.src_crc = file_crc(fp);
+    rewind(fp);
+
+    /* offset 0 is the empty string */
+    if (iobuf_add(&b.strings, 0, "", 1) == 0 || builder_scan_sections(&b, fp) != 0)
+        goto out;
+    if (!ini_browse(builder_browse_cb, &b, conf_file))
+        goto out;
+
+    /* keep every array 4-byte aligned */
+    while (b.strings.len % 4)
+        iobuf_add(&b.strings, b.strings.len, "", 1);
+
+    memcpy(hdr.magic, CONFDB_MAGIC, sizeof(hdr.magic));
+    hdr.version = CONFDB_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.byte_order = CONFDB_BYTE_ORDER;
+    hdr.nsections = b.nsections;
+    hdr.nentries = b.nentries;
+    hdr.strings_size = b.strings.len;
+    hdr.image_size = sizeof(hdr) + b.sections.len + b.entries.len + b.strings.len;
+
+    if ((image = calloc(1, hdr.image_size)) == NULL)
+        goto out;
+    /* a file without sections leaves sections/entries unallocated */
+    off = sizeof(hdr);
+    if (b.sections.len)
+        memcpy(image + off, b.sections.buf, b.sections.len);
+    off += b.sections.len;
+    if (b.entries.len)
+        memcpy(image + off, b.entries.buf, b.entries.len);
+    off += b.entries.len;
+    memcpy(image + off, b.strings.buf, b.strings.len);
+    hdr.crc = crc32(0, image + sizeof(hdr), hdr.image_size - sizeof(hdr));
+    memcpy(image, &hdr, sizeof(hdr));
+    *size = hdr.image_size;
+
+out:
+    iobuf_free(&b.sections);
+    iobuf_free(&b.entries);
+    iobuf_free(&b.strings);
+    fclose(fp);
+    return image;
+}
+
+/* Never trust an image read from disk: every offset is checked once here */
+static bool confdb_validate(confdb_t *db)
+{
+    const struct confdb_header *hdr = (const struct confdb_header *)db->image;
+    size_t sections_size, entries_size;
+    uint32_t i;
+
+    if (db->size < sizeof(*hdr))
+        return false;
+    if (memcmp(hdr->magic, CONFDB_MAGIC, sizeof(hdr->magic)) || hdr->version != CONFDB_VERSION
+        || hdr->header_size != sizeof(*hdr) || hdr->byte_order != CONFDB_BYTE_ORDER
+        || hdr->image_size != db->size)
+        return false;
+
+    sections_size = (size_t)hdr->nsections * sizeof(struct confdb_section);
+    entries_size = (size_t)hdr->nentries * sizeof(struct confdb_entry);
+    if (hdr->nsections > db->size || hdr->nentries > db->size || hdr->strings_size == 0
+        || sizeof(*hdr) + sections_size + entries_size + hdr->strings_size != db->size)
+        return false;
+    if (crc32(0, db->image + sizeof(*hdr), db->size - sizeof(*hdr)) != hdr->crc)
+        return false;
+
+    db->hdr = hdr;
+    db->sections = (const struct confdb_section *)(db->image + sizeof(*hdr));
+    db->entries = (const struct confdb_entry *)((const uint8_t *)db->sections + sections_size);
+    db->strings = (const char *)db->entries + entries_size;
+
+    /* a NUL at the end keeps every string offset terminated */
+    if (db->strings[hdr->strings_size - 1] != '\0')
+        return false;
+    for (i = 0; i < hdr->nsections; i++) {
+        const struct confdb_section *sec = &db->sections[i];
+        if (sec->name >= hdr->strings_size || sec->first > hdr->nentries
+            || sec->count > hdr->nentries - sec->first)
+            return false;
+    }
+    for (i = 0; i < hdr->nentries; i++) {
+        if (db->entries[i].key >= hdr->strings_size || db->entries[i].value >= hdr->strings_size)
+            return false;
+    }
+    return true;
+}
+
+static bool confdb_is_stale(confdb_t *db, const char *conf_file)
+{
+    const struct confdb_header *hdr = db->hdr;
+    struct stat st;
+    bool stale;
+    FILE *fp;
+
+    if (stat(conf_file, &st) < 0 || st.st_size != hdr->src_size)
+        return true;
+    if (st.st_mtim.tv_sec == hdr->src_mtime_sec && st.st_mtim.tv_nsec == hdr->src_mtime_nsec)
+        return false;
+
+    /* copied or installed without preserving mtime, compare content */
+    if ((fp = fopen(conf_file, "rb")) == NULL)
+        return true;
+    stale = file_crc(fp) != hdr->src_crc;
+    fclose(fp);
+    return stale;
+}
+
+static int confdb_map(confdb_t *db, const char *snapshot)
+{
+    struct stat st;
+    void *p;
+    int fd;
+
+    if ((fd = open(snapshot, O_RDONLY)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct confdb_header)) {
+        close(fd);
+        return -1;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+
+    db->image = p;
+    db->size = st.st_size;
+    db->mapped = true;
+    return 0;
+}
+
+static void confdb_unmap(confdb_t *db)
+{
+    if (db->mapped)
+        munmap((void *)db->image, db->size);
+    else
+        free((void *)db->image);
+    db->image = NULL;
+    db->size = 0;
+    db->mapped = false;
+}
+
+confdb_t *confdb_open(const char *conf_file, const char *snapshot)
+{
+    confdb_t *db = calloc(1, sizeof(confdb_t));
+    size_t size;
+
+    if (db == NULL)
+        return NULL;
+
+    if (snapshot && confdb_map(db, snapshot) == 0) {
+        if (confdb_validate(db) && !confdb_is_stale(db, conf_file))
+            return db;
+        log_warn("Config snapshot %s is stale, parsing %s", snapshot, conf_file);
+        confdb_unmap(db);
+    }
+
+    if ((db->image = confdb_build(conf_file, &size)) == NULL) {
+        free(db);
+        return NULL;
+    }
+    db->size = size;
+    if (!confdb_validate(db)) {
+        confdb_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+void confdb_close(confdb_t *db)
+{
+    if (db == NULL)
+        return;
+    confdb_unmap(db);
+    free(db);
+}
+
+int confdb_compile(const char *conf_file, const char *snapshot)
+{
+    char tmp[PATH_MAX];
+    uint8_t *image;
+    size_t size;
+    FILE *fp;
+    int ret = 0;
+
+    if ((image = confdb_build(conf_file, &size)) == NULL)
+        return -1;
+
+    /* write aside and rename, a reader never maps a half written image */
+    snprintf(tmp, sizeof(tmp), "%s.tmp", snapshot);
+    if ((fp = fopen(tmp, "wb")) == NULL) {
+        log_error("Creating %s: %s", tmp, strerror(errno));
+        free(image);
+        return -1;
+    }
+    if (fwrite(image, 1, size, fp) != size)
+        ret = -1;
+    if (fclose(fp) != 0)
+        ret = -1;
+    if (ret == 0 && rename(tmp, snapshot) < 0)
+        ret = -1;
+    if (ret != 0) {
+        log_error("Writing %s: %s", snapshot, strerror(errno));
+        unlink(tmp);
+    }
+    free(image);
+    return ret;
+}
+
+bool confdb_is_snapshot(confdb_t *db)
+{
+    return db->mapped;
+}
+
+int confdb_section_count(confdb_t *db)
+{
+    return db->hdr->nsections;
+}
+
+const char *confdb_section(confdb_t *db, int section)
+{
+    if (section < 0 || section >= (int)db->hdr->nsections)
+        return NULL;
+    return db->strings + db->sections[section].name;
+}
+
+int confdb_key_count(confdb_t *db, int section)
+{
+    if (section < 0 || section >= (int)db->hdr->nsections)
+        return 0;
+    return db->sections[section].count;
+}
+
+static const struct confdb_entry *confdb_entry(confdb_t *db, int section, int idx)
+{
+    if (idx < 0 || idx >= confdb_key_count(db, section))
+        return NULL;
+    return &db->entries[db->sections[section].first + idx];
+}
+
+const char *confdb_key(confdb_t *db, int section, int idx)
+{
+    const struct confdb_entry *entry = confdb_entry(db, section, idx);
+    return entry ? db->strings + entry->key : NULL;
+}
+
+const char *confdb_value(confdb_t *db, int section, int idx)
+{
+    const struct confdb_entry *entry = confdb_entry(db, section, idx);
+    return entry ? db->strings + entry->value : NULL;
+}
+
+/* same conversion rules as ini_getl() */
+static long confdb_strtol(const char *value, long def)
+{
+    if (value == NULL || *value == '\0')
+        return def;
+    if (strlen(value) >= 2 && toupper((unsigned char)value[1]) == 'X')
+        return strtol(value, NULL, 16);
+    return strtol(value, NULL, 10);
+}
+
+long confdb_value_l(confdb_t *db, int section, int idx, long def)
+{
+    return confdb_strtol(confdb_value(db, section, idx), def);
+}
+
+const char *confdb_get(confdb_t *db, const char *section, const char *key)
+{
+    int s, k;
+
+    for (s = 0; s < (int)db->hdr->nsections; s++) {
+        if (strcasecmp(confdb_section(db, s), section))
+            continue;
+        for (k = 0; k < confdb_key_count(db, s); k++) {
+            if (!strcasecmp(confdb_key(db, s, k), key))
+                return confdb_value(db, s, k);
+        }
+    }
+    return NULL;
+}
+
+long confdb_getl(confdb_t *db, const char *section, const char *key, long def)
+{
+    return confdb_strtol(confdb_get(db, section, key), def);
+}
@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "evprof.h"
+#include "metrics.h"
+
+#define EVPROF_MAX_PROBES   128
+
+typedef void (*evprof_cb)(struct ev_loop *loop, ev_watcher *w, int revents);
+
+struct evprof_probe {
+    evprof_cb cb;
+    char type[32];
+    char name[96];
+    metric_t *duration;
+};
+
+static struct {
+    atomic_bool enabled;
+    pthread_mutex_t lock;
+    struct evprof_probe probes[EVPROF_MAX_PROBES];
+    int nprobes;
+    /* loop */
+    struct ev_loop *loop;
+    ev_prepare prepare;
+    ev_check check;
+    uint64_t woke_at;
+    metric_t *busy;
+    metric_t *dispatch;
+    metric_t *pending;
+} P = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void evprof_trampoline(struct ev_loop *loop, ev_watcher *w, int revents)
+{
+    struct evprof_probe *probe = w->data;
+    uint64_t start;
+
+    if (!atomic_load_explicit(&P.enabled, memory_order_relaxed)) {
+        probe->cb(loop, w, revents);
+        return;
+    }
+    start = metric_now();
+    /* the callback may stop or free w, only touch the probe afterwards */
+    probe->cb(loop, w, revents);
+    metric_observe(probe->duration, metric_now() - start);
+}
+
+static struct evprof_probe *probe_get(evprof_cb cb, const char *type, const char *name)
+{
+    struct evprof_probe *probe = NULL;
+    int i;
+
+    pthread_mutex_lock(&P.lock);
+    for (i=0; i<P.nprobes; i++) {
+        probe = &P.probes[i];
+        if (probe->cb == cb && !strcmp(probe->type, type) && !strcmp(probe->name, name))
+            goto out;
+    }
+    probe = NULL;
+    if (P.nprobes >= EVPROF_MAX_PROBES)
+        goto out;
+    probe = &P.probes[P.nprobes];
+    probe->cb = cb;
+    strncpy(probe->type, type, sizeof(probe->type)-1);
+    strncpy(probe->name, name, sizeof(probe->name)-1);
+    probe->duration = metric_get(METRIC_HISTOGRAM, "devctl_callback_seconds",
+                                 "Event loop callback duration",
+                                 "type", type, "name", name, NULL);
+    P.nprobes++;
+out:
+    pthread_mutex_unlock(&P.lock);
+    return probe;
+}
+
+/* Call after ev_*_init(), before the watcher is started. */
+void evprof_watch(void *watcher, const char *type, const char *name)
+{
+    ev_watcher *w = watcher;
+    evprof_cb cb = (evprof_cb)ev_cb(w);
+    struct evprof_probe *probe;
+
+    if (cb == evprof_trampoline)
+        return;
+    if ((probe = probe_get(cb, type, name ? name : "")) == NULL)
+        return;
+    w->data = probe;
+    ev_set_cb(w, evprof_trampoline);
+}
+
+/* Time spent between waking up from the backend and blocking again. */
+static void evprof_check_cb(struct ev_loop *loop, ev_check *w, int revents)
+{
+    P.woke_at = metric_now();
+}
+
+static void evprof_prepare_cb(struct ev_loop *loop, ev_prepare *w, int revents)
+{
+    if (P.woke_at && atomic_load_explicit(&P.enabled, memory_order_relaxed))
+        metric_observe(P.busy, metric_now() - P.woke_at);
+    P.woke_at = 0;
+}
+
+static void evprof_invoke_pending(struct ev_loop *loop)
+{
+    uint64_t start;
+
+    if (!atomic_load_explicit(&P.enabled, memory_order_relaxed)) {
+        ev_invoke_pending(loop);
+        return;
+    }
+    metric_set(P.pending, ev_pending_count(loop));
+    start = metric_now();
+    ev_invoke_pending(loop);
+    metric_observe(P.dispatch, metric_now() - start);
+}
+
+void evprof_init(struct ev_loop *loop)
+{
+    P.loop = loop;
+    P.busy = metric_get(METRIC_HISTOGRAM, "devctl_loop_busy_seconds",
+                        "Time from loop wakeup to the next poll", NULL);
+    P.dispatch = metric_get(METRIC_HISTOGRAM, "devctl_loop_dispatch_seconds",
+                            "Time spent invoking pending callbacks per iteration", NULL);
+    P.pending = metric_get(METRIC_GAUGE, "devctl_loop_pending",
+                           "Pending watchers in the last profiled iteration", NULL);
+    ev_set_invoke_pending_cb(loop, evprof_invoke_pending);
+    ev_prepare_init(&P.prepare, evprof_prepare_cb);
+    ev_check_init(&P.check, evprof_check_cb);
+    /* run last before blocking and first after waking up */
+    ev_set_priority(&P.prepare, EV_MINPRI);
+    ev_set_priority(&P.check, EV_MAXPRI);
+    ev_prepare_start(loop, &P.prepare);
+    ev_check_start(loop, &P.check);
+    ev_unref(loop);
+    ev_unref(loop);
+}
+
+void evprof_exit(struct ev_loop *loop)
+{
+    if (P.loop != loop)
+        return;
+    ev_ref(loop);
+    ev_ref(loop);
+    ev_prepare_stop(loop, &P.prepare);
+    ev_check_stop(loop, &P.check);
+    ev_set_invoke_pending_cb(loop, ev_invoke_pending);
+    P.loop = NULL;
+}
+
+void evprof_enable(bool enable)
+{
+    atomic_store(&P.enabled, enable);
+}
+
+bool evprof_enabled(void)
+{
+    return atomic_load(&P.enabled);
+}
+
+static void histogram_reset(metric_t *m)
+{
+    int i;
+
+    if (m == NULL)
+        return;
+    for (i=0; i<METRIC_HIST_BUCKETS; i++)
+        atomic_store(&m->buckets[i], 0);
+    atomic_store(&m->count, 0);
+    atomic_store(&m->sum, 0);
+    atomic_store(&m->max, 0);
+}
+
+void evprof_reset(void)
+{
+    int i;
+
+    pthread_mutex_lock(&P.lock);
+    for (i=0; i<P.nprobes; i++)
+        histogram_reset(P.probes[i].duration);
+    pthread_mutex_unlock(&P.lock);
+    histogram_reset(P.busy);
+    histogram_reset(P.dispatch);
+}
+
+static int probe_cmp(const void *a, const void *b)
+{
+    const struct evprof_probe *pa = *(const struct evprof_probe **)a;
+    const struct evprof_probe *pb = *(const struct evprof_probe **)b;
+    uint64_t ma = atomic_load(&pa->duration->max);
+    uint64_t mb = atomic_load(&pb->duration->max);
+
+    return ma < mb ? 1 : ma > mb ? -1 : 0;
+}
+
+/* Worst offenders first, by the longest single invocation. */
+void evprof_report(void (*print)(const char *fmt, ...), int top)
+{
+    struct evprof_probe *sorted[EVPROF_MAX_PROBES];
+    int i, n = 0;
+
+    pthread_mutex_lock(&P.lock);
+    for (i=0; i<P.nprobes; i++) {
+        if (P.probes[i].duration && atomic_load(&P.probes[i].duration->count))
+            sorted[n++] = &P.probes[i];
+    }
+    pthread_mutex_unlock(&P.lock);
+    qsort(sorted, n, sizeof(sorted[0]), probe_cmp);
+
+    print("profiling %s\n", evprof_enabled() ? "on" : "off");
+    if (P.busy)
+        print("loop busy: n=%llu p50=%.3fms p99=%.3fms max=%.3fms\n",
+              (unsigned long long)atomic_load(&P.busy->count),
+              metric_quantile(P.busy, 0.5) / 1e6, metric_quantile(P.busy, 0.99) / 1e6,
+              atomic_load(&P.busy->max) / 1e6);
+    print("%-16s %-32s %10s %10s %10s %10s\n", "type", "name", "calls", "total ms", "p99 ms", "max ms");
+    for (i=0; i<n && i<top; i++) {
+        metric_t *m = sorted[i]->duration;
+        print("%-16s %-32s %10llu %10.3f %10.3f %10.3f\n", sorted[i]->type, sorted[i]->name,
+              (unsigned long long)atomic_load(&m->count), atomic_load(&m->sum) / 1e6,
+              metric_quantile(m, 0.99) / 1e6, atomic_load(&m->max) / 1e6);
+    }
+}
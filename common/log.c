@@ -1,7 +1,44 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+
 #include "log.h"
 
 #define MAX_CALLBACKS 32
 
+/*
+ * Asynchronous mode: every thread owns a single-producer/single-consumer
+ * ring of fixed size records. The caller only renders the message body
+ * into its own ring slot, the background thread adds the timestamp and
+ * header and does the actual I/O. A full ring drops the record instead of
+ * blocking the caller.
+ */
+#define LOG_RING_SLOTS      256             /* power of 2 */
+#define LOG_RECORD_MSG      (512 - 48)
+#define LOG_IDLE_WAIT_MS    100
+
+typedef struct {
+    const char *file;
+    const char *function;
+    struct timespec ts;
+    int line;
+    int level;
+    bool forced;
+    char msg[LOG_RECORD_MSG];
+} log_Record;
+
+typedef struct log_Ring {
+    _Alignas(64) atomic_uint head;          /* producer */
+    _Alignas(64) atomic_uint tail;          /* consumer */
+    atomic_ulong dropped;
+    atomic_bool dead;
+    struct log_Ring *next;
+    log_Record slots[LOG_RING_SLOTS];
+} log_Ring;
+
 typedef struct {
     log_LogFn fn;
     void *udata;
@@ -14,7 +51,34 @@ static struct {
     int level;
     bool quiet;
     Callback callbacks[MAX_CALLBACKS];
-} L;
+    pthread_mutex_t modules_lock;
+    log_Module *modules;
+} L = {
+    .modules_lock = PTHREAD_MUTEX_INITIALIZER,
+    .modules = &log_module_default,
+};
+
+log_Module log_module_default = { "default", -1, LOG_TRACE, NULL };
+
+static struct {
+    atomic_bool running;
+    atomic_bool sleeping;
+    bool stop;
+    bool exited;                /* final drain done, late records are ours */
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_key_t key;
+    pthread_once_t key_once;
+    _Atomic(log_Ring *) rings;
+    unsigned long dropped;
+} A = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .key_once = PTHREAD_ONCE_INIT,
+};
+
+static __thread log_Ring *thread_ring;
 
 
 static const char *level_strings[] = {
@@ -28,10 +92,38 @@ static const char *level_colors[] = {
 #endif
 
 
+/* localtime_r() + strftime() only once per second */
+static const char *time_string(log_Event *ev, bool full)
+{
+    static __thread time_t cached = -1;
+    static __thread char hms[16], ymdhms[64];
+
+    if (ev->sec != cached) {
+        struct tm tm;
+        localtime_r(&ev->sec, &tm);
+        hms[strftime(hms, sizeof(hms), "%H:%M:%S", &tm)] = '\0';
+        ymdhms[strftime(ymdhms, sizeof(ymdhms), "%Y-%m-%d %H:%M:%S", &tm)] = '\0';
+        cached = ev->sec;
+    }
+    return full ? ymdhms : hms;
+}
+
+
+static void print_message(log_Event *ev)
+{
+    if (ev->msg) {
+        fputs(ev->msg, ev->udata);
+    } else {
+        vfprintf(ev->udata, ev->fmt, ev->ap);
+    }
+    fputc('\n', ev->udata);
+    fflush(ev->udata);
+}
+
+
 static void stdout_callback(log_Event *ev)
 {
-    char buf[16];
-    buf[strftime(buf, sizeof(buf), "%H:%M:%S", ev->time)] = '\0';
+    const char *buf = time_string(ev, false);
 #ifdef LOG_USE_COLOR
     fprintf(
         ev->udata, "%s %s%-5s\x1b[0m \x1b[90m%s:%d:\x1b[0m ",
@@ -48,29 +140,24 @@ static void stdout_callback(log_Event *ev)
             buf, level_strings[ev->level], ev->file, ev->function, ev->line);
     }
 #endif
-    vfprintf(ev->udata, ev->fmt, ev->ap);
-    fprintf(ev->udata, "\n");
-    fflush(ev->udata);
+    print_message(ev);
 }
 
 
 static void file_callback(log_Event *ev)
 {
-    char buf[64];
-    buf[strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", ev->time)] = '\0';
+    const char *buf = time_string(ev, true);
     if (ev->level == LOG_INFO) {
         fprintf(
             ev->udata, "%s %-5s ",
-            buf, level_strings[ev->level], ev->file, ev->function, ev->line);
+            buf, level_strings[ev->level]);
 
     } else {
         fprintf(
             ev->udata, "%s %-5s %s %s() %d ",
             buf, level_strings[ev->level], ev->file, ev->function, ev->line);
     }
-    vfprintf(ev->udata, ev->fmt, ev->ap);
-    fprintf(ev->udata, "\n");
-    fflush(ev->udata);
+    print_message(ev);
 }
 
 
@@ -99,15 +186,99 @@ void log_set_lock(log_LockFn fn, void *udata)
 }
 
 
+/* Lowest level any sink prints, LOG_FATAL + 1 when there is no sink. */
+static int sinks_threshold(void)
+{
+    int threshold = LOG_FATAL + 1;
+
+    if (!L.quiet)
+        threshold = L.level;
+    for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
+        if (L.callbacks[i].level < threshold)
+            threshold = L.callbacks[i].level;
+    }
+    return threshold;
+}
+
+
+/* Recompute the inline thresholds after any level or sink change. */
+static void update_thresholds(void)
+{
+    int threshold = sinks_threshold();
+    log_Module *module;
+
+    pthread_mutex_lock(&L.modules_lock);
+    for (module = L.modules; module; module = module->next)
+        module->threshold = module->level >= 0 ? module->level : threshold;
+    pthread_mutex_unlock(&L.modules_lock);
+}
+
+
+void log_module_register(log_Module *module)
+{
+    pthread_mutex_lock(&L.modules_lock);
+    module->next = L.modules;
+    L.modules = module;
+    pthread_mutex_unlock(&L.modules_lock);
+    update_thresholds();
+}
+
+
+log_Module *log_module_first(void)
+{
+    return L.modules;
+}
+
+
+/*
+ * A module level overrides the global and sink levels for that module,
+ * -1 makes it follow them again. Returns the number of modules matched.
+ */
+int log_set_module_level(const char *name, int level)
+{
+    log_Module *module;
+    int count = 0;
+
+    pthread_mutex_lock(&L.modules_lock);
+    for (module = L.modules; module; module = module->next) {
+        if (!strcmp(module->name, name)) {
+            module->level = level;
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&L.modules_lock);
+    update_thresholds();
+    return count;
+}
+
+
+int log_level_from_string(const char *str)
+{
+    char *end;
+    long level;
+
+    for (int i = LOG_TRACE; i <= LOG_FATAL; i++) {
+        if (!strcasecmp(str, level_strings[i]))
+            return i;
+    }
+    level = strtol(str, &end, 0);
+    if (*str == '\0' || *end != '\0' || level < LOG_TRACE || level > LOG_FATAL)
+        return -1;
+    return level;
+}
+
+
 void log_set_level(int level)
 {
     L.level = level;
+    update_thresholds();
 }
 
 
 void log_set_quiet(bool enable)
 {
     L.quiet = enable;
+    update_thresholds();
 }
 
 
@@ -116,6 +287,7 @@ int log_add_callback(log_LogFn fn, void *udata, int level)
     for (int i = 0; i < MAX_CALLBACKS; i++) {
         if (!L.callbacks[i].fn) {
             L.callbacks[i] = (Callback) { fn, udata, level };
+            update_thresholds();
             return 0;
         }
     }
@@ -129,44 +301,323 @@ int log_add_fp(FILE *fp, int level)
 }
 
 
-static void init_event(log_Event *ev, void *udata)
+/*
+ * Runs the sinks for one event, either a va_list or a preformatted message.
+ * Forced events come from a module with its own level and skip the sink
+ * levels.
+ */
+static void dispatch_event(log_Event *ev, va_list *ap, bool forced)
 {
-    if (!ev->time) {
-        time_t t = time(NULL);
-        ev->time = localtime(&t);
+    if (!L.quiet && (forced || ev->level >= L.level)) {
+        ev->udata = stderr;
+        if (ap)
+            va_copy(ev->ap, *ap);
+        stdout_callback(ev);
+        if (ap)
+            va_end(ev->ap);
+    }
+
+    for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
+        Callback *cb = &L.callbacks[i];
+        if (forced || ev->level >= cb->level) {
+            ev->udata = cb->udata;
+            if (ap)
+                va_copy(ev->ap, *ap);
+            cb->fn(ev);
+            if (ap)
+                va_end(ev->ap);
+        }
     }
-    ev->udata = udata;
 }
 
 
-void log_log(int level, const char *file, const char *function, int line, const char *fmt, ...)
+static void dispatch_record(log_Record *rec)
 {
+    log_Event ev = {
+        .msg = rec->msg,
+        .file = rec->file,
+        .function = rec->function,
+        .line = rec->line,
+        .level = rec->level,
+        .sec = rec->ts.tv_sec,
+    };
+
+    lock();
+    dispatch_event(&ev, NULL, rec->forced);
+    unlock();
+}
+
+
+static void ring_release(void *arg)
+{
+    log_Ring *ring = arg;
+    atomic_store_explicit(&ring->dead, true, memory_order_release);
+}
+
+
+static void ring_key_init(void)
+{
+    pthread_key_create(&A.key, ring_release);
+}
+
+
+static log_Ring *ring_get(void)
+{
+    log_Ring *ring = thread_ring;
+
+    if (ring)
+        return ring;
+
+    ring = calloc(1, sizeof(*ring));
+    if (ring == NULL)
+        return NULL;
+
+    pthread_once(&A.key_once, ring_key_init);
+    pthread_setspecific(A.key, ring);
+
+    /* lock free push, only the consumer ever unlinks */
+    ring->next = atomic_load(&A.rings);
+    while (!atomic_compare_exchange_weak(&A.rings, &ring->next, ring))
+        ;
+    thread_ring = ring;
+    return ring;
+}
+
+
+static int log_async_drain(void);
+
+static bool log_async_push(int level, bool forced, const char *file, const char *function,
+                           int line, const char *fmt, va_list ap)
+{
+    log_Ring *ring = ring_get();
+    log_Record *rec;
+    unsigned head, tail;
+
+    if (ring == NULL)
+        return false;
+
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= LOG_RING_SLOTS) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return true;
+    }
+
+    rec = &ring->slots[head & (LOG_RING_SLOTS - 1)];
+    clock_gettime(CLOCK_REALTIME_COARSE, &rec->ts);
+    rec->file = file;
+    rec->function = function;
+    rec->line = line;
+    rec->level = level;
+    rec->forced = forced;
+    vsnprintf(rec->msg, sizeof(rec->msg), fmt, ap);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    /*
+     * Pairs with the fence in log_async_thread(): either the writer sees
+     * this record before it sleeps, or we see it sleeping and wake it.
+     * Only pay for the wakeup when the writer actually sleeps.
+     */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&A.sleeping, memory_order_relaxed)) {
+        pthread_mutex_lock(&A.mutex);
+        pthread_cond_signal(&A.cond);
+        pthread_mutex_unlock(&A.mutex);
+    }
+
+    /* raced with log_async_stop(), write it here once the writer is gone */
+    if (!atomic_load_explicit(&A.running, memory_order_relaxed)) {
+        pthread_mutex_lock(&A.mutex);
+        if (A.exited)
+            log_async_drain();
+        pthread_mutex_unlock(&A.mutex);
+    }
+    return true;
+}
+
+
+static int log_async_drain(void)
+{
+    log_Ring *ring, *prev = NULL, *next;
+    unsigned long dropped = 0;
+    int count = 0;
+
+    for (ring = atomic_load(&A.rings); ring; ring = next) {
+        unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        bool dead = atomic_load_explicit(&ring->dead, memory_order_acquire);
+
+        next = ring->next;
+        for (; tail != head; tail++, count++) {
+            dispatch_record(&ring->slots[tail & (LOG_RING_SLOTS - 1)]);
+            atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+        }
+        dropped += atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+
+        /* producers only touch the list head, anything behind it is ours */
+        if (dead && prev && atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+            prev->next = next;
+            free(ring);
+            continue;
+        }
+        prev = ring;
+    }
+
+    if (dropped) {
+        char msg[64];
+        log_Event ev = {
+            .msg = msg,
+            .file = __FILE__,
+            .function = __FUNCTION__,
+            .line = __LINE__,
+            .level = LOG_WARN,
+            .sec = time(NULL),
+        };
+        snprintf(msg, sizeof(msg), "log ring full, %lu records dropped", dropped);
+        A.dropped += dropped;
+        lock();
+        dispatch_event(&ev, NULL, false);
+        unlock();
+    }
+    return count;
+}
+
+
+static bool log_async_pending(void)
+{
+    log_Ring *ring;
+
+    for (ring = atomic_load(&A.rings); ring; ring = ring->next) {
+        if (atomic_load_explicit(&ring->head, memory_order_acquire) !=
+            atomic_load_explicit(&ring->tail, memory_order_relaxed))
+            return true;
+    }
+    return false;
+}
+
+
+static void *log_async_thread(void *arg)
+{
+    struct timespec deadline;
+
+    for (;;) {
+        if (log_async_drain() > 0)
+            continue;
+
+        /*
+         * Producers signal under the mutex only while sleeping is set, and
+         * the fences order each side's store before its load, so checking
+         * for pending records with the mutex held cannot miss one.
+         */
+        pthread_mutex_lock(&A.mutex);
+        if (A.stop) {
+            /* under the mutex, producers that missed the stop drain after us */
+            log_async_drain();
+            A.exited = true;
+            pthread_mutex_unlock(&A.mutex);
+            break;
+        }
+        atomic_store(&A.sleeping, true);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!log_async_pending()) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += LOG_IDLE_WAIT_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&A.cond, &A.mutex, &deadline);
+        }
+        atomic_store(&A.sleeping, false);
+        pthread_mutex_unlock(&A.mutex);
+    }
+    return NULL;
+}
+
+
+int log_async_start(void)
+{
+    if (atomic_load(&A.running))
+        return 0;
+
+    pthread_mutex_lock(&A.mutex);
+    A.stop = false;
+    A.exited = false;
+    pthread_mutex_unlock(&A.mutex);
+    if (pthread_create(&A.thread, NULL, log_async_thread, NULL) != 0)
+        return -1;
+    atomic_store(&A.running, true);
+    return 0;
+}
+
+
+/* Flushes everything queued so far and goes back to synchronous logging. */
+void log_async_stop(void)
+{
+    if (!atomic_load(&A.running))
+        return;
+
+    atomic_store(&A.running, false);
+    pthread_mutex_lock(&A.mutex);
+    A.stop = true;
+    pthread_cond_signal(&A.cond);
+    pthread_mutex_unlock(&A.mutex);
+    pthread_join(A.thread, NULL);
+}
+
+
+unsigned long log_async_dropped(void)
+{
+    return A.dropped;
+}
+
+
+static void log_vlog(log_Module *module, int level, const char *file, const char *function,
+                     int line, const char *fmt, va_list ap)
+{
+    bool forced = module->level >= 0;
+
+    if (level < module->threshold)
+        return;
+
+    if (atomic_load_explicit(&A.running, memory_order_relaxed) &&
+        log_async_push(level, forced, file, function, line, fmt, ap))
+        return;
+
     log_Event ev = {
         .fmt     = fmt,
         .file    = file,
         .function = function,
         .line    = line,
         .level = level,
+        .sec = time(NULL),
     };
 
+    va_list copy;
+    va_copy(copy, ap);
     lock();
+    dispatch_event(&ev, &copy, forced);
+    unlock();
+    va_end(copy);
+}
 
-    if (!L.quiet && level >= L.level) {
-        init_event(&ev, stderr);
-        va_start(ev.ap, fmt);
-        stdout_callback(&ev);
-        va_end(ev.ap);
-    }
 
-    for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
-        Callback *cb = &L.callbacks[i];
-        if (level >= cb->level) {
-            init_event(&ev, cb->udata);
-            va_start(ev.ap, fmt);
-            cb->fn(&ev);
-            va_end(ev.ap);
-        }
-    }
+void log_log_module(log_Module *module, int level, const char *file, const char *function,
+                    int line, const char *fmt, ...)
+{
+    va_list ap;
 
-    unlock();
+    va_start(ap, fmt);
+    log_vlog(module, level, file, function, line, fmt, ap);
+    va_end(ap);
+}
+
+
+void log_log(int level, const char *file, const char *function, int line, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    log_vlog(&log_module_default, level, file, function, line, fmt, ap);
+    va_end(ap);
 }
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "evprof.h"
+
+#define LOOP_LAG_INTERVAL   (0.1)       /* seconds */
+#define LE_MIN_SHIFT        10          /* 1us */
+#define LE_MAX_SHIFT        34          /* ~17s */
+
+static struct {
+    pthread_mutex_t lock;
+    _Atomic(metric_t *) head;
+    /* event loop lag */
+    struct ev_loop *loop;
+    ev_timer timer;
+    uint64_t expected;
+    metric_t *lag;
+    metric_t *iterations;
+} M = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static int bucket_index(uint64_t v)
+{
+    int msb, idx;
+
+    if (v < 16)
+        return v;
+    msb = 63 - __builtin_clzll(v);
+    idx = 16 + (msb - 4) * 8 + ((v >> (msb - 3)) & 7);
+    return idx < METRIC_HIST_BUCKETS ? idx : METRIC_HIST_BUCKETS - 1;
+}
+
+static uint64_t bucket_lower(int idx)
+{
+    int msb;
+
+    if (idx < 16)
+        return idx;
+    msb = (idx - 16) / 8 + 4;
+    return (uint64_t)(8 + (idx - 16) % 8) << (msb - 3);
+}
+
+static uint64_t bucket_upper(int idx)
+{
+    if (idx < 16)
+        return idx + 1;
+    return bucket_lower(idx) + (1ULL << ((idx - 16) / 8 + 1));
+}
+
+/* key="value" pairs, value escaped as the text format requires */
+static void render_labels(char *out, size_t size, va_list ap)
+{
+    const char *key, *val;
+    size_t n = 0;
+
+    out[0] = '\0';
+    while ((key = va_arg(ap, const char *)) != NULL && n + 4 < size) {
+        val = va_arg(ap, const char *);
+        n += snprintf(out + n, size - n, "%s%s=\"", n ? "," : "", key);
+        for (; val && *val && n + 3 < size; val++) {
+            if (*val == '"' || *val == '\\')
+                out[n++] = '\\';
+            if (*val == '\n') {
+                out[n++] = '\\';
+                out[n++] = 'n';
+                continue;
+            }
+            out[n++] = *val;
+        }
+        if (n + 1 < size)
+            out[n++] = '"';
+        out[n] = '\0';
+    }
+}
+
+metric_t *metric_get(enum metric_type type, const char *name, const char *help, ...)
+{
+    char labels[sizeof(((metric_t *)0)->labels)];
+    metric_t *m;
+    va_list ap;
+
+    va_start(ap, help);
+    render_labels(labels, sizeof(labels), ap);
+    va_end(ap);
+
+    pthread_mutex_lock(&M.lock);
+    for (m = atomic_load(&M.head); m; m = m->next) {
+        if (m->type == type && !strcmp(m->name, name) && !strcmp(m->labels, labels))
+            goto out;
+    }
+    if ((m = calloc(1, sizeof(*m))) == NULL)
+        goto out;
+    if (type == METRIC_HISTOGRAM &&
+        (m->buckets = calloc(METRIC_HIST_BUCKETS, sizeof(*m->buckets))) == NULL) {
+        free(m);
+        m = NULL;
+        goto out;
+    }
+    m->name = name;
+    m->help = help;
+    m->type = type;
+    strcpy(m->labels, labels);
+    /* append, so related series stay in registration order */
+    if (atomic_load(&M.head) == NULL) {
+        atomic_store(&M.head, m);
+    } else {
+        metric_t *tail = atomic_load(&M.head);
+        while (tail->next)
+            tail = tail->next;
+        tail->next = m;
+    }
+out:
+    pthread_mutex_unlock(&M.lock);
+    return m;
+}
+
+void metric_observe(metric_t *m, uint64_t ns)
+{
+    uint64_t max;
+
+    if (m == NULL || m->buckets == NULL)
+        return;
+    /* buckets hold (lower, upper], so a value on an le boundary counts toward it */
+    atomic_fetch_add_explicit(&m->buckets[bucket_index(ns ? ns - 1 : 0)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->sum, ns, memory_order_relaxed);
+    max = atomic_load_explicit(&m->max, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&m->max, &max, ns,
+                            memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+uint64_t metric_quantile(metric_t *m, double q)
+{
+    uint64_t count, rank, seen = 0;
+    int i;
+
+    if (m == NULL || m->buckets == NULL)
+        return 0;
+    count = atomic_load_explicit(&m->count, memory_order_relaxed);
+    if (count == 0)
+        return 0;
+    rank = q * count;
+    if (rank >= count)
+        rank = count - 1;
+    for (i=0; i<METRIC_HIST_BUCKETS; i++) {
+        seen += atomic_load_explicit(&m->buckets[i], memory_order_relaxed);
+        if (seen > rank)
+            return (bucket_lower(i) + bucket_upper(i) + 1) / 2;
+    }
+    return atomic_load_explicit(&m->max, memory_order_relaxed);
+}
+
+metric_t *metric_first(void)
+{
+    return atomic_load(&M.head);
+}
+
+static void appendf(struct iobuf *out, const char *fmt, ...)
+{
+    char buf[512];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        iobuf_add(out, out->len, buf, n < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+static void render_series(struct iobuf *out, metric_t *m)
+{
+    const char *sep = m->labels[0] ? "," : "";
+    const char *open = m->labels[0] ? "{" : "";
+    const char *close = m->labels[0] ? "}" : "";
+    uint64_t cumulative = 0;
+    int i = 0, shift;
+
+    switch (m->type) {
+    case METRIC_COUNTER:
+        appendf(out, "%s%s%s%s %llu\n", m->name, open, m->labels, close,
+                (unsigned long long)atomic_load(&m->value));
+        break;
+    case METRIC_GAUGE:
+        appendf(out, "%s%s%s%s %lld\n", m->name, open, m->labels, close,
+                (long long)atomic_load(&m->value));
+        break;
+    case METRIC_HISTOGRAM:
+        /* power of two boundaries line up with the sub-bucket groups */
+        for (shift = LE_MIN_SHIFT; shift <= LE_MAX_SHIFT; shift++) {
+            int end = bucket_index(1ULL << shift);
+            for (; i < end; i++)
+                cumulative += atomic_load_explicit(&m->buckets[i], memory_order_relaxed);
+            appendf(out, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", m->name, m->labels, sep,
+                    (double)(1ULL << shift) / 1e9, (unsigned long long)cumulative);
+        }
+        appendf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", m->name, m->labels, sep,
+                (unsigned long long)atomic_load(&m->count));
+        appendf(out, "%s_sum%s%s%s %.9f\n", m->name, open, m->labels, close,
+                (double)atomic_load(&m->sum) / 1e9);
+        appendf(out, "%s_count%s%s%s %llu\n", m->name, open, m->labels, close,
+                (unsigned long long)atomic_load(&m->count));
+        break;
+    }
+}
+
+int metrics_render(struct iobuf *out)
+{
+    static const char *types[] = { "counter", "gauge", "histogram" };
+    metric_t *m, *p;
+
+    pthread_mutex_lock(&M.lock);
+    for (m = metric_first(); m; m = m->next) {
+        /* one HELP/TYPE header per family, at its first series */
+        for (p = metric_first(); p != m && strcmp(p->name, m->name); p = p->next)
+            ;
+        if (p != m)
+            continue;
+        appendf(out, "# HELP %s %s\n# TYPE %s %s\n", m->name, m->help, m->name, types[m->type]);
+        for (p = m; p; p = p->next) {
+            if (!strcmp(p->name, m->name))
+                render_series(out, p);
+        }
+    }
+    pthread_mutex_unlock(&M.lock);
+    return out->len;
+}
+
+static void loop_lag_cb(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    uint64_t now = metric_now();
+
+    if (now > M.expected)
+        metric_observe(M.lag, now - M.expected);
+    /* same rescheduling rule as libev repeat timers */
+    M.expected += LOOP_LAG_INTERVAL * 1e9;
+    if (M.expected < now)
+        M.expected = now;
+    metric_set(M.iterations, ev_iteration(loop));
+}
+
+/* Periodic timer, how late it fires is how long the loop was blocked. */
+void metrics_loop_init(struct ev_loop *loop)
+{
+    M.loop = loop;
+    M.lag = metric_get(METRIC_HISTOGRAM, "devctl_loop_lag_seconds",
+                       "Event loop timer lateness", NULL);
+    M.iterations = metric_get(METRIC_GAUGE, "devctl_loop_iterations",
+                              "Event loop iterations", NULL);
+    M.expected = metric_now() + LOOP_LAG_INTERVAL * 1e9;
+    ev_timer_init(&M.timer, loop_lag_cb, LOOP_LAG_INTERVAL, LOOP_LAG_INTERVAL);
+    evprof_watch(&M.timer, "metrics.lag", "");
+    ev_timer_start(loop, &M.timer);
+}
+
+void metrics_loop_exit(void)
+{
+    if (M.loop)
+        ev_timer_stop(M.loop, &M.timer);
+}
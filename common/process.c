@@ -0,0 +1,517 @@
+#define _GNU_SOURCE                 /* pipe2 */
+#define LOG_MODULE_NAME "process"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "log.h"
+#include "list.h"
+#include "evprof.h"
+#include "metrics.h"
+#include "process.h"
+
+extern char **environ;
+
+enum process_state {
+    PROCESS_QUEUED,
+    PROCESS_RUNNING,
+    PROCESS_EXITED,
+};
+
+struct process {
+    enum process_state state;
+    char **argv;
+    double timeout;
+    size_t max_output;
+    bool merge_stderr;
+    bool cancel;
+    int signal;                 /* last signal sent to the group */
+    pid_t pid;
+    int out_fd;
+    int err_fd;
+    ev_io out_io;
+    ev_io err_io;
+    ev_child child;
+    ev_timer timer;
+    uint64_t start_ns;
+    struct process_result res;
+    process_done_cb cb;
+    void *arg;
+    struct list_head list;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct ev_loop *loop;
+    ev_async async;
+    struct list_head queued;
+    struct list_head running;
+    int nqueued;
+    int nrunning;
+    int max_running;
+    int next_id;
+    metric_t *spawned;
+    metric_t *failed;
+    metric_t *timeouts;
+    metric_t *duration;
+} P = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static char **argv_dup(const char *const *argv)
+{
+    char **copy;
+    int i, n;
+
+    for (n=0; argv[n]; n++)
+        ;
+    if ((copy = calloc(n + 1, sizeof(char *))) == NULL)
+        return NULL;
+    for (i=0; i<n; i++) {
+        if ((copy[i] = strdup(argv[i])) == NULL)
+            goto fail;
+    }
+    return copy;
+
+fail:
+    while (i--)
+        free(copy[i]);
+    free(copy);
+    return NULL;
+}
+
+static void process_free(struct process *p)
+{
+    char **arg;
+
+    for (arg = p->argv; *arg; arg++)
+        free(*arg);
+    free(p->argv);
+    iobuf_free(&p->res.out);
+    iobuf_free(&p->res.err);
+    free(p);
+}
+
+static void pipe_close(struct process *p, ev_io *w, int *fd)
+{
+    if (*fd < 0)
+        return;
+    ev_io_stop(P.loop, w);
+    close(*fd);
+    *fd = -1;
+}
+
+/* Loop thread, p is off the lists */
+static void process_done(struct process *p)
+{
+    p->res.elapsed_ns = p->start_ns ? metric_now() - p->start_ns : 0;
+    if (p->start_ns)
+        metric_observe(P.duration, p->res.elapsed_ns);
+    log_debug("[%d] %s: status %d, %zu+%zu bytes, %.3f ms", p->res.id, p->argv[0],
+              p->res.status, p->res.out.len, p->res.err.len, p->res.elapsed_ns / 1e6);
+    if (p->cb)
+        p->cb(&p->res, p->arg);
+    process_free(p);
+}
+
+static void process_finish(struct process *p)
+{
+    pipe_close(p, &p->out_io, &p->out_fd);
+    pipe_close(p, &p->err_io, &p->err_fd);
+    ev_timer_stop(P.loop, &p->timer);
+    ev_child_stop(P.loop, &p->child);
+
+    pthread_mutex_lock(&P.lock);
+    list_del(&p->list);
+    P.nrunning--;
+    pthread_mutex_unlock(&P.lock);
+
+    process_done(p);
+    /* a slot is free */
+    ev_async_send(P.loop, &P.async);
+}
+
+static void process_signal(struct process *p, int sig)
+{
+    p->signal = sig;
+    if (kill(-p->pid, sig) != 0 && errno != ESRCH)
+        log_warn("[%d] kill %d: %s", p->res.id, sig, strerror(errno));
+    ev_timer_stop(P.loop, &p->timer);
+    ev_timer_set(&p->timer, PROCESS_KILL_GRACE, 0.);
+    ev_timer_start(P.loop, &p->timer);
+}
+
+static void timer_cb(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct process *p = container_of(w, struct process, timer);
+
+    if (p->state == PROCESS_EXITED) {
+        /* the child is gone but something it spawned keeps the pipes open */
+        process_finish(p);
+    } else if (p->signal == 0) {
+        log_warn("[%d] %s: timeout after %.1fs", p->res.id, p->argv[0], p->timeout);
+        p->res.timed_out = true;
+        metric_add(P.timeouts, 1);
+        process_signal(p, SIGTERM);
+    } else {
+        process_signal(p, SIGKILL);
+    }
+}
+
+static void child_cb(struct ev_loop *loop, ev_child *w, int revents)
+{
+    struct process *p = container_of(w, struct process, child);
+
+    ev_child_stop(loop, w);
+    p->state = PROCESS_EXITED;
+    if (WIFEXITED(w->rstatus))
+        p->res.status = WEXITSTATUS(w->rstatus);
+    else if (WIFSIGNALED(w->rstatus))
+        p->res.status = 128 + WTERMSIG(w->rstatus);
+
+    if (p->out_fd < 0 && p->err_fd < 0) {
+        process_finish(p);
+        return;
+    }
+    ev_timer_stop(loop, &p->timer);
+    ev_timer_set(&p->timer, PROCESS_DRAIN_TIMEOUT, 0.);
+    ev_timer_start(loop, &p->timer);
+}
+
+static void pipe_read(struct process *p, ev_io *w, int *fd, struct iobuf *io)
+{
+    char buf[4096];
+    size_t room, size;
+    ssize_t n;
+
+    for (;;) {
+        n = read(*fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                return;
+            log_error("[%d] read: %s", p->res.id, strerror(errno));
+            n = 0;
+        }
+        if (n == 0) {
+            pipe_close(p, w, fd);
+            break;
+        }
+
+        room = io->len < p->max_output ? p->max_output - io->len : 0;
+        if ((size_t)n > room) {
+            p->res.truncated += n - room;
+            n = room;
+        }
+        if (n == 0)
+            continue;
+        /* grow geometrically, iobuf_add() only grows by a chunk */
+        if (io->len + n > io->cap) {
+            size = io->cap ? io->cap * 2 : IOBUF_CHUNK_SIZE;
+            while (size < io->len + n)
+                size *= 2;
+            iobuf_resize(io, size);
+        }
+        iobuf_add(io, io->len, buf, n);
+    }
+}
+
+static void out_cb(struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct process *p = container_of(w, struct process, out_io);
+
+    pipe_read(p, w, &p->out_fd, &p->res.out);
+    if (p->state == PROCESS_EXITED && p->out_fd < 0 && p->err_fd < 0)
+        process_finish(p);
+}
+
+static void err_cb(struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct process *p = container_of(w, struct process, err_io);
+
+    pipe_read(p, w, &p->err_fd, &p->res.err);
+    if (p->state == PROCESS_EXITED && p->out_fd < 0 && p->err_fd < 0)
+        process_finish(p);
+}
+
+/* Only the parent's read end is non-blocking, the child gets a plain pipe. */
+static int pipe_open(int fds[2])
+{
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return -1;
+    if (fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        fds[0] = fds[1] = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static int process_spawn(struct process *p)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    int out[2] = {-1, -1};
+    int err[2] = {-1, -1};
+    int ret;
+
+    if (pipe_open(out) != 0 || (!p->merge_stderr && pipe_open(err) != 0)) {
+        ret = errno;
+        goto out;
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, p->merge_stderr ? out[1] : err[1], STDERR_FILENO);
+
+    /* own group so a timeout reaches pipelines too, default signal state */
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK |
+                                    POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&attr, 0);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigfillset(&mask);
+    sigdelset(&mask, SIGKILL);
+    sigdelset(&mask, SIGSTOP);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+
+    ret = posix_spawnp(&p->pid, p->argv[0], &actions, &attr, p->argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+out:
+    if (out[1] >= 0)
+        close(out[1]);
+    if (err[1] >= 0)
+        close(err[1]);
+    if (ret != 0) {
+        if (out[0] >= 0)
+            close(out[0]);
+        if (err[0] >= 0)
+            close(err[0]);
+        return ret;
+    }
+    p->out_fd = out[0];
+    p->err_fd = err[0];
+    return 0;
+}
+
+static void process_start(struct process *p)
+{
+    int ret;
+
+    if ((ret = process_spawn(p)) != 0) {
+        log_error("[%d] spawn %s: %s", p->res.id, p->argv[0], strerror(ret));
+        metric_add(P.failed, 1);
+        process_done(p);
+        return;
+    }
+    metric_add(P.spawned, 1);
+    p->state = PROCESS_RUNNING;
+    p->start_ns = metric_now();
+
+    ev_io_init(&p->out_io, out_cb, p->out_fd, EV_READ);
+    evprof_watch(&p->out_io, "process.read", "stdout");
+    ev_io_start(P.loop, &p->out_io);
+    if (p->err_fd >= 0) {
+        ev_io_init(&p->err_io, err_cb, p->err_fd, EV_READ);
+        evprof_watch(&p->err_io, "process.read", "stderr");
+        ev_io_start(P.loop, &p->err_io);
+    }
+    ev_child_init(&p->child, child_cb, p->pid, 0);
+    evprof_watch(&p->child, "process.exit", "child");
+    ev_child_start(P.loop, &p->child);
+    ev_timer_init(&p->timer, timer_cb, p->timeout, 0.);
+    evprof_watch(&p->timer, "process.timeout", "timer");
+    if (p->timeout > 0)
+        ev_timer_start(P.loop, &p->timer);
+
+    pthread_mutex_lock(&P.lock);
+    list_add_tail(&p->list, &P.running);
+    P.nrunning++;
+    pthread_mutex_unlock(&P.lock);
+}
+
+/* Loop thread: handle cancellations, then fill free slots from the queue. */
+static void async_cb(struct ev_loop *loop, ev_async *w, int revents)
+{
+    struct process *p, *n;
+    LIST_HEAD(cancelled);
+
+    pthread_mutex_lock(&P.lock);
+    list_for_each_entry_safe(p, n, &P.queued, list) {
+        if (p->cancel) {
+            list_del(&p->list);
+            list_add_tail(&p->list, &cancelled);
+            P.nqueued--;
+        }
+    }
+    list_for_each_entry(p, &P.running, list) {
+        if (p->cancel && p->signal == 0 && p->state == PROCESS_RUNNING)
+            process_signal(p, SIGTERM);
+    }
+    pthread_mutex_unlock(&P.lock);
+
+    list_for_each_entry_safe(p, n, &cancelled, list)
+        process_done(p);
+
+    for (;;) {
+        pthread_mutex_lock(&P.lock);
+        if (P.nrunning >= P.max_running || list_empty(&P.queued)) {
+            pthread_mutex_unlock(&P.lock);
+            break;
+        }
+        p = list_first_entry(&P.queued, struct process, list);
+        list_del(&p->list);
+        P.nqueued--;
+        pthread_mutex_unlock(&P.lock);
+        process_start(p);
+    }
+}
+
+int process_init(struct ev_loop *loop, int max_running)
+{
+    P.loop = loop;
+    P.max_running = max_running > 0 ? max_running : PROCESS_MAX_RUNNING;
+    INIT_LIST_HEAD(&P.queued);
+    INIT_LIST_HEAD(&P.running);
+    P.spawned = metric_get(METRIC_COUNTER, "devctl_process_spawned_total",
+                           "Subprocesses started", NULL);
+    P.failed = metric_get(METRIC_COUNTER, "devctl_process_failed_total",
+                          "Subprocesses that could not be started", NULL);
+    P.timeouts = metric_get(METRIC_COUNTER, "devctl_process_timeouts_total",
+                            "Subprocesses killed on timeout", NULL);
+    P.duration = metric_get(METRIC_HISTOGRAM, "devctl_process_seconds",
+                            "Subprocess run time", NULL);
+
+    ev_async_init(&P.async, async_cb);
+    evprof_watch(&P.async, "process.async", "queue");
+    ev_async_start(loop, &P.async);
+    return 0;
+}
+
+void process_exit(void)
+{
+    struct process *p;
+
+    if (P.loop == NULL)
+        return;
+    ev_async_stop(P.loop, &P.async);
+
+    while (!list_empty(&P.queued)) {
+        p = list_first_entry(&P.queued, struct process, list);
+        list_del(&p->list);
+        P.nqueued--;
+        process_done(p);
+    }
+    while (!list_empty(&P.running)) {
+        p = list_first_entry(&P.running, struct process, list);
+        if (p->state == PROCESS_RUNNING) {
+            kill(-p->pid, SIGKILL);
+            if (waitpid(p->pid, &p->child.rstatus, 0) == p->pid)
+                p->res.status = 128 + SIGKILL;
+        }
+        p->state = PROCESS_EXITED;
+        if (p->out_fd >= 0)
+            pipe_read(p, &p->out_io, &p->out_fd, &p->res.out);
+        if (p->err_fd >= 0)
+            pipe_read(p, &p->err_io, &p->err_fd, &p->res.err);
+        process_finish(p);
+    }
+    P.loop = NULL;
+}
+
+int process_run(const process_options_t *opt, process_done_cb cb, void *arg)
+{
+    struct process *p;
+    int id;
+
+    if (P.loop == NULL || opt->argv == NULL || opt->argv[0] == NULL)
+        return -1;
+    if ((p = calloc(1, sizeof(*p))) == NULL)
+        return -1;
+    if ((p->argv = argv_dup(opt->argv)) == NULL) {
+        free(p);
+        return -1;
+    }
+    p->state = PROCESS_QUEUED;
+    p->timeout = opt->timeout;
+    p->max_output = opt->max_output ? opt->max_output : PROCESS_MAX_OUTPUT;
+    p->merge_stderr = opt->merge_stderr;
+    p->pid = -1;
+    p->out_fd = p->err_fd = -1;
+    p->res.status = -1;
+    p->cb = cb;
+    p->arg = arg;
+
+    pthread_mutex_lock(&P.lock);
+    if (P.nqueued >= PROCESS_MAX_QUEUED) {
+        pthread_mutex_unlock(&P.lock);
+        log_warn("%s: queue full", opt->argv[0]);
+        process_free(p);
+        return -1;
+    }
+    id = p->res.id = ++P.next_id;
+    list_add_tail(&p->list, &P.queued);
+    P.nqueued++;
+    pthread_mutex_unlock(&P.lock);
+
+    ev_async_send(P.loop, &P.async);
+    return id;
+}
+
+int process_cancel(int id)
+{
+    struct process *p;
+    int ret = -1;
+
+    pthread_mutex_lock(&P.lock);
+    list_for_each_entry(p, &P.queued, list) {
+        if (p->res.id == id)
+            goto found;
+    }
+    list_for_each_entry(p, &P.running, list) {
+        if (p->res.id == id)
+            goto found;
+    }
+    goto out;
+
+found:
+    p->cancel = true;
+    ret = 0;
+out:
+    pthread_mutex_unlock(&P.lock);
+    if (ret == 0)
+        ev_async_send(P.loop, &P.async);
+    return ret;
+}
+
+void process_report(void (*print)(const char *fmt, ...))
+{
+    static const char *states[] = { "queued", "running", "exited" };
+    struct process *p;
+    uint64_t now = metric_now();
+
+    pthread_mutex_lock(&P.lock);
+    print("%d running, %d queued, limit %d\n", P.nrunning, P.nqueued, P.max_running);
+    list_for_each_entry(p, &P.running, list) {
+        print("  [%d] pid %d %-8s %8.1fs  %s\n", p->res.id, (int)p->pid, states[p->state],
+              (now - p->start_ns) / 1e9, p->argv[0]);
+    }
+    list_for_each_entry(p, &P.queued, list)
+        print("  [%d] %-16s %8s  %s\n", p->res.id, states[p->state], "", p->argv[0]);
+    pthread_mutex_unlock(&P.lock);
+}
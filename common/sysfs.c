@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+
+#include "sysfs.h"
+
+int sysfs_attr_open(sysfs_attr_t *attr, const char *dir, const char *name, int flags)
+{
+    struct statfs fs;
+
+    attr->fd = -1;
+    attr->regular = false;
+    if ((size_t)snprintf(attr->path, sizeof(attr->path), "%s/%s", dir, name) >= sizeof(attr->path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if ((attr->fd = open(attr->path, flags | O_CLOEXEC)) < 0)
+        return -1;
+    if (fstatfs(attr->fd, &fs) == 0 && fs.f_type != SYSFS_MAGIC)
+        attr->regular = true;
+    return 0;
+}
+
+void sysfs_attr_close(sysfs_attr_t *attr)
+{
+    if (attr->fd >= 0)
+        close(attr->fd);
+    attr->fd = -1;
+}
+
+ssize_t sysfs_attr_read(sysfs_attr_t *attr, char *buf, size_t size)
+{
+    ssize_t n;
+
+    if (size == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((n = pread(attr->fd, buf, size - 1, 0)) < 0)
+        return -1;
+    while (n > 0 && (buf[n-1] == '\n' || buf[n-1] == ' '))
+        n--;
+    buf[n] = '\0';
+    return n;
+}
+
+int sysfs_attr_read_l(sysfs_attr_t *attr, long long *value)
+{
+    char buf[32], *end;
+
+    if (sysfs_attr_read(attr, buf, sizeof(buf)) < 0)
+        return -1;
+    *value = strtoll(buf, &end, 0);
+    if (end == buf) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int sysfs_attr_write(sysfs_attr_t *attr, const char *value)
+{
+    size_t len = strlen(value);
+
+    if (pwrite(attr->fd, value, len, 0) != (ssize_t)len)
+        return -1;
+    if (attr->regular && ftruncate(attr->fd, len) < 0)
+        return -1;
+    return 0;
+}
+
+int sysfs_attr_write_l(sysfs_attr_t *attr, long long value)
+{
+    char buf[32];
+
+    snprintf(buf, sizeof(buf), "%lld", value);
+    return sysfs_attr_write(attr, buf);
+}
+
+int sysfs_write(const char *dir, const char *name, const char *value)
+{
+    sysfs_attr_t attr;
+    int ret;
+
+    if (sysfs_attr_open(&attr, dir, name, O_WRONLY) < 0)
+        return -1;
+    ret = sysfs_attr_write(&attr, value);
+    sysfs_attr_close(&attr);
+    return ret;
+}
+
+ssize_t sysfs_read(const char *dir, const char *name, char *buf, size_t size)
+{
+    sysfs_attr_t attr;
+    ssize_t n;
+
+    if (sysfs_attr_open(&attr, dir, name, O_RDONLY) < 0)
+        return -1;
+    n = sysfs_attr_read(&attr, buf, size);
+    sysfs_attr_close(&attr);
+    return n;
+}
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "trace.h"
+
+#define TRACE_MAX_IF        32
+#define TRACE_RING_SIZE     (1 << 20)       /* power of 2 */
+#define TRACE_MAX_CAPLEN    4096            /* longer records are truncated */
+
+/* pcapng block types */
+#define PCAPNG_SHB          0x0A0D0D0A
+#define PCAPNG_IDB          0x00000001
+#define PCAPNG_EPB          0x00000006
+#define PCAPNG_BYTE_ORDER   0x1A2B3C4D
+
+struct trace_rec {
+    uint64_t ts;                /* ns since epoch */
+    uint32_t len;               /* original length */
+    uint16_t caplen;
+    uint8_t id;
+    uint8_t dir;
+};
+
+struct trace_if {
+    char name[64];
+    uint16_t link;
+};
+
+atomic_bool trace_on;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool stop;
+    FILE *fp;
+    struct trace_if ifs[TRACE_MAX_IF];
+    int nifs;
+    int described;              /* interfaces written to the current file */
+    uint8_t *ring;
+    uint64_t head, tail;
+    uint64_t records, bytes, dropped;
+} T = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static inline size_t pad4(size_t len)
+{
+    return (len + 3) & ~(size_t)3;
+}
+
+static void ring_put(uint64_t pos, const void *src, size_t len)
+{
+    size_t off = pos & (TRACE_RING_SIZE - 1);
+    size_t first = TRACE_RING_SIZE - off;
+
+    if (first > len)
+        first = len;
+    memcpy(T.ring + off, src, first);
+    memcpy(T.ring, (const uint8_t *)src + first, len - first);
+}
+
+static void ring_get(uint64_t pos, void *dst, size_t len)
+{
+    size_t off = pos & (TRACE_RING_SIZE - 1);
+    size_t first = TRACE_RING_SIZE - off;
+
+    if (first > len)
+        first = len;
+    memcpy(dst, T.ring + off, first);
+    memcpy((uint8_t *)dst + first, T.ring, len - first);
+}
+
+int trace_register(const char *name, enum trace_link link)
+{
+    int i;
+
+    pthread_mutex_lock(&T.lock);
+    for (i=0; i<T.nifs; i++) {
+        if (T.ifs[i].link == link && !strcmp(T.ifs[i].name, name))
+            goto out;
+    }
+    if (i >= TRACE_MAX_IF) {
+        i = -1;
+        goto out;
+    }
+    strncpy(T.ifs[i].name, name, sizeof(T.ifs[i].name)-1);
+    T.ifs[i].link = link;
+    T.nifs++;
+out:
+    pthread_mutex_unlock(&T.lock);
+    return i;
+}
+
+void __trace_record(int id, enum trace_dir dir, const void *buf, size_t len)
+{
+    struct trace_rec rec;
+    struct timespec ts;
+    size_t need;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec.ts = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec.len = len;
+    rec.caplen = len > TRACE_MAX_CAPLEN ? TRACE_MAX_CAPLEN : len;
+    rec.id = id;
+    rec.dir = dir;
+    need = sizeof(rec) + pad4(rec.caplen);
+
+    pthread_mutex_lock(&T.lock);
+    if (T.ring == NULL) {
+        pthread_mutex_unlock(&T.lock);
+        return;
+    }
+    if (TRACE_RING_SIZE - (T.head - T.tail) < need) {
+        T.dropped++;
+        pthread_mutex_unlock(&T.lock);
+        return;
+    }
+    ring_put(T.head, &rec, sizeof(rec));
+    ring_put(T.head + sizeof(rec), buf, rec.caplen);
+    T.head += need;
+    T.records++;
+    T.bytes += len;
+    pthread_cond_signal(&T.cond);
+    pthread_mutex_unlock(&T.lock);
+}
+
+static void write_shb(FILE *fp)
+{
+    uint32_t hdr[3] = { PCAPNG_SHB, 28, PCAPNG_BYTE_ORDER };
+    uint16_t version[2] = { 1, 0 };
+    int64_t section_len = -1;
+    uint32_t total = 28;
+
+    fwrite(hdr, sizeof(hdr), 1, fp);
+    fwrite(version, sizeof(version), 1, fp);
+    fwrite(&section_len, sizeof(section_len), 1, fp);
+    fwrite(&total, sizeof(total), 1, fp);
+}
+
+static void write_option(FILE *fp, uint16_t code, const void *val, uint16_t len)
+{
+    static const uint8_t zero[4];
+    uint16_t opt[2] = { code, len };
+
+    fwrite(opt, sizeof(opt), 1, fp);
+    if (len) {
+        fwrite(val, len, 1, fp);
+        fwrite(zero, pad4(len) - len, 1, fp);
+    }
+}
+
+static void write_idb(FILE *fp, const struct trace_if *ifc)
+{
+    uint16_t name_len = strlen(ifc->name);
+    uint8_t tsresol = 9;        /* nanoseconds */
+    uint32_t total = 20 + 4 + pad4(name_len) + 4 + 4 + 4;
+    uint32_t hdr[2] = { PCAPNG_IDB, total };
+    uint16_t link[2] = { ifc->link, 0 };
+    uint32_t snaplen = 0;
+
+    fwrite(hdr, sizeof(hdr), 1, fp);
+    fwrite(link, sizeof(link), 1, fp);
+    fwrite(&snaplen, sizeof(snaplen), 1, fp);
+    write_option(fp, 2, ifc->name, name_len);       /* if_name */
+    write_option(fp, 9, &tsresol, 1);               /* if_tsresol */
+    write_option(fp, 0, NULL, 0);                   /* opt_endofopt */
+    fwrite(&total, sizeof(total), 1, fp);
+}
+
+static void write_epb(FILE *fp, const struct trace_rec *rec, const uint8_t *data)
+{
+    static const uint8_t zero[4];
+    uint32_t total = 28 + pad4(rec->caplen) + 8 + 4 + 4;
+    uint32_t hdr[7] = {
+        PCAPNG_EPB, total, rec->id,
+        (uint32_t)(rec->ts >> 32), (uint32_t)rec->ts,
+        rec->caplen, rec->len,
+    };
+    uint32_t flags = rec->dir;
+
+    fwrite(hdr, sizeof(hdr), 1, fp);
+    fwrite(data, rec->caplen, 1, fp);
+    fwrite(zero, pad4(rec->caplen) - rec->caplen, 1, fp);
+    write_option(fp, 2, &flags, sizeof(flags));     /* epb_flags */
+    write_option(fp, 0, NULL, 0);
+    fwrite(&total, sizeof(total), 1, fp);
+}
+
+static void *trace_thread(void *arg)
+{
+    static uint8_t data[TRACE_MAX_CAPLEN];
+    struct trace_if ifc;
+    struct trace_rec rec;
+
+    pthread_mutex_lock(&T.lock);
+    for (;;) {
+        while (T.head == T.tail && !T.stop)
+            pthread_cond_wait(&T.cond, &T.lock);
+        if (T.head == T.tail)
+            break;
+
+        ring_get(T.tail, &rec, sizeof(rec));
+        ring_get(T.tail + sizeof(rec), data, rec.caplen);
+        T.tail += sizeof(rec) + pad4(rec.caplen);
+
+        /* interface ids are allocated in order, describe them in order */
+        while (T.described <= rec.id) {
+            ifc = T.ifs[T.described++];
+            pthread_mutex_unlock(&T.lock);
+            write_idb(T.fp, &ifc);
+            pthread_mutex_lock(&T.lock);
+        }
+        pthread_mutex_unlock(&T.lock);
+        write_epb(T.fp, &rec, data);
+        pthread_mutex_lock(&T.lock);
+        if (T.head == T.tail)
+            fflush(T.fp);
+    }
+    pthread_mutex_unlock(&T.lock);
+    fflush(T.fp);
+    return NULL;
+}
+
+int trace_start(const char *path)
+{
+    FILE *fp;
+
+    if (trace_enabled())
+        return 0;
+
+    if ((fp = fopen(path, "wb")) == NULL) {
+        log_error("trace open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    write_shb(fp);
+
+    pthread_mutex_lock(&T.lock);
+    T.ring = malloc(TRACE_RING_SIZE);
+    if (T.ring == NULL) {
+        pthread_mutex_unlock(&T.lock);
+        fclose(fp);
+        return -1;
+    }
+    T.fp = fp;
+    T.stop = false;
+    T.head = T.tail = 0;
+    T.described = 0;
+    T.records = T.bytes = T.dropped = 0;
+    pthread_mutex_unlock(&T.lock);
+
+    if (pthread_create(&T.thread, NULL, trace_thread, NULL) != 0) {
+        pthread_mutex_lock(&T.lock);
+        free(T.ring);
+        T.ring = NULL;
+        pthread_mutex_unlock(&T.lock);
+        fclose(fp);
+        return -1;
+    }
+    atomic_store(&trace_on, true);
+    log_info("Tracing to %s", path);
+    return 0;
+}
+
+void trace_stop(void)
+{
+    if (!trace_enabled())
+        return;
+
+    atomic_store(&trace_on, false);
+    pthread_mutex_lock(&T.lock);
+    T.stop = true;
+    pthread_cond_signal(&T.cond);
+    pthread_mutex_unlock(&T.lock);
+    pthread_join(T.thread, NULL);
+
+    pthread_mutex_lock(&T.lock);
+    free(T.ring);
+    T.ring = NULL;
+    fclose(T.fp);
+    T.fp = NULL;
+    pthread_mutex_unlock(&T.lock);
+    log_info("Trace stopped: %llu records, %llu bytes, %llu dropped",
+             (unsigned long long)T.records, (unsigned long long)T.bytes,
+             (unsigned long long)T.dropped);
+}
+
+void trace_stats(uint64_t *records, uint64_t *bytes, uint64_t *dropped)
+{
+    pthread_mutex_lock(&T.lock);
+    *records = T.records;
+    *bytes = T.bytes;
+    *dropped = T.dropped;
+    pthread_mutex_unlock(&T.lock);
+}
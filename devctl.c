@@ -4,6 +4,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <string.h>
+#include <limits.h>
 #include <ev.h>
 
 #include "devctl.h"
@@ -12,6 +14,10 @@
 #include "device.h"
 #include "thpool.h"
 #include "shell.h"
+#include "trace.h"
+#include "metrics.h"
+#include "evprof.h"
+#include "process.h"
 
 threadpool thpool;
 static struct ev_loop *loop;
@@ -47,7 +53,9 @@ static void help(void)
     fprintf(stderr, "Usage:\n");
     fprintf(stderr, "    devctl <-c config_file> [-l config file] <-m mode> [-r command]\n");
     fprintf(stderr, "       --config <filename>   Specify config file.\n");
+    fprintf(stderr, "       --snapshot <filename> Specify compiled config, default <config_file>.db\n");
     fprintf(stderr, "       --log <filename>      Log to file.\n");
+    fprintf(stderr, "       --trace <filename>    Capture device traffic to pcapng file.\n");
     fprintf(stderr, "       --mode <mode>         Select work mode. 0: cmd, 1: shell, 2: server\n");
     fprintf(stderr, "       --run <command>       Specify command in normal mode\n");
     fprintf(stderr, "       --quiet               Qiut mode less log\n");
@@ -60,6 +68,9 @@ int main(int argc, char *argv[])
     int c, option_index = 0;
     char *log_file = NULL;
     char *conf_file = "/etc/devctl.conf";
+    char *snapshot = NULL;
+    char *trace_file = NULL;
+    char snapshot_default[PATH_MAX];
     char *command = NULL;
     int mode = MODE_UNKNOWN;
     int log_level = LOG_INFO;
@@ -75,10 +86,12 @@ int main(int argc, char *argv[])
         {"mode", required_argument, 0, 'm'},
         {"run", required_argument, 0, 'r'},
         {"quiet", no_argument, 0, 'q'},
+        {"snapshot", required_argument, 0, 's'},
+        {"trace", required_argument, 0, 't'},
         {0, 0, 0, 0}
     };
 
-    while ((c = getopt_long(argc, argv, "c:hl:m:qr:", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "c:hl:m:qr:s:t:", long_options, &option_index)) != -1) {
         switch(c) {
             case 'c':
                 conf_file = optarg;
@@ -107,6 +120,12 @@ int main(int argc, char *argv[])
             case 'r':
                 command = optarg;
                 break;
+            case 's':
+                snapshot = optarg;
+                break;
+            case 't':
+                trace_file = optarg;
+                break;
             default:
                 break;
         }
@@ -118,8 +137,16 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    if (snapshot == NULL) {
+        snprintf(snapshot_default, sizeof(snapshot_default), "%s.db", conf_file);
+        snapshot = snapshot_default;
+    }
+
     logger_init(log_file, 0);
     log_set_level(log_level);
+    /* format and write logs off the device threads, flushed on exit() */
+    if (log_async_start() == 0)
+        atexit(log_async_stop);
     log_info("Build time: %s %s", __DATE__, __TIME__);
     log_info("Config file: %s", conf_file);
 
@@ -130,14 +157,20 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    /* setup async io */
-    loop = ev_loop_new(EVBACKEND_EPOLL);
+    /* setup async io, ev_child watchers only work on the default loop */
+    loop = ev_default_loop(EVBACKEND_EPOLL);
     ev_signal signal_watcher;
     ev_signal_init(&signal_watcher, signal_cb, SIGINT);
     ev_signal_start(loop, &signal_watcher);
+    metrics_loop_init(loop);
+    evprof_init(loop);
+    process_init(loop, PROCESS_MAX_RUNNING);
+
+    if (trace_file && trace_start(trace_file) == 0)
+        atexit(trace_stop);
 
     /* init hardware device */
-    if (devices_init(loop, conf_file) < 0) {
+    if (devices_init(loop, conf_file, snapshot) < 0) {
         log_error("devices_init() fail");
         exit(1);
     }
@@ -159,7 +192,7 @@ int main(int argc, char *argv[])
             break;
         case MODE_SERVER:
             /* setup websocket server */
-            if (ws_server_init(thpool, ws_server_url) != 0) {
+            if (ws_server_init(loop, thpool, ws_server_url) != 0) {
                 log_error("websocket server start fail");
                 exit(1);
             }
@@ -172,6 +205,9 @@ int main(int argc, char *argv[])
     /* cleanup */
     log_info("Cleaning...");
     devices_exit();
+    process_exit();
+    metrics_loop_exit();
+    evprof_exit(loop);
     ev_loop_destroy(loop);
     thpool_wait(thpool);
     thpool_destroy(thpool);
@@ -1,3 +1,5 @@
+#define LOG_MODULE_NAME "aw5808"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -12,43 +14,29 @@
 #include "log.h"
 #include "utils.h"
 #include "io_channel.h"
+#include "metrics.h"
+#include "evprof.h"
 
 #define AW5808_VID_PID "25A7:5830"
 
-enum aw5808_usbid {
-    AW5808_USB_VID = 0x25a7,
-    //AW5808_USB_PID = 0x5804,
-    AW5808_USB_PID=0x5830,
-};
-
-enum aw5808_58g_rw {
-    HID_58G_WRITE = 0x01,
-    HID_58G_READ = 0x02,
-};
-
-typedef struct {
-    uint8_t rw;     // 1: write, 2: read
-    uint8_t reg;    // reg address
-    uint8_t len;    // data length
-    uint8_t data[61];
-} __attribute__((packed)) hidraw_packet_t;
-
 struct aw5808_handle {
     char ident[128];
     /* io */
     struct ev_loop *loop;
-    serial_t *serial;
-    const aw5808_codec_t *codec_serial;
+    serial_t *serial;                   /* shared, NULL without serial */
+    struct serial_client serial_client;
+    codec_t *codec_serial;
 
     char usb_name[128];
     hidraw_t *hidraw;
-    const aw5808_codec_t *codec_hid;
+    codec_t *codec_hid;
     /* device config */
     aw5808_mode_t mode;                 /* i2s or usb */
     aw5808_i2s_mode_t i2s_mode;         /* master or slave */
     aw5808_connect_mode_t conn_mode;    /* multi or single */
     uint8_t rf_channel;
     uint8_t rf_power;
+    uint64_t rx_time;                   /* frame being dispatched, CLOCK_MONOTONIC ns */
     /* hotplug */
     int udev_fd;
     struct io_channel udev_io;
@@ -56,6 +44,15 @@ struct aw5808_handle {
     struct udev_monitor *mon;
     
     struct list_head clients;
+    /* metrics, rtt indexed by command & 0x0F */
+    struct {
+        metric_t *frames;
+        metric_t *unknown;
+        metric_t *skipped;
+        metric_t *notify;
+        metric_t *rtt[16];
+        uint64_t sent_at[16];
+    } stats;
     /* error handle */
     struct {
         int c_errno;
@@ -222,16 +219,48 @@ static void handle_set_rfpower(aw5808_t *aw, const uint8_t *data, uint32_t data_
     }
 }
 
+static void stats_init(aw5808_t *aw, const char *device)
+{
+    char cmd[8];
+    int i;
+
+    aw->stats.frames = metric_get(METRIC_COUNTER, "devctl_aw5808_frames_total",
+                                  "Frames decoded from aw5808", "device", device, NULL);
+    aw->stats.unknown = metric_get(METRIC_COUNTER, "devctl_aw5808_unknown_frames_total",
+                                   "Frames with an unknown command", "device", device, NULL);
+    aw->stats.skipped = metric_get(METRIC_COUNTER, "devctl_aw5808_skipped_bytes_total",
+                                   "Bytes dropped resyncing to a frame header", "device", device, NULL);
+    aw->stats.notify = metric_get(METRIC_COUNTER, "devctl_aw5808_notify_total",
+                                  "Unsolicited notifications", "device", device, NULL);
+    for (i=0x50; i<=0x58; i++) {
+        snprintf(cmd, sizeof(cmd), "0x%02x", i);
+        aw->stats.rtt[i & 0x0F] = metric_get(METRIC_HISTOGRAM, "devctl_aw5808_rtt_seconds",
+                                             "Command to reply round trip time",
+                                             "device", device, "cmd", cmd, NULL);
+    }
+}
+
+static void stats_reply(aw5808_t *aw, uint8_t cmd)
+{
+    int idx = cmd & 0x0F;
+
+    /* from the read that completed the reply, not from when we got to it */
+    if (aw->stats.sent_at[idx] && aw->rx_time > aw->stats.sent_at[idx]) {
+        metric_observe(aw->stats.rtt[idx], aw->rx_time - aw->stats.sent_at[idx]);
+        aw->stats.sent_at[idx] = 0;
+    }
+}
+
 static int serial_sendframe(aw5808_t *aw, const uint8_t *data, size_t data_len, bool sync)
 {
     uint8_t frame[64]={0};
     size_t frame_len;
 
-    memcpy(frame+3, data, data_len);
-    frame_len = aw->codec_serial->encode(frame, data_len);
+    frame_len = codec_encode(aw->codec_serial, data, data_len, frame, sizeof(frame));
     if (frame_len <= 0)
         return -1; 
 
+    aw->stats.sent_at[data[0] & 0x0F] = metric_now();
     if (sync) {
         if (serial_write_sync(aw->serial, frame, frame_len) != frame_len)
             return -1;
@@ -242,76 +271,77 @@ static int serial_sendframe(aw5808_t *aw, const uint8_t *data, size_t data_len,
     return 0;
 }
 
-static int on_serial_receive(serial_t *serial, const uint8_t *buf, size_t len)
+/* claim 0x55 0xAA frames when the port is shared with other protocols */
+static int detect_serial_frame(serial_t *serial, struct serial_client *client, const uint8_t *buf, size_t len)
 {
-    aw5808_t *aw = serial_get_userdata(serial);
-    const aw5808_codec_t *codec_serial = aw->codec_serial;
-    size_t used = 0;
-	const uint8_t *data = NULL;
-	size_t data_len, ret;
+    aw5808_t *aw = client->userdata;
+    const uint8_t *data;
+    size_t data_len, ret;
 
-    for(;;) {
-        ret = codec_serial->decode(buf, len, &data, &data_len);
-        if (!data)
-            break;
-#if 0
-        int i;
-        printf("----------buf_len=%ld\n", len);
-        for(i=0; i<len; i++) {
-            printf("%02x ", buf[i]);
-        }
-        printf("\n----------data_len=%ld\n", data_len);
-        for(i=0; i<data_len; i++) {
-            printf("%02x ", data[i]);
-        }
-        printf("\n");
-#endif
+    ret = codec_decode(aw->codec_serial, buf, len, &data, &data_len);
+    if (data)
+        return ret;
+    return ret ? -1 : 0;
+}
 
-        used += ret;
-        buf += ret;
-        len -= ret;
-        switch(data[0]) {
-            case 0xD0:
-                handle_get_config(aw, data+1, data_len-1);
-                break;
-            case 0xD1:
-                handl_get_rfstatus(aw, data+1, data_len-1);
-                break;
-            case 0x52:
-                handle_notify_rfstatus(aw, data+1, data_len-1);
-                break;
-            case 0xD3:
-                handle_pair(aw);
-                break;
-            case 0xD4:
-                handle_set_mode(aw, data+1, data_len-1);
-                break;
-            case 0xD5:
-                handle_set_i2s_mode(aw, data+1, data_len-1);
-                break;
-            case 0xD6:
-                handle_set_connect_mode(aw, data+1, data_len-1);
-                break;
-            case 0xD7:
-                handle_set_rfchannel(aw, data+1, data_len-1);
-                break;
-            case 0xD8:
-                handle_set_rfpower(aw, data+1, data_len-1);
-                break;
-            default:
-                break;
-        }
+static void handle_serial_frame(void *arg, const uint8_t *data, size_t data_len)
+{
+    aw5808_t *aw = arg;
+
+    metric_add(aw->stats.frames, 1);
+    if (data[0] & 0x80)
+        stats_reply(aw, data[0]);
+    switch(data[0]) {
+        case 0xD0:
+            handle_get_config(aw, data+1, data_len-1);
+            break;
+        case 0xD1:
+            handl_get_rfstatus(aw, data+1, data_len-1);
+            break;
+        case 0x52:
+            metric_add(aw->stats.notify, 1);
+            handle_notify_rfstatus(aw, data+1, data_len-1);
+            break;
+        case 0xD3:
+            handle_pair(aw);
+            break;
+        case 0xD4:
+            handle_set_mode(aw, data+1, data_len-1);
+            break;
+        case 0xD5:
+            handle_set_i2s_mode(aw, data+1, data_len-1);
+            break;
+        case 0xD6:
+            handle_set_connect_mode(aw, data+1, data_len-1);
+            break;
+        case 0xD7:
+            handle_set_rfchannel(aw, data+1, data_len-1);
+            break;
+        case 0xD8:
+            handle_set_rfpower(aw, data+1, data_len-1);
+            break;
+        default:
+            metric_add(aw->stats.unknown, 1);
+            break;
     }
+}
+
+static int on_serial_receive(serial_t *serial, struct serial_client *client, const uint8_t *buf, size_t len)
+{
+    aw5808_t *aw = client->userdata;
+    size_t dropped = aw->codec_serial->dropped;
+    size_t used;
+
+    aw->rx_time = client->rx_time;
+    used = codec_feed(aw->codec_serial, buf, len, handle_serial_frame, aw);
+    /* line noise or a partial frame from before we opened the port */
+    metric_add(aw->stats.skipped, aw->codec_serial->dropped - dropped);
     return used;
 }
 
 static struct serial_client_ops serial_client_aw5808_ops = {
     .on_receive = on_serial_receive,
-};
-
-static struct serial_client serial_client_aw5808 = {
-    .name = "aw5808 serial",
-    .ops = &serial_client_aw5808_ops,
+    .detect = detect_serial_frame,
 };
 
 const char *aw5808_errmsg(aw5808_t *aw)
@@ -329,9 +359,16 @@ aw5808_t *aw5808_new()
     aw5808_t *aw = calloc(1, sizeof(aw5808_t));
     if (!aw)
         return NULL;
+    INIT_LIST_HEAD(&aw->clients);
 
-    aw->serial = serial_new();
-    if (!aw->serial)
+    snprintf(aw->serial_client.name, sizeof(aw->serial_client.name), "aw5808 serial");
+    aw->serial_client.ops = &serial_client_aw5808_ops;
+    aw->serial_client.userdata = aw;
+    INIT_LIST_HEAD(&aw->serial_client.list);
+
+    aw->codec_serial = codec_new("aw5808_serial");
+    aw->codec_hid = codec_new("aw5808_hid");
+    if (!aw->codec_serial || !aw->codec_hid)
         goto fail;
 
     aw->hidraw = hidraw_new();
@@ -342,7 +379,6 @@ aw5808_t *aw5808_new()
     aw->udev = udev_new();
     if (!aw->udev)
         goto fail;
-    INIT_LIST_HEAD(&aw->clients);
     return aw;
 fail:
     aw5808_free(aw);
@@ -351,12 +387,20 @@ fail:
 
 void aw5808_free(aw5808_t *aw)
 {
+    struct aw5808_client *client, *tmp;
+
+    list_for_each_entry_safe(client, tmp, &aw->clients, list)
+        list_del_init(&client->list);
     udev_unref(aw->udev);
 
     if (aw->hidraw)
         hidraw_free(aw->hidraw);
-    if (aw->serial)
-        serial_free(aw->serial);
+    if (aw->serial) {
+        serial_remove_client(aw->serial, &aw->serial_client);
+        serial_put(aw->serial);
+    }
+    codec_free(aw->codec_serial);
+    codec_free(aw->codec_hid);
     if (aw)
         free(aw);
 }
@@ -376,18 +420,17 @@ int aw5808_open(aw5808_t *aw, aw5808_options_t *opt)
     udev_monitor_enable_receiving(aw->mon);
     aw->udev_fd = udev_monitor_get_fd(aw->mon);
     ev_io_init(&aw->udev_io.ior, udev_read_cb, aw->udev_fd, EV_READ);
+    evprof_watch(&aw->udev_io.ior, "aw5808.udev", aw->usb_name);
     ev_io_start(aw->loop, &aw->udev_io.ior);
 
     if (opt->serial && access(opt->serial, R_OK|W_OK) == 0) {
-        if (serial_open(aw->serial, opt->serial, 57600, opt->loop) !=0) {
+        if ((aw->serial = serial_get(opt->serial, 57600, opt->loop)) == NULL) {
             return _error(aw, AW5808_ERROR_OPEN, 0, "Openning aw5808 serial %s", opt->serial);
         }
 
-        serial_add_client(aw->serial, &serial_client_aw5808);
-        serial_set_userdata(aw->serial, aw);
-        aw->codec_serial = &codec_aw5808_serial;
-        if (!aw->codec_serial)
-            return _error(aw, AW5808_ERROR_OPEN, 0, "Openning aw5808 get serial codec");
+        codec_reset(aw->codec_serial);
+        serial_add_client(aw->serial, &aw->serial_client);
+        stats_init(aw, opt->serial);
 
         if(aw5808_set_mode_sync(aw, opt->mode, 2000)) {
 	     log_error("aw5808_set_mode_sync fail: %s", aw5808_errmsg(aw));
@@ -402,8 +445,17 @@ int aw5808_open(aw5808_t *aw, aw5808_options_t *opt)
 
 void aw5808_close(aw5808_t *aw)
 {
+    if (aw->mon) {
+        ev_io_stop(aw->loop, &aw->udev_io.ior);
+        udev_monitor_unref(aw->mon);
+        aw->mon = NULL;
+    }
     hidraw_close(aw->hidraw);
-    serial_close(aw->serial);
+    if (aw->serial) {
+        serial_remove_client(aw->serial, &aw->serial_client);
+        serial_put(aw->serial);
+        aw->serial = NULL;
+    }
 }
 
 int aw5808_get_config(aw5808_t *aw)
@@ -473,6 +525,8 @@ int aw5808_set_mode_sync(aw5808_t *aw, aw5808_mode_t mode, int timeout_us)
 
     if (serial_read(aw->serial, frame, frame_len, timeout_us) != frame_len)
         return _error(aw, AW5808_ERROR_CONFIGURE, 0, "Setting mode but no reply");
+    aw->rx_time = serial_rx_time(aw->serial);
+    stats_reply(aw, frame[3]);
 
     if (frame[4] != mode)
         return _error(aw, AW5808_ERROR_CONFIGURE, 0, "Setting mode not work");
@@ -650,7 +704,7 @@ void aw5808_remove_client(aw5808_t *aw, struct aw5808_client *client)
 {
     if (!client)
         return;
-    list_del(&client->list);
+    list_del_init(&client->list);
 }
 
 int aw5808_mode(aw5808_t *aw)
@@ -658,6 +712,11 @@ int aw5808_mode(aw5808_t *aw)
     return aw->mode;
 }
 
+uint64_t aw5808_rx_time(aw5808_t *aw)
+{
+    return aw->rx_time;
+}
+
 int aw5808_hidraw_fd(aw5808_t *aw)
 {
     return hidraw_fd(aw->hidraw);
@@ -665,11 +724,11 @@ int aw5808_hidraw_fd(aw5808_t *aw)
 
 int aw5808_serial_fd(aw5808_t *aw)
 {
-    return serial_fd(aw->serial);
+    return aw->serial ? serial_fd(aw->serial) : -1;
 }
 
 const char *aw5808_id(aw5808_t *aw)
 {
-    snprintf(aw->ident, sizeof(aw->ident)-1, "%s %s", serial_id(aw->serial), hidraw_id(aw->hidraw));
+    snprintf(aw->ident, sizeof(aw->ident)-1, "%s %s", aw->serial ? serial_id(aw->serial) : "", hidraw_id(aw->hidraw));
     return aw->ident;
 }
\ No newline at end of file
@@ -35,6 +35,25 @@ typedef enum aw5808_connect_mode {
     AW5808_MODE_CONN_UNKNOWN = 2,
 } aw5808_connect_mode_t;
 
+enum aw5808_usbid {
+    AW5808_USB_VID = 0x25a7,
+    //AW5808_USB_PID = 0x5804,
+    AW5808_USB_PID=0x5830,
+};
+
+enum aw5808_58g_rw {
+    HID_58G_WRITE = 0x01,
+    HID_58G_READ = 0x02,
+};
+
+/* register access over hidraw, one 64 bytes report each way */
+typedef struct {
+    uint8_t rw;     // 1: write, 2: read
+    uint8_t reg;    // reg address
+    uint8_t len;    // data length
+    uint8_t data[61];
+} __attribute__((packed)) hidraw_packet_t;
+
 typedef struct aw5808_handle aw5808_t;
 
 typedef struct aw5808_options {
@@ -80,6 +99,8 @@ int aw5808_read_fw(aw5808_t *aw, uint8_t *buf, size_t len);
 int aw5808_add_client(aw5808_t *aw, struct aw5808_client *client);
 void aw5808_remove_client(aw5808_t *aw, struct aw5808_client *client);
 int aw5808_mode(aw5808_t *aw);
+/* CLOCK_MONOTONIC ns the frame behind the current client callback was read */
+uint64_t aw5808_rx_time(aw5808_t *aw);
 const char *aw5808_id(aw5808_t *aw);
 const char *aw5808_tostring(aw5808_t *aw);
 /* Error Handling */
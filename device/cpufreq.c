@@ -0,0 +1,295 @@
+#define LOG_MODULE_NAME "cpufreq"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ev.h>
+
+#include "list.h"
+#include "cpufreq.h"
+#include "sysfs.h"
+#include "log.h"
+#include "utils.h"
+#include "metrics.h"
+#include "evprof.h"
+
+struct cpufreq_handle {
+    char ident[96];
+    char dir[160];
+    sysfs_attr_t cur;
+    sysfs_attr_t min;
+    sysfs_attr_t max;
+    sysfs_attr_t governor;
+    /* what the policy has, writes of the same value are skipped */
+    unsigned int min_khz;
+    unsigned int max_khz;
+    char governor_name[32];
+    /* sampling */
+    struct ev_loop *loop;
+    ev_timer timer;
+    int period_ms;
+
+    struct list_head clients;
+    struct {
+        metric_t *khz;
+        metric_t *errors;
+    } stats;
+    /* error handle */
+    struct {
+        int c_errno;
+        char errmsg[96];
+    } error;
+};
+
+static int _error(cpufreq_t *cpufreq, int code, int c_errno, const char *fmt, ...)
+{
+    va_list ap;
+
+    cpufreq->error.c_errno = c_errno;
+
+    va_start(ap, fmt);
+    vsnprintf(cpufreq->error.errmsg, sizeof(cpufreq->error.errmsg), fmt, ap);
+    va_end(ap);
+
+    if (c_errno) {
+        char buf[64];
+        strerror_r(c_errno, buf, sizeof(buf));
+        snprintf(cpufreq->error.errmsg+strlen(cpufreq->error.errmsg), sizeof(cpufreq->error.errmsg)-strlen(cpufreq->error.errmsg), ": %s [errno %d]", buf, c_errno);
+    }
+
+    return code;
+}
+
+static void stats_init(cpufreq_t *cpufreq)
+{
+    cpufreq->stats.khz = metric_get(METRIC_GAUGE, "devctl_cpufreq_khz",
+                                    "Current cpu frequency of the policy", "device", cpufreq->ident, NULL);
+    cpufreq->stats.errors = metric_get(METRIC_COUNTER, "devctl_cpufreq_errors_total",
+                                       "Failed frequency reads", "device", cpufreq->ident, NULL);
+}
+
+static int read_khz(sysfs_attr_t *attr, unsigned int *khz)
+{
+    long long v;
+
+    if (sysfs_attr_read_l(attr, &v) < 0)
+        return -1;
+    *khz = v;
+    return 0;
+}
+
+static int write_limit(cpufreq_t *cpufreq, bool is_max, unsigned int khz)
+{
+    unsigned int *cached = is_max ? &cpufreq->max_khz : &cpufreq->min_khz;
+
+    if (khz == *cached)
+        return 0;
+    if (sysfs_attr_write_l(is_max ? &cpufreq->max : &cpufreq->min, khz) < 0)
+        return _error(cpufreq, CPUFREQ_ERROR_IO, errno, "Writing %s scaling_%s_freq %u",
+                      cpufreq->ident, is_max ? "max" : "min", khz);
+    *cached = khz;
+    return 0;
+}
+
+static void cpufreq_timer_cb(struct ev_loop *loop, struct ev_timer *w, int revents)
+{
+    cpufreq_t *cpufreq = container_of(w, cpufreq_t, timer);
+    struct cpufreq_client *client, *tmp;
+    unsigned int khz;
+
+    if (cpufreq_get_cur(cpufreq, &khz) != 0) {
+        metric_add(cpufreq->stats.errors, 1);
+        log_debug("%s", cpufreq->error.errmsg);
+        return;
+    }
+    list_for_each_entry_safe(client, tmp, &cpufreq->clients, list) {
+        if (client->ops->on_sample)
+            client->ops->on_sample(cpufreq, khz);
+    }
+}
+
+const char *cpufreq_errmsg(cpufreq_t *cpufreq)
+{
+    return cpufreq->error.errmsg;
+}
+
+int cpufreq_errno(cpufreq_t *cpufreq)
+{
+    return cpufreq->error.c_errno;
+}
+
+cpufreq_t *cpufreq_new(void)
+{
+    cpufreq_t *cpufreq = calloc(1, sizeof(cpufreq_t));
+    if (!cpufreq)
+        return NULL;
+    sysfs_attr_init(&cpufreq->cur);
+    sysfs_attr_init(&cpufreq->min);
+    sysfs_attr_init(&cpufreq->max);
+    sysfs_attr_init(&cpufreq->governor);
+    INIT_LIST_HEAD(&cpufreq->clients);
+    ev_timer_init(&cpufreq->timer, cpufreq_timer_cb, 0., 0.);
+    return cpufreq;
+}
+
+void cpufreq_free(cpufreq_t *cpufreq)
+{
+    struct cpufreq_client *client, *tmp;
+
+    if (!cpufreq)
+        return;
+    cpufreq_close(cpufreq);
+    list_for_each_entry_safe(client, tmp, &cpufreq->clients, list)
+        list_del_init(&client->list);
+    free(cpufreq);
+}
+
+int cpufreq_open(cpufreq_t *cpufreq, cpufreq_options_t *opt)
+{
+    const char *name;
+    int ret;
+
+    if (opt->policy[0] == '\0' || !opt->loop)
+        return _error(cpufreq, CPUFREQ_ERROR_ARG, 0, "No cpufreq policy");
+    if (opt->policy[0] == '/')
+        snprintf(cpufreq->dir, sizeof(cpufreq->dir), "%s", opt->policy);
+    else if (!strncmp(opt->policy, "cpu", 3))
+        snprintf(cpufreq->dir, sizeof(cpufreq->dir), CPUFREQ_SYSFS_DIR "/%s/cpufreq", opt->policy);
+    else
+        snprintf(cpufreq->dir, sizeof(cpufreq->dir), CPUFREQ_SYSFS_DIR "/cpufreq/%s", opt->policy);
+    /* cpuN/cpufreq is a link to its policy */
+    name = strrchr(cpufreq->dir, '/') + 1;
+    snprintf(cpufreq->ident, sizeof(cpufreq->ident), "%s", strcmp(name, "cpufreq") ? name : opt->policy);
+
+    if (sysfs_attr_open(&cpufreq->cur, cpufreq->dir, "scaling_cur_freq", O_RDONLY) < 0 ||
+            sysfs_attr_open(&cpufreq->min, cpufreq->dir, "scaling_min_freq", O_RDWR) < 0 ||
+            sysfs_attr_open(&cpufreq->max, cpufreq->dir, "scaling_max_freq", O_RDWR) < 0 ||
+            sysfs_attr_open(&cpufreq->governor, cpufreq->dir, "scaling_governor", O_RDWR) < 0) {
+        _error(cpufreq, CPUFREQ_ERROR_OPEN, errno, "Opening %s", cpufreq->ident);
+        cpufreq_close(cpufreq);
+        return CPUFREQ_ERROR_OPEN;
+    }
+    if (read_khz(&cpufreq->min, &cpufreq->min_khz) < 0 || read_khz(&cpufreq->max, &cpufreq->max_khz) < 0 ||
+            sysfs_attr_read(&cpufreq->governor, cpufreq->governor_name, sizeof(cpufreq->governor_name)) < 0) {
+        _error(cpufreq, CPUFREQ_ERROR_IO, errno, "Reading %s", cpufreq->ident);
+        cpufreq_close(cpufreq);
+        return CPUFREQ_ERROR_IO;
+    }
+
+    if ((opt->governor[0] && (ret = cpufreq_set_governor(cpufreq, opt->governor)) != 0) ||
+            ((opt->min_khz || opt->max_khz) &&
+             (ret = cpufreq_set_limits(cpufreq, opt->min_khz, opt->max_khz)) != 0)) {
+        cpufreq_close(cpufreq);
+        return ret;
+    }
+
+    cpufreq->loop = opt->loop;
+    stats_init(cpufreq);
+    evprof_watch(&cpufreq->timer, "cpufreq.sample", cpufreq->ident);
+    cpufreq_set_period(cpufreq, opt->period_ms);
+    return 0;
+}
+
+/* the limits and governor stay as set */
+void cpufreq_close(cpufreq_t *cpufreq)
+{
+    if (cpufreq->loop)
+        ev_timer_stop(cpufreq->loop, &cpufreq->timer);
+    sysfs_attr_close(&cpufreq->cur);
+    sysfs_attr_close(&cpufreq->min);
+    sysfs_attr_close(&cpufreq->max);
+    sysfs_attr_close(&cpufreq->governor);
+}
+
+int cpufreq_set_limits(cpufreq_t *cpufreq, unsigned int min_khz, unsigned int max_khz)
+{
+    int ret;
+
+    if (cpufreq->min.fd < 0)
+        return _error(cpufreq, CPUFREQ_ERROR_ARG, 0, "%s not open", cpufreq->ident);
+    if (min_khz == 0)
+        min_khz = cpufreq->min_khz;
+    if (max_khz == 0)
+        max_khz = cpufreq->max_khz;
+    if (min_khz > max_khz)
+        return _error(cpufreq, CPUFREQ_ERROR_ARG, 0, "Min %u kHz above max %u kHz", min_khz, max_khz);
+
+    /* the kernel clamps a min above the current max, so raise max first */
+    if (min_khz > cpufreq->max_khz) {
+        if ((ret = write_limit(cpufreq, true, max_khz)) != 0)
+            return ret;
+        return write_limit(cpufreq, false, min_khz);
+    }
+    if ((ret = write_limit(cpufreq, false, min_khz)) != 0)
+        return ret;
+    return write_limit(cpufreq, true, max_khz);
+}
+
+void cpufreq_limits(cpufreq_t *cpufreq, unsigned int *min_khz, unsigned int *max_khz)
+{
+    if (min_khz)
+        *min_khz = cpufreq->min_khz;
+    if (max_khz)
+        *max_khz = cpufreq->max_khz;
+}
+
+int cpufreq_set_governor(cpufreq_t *cpufreq, const char *governor)
+{
+    if (cpufreq->governor.fd < 0)
+        return _error(cpufreq, CPUFREQ_ERROR_ARG, 0, "%s not open", cpufreq->ident);
+    if (!strcmp(governor, cpufreq->governor_name))
+        return 0;
+    if (sysfs_attr_write(&cpufreq->governor, governor) < 0)
+        return _error(cpufreq, CPUFREQ_ERROR_IO, errno, "Writing %s governor %s", cpufreq->ident, governor);
+    snprintf(cpufreq->governor_name, sizeof(cpufreq->governor_name), "%s", governor);
+    return 0;
+}
+
+const char *cpufreq_governor(cpufreq_t *cpufreq)
+{
+    return cpufreq->governor_name;
+}
+
+int cpufreq_get_cur(cpufreq_t *cpufreq, unsigned int *khz)
+{
+    if (cpufreq->cur.fd < 0)
+        return _error(cpufreq, CPUFREQ_ERROR_ARG, 0, "%s not open", cpufreq->ident);
+    if (read_khz(&cpufreq->cur, khz) < 0)
+        return _error(cpufreq, CPUFREQ_ERROR_IO, errno, "Reading %s scaling_cur_freq", cpufreq->ident);
+    metric_set(cpufreq->stats.khz, *khz);
+    return 0;
+}
+
+void cpufreq_set_period(cpufreq_t *cpufreq, int period_ms)
+{
+    cpufreq->period_ms = period_ms > 0 ? period_ms : 0;
+    ev_timer_stop(cpufreq->loop, &cpufreq->timer);
+    if (cpufreq->period_ms == 0)
+        return;
+    ev_timer_set(&cpufreq->timer, 0., cpufreq->period_ms / 1000.);
+    ev_timer_start(cpufreq->loop, &cpufreq->timer);
+}
+
+int cpufreq_add_client(cpufreq_t *cpufreq, struct cpufreq_client *client)
+{
+    if (!client || !client->ops)
+        return -1;
+    list_add_tail(&client->list, &cpufreq->clients);
+    return 0;
+}
+
+void cpufreq_remove_client(cpufreq_t *cpufreq, struct cpufreq_client *client)
+{
+    if (!client)
+        return;
+    list_del_init(&client->list);
+}
+
+const char *cpufreq_id(cpufreq_t *cpufreq)
+{
+    return cpufreq->ident;
+}
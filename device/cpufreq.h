@@ -0,0 +1,58 @@
+#ifndef __CPUFREQ_H__
+#define __CPUFREQ_H__
+
+#include <stdbool.h>
+#include <ev.h>
+#include "list.h"
+
+enum cpufreq_error_code {
+    CPUFREQ_ERROR_ARG           = -1, /* Invalid arguments */
+    CPUFREQ_ERROR_OPEN          = -2, /* Opening cpufreq policy */
+    CPUFREQ_ERROR_IO            = -3, /* Reading/writing cpufreq attributes */
+};
+
+#define CPUFREQ_SYSFS_DIR   "/sys/devices/system/cpu"
+
+typedef struct cpufreq_handle cpufreq_t;
+
+/* an empty governor and min_khz/max_khz 0 leave what the policy has */
+typedef struct cpufreq_options {
+    char policy[96];                /* policyN, cpuN or a path */
+    char governor[32];
+    unsigned int min_khz;
+    unsigned int max_khz;
+    int period_ms;                  /* optional, sample into the metrics and clients, 0 off */
+    struct ev_loop *loop;
+} cpufreq_options_t;
+
+struct cpufreq_client_ops {
+    /* every sampling period, on the loop */
+    void (*on_sample)(cpufreq_t *cpufreq, unsigned int khz);
+};
+
+struct cpufreq_client {
+    char name[64];
+    struct cpufreq_client_ops *ops;
+    struct list_head list;
+};
+
+cpufreq_t *cpufreq_new(void);
+void cpufreq_free(cpufreq_t *cpufreq);
+int cpufreq_open(cpufreq_t *cpufreq, cpufreq_options_t *opt);
+void cpufreq_close(cpufreq_t *cpufreq);
+/* both limits in one go, 0 keeps one; written in the order the kernel accepts */
+int cpufreq_set_limits(cpufreq_t *cpufreq, unsigned int min_khz, unsigned int max_khz);
+void cpufreq_limits(cpufreq_t *cpufreq, unsigned int *min_khz, unsigned int *max_khz);
+int cpufreq_set_governor(cpufreq_t *cpufreq, const char *governor);
+const char *cpufreq_governor(cpufreq_t *cpufreq);
+int cpufreq_get_cur(cpufreq_t *cpufreq, unsigned int *khz);
+/* 0 stops sampling */
+void cpufreq_set_period(cpufreq_t *cpufreq, int period_ms);
+int cpufreq_add_client(cpufreq_t *cpufreq, struct cpufreq_client *client);
+void cpufreq_remove_client(cpufreq_t *cpufreq, struct cpufreq_client *client);
+/* "policyN" */
+const char *cpufreq_id(cpufreq_t *cpufreq);
+const char *cpufreq_errmsg(cpufreq_t *cpufreq);
+int cpufreq_errno(cpufreq_t *cpufreq);
+
+#endif
@@ -2,132 +2,1146 @@
 #include <pthread.h>
 #include <ev.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
 
 #include "log.h"
 #include "utils.h"
 #include "device.h"
-#include "ini.h"
+#include "confdb.h"
 #include "usb.h"
 #include "aw5808.h"
+#include "uband.h"
 #include "serial.h"
 #include "wifi.h"
+#include "gpio.h"
+#include "input.h"
+#include "pwm.h"
+#include "led.h"
+#include "thermal.h"
+#include "cpufreq.h"
+#include "evprof.h"
+#include "codec.h"
 
-#define DEVICE_MAX_NUM  (8)
+#define DEVICE_RELOAD_DELAY (0.05)      /* seconds, coalesce editor write bursts */
+
+/*
+ * Every opened device remembers the section it came from and the options
+ * it was opened with, so a reload can tell what actually changed.
+ */
+struct device_slot {
+    char section[64];
+    union {
+        aw5808_options_t aw5808;
+        uband_options_t uband;
+        serial_options_t serial;
+        usb_options_t usb;
+        wifi_options_t wifi;
+        gpio_options_t gpio;
+        input_options_t input;
+        pwm_options_t pwm;
+        led_options_t led;
+        thermal_options_t thermal;
+        cpufreq_options_t cpufreq;
+    } opt;
+};
 
 static aw5808_t *aw5808_array[DEVICE_MAX_NUM];
+static uband_t *uband_array[DEVICE_MAX_NUM];
 static serial_t *serial_array[DEVICE_MAX_NUM];
 static usb_t *usb_array[DEVICE_MAX_NUM];
 static wifi_t *wifi_array[DEVICE_MAX_NUM];
-static int aw5808_idx, serial_idx, usb_idx, wifi_idx;
+static gpio_t *gpio_array[DEVICE_MAX_NUM];
+static input_t *input_array[DEVICE_MAX_NUM];
+static pwm_t *pwm_array[DEVICE_MAX_NUM];
+static led_t *led_array[DEVICE_MAX_NUM];
+static thermal_t *thermal_array[DEVICE_MAX_NUM];
+static cpufreq_t *cpufreq_array[DEVICE_MAX_NUM];
+static struct device_slot aw5808_slot[DEVICE_MAX_NUM];
+static struct device_slot uband_slot[DEVICE_MAX_NUM];
+static struct device_slot serial_slot[DEVICE_MAX_NUM];
+static struct device_slot usb_slot[DEVICE_MAX_NUM];
+static struct device_slot wifi_slot[DEVICE_MAX_NUM];
+static struct device_slot gpio_slot[DEVICE_MAX_NUM];
+static struct device_slot input_slot[DEVICE_MAX_NUM];
+static struct device_slot pwm_slot[DEVICE_MAX_NUM];
+static struct device_slot led_slot[DEVICE_MAX_NUM];
+static struct device_slot thermal_slot[DEVICE_MAX_NUM];
+static struct device_slot cpufreq_slot[DEVICE_MAX_NUM];
+static int aw5808_idx, uband_idx, serial_idx, usb_idx, wifi_idx, gpio_idx, input_idx;
+static int pwm_idx, led_idx, thermal_idx, cpufreq_idx;
+
+static struct ev_loop *device_loop;
+static char device_conf_file[PATH_MAX];
+static ev_stat conf_watcher;
+static ev_timer reload_timer;
+static LIST_HEAD(reload_clients);
+
+static bool device_section_is(const char *section, const char *type)
+{
+    const char *end = strchr(section, '/');
+    int section_len = strlen(section);
+    if (end != NULL)
+        section_len = end - section;
+    return !strncmp(section, type, section_len);
+}
+
+static int device_slot_find(struct device_slot *slot, int num, const char *section)
+{
+    int i;
+    for (i=0; i<num; i++) {
+        if (!strcmp(slot[i].section, section))
+            return i;
+    }
+    return -1;
+}
 
-static bool device_aw5808_init(struct ev_loop *loop, const char *conf_file, const char *section)
+static void device_aw5808_parse(confdb_t *db, int section, aw5808_options_t *opt)
 {
-    char key[64] = {0};
+    const char *key;
     int k;
-    aw5808_options_t opt;
 
-    memset(&opt, 0, sizeof(opt));
-    opt.loop = loop;
-    for (k = 0; ini_getkey(section, k, key, sizearray(key), conf_file) > 0; k++) {
+    memset(opt, 0, sizeof(*opt));
+    opt->loop = device_loop;
+    for (k = 0; (key = confdb_key(db, section, k)) != NULL; k++) {
         if (!strncmp(key, "serial", strlen("serial"))) {
-            ini_gets(section, key, "dummy", opt.serial, sizearray(opt.serial), conf_file);
+            strncpy(opt->serial, confdb_value(db, section, k), sizearray(opt->serial)-1);
         } else if (!strncmp(key, "usb", strlen("usb"))) {
-            ini_gets(section, key, "dummy", opt.usb, sizearray(opt.usb), conf_file);
+            strncpy(opt->usb, confdb_value(db, section, k), sizearray(opt->usb)-1);
         } else if (!strncmp(key, "mode", strlen("mode"))) {
-            opt.mode = ini_getl(section, key, 0, conf_file);
+            opt->mode = confdb_value_l(db, section, k, 0);
         }
     }
-    if ((aw5808_array[aw5808_idx] = aw5808_new()) == NULL) {
-        log_error("aw5808[%d] new fail", aw5808_idx, opt.usb);
+}
+
+static bool device_aw5808_open(int idx, const char *section, aw5808_options_t *opt)
+{
+    if ((aw5808_array[idx] = aw5808_new()) == NULL) {
+        log_error("aw5808[%d] new fail", idx);
         return false;
     }
-    if (aw5808_open(aw5808_array[aw5808_idx], &opt) != 0) {
-        log_error("aw5808[%d] open fail: %s", aw5808_idx, aw5808_errmsg(aw5808_array[aw5808_idx]));
-        aw5808_free(aw5808_array[aw5808_idx]);
-        aw5808_array[aw5808_idx] = NULL;
+    if (aw5808_open(aw5808_array[idx], opt) != 0) {
+        log_error("aw5808[%d] open fail: %s", idx, aw5808_errmsg(aw5808_array[idx]));
+        aw5808_close(aw5808_array[idx]);
+        aw5808_free(aw5808_array[idx]);
+        aw5808_array[idx] = NULL;
         return false;
     }
-    aw5808_idx++;
+    strncpy(aw5808_slot[idx].section, section, sizearray(aw5808_slot[idx].section)-1);
+    aw5808_slot[idx].opt.aw5808 = *opt;
     return true;
 }
 
-static bool device_serial_init(struct ev_loop *loop, const char *conf_file, const char *section)
+static void device_aw5808_close(int idx)
+{
+    if (aw5808_array[idx]) {
+        aw5808_close(aw5808_array[idx]);
+        aw5808_free(aw5808_array[idx]);
+        aw5808_array[idx] = NULL;
+    }
+}
+
+static void device_uband_parse(confdb_t *db, int section, uband_options_t *opt)
 {
-    char key[64] = {0};
+    const char *key;
     int k;
-    serial_options_t opt;
 
-    memset(&opt, 0, sizeof(opt));
-    for (k = 0; ini_getkey(section, k, key, sizearray(key), conf_file) > 0; k++) {
-        if (!strncmp(key, "path", strlen("path"))) {
-            ini_gets(section, key, "dummy", opt.path, sizearray(opt.path), conf_file);
+    memset(opt, 0, sizeof(*opt));
+    opt->loop = device_loop;
+    for (k = 0; (key = confdb_key(db, section, k)) != NULL; k++) {
+        if (!strncmp(key, "serial", strlen("serial"))) {
+            strncpy(opt->serial, confdb_value(db, section, k), sizearray(opt->serial)-1);
         } else if (!strncmp(key, "baudrate", strlen("baudrate"))) {
-            opt.baudrate = ini_getl(section, key, 0, conf_file);
+            opt->baudrate = confdb_value_l(db, section, k, 0);
+        } else if (!strncmp(key, "timeout", strlen("timeout"))) {
+            opt->timeout_ms = confdb_value_l(db, section, k, 0);
+        } else if (!strncmp(key, "provisional", strlen("provisional"))) {
+            opt->provisional = confdb_value_l(db, section, k, 0) != 0;
         }
     }
-    if ((serial_array[serial_idx] = serial_new()) == NULL) {
-        log_error("serial[%d] new fail", serial_idx);
+}
+
+static bool device_uband_open(int idx, const char *section, uband_options_t *opt)
+{
+    if ((uband_array[idx] = uband_new()) == NULL) {
+        log_error("uband[%d] new fail", idx);
         return false;
     }
-    if (serial_open(serial_array[serial_idx], opt.path, opt.baudrate, loop) != 0) {
-        log_error("serial[%d] open fail: %s", serial_idx, serial_errmsg(serial_array[serial_idx]));
-        serial_free(serial_array[serial_idx]);
-        serial_array[serial_idx] = NULL;
+    if (uband_open(uband_array[idx], opt) != 0) {
+        log_error("uband[%d] open fail: %s", idx, uband_errmsg(uband_array[idx]));
+        uband_free(uband_array[idx]);
+        uband_array[idx] = NULL;
+        return false;
+    }
+    strncpy(uband_slot[idx].section, section, sizearray(uband_slot[idx].section)-1);
+    uband_slot[idx].opt.uband = *opt;
+    return true;
+}
+
+static void device_uband_close(int idx)
+{
+    if (uband_array[idx]) {
+        uband_close(uband_array[idx]);
+        uband_free(uband_array[idx]);
+        uband_array[idx] = NULL;
+    }
+}
+
+/* once per config load: a bad spec falls back to raw bytes instead of failing every receive */
+static void device_codec_check(const char *section, char *spec)
+{
+    codec_t *codec;
+
+    if (spec[0] == '\0')
+        return;
+    if ((codec = codec_new(spec)) == NULL) {
+        log_warn("%s: codec '%s' ignored, raw bytes", section, spec);
+        spec[0] = '\0';
+        return;
+    }
+    codec_free(codec);
+}
+
+static void device_serial_parse(confdb_t *db, int section, serial_options_t *opt)
+{
+    const char *key;
+    int k;
+
+    memset(opt, 0, sizeof(*opt));
+    opt->loop = device_loop;
+    for (k = 0; (key = confdb_key(db, section, k)) != NULL; k++) {
+        if (!strncmp(key, "path", strlen("path"))) {
+            strncpy(opt->path, confdb_value(db, section, k), sizearray(opt->path)-1);
+        } else if (!strncmp(key, "baudrate", strlen("baudrate"))) {
+            opt->baudrate = confdb_value_l(db, section, k, 0);
+        } else if (!strncmp(key, "codec", strlen("codec"))) {
+            strncpy(opt->codec, confdb_value(db, section, k), sizearray(opt->codec)-1);
+        }
+    }
+    device_codec_check(confdb_section(db, section), opt->codec);
+}
+
+static bool device_serial_open(int idx, const char *section, serial_options_t *opt)
+{
+    if ((serial_array[idx] = serial_get(opt->path, opt->baudrate, opt->loop)) == NULL) {
+        log_error("serial[%d] open %s fail", idx, opt->path);
         return false;
     }
-    serial_idx++;
+    strncpy(serial_slot[idx].section, section, sizearray(serial_slot[idx].section)-1);
+    serial_slot[idx].opt.serial = *opt;
     return true;
 }
 
-static bool device_usb_init(struct ev_loop *loop, const char *conf_file, const char *section)
+static void device_serial_close(int idx)
+{
+    if (serial_array[idx]) {
+        serial_put(serial_array[idx]);
+        serial_array[idx] = NULL;
+    }
+}
+
+static void device_usb_parse(confdb_t *db, int section, usb_options_t *opt)
 {
-    char key[64] = {0};
+    const char *key;
     int k;
 
-    usb_options_t opt;
-    memset(&opt, 0, sizeof(opt));
-    for (k = 0; ini_getkey(section, k, key, sizearray(key), conf_file) > 0; k++) {
+    memset(opt, 0, sizeof(*opt));
+    for (k = 0; (key = confdb_key(db, section, k)) != NULL; k++) {
         if (!strncmp(key, "path", strlen("path"))) {
-            ini_gets(section, key, "dummy", opt.path, sizearray(opt.path), conf_file);
+            strncpy(opt->path, confdb_value(db, section, k), sizearray(opt->path)-1);
         } else if (!strncmp(key, "vid", strlen("vid"))) {
-            opt.vid = ini_getl(section, key, 0, conf_file);
+            opt->vid = confdb_value_l(db, section, k, 0);
         } else if (!strncmp(key, "pid", strlen("pid"))) {
-            opt.pid = ini_getl(section, key, 0, conf_file);
+            opt->pid = confdb_value_l(db, section, k, 0);
         }
     }
-    if ((usb_array[usb_idx] = usb_new()) == NULL) {
-        log_error("usb[%d] new fail", usb_idx);
+}
+
+static bool device_usb_open(int idx, const char *section, usb_options_t *opt)
+{
+    if ((usb_array[idx] = usb_new()) == NULL) {
+        log_error("usb[%d] new fail", idx);
         return false;
     }
-    if (usb_open(usb_array[usb_idx], opt.vid, opt.pid, opt.path) != 0) {
-        log_error("usb[%d] open fail: %s", usb_idx, usb_errmsg(usb_array[usb_idx]));
-        usb_free(usb_array[usb_idx]);
-        usb_array[usb_idx] = NULL;
+    if (usb_open(usb_array[idx], opt->vid, opt->pid, opt->path) != 0) {
+        log_error("usb[%d] open fail: %s", idx, usb_errmsg(usb_array[idx]));
+        usb_free(usb_array[idx]);
+        usb_array[idx] = NULL;
         return false;
     }
-    usb_idx++;
+    strncpy(usb_slot[idx].section, section, sizearray(usb_slot[idx].section)-1);
+    usb_slot[idx].opt.usb = *opt;
     return true;
 }
 
-static bool device_wifi_init(struct ev_loop *loop, const char *conf_file, const char *section)
+static void device_usb_close(int idx)
+{
+    if (usb_array[idx]) {
+        usb_close(usb_array[idx]);
+        usb_free(usb_array[idx]);
+        usb_array[idx] = NULL;
+    }
+}
+
+static void device_wifi_parse(confdb_t *db, int section, wifi_options_t *opt)
 {
-    if ((wifi_array[wifi_idx] = wifi_new()) == NULL) {
-        log_error("wifi[%d] new fail", wifi_idx);
+    const char *key;
+    int k;
+
+    memset(opt, 0, sizeof(*opt));
+    opt->loop = device_loop;
+    for (k = 0; (key = confdb_key(db, section, k)) != NULL; k++) {
+        if (!strncmp(key, "backend", strlen("backend"))) {
+            strncpy(opt->backend, confdb_value(db, section, k), sizearray(opt->backend)-1);
+        } else if (!strncmp(key, "interface", strlen("interface"))) {
+            strncpy(opt->ifname, confdb_value(db, section, k), sizearray(opt->ifname)-1);
+        } else if (!strncmp(key, "ctrl_dir", strlen("ctrl_dir"))) {
+            strncpy(opt->ctrl_dir, confdb_value(db, section, k), sizearray(opt->ctrl_dir)-1);
+        }
+    }
+}
+
+static bool device_wifi_open(int idx, const char *section, wifi_options_t *opt)
+{
+    if ((wifi_array[idx] = wifi_new()) == NULL) {
+        log_error("wifi[%d] new fail", idx);
         return false;
     }
-    if (wifi_open(wifi_array[wifi_idx], NULL) != 0) {
-        log_error("wifi[%d] open fail: %s", wifi_idx, wifi_errmsg(wifi_array[wifi_idx]));
-        wifi_free(wifi_array[wifi_idx]);
-        wifi_array[wifi_idx] = NULL;
+    if (wifi_open(wifi_array[idx], opt) != 0) {
+        log_error("wifi[%d] open fail: %s", idx, wifi_errmsg(wifi_array[idx]));
+        wifi_free(wifi_array[idx]);
+        wifi_array[idx] = NULL;
         return false;
     }
-    wifi_idx++;
+    strncpy(wifi_slot[idx].section, section, sizearray(wifi_slot[idx].section)-1);
+    wifi_slot[idx].opt.wifi = *opt;
     return true;
 }
 
-int devices_init(struct ev_loop *loop, const char *conf_file)
+static void device_wifi_close(int idx)
+{
+    if (wifi_array[idx]) {
+        wifi_close(wifi_array[idx]);
+        wifi_free(wifi_array[idx]);
+        wifi_array[idx] = NULL;
+    }
+}
+
+/* "17,18,20" */
+static int device_parse_lines(const char *value, unsigned int *lines, int max)
 {
-    char section[64] = {0};
+    char *end;
+    int n = 0;
+
+    while (value && *value && n < max) {
+        lines[n++] = strtoul(value, &end, 0);
+        if (end == value)
+            return n - 1;
+        value = end + strspn(end, ", ");
+    }
+    return n;
+}
+
+static void device_gpio_parse(confdb_t *db, int section, gpio_options_t *opt)
+{
+    const char *key, *value;
+    int k;
+
+    memset(opt, 0, sizeof(*opt));
+    opt->loop = device_loop;
+    for (k = 0; (key = confdb_key(db, section, k)) != NULL; k++) {
+        value = confdb_value(db, section, k);
+        if (!strncmp(key, "chip", strlen("chip"))) {
+            strncpy(opt->chip, value, sizearray(opt->chip)-1);
+        } else if (!strncmp(key, "consumer", strlen("consumer"))) {
+            strncpy(opt->consumer, value, sizearray(opt->consumer)-1);
+        } else if (!strncmp(key, "inputs", strlen("inputs"))) {
+            opt->ninputs = device_parse_lines(value, opt->inputs, GPIO_MAX_LINES);
+        } else if (!strncmp(key, "outputs", strlen("outputs"))) {
+            opt->noutputs = device_parse_lines(value, opt->outputs, GPIO_MAX_LINES);
+        } else if (!strncmp(key, "edge", strlen("edge"))) {
+            opt->edge = !strcmp(value, "rising") ? GPIO_EDGE_RISING :
+                        !strcmp(value, "falling") ? GPIO_EDGE_FALLING :
+                        !strcmp(value, "both") ? GPIO_EDGE_BOTH : GPIO_EDGE_NONE;
+        } else if (!strncmp(key, "bias", strlen("bias"))) {
+            opt->bias = !strcmp(value, "disabled") ? GPIO_BIAS_DISABLED :
+                        !strcmp(value, "pull-up") ? GPIO_BIAS_PULL_UP :
+                        !strcmp(value, "pull-down") ? GPIO_BIAS_PULL_DOWN : GPIO_BIAS_AS_IS;
+        } else if (!strncmp(key, "active_low", strlen("active_low"))) {
+            opt->active_low = confdb_value_l(db, section, k, 0) != 0;
+        } else if (!strncmp(key, "debounce_us", strlen("debounce_us"))) {
+            opt->debounce_us = confdb_value_l(db, section, k, 0);
+        }
+    }
+}
+
+static bool device_gpio_open(int idx, const char *section, gpio_options_t *opt)
+{
+    if ((gpio_array[idx] = gpio_new()) == NULL) {
+        log_error("gpio[%d] new fail", idx);
+        return false;
+    }
+    if (gpio_open(gpio_array[idx], opt) != 0) {
+        log_error("gpio[%d] open fail: %s", idx, gpio_errmsg(gpio_array[idx]));
+        gpio_free(gpio_array[idx]);
+        gpio_array[idx] = NULL;
+        return false;
+    }
+    strncpy(gpio_slot[idx].section, section, sizearray(gpio_slot[idx].section)-1);
+    gpio_slot[idx].opt.gpio = *opt;
+    return true;
+}
+
+static void device_gpio_close(int idx)
+{
+    if (gpio_array[idx]) {
+        gpio_close(gpio_array[idx]);
+        gpio_free(gpio_array[idx]);
+        gpio_array[idx] = NULL;
+    }
+}
+
+static void device_input_parse(confdb_t *db, int section, input_options_t *opt)
+{
+    const char *key;
+    int k;
+
+    memset(opt, 0, sizeof(*opt));
+    opt->loop = device_loop;
+    for (k = 0; (key = confdb_key(db, section, k)) != NULL; k++) {
+        if (!strncmp(key, "path", strlen("path"))) {
+            strncpy(opt->path, confdb_value(db, section, k), sizearray(opt->path)-1);
+        } else if (!strncmp(key, "name", strlen("name"))) {
+            strncpy(opt->name, confdb_value(db, section, k), sizearray(opt->name)-1);
+        } else if (!strncmp(key, "phys", strlen("phys"))) {
+            strncpy(opt->phys, confdb_value(db, section, k), sizearray(opt->phys)-1);
+        } else if (!strncmp(key, "grab", strlen("grab"))) {
+            opt->grab = confdb_value_l(db, section, k, 0) != 0;
+        } else if (!strncmp(key, "record", strlen("record"))) {
+            strncpy(opt->record, confdb_value(db, section, k), sizearray(opt->record)-1);
+        }
+    }
+}
+
+static bool device_input_open(int idx, const char *section, input_options_t *opt)
+{
+    if ((input_array[idx] = input_new()) == NULL) {
+        log_error("input[%d] new fail", idx);
+        return false;
+    }
+    if (input_open(input_array[idx], opt) != 0) {
+        log_error("input[%d] open fail: %s", idx, input_errmsg(input_array[idx]));
+        input_free(input_array[idx]);
+        input_array[idx] = NULL;
+        return false;
+    }
+    strncpy(input_slot[idx].section, section, sizearray(input_slot[idx].section)-1);
+    input_slot[idx].opt.input = *opt;
+    return true;
+}
+
+static void device_input_close(int idx)
+{
+    if (input_array[idx]) {
+        input_close(input_array[idx]);
+        input_free(input_array[idx]);
+        input_array[idx] = NULL;
+    }
+}
+
+static void device_pwm_parse(confdb_t *db, int section, pwm_options_t *opt)
+{
+    const char *key, *value;
+    int k;
+
+    memset(opt, 0, sizeof(*opt));
+    opt->enable = -1;
+    for (k = 0; (key = confdb_key(db, section, k)) != NULL; k++) {
+        value = confdb_value(db, section, k);
+        if (!strncmp(key, "chip", strlen("chip"))) {
+            strncpy(opt->chip, value, sizearray(opt->chip)-1);
+        } else if (!strncmp(key, "channel", strlen("channel"))) {
+            opt->channel = confdb_value_l(db, section, k, 0);
+        } else if (!strncmp(key, "period_ns", strlen("period_ns"))) {
+            opt->period_ns = strtoull(value, NULL, 0);
+        } else if (!strncmp(key, "duty_ns", strlen("duty_ns"))) {
+            opt->duty_ns = strtoull(value, NULL, 0);
+        } else if (!strncmp(key, "polarity", strlen("polarity"))) {
+            opt->inversed = !strcmp(value, "inversed");
+        } else if (!strncmp(key, "enable", strlen("enable"))) {
+            opt->enable = confdb_value_l(db, section, k, 0) != 0;
+        }
+    }
+}
+
+static bool device_pwm_open(int idx, const char *section, pwm_options_t *opt)
+{
+    if ((pwm_array[idx] = pwm_new()) == NULL) {
+        log_error("pwm[%d] new fail", idx);
+        return false;
+    }
+    if (pwm_open(pwm_array[idx], opt) != 0) {
+        log_error("pwm[%d] open fail: %s", idx, pwm_errmsg(pwm_array[idx]));
+        pwm_free(pwm_array[idx]);
+        pwm_array[idx] = NULL;
+        return false;
+    }
+    strncpy(pwm_slot[idx].section, section, sizearray(pwm_slot[idx].section)-1);
+    pwm_slot[idx].opt.pwm = *opt;
+    return true;
+}
+
+static void device_pwm_close(int idx)
+{
+    if (pwm_array[idx]) {
+        pwm_close(pwm_array[idx]);
+        pwm_free(pwm_array[idx]);
+        pwm_array[idx] = NULL;
+    }
+}
+
+static void device_led_parse(confdb_t *db, int section, led_options_t *opt)
+{
+    const char *key;
+    int k;
+
+    memset(opt, 0, sizeof(*opt));
+    opt->brightness = -1;
+    for (k = 0; (key = confdb_key(db, section, k)) != NULL; k++) {
+        if (!strncmp(key, "name", strlen("name"))) {
+            strncpy(opt->name, confdb_value(db, section, k), sizearray(opt->name)-1);
+        } else if (!strncmp(key, "brightness", strlen("brightness"))) {
+            opt->brightness = confdb_value_l(db, section, k, -1);
+        } else if (!strncmp(key, "trigger", strlen("trigger"))) {
+            strncpy(opt->trigger, confdb_value(db, section, k), sizearray(opt->trigger)-1);
+        }
+    }
+}
+
+static bool device_led_open(int idx, const char *section, led_options_t *opt)
+{
+    if ((led_array[idx] = led_new()) == NULL) {
+        log_error("led[%d] new fail", idx);
+        return false;
+    }
+    if (led_open(led_array[idx], opt) != 0) {
+        log_error("led[%d] open fail: %s", idx, led_errmsg(led_array[idx]));
+        led_free(led_array[idx]);
+        led_array[idx] = NULL;
+        return false;
+    }
+    strncpy(led_slot[idx].section, section, sizearray(led_slot[idx].section)-1);
+    led_slot[idx].opt.led = *opt;
+    return true;
+}
+
+static void device_led_close(int idx)
+{
+    if (led_array[idx]) {
+        led_close(led_array[idx]);
+        led_free(led_array[idx]);
+        led_array[idx] = NULL;
+    }
+}
+
+static void device_thermal_parse(confdb_t *db, int section, thermal_options_t *opt)
+{
+    const char *key;
+    int k;
+
+    memset(opt, 0, sizeof(*opt));
+    opt->loop = device_loop;
+    for (k = 0; (key = confdb_key(db, section, k)) != NULL; k++) {
+        if (!strncmp(key, "zone", strlen("zone"))) {
+            strncpy(opt->zone, confdb_value(db, section, k), sizearray(opt->zone)-1);
+        } else if (!strncmp(key, "period_ms", strlen("period_ms"))) {
+            opt->period_ms = confdb_value_l(db, section, k, 0);
+        }
+    }
+}
+
+static bool device_thermal_open(int idx, const char *section, thermal_options_t *opt)
+{
+    if ((thermal_array[idx] = thermal_new()) == NULL) {
+        log_error("thermal[%d] new fail", idx);
+        return false;
+    }
+    if (thermal_open(thermal_array[idx], opt) != 0) {
+        log_error("thermal[%d] open fail: %s", idx, thermal_errmsg(thermal_array[idx]));
+        thermal_free(thermal_array[idx]);
+        thermal_array[idx] = NULL;
+        return false;
+    }
+    strncpy(thermal_slot[idx].section, section, sizearray(thermal_slot[idx].section)-1);
+    thermal_slot[idx].opt.thermal = *opt;
+    return true;
+}
+
+static void device_thermal_close(int idx)
+{
+    if (thermal_array[idx]) {
+        thermal_close(thermal_array[idx]);
+        thermal_free(thermal_array[idx]);
+        thermal_array[idx] = NULL;
+    }
+}
+
+static void device_cpufreq_parse(confdb_t *db, int section, cpufreq_options_t *opt)
+{
+    const char *key;
+    int k;
+
+    memset(opt, 0, sizeof(*opt));
+    opt->loop = device_loop;
+    for (k = 0; (key = confdb_key(db, section, k)) != NULL; k++) {
+        if (!strncmp(key, "policy", strlen("policy"))) {
+            strncpy(opt->policy, confdb_value(db, section, k), sizearray(opt->policy)-1);
+        } else if (!strncmp(key, "governor", strlen("governor"))) {
+            strncpy(opt->governor, confdb_value(db, section, k), sizearray(opt->governor)-1);
+        } else if (!strncmp(key, "min_khz", strlen("min_khz"))) {
+            opt->min_khz = confdb_value_l(db, section, k, 0);
+        } else if (!strncmp(key, "max_khz", strlen("max_khz"))) {
+            opt->max_khz = confdb_value_l(db, section, k, 0);
+        } else if (!strncmp(key, "period_ms", strlen("period_ms"))) {
+            opt->period_ms = confdb_value_l(db, section, k, 0);
+        }
+    }
+}
+
+static bool device_cpufreq_open(int idx, const char *section, cpufreq_options_t *opt)
+{
+    if ((cpufreq_array[idx] = cpufreq_new()) == NULL) {
+        log_error("cpufreq[%d] new fail", idx);
+        return false;
+    }
+    if (cpufreq_open(cpufreq_array[idx], opt) != 0) {
+        log_error("cpufreq[%d] open fail: %s", idx, cpufreq_errmsg(cpufreq_array[idx]));
+        cpufreq_free(cpufreq_array[idx]);
+        cpufreq_array[idx] = NULL;
+        return false;
+    }
+    strncpy(cpufreq_slot[idx].section, section, sizearray(cpufreq_slot[idx].section)-1);
+    cpufreq_slot[idx].opt.cpufreq = *opt;
+    return true;
+}
+
+static void device_cpufreq_close(int idx)
+{
+    if (cpufreq_array[idx]) {
+        cpufreq_close(cpufreq_array[idx]);
+        cpufreq_free(cpufreq_array[idx]);
+        cpufreq_array[idx] = NULL;
+    }
+}
+
+/*
+ * Drop every slot not marked in keep[] and compact the arrays, the getters
+ * stop at the first NULL so there must be no holes.
+ */
+#define DEVICE_COMPACT(type, keep)                                          \
+    do {                                                                    \
+        int _i, _j;                                                         \
+        for (_i = 0, _j = 0; _i < type##_idx; _i++) {                       \
+            if (!(keep)[_i] || type##_array[_i] == NULL) {                  \
+                if (type##_array[_i])                                       \
+                    log_info(#type "[%d] %s removed", _i, type##_slot[_i].section); \
+                device_##type##_close(_i);                                  \
+                continue;                                                   \
+            }                                                               \
+            type##_array[_j] = type##_array[_i];                            \
+            type##_slot[_j] = type##_slot[_i];                              \
+            _j++;                                                           \
+        }                                                                   \
+        for (_i = _j; _i < type##_idx; _i++) {                              \
+            type##_array[_i] = NULL;                                        \
+            memset(&type##_slot[_i], 0, sizeof(type##_slot[_i]));           \
+        }                                                                   \
+        type##_idx = _j;                                                    \
+    } while (0)
+
+static void devices_reload_aw5808(confdb_t *db)
+{
+    bool keep[DEVICE_MAX_NUM] = { false };
+    aw5808_options_t opt, *cur;
+    const char *section;
+    int s, i;
+
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (!device_section_is(section, "aw5808"))
+            continue;
+        device_aw5808_parse(db, s, &opt);
+        if ((i = device_slot_find(aw5808_slot, aw5808_idx, section)) < 0) {
+            if (aw5808_idx < DEVICE_MAX_NUM && device_aw5808_open(aw5808_idx, section, &opt)) {
+                log_info("aw5808[%d] %s added", aw5808_idx, section);
+                keep[aw5808_idx++] = true;
+            }
+            continue;
+        }
+        keep[i] = true;
+        cur = &aw5808_slot[i].opt.aw5808;
+        if (strcmp(cur->serial, opt.serial) || strcmp(cur->usb, opt.usb)) {
+            log_info("aw5808[%d] %s reopen", i, section);
+            device_aw5808_close(i);
+            keep[i] = device_aw5808_open(i, section, &opt);
+        } else if (cur->mode != opt.mode) {
+            log_info("aw5808[%d] %s mode %d -> %d", i, section, cur->mode, opt.mode);
+            if (aw5808_set_mode(aw5808_array[i], opt.mode) != 0)
+                log_error("aw5808[%d] set mode fail: %s", i, aw5808_errmsg(aw5808_array[i]));
+            cur->mode = opt.mode;
+        }
+    }
+    DEVICE_COMPACT(aw5808, keep);
+}
+
+static void devices_reload_uband(confdb_t *db)
+{
+    bool keep[DEVICE_MAX_NUM] = { false };
+    uband_options_t opt, *cur;
+    const char *section;
+    int s, i;
+
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (!device_section_is(section, "uband"))
+            continue;
+        device_uband_parse(db, s, &opt);
+        if ((i = device_slot_find(uband_slot, uband_idx, section)) < 0) {
+            if (uband_idx < DEVICE_MAX_NUM && device_uband_open(uband_idx, section, &opt)) {
+                log_info("uband[%d] %s added", uband_idx, section);
+                keep[uband_idx++] = true;
+            }
+            continue;
+        }
+        keep[i] = true;
+        cur = &uband_slot[i].opt.uband;
+        if (strcmp(cur->serial, opt.serial) || cur->baudrate != opt.baudrate || cur->timeout_ms != opt.timeout_ms ||
+                cur->provisional != opt.provisional) {
+            log_info("uband[%d] %s reopen", i, section);
+            device_uband_close(i);
+            keep[i] = device_uband_open(i, section, &opt);
+        }
+    }
+    DEVICE_COMPACT(uband, keep);
+}
+
+static void devices_reload_serial(confdb_t *db)
+{
+    bool keep[DEVICE_MAX_NUM] = { false };
+    serial_options_t opt, *cur;
+    const char *section;
+    int s, i;
+
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (!device_section_is(section, "serial"))
+            continue;
+        device_serial_parse(db, s, &opt);
+        if ((i = device_slot_find(serial_slot, serial_idx, section)) < 0) {
+            if (serial_idx < DEVICE_MAX_NUM && device_serial_open(serial_idx, section, &opt)) {
+                log_info("serial[%d] %s added", serial_idx, section);
+                keep[serial_idx++] = true;
+            }
+            continue;
+        }
+        keep[i] = true;
+        cur = &serial_slot[i].opt.serial;
+        if (strcmp(cur->path, opt.path)) {
+            log_info("serial[%d] %s reopen", i, section);
+            device_serial_close(i);
+            keep[i] = device_serial_open(i, section, &opt);
+        } else if (cur->baudrate != opt.baudrate && serial_refcount(serial_array[i]) > 1) {
+            log_warn("serial[%d] %s shared, keeping baudrate %u", i, section, cur->baudrate);
+        } else if (cur->baudrate != opt.baudrate) {
+            log_info("serial[%d] %s baudrate %u -> %u", i, section, cur->baudrate, opt.baudrate);
+            if (serial_set_baudrate(serial_array[i], opt.baudrate) != 0) {
+                log_error("serial[%d] set baudrate fail: %s", i, serial_errmsg(serial_array[i]));
+                continue;
+            }
+            cur->baudrate = opt.baudrate;
+        }
+        /* already validated, picked up by the shell on the next receive */
+        if (keep[i] && strcmp(cur->codec, opt.codec)) {
+            log_info("serial[%d] %s codec '%s' -> '%s'", i, section, cur->codec, opt.codec);
+            memcpy(cur->codec, opt.codec, sizeof(cur->codec));
+        }
+    }
+    DEVICE_COMPACT(serial, keep);
+}
+
+static void devices_reload_usb(confdb_t *db)
+{
+    bool keep[DEVICE_MAX_NUM] = { false };
+    usb_options_t opt, *cur;
+    const char *section;
+    int s, i;
+
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (!device_section_is(section, "usb"))
+            continue;
+        device_usb_parse(db, s, &opt);
+        if ((i = device_slot_find(usb_slot, usb_idx, section)) < 0) {
+            if (usb_idx < DEVICE_MAX_NUM && device_usb_open(usb_idx, section, &opt)) {
+                log_info("usb[%d] %s added", usb_idx, section);
+                keep[usb_idx++] = true;
+            }
+            continue;
+        }
+        keep[i] = true;
+        cur = &usb_slot[i].opt.usb;
+        if (strcmp(cur->path, opt.path) || cur->vid != opt.vid || cur->pid != opt.pid) {
+            log_info("usb[%d] %s reopen", i, section);
+            device_usb_close(i);
+            keep[i] = device_usb_open(i, section, &opt);
+        }
+    }
+    DEVICE_COMPACT(usb, keep);
+}
+
+static void devices_reload_wifi(confdb_t *db)
+{
+    bool keep[DEVICE_MAX_NUM] = { false };
+    wifi_options_t opt, *cur;
+    const char *section;
+    int s, i;
+
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (!device_section_is(section, "wifi"))
+            continue;
+        device_wifi_parse(db, s, &opt);
+        if ((i = device_slot_find(wifi_slot, wifi_idx, section)) < 0) {
+            if (wifi_idx < DEVICE_MAX_NUM && device_wifi_open(wifi_idx, section, &opt)) {
+                log_info("wifi[%d] %s added", wifi_idx, section);
+                keep[wifi_idx++] = true;
+            }
+            continue;
+        }
+        keep[i] = true;
+        cur = &wifi_slot[i].opt.wifi;
+        if (strcmp(cur->backend, opt.backend) || strcmp(cur->ifname, opt.ifname) ||
+                strcmp(cur->ctrl_dir, opt.ctrl_dir)) {
+            log_info("wifi[%d] %s reopen", i, section);
+            device_wifi_close(i);
+            keep[i] = device_wifi_open(i, section, &opt);
+        }
+    }
+    DEVICE_COMPACT(wifi, keep);
+}
+
+static void devices_reload_gpio(confdb_t *db)
+{
+    bool keep[DEVICE_MAX_NUM] = { false };
+    gpio_options_t opt, *cur;
+    const char *section;
+    int s, i;
+
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (!device_section_is(section, "gpio"))
+            continue;
+        device_gpio_parse(db, s, &opt);
+        if ((i = device_slot_find(gpio_slot, gpio_idx, section)) < 0) {
+            if (gpio_idx < DEVICE_MAX_NUM && device_gpio_open(gpio_idx, section, &opt)) {
+                log_info("gpio[%d] %s added", gpio_idx, section);
+                keep[gpio_idx++] = true;
+            }
+            continue;
+        }
+        keep[i] = true;
+        cur = &gpio_slot[i].opt.gpio;
+        if (strcmp(cur->chip, opt.chip) || strcmp(cur->consumer, opt.consumer) ||
+                cur->ninputs != opt.ninputs || cur->noutputs != opt.noutputs ||
+                memcmp(cur->inputs, opt.inputs, sizeof(opt.inputs)) ||
+                memcmp(cur->outputs, opt.outputs, sizeof(opt.outputs))) {
+            log_info("gpio[%d] %s reopen", i, section);
+            device_gpio_close(i);
+            keep[i] = device_gpio_open(i, section, &opt);
+        } else if (cur->edge != opt.edge || cur->bias != opt.bias ||
+                cur->active_low != opt.active_low || cur->debounce_us != opt.debounce_us) {
+            /* the request fd stays, outputs keep driving and no edge is lost */
+            log_info("gpio[%d] %s reconfigure", i, section);
+            if (gpio_reconfigure(gpio_array[i], &opt) != 0) {
+                log_error("gpio[%d] reconfigure fail: %s", i, gpio_errmsg(gpio_array[i]));
+                continue;
+            }
+            *cur = opt;
+        }
+    }
+    DEVICE_COMPACT(gpio, keep);
+}
+
+static void devices_reload_input(confdb_t *db)
+{
+    bool keep[DEVICE_MAX_NUM] = { false };
+    input_options_t opt, *cur;
+    const char *section;
+    int s, i;
+
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (!device_section_is(section, "input"))
+            continue;
+        device_input_parse(db, s, &opt);
+        if ((i = device_slot_find(input_slot, input_idx, section)) < 0) {
+            if (input_idx < DEVICE_MAX_NUM && device_input_open(input_idx, section, &opt)) {
+                log_info("input[%d] %s added", input_idx, section);
+                keep[input_idx++] = true;
+            }
+            continue;
+        }
+        keep[i] = true;
+        cur = &input_slot[i].opt.input;
+        if (strcmp(cur->path, opt.path) || strcmp(cur->name, opt.name) || strcmp(cur->phys, opt.phys)) {
+            log_info("input[%d] %s reopen", i, section);
+            device_input_close(i);
+            keep[i] = device_input_open(i, section, &opt);
+            continue;
+        }
+        if (cur->grab != opt.grab) {
+            log_info("input[%d] %s grab %d -> %d", i, section, cur->grab, opt.grab);
+            if (input_grab(input_array[i], opt.grab) != 0)
+                log_error("input[%d] grab fail: %s", i, input_errmsg(input_array[i]));
+            else
+                cur->grab = opt.grab;
+        }
+        if (strcmp(cur->record, opt.record)) {
+            log_info("input[%d] %s record '%s' -> '%s'", i, section, cur->record, opt.record);
+            if (opt.record[0] == '\0')
+                input_record_stop(input_array[i]);
+            else if (input_record_start(input_array[i], opt.record) != 0)
+                log_error("input[%d] record fail: %s", i, input_errmsg(input_array[i]));
+            memcpy(cur->record, opt.record, sizeof(cur->record));
+        }
+    }
+    DEVICE_COMPACT(input, keep);
+}
+
+static void devices_reload_pwm(confdb_t *db)
+{
+    bool keep[DEVICE_MAX_NUM] = { false };
+    pwm_options_t opt, *cur;
+    const char *section;
+    int s, i, ret;
+
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (!device_section_is(section, "pwm"))
+            continue;
+        device_pwm_parse(db, s, &opt);
+        if ((i = device_slot_find(pwm_slot, pwm_idx, section)) < 0) {
+            if (pwm_idx < DEVICE_MAX_NUM && device_pwm_open(pwm_idx, section, &opt)) {
+                log_info("pwm[%d] %s added", pwm_idx, section);
+                keep[pwm_idx++] = true;
+            }
+            continue;
+        }
+        keep[i] = true;
+        cur = &pwm_slot[i].opt.pwm;
+        if (strcmp(cur->chip, opt.chip) || cur->channel != opt.channel) {
+            log_info("pwm[%d] %s reopen", i, section);
+            device_pwm_close(i);
+            keep[i] = device_pwm_open(i, section, &opt);
+            continue;
+        }
+        if (cur->inversed == opt.inversed && cur->period_ns == opt.period_ns &&
+                cur->duty_ns == opt.duty_ns && cur->enable == opt.enable)
+            continue;
+        /* the cached fds stay, unchanged attributes are not written */
+        log_info("pwm[%d] %s reconfigure", i, section);
+        if ((opt.inversed != cur->inversed && (ret = pwm_set_polarity(pwm_array[i], opt.inversed)) != 0) ||
+                (opt.period_ns && (ret = pwm_config(pwm_array[i], opt.period_ns, opt.duty_ns)) != 0) ||
+                (opt.enable >= 0 && (ret = pwm_enable(pwm_array[i], opt.enable)) != 0)) {
+            log_error("pwm[%d] reconfigure fail: %s", i, pwm_errmsg(pwm_array[i]));
+            continue;
+        }
+        *cur = opt;
+    }
+    DEVICE_COMPACT(pwm, keep);
+}
+
+static void devices_reload_led(confdb_t *db)
+{
+    bool keep[DEVICE_MAX_NUM] = { false };
+    led_options_t opt, *cur;
+    const char *section;
+    int s, i;
+
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (!device_section_is(section, "led"))
+            continue;
+        device_led_parse(db, s, &opt);
+        if ((i = device_slot_find(led_slot, led_idx, section)) < 0) {
+            if (led_idx < DEVICE_MAX_NUM && device_led_open(led_idx, section, &opt)) {
+                log_info("led[%d] %s added", led_idx, section);
+                keep[led_idx++] = true;
+            }
+            continue;
+        }
+        keep[i] = true;
+        cur = &led_slot[i].opt.led;
+        if (strcmp(cur->name, opt.name)) {
+            log_info("led[%d] %s reopen", i, section);
+            device_led_close(i);
+            keep[i] = device_led_open(i, section, &opt);
+            continue;
+        }
+        if (strcmp(cur->trigger, opt.trigger) && opt.trigger[0]) {
+            log_info("led[%d] %s trigger '%s' -> '%s'", i, section, cur->trigger, opt.trigger);
+            if (led_set_trigger(led_array[i], opt.trigger) != 0)
+                log_error("led[%d] trigger fail: %s", i, led_errmsg(led_array[i]));
+        }
+        if (cur->brightness != opt.brightness && opt.brightness >= 0) {
+            log_info("led[%d] %s brightness %d -> %d", i, section, cur->brightness, opt.brightness);
+            if (led_set_brightness(led_array[i], opt.brightness) != 0)
+                log_error("led[%d] brightness fail: %s", i, led_errmsg(led_array[i]));
+        }
+        *cur = opt;
+    }
+    DEVICE_COMPACT(led, keep);
+}
+
+static void devices_reload_thermal(confdb_t *db)
+{
+    bool keep[DEVICE_MAX_NUM] = { false };
+    thermal_options_t opt, *cur;
+    const char *section;
+    int s, i;
+
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (!device_section_is(section, "thermal"))
+            continue;
+        device_thermal_parse(db, s, &opt);
+        if ((i = device_slot_find(thermal_slot, thermal_idx, section)) < 0) {
+            if (thermal_idx < DEVICE_MAX_NUM && device_thermal_open(thermal_idx, section, &opt)) {
+                log_info("thermal[%d] %s added", thermal_idx, section);
+                keep[thermal_idx++] = true;
+            }
+            continue;
+        }
+        keep[i] = true;
+        cur = &thermal_slot[i].opt.thermal;
+        if (strcmp(cur->zone, opt.zone)) {
+            log_info("thermal[%d] %s reopen", i, section);
+            device_thermal_close(i);
+            keep[i] = device_thermal_open(i, section, &opt);
+        } else if (cur->period_ms != opt.period_ms) {
+            log_info("thermal[%d] %s period %d -> %d ms", i, section, cur->period_ms, opt.period_ms);
+            thermal_set_period(thermal_array[i], opt.period_ms);
+            cur->period_ms = opt.period_ms;
+        }
+    }
+    DEVICE_COMPACT(thermal, keep);
+}
+
+static void devices_reload_cpufreq(confdb_t *db)
+{
+    bool keep[DEVICE_MAX_NUM] = { false };
+    cpufreq_options_t opt, *cur;
+    const char *section;
+    int s, i;
+
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (!device_section_is(section, "cpufreq"))
+            continue;
+        device_cpufreq_parse(db, s, &opt);
+        if ((i = device_slot_find(cpufreq_slot, cpufreq_idx, section)) < 0) {
+            if (cpufreq_idx < DEVICE_MAX_NUM && device_cpufreq_open(cpufreq_idx, section, &opt)) {
+                log_info("cpufreq[%d] %s added", cpufreq_idx, section);
+                keep[cpufreq_idx++] = true;
+            }
+            continue;
+        }
+        keep[i] = true;
+        cur = &cpufreq_slot[i].opt.cpufreq;
+        if (strcmp(cur->policy, opt.policy)) {
+            log_info("cpufreq[%d] %s reopen", i, section);
+            device_cpufreq_close(i);
+            keep[i] = device_cpufreq_open(i, section, &opt);
+            continue;
+        }
+        if (strcmp(cur->governor, opt.governor) && opt.governor[0]) {
+            log_info("cpufreq[%d] %s governor '%s' -> '%s'", i, section, cur->governor, opt.governor);
+            if (cpufreq_set_governor(cpufreq_array[i], opt.governor) != 0)
+                log_error("cpufreq[%d] governor fail: %s", i, cpufreq_errmsg(cpufreq_array[i]));
+        }
+        if (cur->min_khz != opt.min_khz || cur->max_khz != opt.max_khz) {
+            log_info("cpufreq[%d] %s limits %u-%u -> %u-%u kHz", i, section,
+                     cur->min_khz, cur->max_khz, opt.min_khz, opt.max_khz);
+            if (cpufreq_set_limits(cpufreq_array[i], opt.min_khz, opt.max_khz) != 0)
+                log_error("cpufreq[%d] limits fail: %s", i, cpufreq_errmsg(cpufreq_array[i]));
+        }
+        if (cur->period_ms != opt.period_ms)
+            cpufreq_set_period(cpufreq_array[i], opt.period_ms);
+        *cur = opt;
+    }
+    DEVICE_COMPACT(cpufreq, keep);
+}
+
+/*
+ * Diff the config file against the running devices. Untouched devices keep
+ * their fd and clients, so active links are not disturbed. Removed devices
+ * are freed and the rest may move down an index, clients re-resolve theirs
+ * in on_reload.
+ */
+int devices_reload(void)
+{
+    struct devices_client *client, *tmp;
+    confdb_t *db;
+
+    /* the edited INI file is authoritative, a snapshot would be stale */
+    if ((db = confdb_open(device_conf_file, NULL)) == NULL) {
+        log_error("config file reload fail, keep running config");
+        return -1;
+    }
+    devices_reload_aw5808(db);
+    devices_reload_uband(db);
+    devices_reload_serial(db);
+    devices_reload_usb(db);
+    devices_reload_wifi(db);
+    devices_reload_gpio(db);
+    devices_reload_input(db);
+    devices_reload_pwm(db);
+    devices_reload_led(db);
+    devices_reload_thermal(db);
+    devices_reload_cpufreq(db);
+    confdb_close(db);
+
+    list_for_each_entry_safe(client, tmp, &reload_clients, list) {
+        if (client->ops->on_reload)
+            client->ops->on_reload();
+    }
+    return 0;
+}
+
+int devices_add_client(struct devices_client *client)
+{
+    if (!client || !client->ops)
+        return -1;
+    list_add_tail(&client->list, &reload_clients);
+    return 0;
+}
+
+void devices_remove_client(struct devices_client *client)
+{
+    if (!client)
+        return;
+    list_del_init(&client->list);
+}
+
+static void reload_timer_cb(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    ev_timer_stop(loop, w);
+    log_info("Config %s changed, reloading", device_conf_file);
+    devices_reload();
+}
+
+static void conf_watcher_cb(struct ev_loop *loop, ev_stat *w, int revents)
+{
+    /* file replaced by rename: wait for the new one to show up */
+    if (w->attr.st_nlink == 0)
+        return;
+    ev_timer_again(loop, &reload_timer);
+}
+
+int devices_init(struct ev_loop *loop, const char *conf_file, const char *snapshot)
+{
+    const char *section;
+    confdb_t *db;
     int s;
 
     if (access(conf_file, R_OK) < 0) {
@@ -135,82 +1149,168 @@ int devices_init(struct ev_loop *loop, const char *conf_file)
         return -1;
     }
 
+    if ((db = confdb_open(conf_file, snapshot)) == NULL) {
+        log_error("config file load fail");
+        return -1;
+    }
+    log_info("Config loaded from %s", confdb_is_snapshot(db) ? snapshot : conf_file);
+
     if (usb_init()) {
         log_error("usb init fail");
+        confdb_close(db);
         return -1;
     }
 
-    for (s = 0; ini_getsection(s, section, sizearray(section), conf_file) > 0; s++) {
-        char *end = strchr(section, '/');
-        int section_len = strlen(section);
-        if (end != NULL)
-            section_len = end - section;
-        if (!strncmp(section, "aw5808", section_len) && aw5808_idx < DEVICE_MAX_NUM) {
-            device_aw5808_init(loop, conf_file, section);
-        } else if (!strncmp(section, "serial", section_len) && serial_idx < DEVICE_MAX_NUM) {
-            device_serial_init(loop, conf_file, section);
-        } else if (!strncmp(section, "usb", section_len) && usb_idx < DEVICE_MAX_NUM) {
-            device_usb_init(loop, conf_file, section);
-        } else if (!strncmp(section, "wifi", section_len) && wifi_idx < DEVICE_MAX_NUM) {
-            device_wifi_init(loop, conf_file, section);
+    device_loop = loop;
+    strncpy(device_conf_file, conf_file, sizeof(device_conf_file)-1);
+    for (s = 0; (section = confdb_section(db, s)) != NULL; s++) {
+        if (device_section_is(section, "aw5808") && aw5808_idx < DEVICE_MAX_NUM) {
+            aw5808_options_t opt;
+            device_aw5808_parse(db, s, &opt);
+            if (device_aw5808_open(aw5808_idx, section, &opt))
+                aw5808_idx++;
+        } else if (device_section_is(section, "uband") && uband_idx < DEVICE_MAX_NUM) {
+            uband_options_t opt;
+            device_uband_parse(db, s, &opt);
+            if (device_uband_open(uband_idx, section, &opt))
+                uband_idx++;
+        } else if (device_section_is(section, "serial") && serial_idx < DEVICE_MAX_NUM) {
+            serial_options_t opt;
+            device_serial_parse(db, s, &opt);
+            if (device_serial_open(serial_idx, section, &opt))
+                serial_idx++;
+        } else if (device_section_is(section, "usb") && usb_idx < DEVICE_MAX_NUM) {
+            usb_options_t opt;
+            device_usb_parse(db, s, &opt);
+            if (device_usb_open(usb_idx, section, &opt))
+                usb_idx++;
+        } else if (device_section_is(section, "wifi") && wifi_idx < DEVICE_MAX_NUM) {
+            wifi_options_t opt;
+            device_wifi_parse(db, s, &opt);
+            if (device_wifi_open(wifi_idx, section, &opt))
+                wifi_idx++;
+        } else if (device_section_is(section, "gpio") && gpio_idx < DEVICE_MAX_NUM) {
+            gpio_options_t opt;
+            device_gpio_parse(db, s, &opt);
+            if (device_gpio_open(gpio_idx, section, &opt))
+                gpio_idx++;
+        } else if (device_section_is(section, "input") && input_idx < DEVICE_MAX_NUM) {
+            input_options_t opt;
+            device_input_parse(db, s, &opt);
+            if (device_input_open(input_idx, section, &opt))
+                input_idx++;
+        } else if (device_section_is(section, "pwm") && pwm_idx < DEVICE_MAX_NUM) {
+            pwm_options_t opt;
+            device_pwm_parse(db, s, &opt);
+            if (device_pwm_open(pwm_idx, section, &opt))
+                pwm_idx++;
+        } else if (device_section_is(section, "led") && led_idx < DEVICE_MAX_NUM) {
+            led_options_t opt;
+            device_led_parse(db, s, &opt);
+            if (device_led_open(led_idx, section, &opt))
+                led_idx++;
+        } else if (device_section_is(section, "thermal") && thermal_idx < DEVICE_MAX_NUM) {
+            thermal_options_t opt;
+            device_thermal_parse(db, s, &opt);
+            if (device_thermal_open(thermal_idx, section, &opt))
+                thermal_idx++;
+        } else if (device_section_is(section, "cpufreq") && cpufreq_idx < DEVICE_MAX_NUM) {
+            cpufreq_options_t opt;
+            device_cpufreq_parse(db, s, &opt);
+            if (device_cpufreq_open(cpufreq_idx, section, &opt))
+                cpufreq_idx++;
         }
     }
+    confdb_close(db);
+
+    ev_timer_init(&reload_timer, reload_timer_cb, 0., DEVICE_RELOAD_DELAY);
+    ev_stat_init(&conf_watcher, conf_watcher_cb, device_conf_file, 0.);
+    evprof_watch(&reload_timer, "config.reload", device_conf_file);
+    evprof_watch(&conf_watcher, "config.stat", device_conf_file);
+    ev_stat_start(loop, &conf_watcher);
     return 0;
 }
 
 void devices_exit(void)
 {
     int i;
-    for (i=0; i<aw5808_idx; i++) {
-        if (aw5808_array[i]) {
-            aw5808_close(aw5808_array[i]);
-            aw5808_free(aw5808_array[i]);
-        }
-    }
 
-    for (i=0; i<serial_idx; i++) {
-        if (serial_array[i]) {
-            serial_close(serial_array[i]);
-            serial_free(serial_array[i]);
-        }
+    if (device_loop) {
+        ev_stat_stop(device_loop, &conf_watcher);
+        ev_timer_stop(device_loop, &reload_timer);
     }
 
-    for (i=0; i<usb_idx; i++) {
-        if (usb_array[i]) {
-            usb_close(usb_array[i]);
-            usb_free(usb_array[i]);
-        }
-    }
+    for (i=0; i<aw5808_idx; i++)
+        device_aw5808_close(i);
 
-    for (i=0; i<wifi_idx; i++) {
-        if (wifi_array[i]) {
-            wifi_close(wifi_array[i]);
-            wifi_free(wifi_array[i]);
-        }
-    }
+    for (i=0; i<uband_idx; i++)
+        device_uband_close(i);
+
+    for (i=0; i<serial_idx; i++)
+        device_serial_close(i);
+
+    for (i=0; i<usb_idx; i++)
+        device_usb_close(i);
+
+    for (i=0; i<wifi_idx; i++)
+        device_wifi_close(i);
+
+    for (i=0; i<gpio_idx; i++)
+        device_gpio_close(i);
+
+    for (i=0; i<input_idx; i++)
+        device_input_close(i);
+
+    for (i=0; i<pwm_idx; i++)
+        device_pwm_close(i);
+
+    for (i=0; i<led_idx; i++)
+        device_led_close(i);
+
+    for (i=0; i<thermal_idx; i++)
+        device_thermal_close(i);
+
+    for (i=0; i<cpufreq_idx; i++)
+        device_cpufreq_close(i);
 
     usb_exit();
 }
 
 aw5808_t *get_aw5808(int index)
 {
-    if(index >= aw5808_idx)
+    if(index < 0 || index >= aw5808_idx)
         return NULL;
 
     return aw5808_array[index];
 }
 
+uband_t *get_uband(int index)
+{
+    if(index < 0 || index >= uband_idx)
+        return NULL;
+
+    return uband_array[index];
+}
+
 serial_t *get_serial(int index)
 {
-    if(index >= serial_idx)
+    if(index < 0 || index >= serial_idx)
         return NULL;
 
     return serial_array[index];
 }
 
+const char *get_serial_codec(int index)
+{
+    if(index < 0 || index >= serial_idx || serial_slot[index].opt.serial.codec[0] == '\0')
+        return NULL;
+
+    return serial_slot[index].opt.serial.codec;
+}
+
 usb_t *get_usb(int index)
 {
-    if(index >= usb_idx)
+    if(index < 0 || index >= usb_idx)
         return NULL;
 
     return usb_array[index];
@@ -218,8 +1318,56 @@ usb_t *get_usb(int index)
 
 wifi_t *get_wifi(int index)
 {
-    if(index >= wifi_idx)
+    if(index < 0 || index >= wifi_idx)
         return NULL;
 
     return wifi_array[index];
+}
+
+gpio_t *get_gpio(int index)
+{
+    if(index < 0 || index >= gpio_idx)
+        return NULL;
+
+    return gpio_array[index];
+}
+
+input_t *get_input(int index)
+{
+    if(index < 0 || index >= input_idx)
+        return NULL;
+
+    return input_array[index];
+}
+
+pwm_t *get_pwm(int index)
+{
+    if(index < 0 || index >= pwm_idx)
+        return NULL;
+
+    return pwm_array[index];
+}
+
+led_t *get_led(int index)
+{
+    if(index < 0 || index >= led_idx)
+        return NULL;
+
+    return led_array[index];
+}
+
+thermal_t *get_thermal(int index)
+{
+    if(index < 0 || index >= thermal_idx)
+        return NULL;
+
+    return thermal_array[index];
+}
+
+cpufreq_t *get_cpufreq(int index)
+{
+    if(index < 0 || index >= cpufreq_idx)
+        return NULL;
+
+    return cpufreq_array[index];
 }
\ No newline at end of file
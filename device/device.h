@@ -2,15 +2,47 @@
 #define __DEVICE_H__
 
 #include "aw5808.h"
+#include "uband.h"
 #include "serial.h"
 #include "usb.h"
 #include "wifi.h"
+#include "gpio.h"
+#include "input.h"
+#include "pwm.h"
+#include "led.h"
+#include "thermal.h"
+#include "cpufreq.h"
+#include "list.h"
 
-int devices_init(struct ev_loop *loop, const char *conf_file);
+#define DEVICE_MAX_NUM  (8)
+
+struct devices_client_ops {
+    /* after a config reload, on the loop; device pointers and indexes taken before are stale */
+    void (*on_reload)(void);
+};
+
+struct devices_client {
+    char name[64];
+    struct devices_client_ops *ops;
+    struct list_head list;
+};
+
+int devices_init(struct ev_loop *loop, const char *conf_file, const char *snapshot);
 void devices_exit(void);
+int devices_reload(void);
+int devices_add_client(struct devices_client *client);
+void devices_remove_client(struct devices_client *client);
 aw5808_t *get_aw5808(int index);
+uband_t *get_uband(int index);
 serial_t *get_serial(int index);
+const char *get_serial_codec(int index);
 usb_t *get_usb(int index);
 wifi_t *get_wifi(int index);
+gpio_t *get_gpio(int index);
+input_t *get_input(int index);
+pwm_t *get_pwm(int index);
+led_t *get_led(int index);
+thermal_t *get_thermal(int index);
+cpufreq_t *get_cpufreq(int index);
 
 #endif
\ No newline at end of file
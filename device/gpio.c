@@ -0,0 +1,475 @@
+#define LOG_MODULE_NAME "gpio"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include <ev.h>
+
+#include "list.h"
+#include "gpio.h"
+#include "log.h"
+#include "utils.h"
+#include "metrics.h"
+#include "evprof.h"
+
+#define GPIO_CONSUMER_DEFAULT   "devctl"
+#define GPIO_EVENT_BUFFER       (1024)      /* kernel fifo, events */
+#define GPIO_EVENT_BATCH        (64)        /* events per read() */
+
+struct gpio_handle {
+    char name[64];                      /* chip name, e.g. gpiochip0 */
+    char path[80];
+    struct ev_loop *loop;
+    int chip_fd;
+    int req_fd;
+    /* requested lines, inputs first, request index == bit in values/masks */
+    unsigned int offsets[GPIO_MAX_LINES];
+    struct gpio_line lines[GPIO_MAX_LINES];
+    int nlines;
+    int ninputs;
+    gpio_options_t opt;
+    /* req_fd, get/set may come from other threads than the loop */
+    pthread_mutex_t lock;
+    ev_io iow;
+    uint32_t seqno;                     /* last event */
+
+    struct list_head clients;
+    struct {
+        metric_t *events;
+        metric_t *dropped;
+        metric_t *ioctl;
+    } stats;
+    /* error handle */
+    struct {
+        int c_errno;
+        char errmsg[96];
+    } error;
+};
+
+static int _error(gpio_t *gpio, int code, int c_errno, const char *fmt, ...)
+{
+    va_list ap;
+
+    gpio->error.c_errno = c_errno;
+
+    va_start(ap, fmt);
+    vsnprintf(gpio->error.errmsg, sizeof(gpio->error.errmsg), fmt, ap);
+    va_end(ap);
+
+    if (c_errno) {
+        char buf[64];
+        strerror_r(c_errno, buf, sizeof(buf));
+        snprintf(gpio->error.errmsg+strlen(gpio->error.errmsg), sizeof(gpio->error.errmsg)-strlen(gpio->error.errmsg), ": %s [errno %d]", buf, c_errno);
+    }
+
+    return code;
+}
+
+static void stats_init(gpio_t *gpio)
+{
+    gpio->stats.events = metric_get(METRIC_COUNTER, "devctl_gpio_events_total",
+                                    "Edge events read", "device", gpio->name, NULL);
+    gpio->stats.dropped = metric_get(METRIC_COUNTER, "devctl_gpio_dropped_events_total",
+                                     "Edge events lost to a full kernel fifo", "device", gpio->name, NULL);
+    gpio->stats.ioctl = metric_get(METRIC_HISTOGRAM, "devctl_gpio_ioctl_seconds",
+                                   "Line value get/set ioctl time", "device", gpio->name, NULL);
+}
+
+/* by path, then by chip name or label over /dev/gpiochip* */
+static int chip_open(gpio_t *gpio, const char *chip)
+{
+    struct gpiochip_info info;
+    struct dirent *de;
+    DIR *dir;
+    int fd;
+
+    if (chip[0] == '/') {
+        if ((fd = open(chip, O_RDWR | O_CLOEXEC)) < 0)
+            return -1;
+        snprintf(gpio->path, sizeof(gpio->path), "%s", chip);
+        return fd;
+    }
+
+    if ((dir = opendir("/dev")) == NULL)
+        return -1;
+    fd = -1;
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, "gpiochip", strlen("gpiochip")) || strlen(de->d_name) >= 64)
+            continue;
+        snprintf(gpio->path, sizeof(gpio->path), "/dev/%s", de->d_name);
+        if ((fd = open(gpio->path, O_RDWR | O_CLOEXEC)) < 0)
+            continue;
+        memset(&info, 0, sizeof(info));
+        if (ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) == 0 &&
+                (!strcmp(info.name, chip) || !strcmp(info.label, chip)))
+            break;
+        close(fd);
+        fd = -1;
+    }
+    closedir(dir);
+    if (fd < 0)
+        errno = ENOENT;
+    return fd;
+}
+
+static uint64_t line_mask(int first, int count)
+{
+    if (count <= 0)
+        return 0;
+    return (count >= 64 ? ~0ULL : (1ULL << count) - 1) << first;
+}
+
+static void line_config(gpio_t *gpio, const gpio_options_t *opt, uint64_t out_values,
+                        struct gpio_v2_line_config *cfg)
+{
+    uint64_t inputs = line_mask(0, gpio->ninputs);
+    uint64_t outputs = line_mask(gpio->ninputs, gpio->nlines - gpio->ninputs);
+    uint64_t flags = GPIO_V2_LINE_FLAG_INPUT;
+    struct gpio_v2_line_config_attribute *attr;
+
+    switch (opt->edge) {
+    case GPIO_EDGE_RISING:  flags |= GPIO_V2_LINE_FLAG_EDGE_RISING; break;
+    case GPIO_EDGE_FALLING: flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING; break;
+    case GPIO_EDGE_BOTH:    flags |= GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING; break;
+    default: break;
+    }
+    switch (opt->bias) {
+    case GPIO_BIAS_DISABLED:    flags |= GPIO_V2_LINE_FLAG_BIAS_DISABLED; break;
+    case GPIO_BIAS_PULL_UP:     flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP; break;
+    case GPIO_BIAS_PULL_DOWN:   flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN; break;
+    default: break;
+    }
+    if (opt->active_low)
+        flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+
+    /* the default flags describe the inputs, attributes override the outputs */
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->flags = flags;
+    if (outputs) {
+        attr = &cfg->attrs[cfg->num_attrs++];
+        attr->attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+        attr->attr.flags = GPIO_V2_LINE_FLAG_OUTPUT | (opt->active_low ? GPIO_V2_LINE_FLAG_ACTIVE_LOW : 0);
+        attr->mask = outputs;
+        attr = &cfg->attrs[cfg->num_attrs++];
+        attr->attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+        attr->attr.values = out_values & outputs;
+        attr->mask = outputs;
+    }
+    if (inputs && opt->debounce_us) {
+        attr = &cfg->attrs[cfg->num_attrs++];
+        attr->attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+        attr->attr.debounce_period_us = opt->debounce_us;
+        attr->mask = inputs;
+    }
+}
+
+static void lines_info(gpio_t *gpio)
+{
+    struct gpio_v2_line_info info;
+    int i;
+
+    for (i=0; i<gpio->nlines; i++) {
+        gpio->lines[i].offset = gpio->offsets[i];
+        gpio->lines[i].output = i >= gpio->ninputs;
+        memset(&info, 0, sizeof(info));
+        info.offset = gpio->offsets[i];
+        if (ioctl(gpio->chip_fd, GPIO_V2_GET_LINEINFO_IOCTL, &info) == 0)
+            snprintf(gpio->lines[i].name, sizeof(gpio->lines[i].name), "%s", info.name);
+    }
+}
+
+static int line_index(gpio_t *gpio, unsigned int offset)
+{
+    int i;
+
+    for (i=0; i<gpio->nlines; i++) {
+        if (gpio->offsets[i] == offset)
+            return i;
+    }
+    return -1;
+}
+
+static void gpio_read_cb(struct ev_loop *loop, struct ev_io *w, int revents)
+{
+    gpio_t *gpio = container_of(w, gpio_t, iow);
+    struct gpio_v2_line_event raw[GPIO_EVENT_BATCH];
+    struct gpio_event events[GPIO_EVENT_BATCH];
+    struct gpio_client *client, *tmp;
+    ssize_t n;
+    int i, count;
+
+    /* a whole batch in one read, the kernel only returns complete events */
+    if ((n = read(gpio->req_fd, raw, sizeof(raw))) <= 0) {
+        if (n < 0 && errno != EAGAIN && errno != EINTR)
+            log_error("%s read events: %s", gpio->name, strerror(errno));
+        return;
+    }
+    count = n / sizeof(raw[0]);
+    for (i=0; i<count; i++) {
+        events[i].line = raw[i].offset;
+        events[i].rising = raw[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+        events[i].timestamp_ns = raw[i].timestamp_ns;
+        events[i].seqno = raw[i].seqno;
+        events[i].line_seqno = raw[i].line_seqno;
+        /* seqno counts the events the fifo had no room for too */
+        if (raw[i].seqno > gpio->seqno + 1)
+            metric_add(gpio->stats.dropped, raw[i].seqno - gpio->seqno - 1);
+        gpio->seqno = raw[i].seqno;
+    }
+    metric_add(gpio->stats.events, count);
+
+    list_for_each_entry_safe(client, tmp, &gpio->clients, list) {
+        if (client->ops->on_event)
+            client->ops->on_event(gpio, events, count);
+    }
+}
+
+const char *gpio_errmsg(gpio_t *gpio)
+{
+    return gpio->error.errmsg;
+}
+
+int gpio_errno(gpio_t *gpio)
+{
+    return gpio->error.c_errno;
+}
+
+gpio_t *gpio_new(void)
+{
+    gpio_t *gpio = calloc(1, sizeof(gpio_t));
+    if (!gpio)
+        return NULL;
+    gpio->chip_fd = -1;
+    gpio->req_fd = -1;
+    pthread_mutex_init(&gpio->lock, NULL);
+    INIT_LIST_HEAD(&gpio->clients);
+    return gpio;
+}
+
+void gpio_free(gpio_t *gpio)
+{
+    struct gpio_client *client, *tmp;
+
+    if (!gpio)
+        return;
+    gpio_close(gpio);
+    list_for_each_entry_safe(client, tmp, &gpio->clients, list)
+        list_del_init(&client->list);
+    pthread_mutex_destroy(&gpio->lock);
+    free(gpio);
+}
+
+int gpio_open(gpio_t *gpio, gpio_options_t *opt)
+{
+    struct gpio_v2_line_request req;
+    struct gpiochip_info info;
+    int i;
+
+    if (opt->chip[0] == '\0' || !opt->loop || opt->ninputs < 0 || opt->noutputs < 0 ||
+            opt->ninputs + opt->noutputs == 0 || opt->ninputs + opt->noutputs > GPIO_MAX_LINES)
+        return _error(gpio, GPIO_ERROR_ARG, 0, "No gpio chip or lines");
+
+    gpio->nlines = 0;
+    for (i=0; i<opt->ninputs; i++)
+        gpio->offsets[gpio->nlines++] = opt->inputs[i];
+    gpio->ninputs = gpio->nlines;
+    for (i=0; i<opt->noutputs; i++)
+        gpio->offsets[gpio->nlines++] = opt->outputs[i];
+    for (i=0; i<gpio->nlines; i++) {
+        if (line_index(gpio, gpio->offsets[i]) != i)
+            return _error(gpio, GPIO_ERROR_ARG, 0, "Line %u requested twice", gpio->offsets[i]);
+    }
+
+    if ((gpio->chip_fd = chip_open(gpio, opt->chip)) < 0)
+        return _error(gpio, GPIO_ERROR_OPEN, errno, "Opening gpio chip %s", opt->chip);
+    memset(&info, 0, sizeof(info));
+    if (ioctl(gpio->chip_fd, GPIO_GET_CHIPINFO_IOCTL, &info) < 0) {
+        _error(gpio, GPIO_ERROR_OPEN, errno, "Querying gpio chip %s", gpio->path);
+        goto fail;
+    }
+    snprintf(gpio->name, sizeof(gpio->name), "%s", info.name);
+
+    memset(&req, 0, sizeof(req));
+    memcpy(req.offsets, gpio->offsets, gpio->nlines * sizeof(req.offsets[0]));
+    snprintf(req.consumer, sizeof(req.consumer), "%s", opt->consumer[0] ? opt->consumer : GPIO_CONSUMER_DEFAULT);
+    req.num_lines = gpio->nlines;
+    req.event_buffer_size = GPIO_EVENT_BUFFER;
+    line_config(gpio, opt, 0, &req.config);
+    if (ioctl(gpio->chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+        _error(gpio, GPIO_ERROR_OPEN, errno, "Requesting %d lines of %s", gpio->nlines, gpio->name);
+        goto fail;
+    }
+    gpio->req_fd = req.fd;
+    fcntl(gpio->req_fd, F_SETFL, fcntl(gpio->req_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(gpio->req_fd, F_SETFD, FD_CLOEXEC);
+
+    gpio->opt = *opt;
+    gpio->loop = opt->loop;
+    gpio->seqno = 0;
+    lines_info(gpio);
+    stats_init(gpio);
+    ev_io_init(&gpio->iow, gpio_read_cb, gpio->req_fd, EV_READ);
+    evprof_watch(&gpio->iow, "gpio.event", gpio->name);
+    ev_io_start(gpio->loop, &gpio->iow);
+    return 0;
+
+fail:
+    close(gpio->chip_fd);
+    gpio->chip_fd = -1;
+    return GPIO_ERROR_OPEN;
+}
+
+void gpio_close(gpio_t *gpio)
+{
+    if (gpio->req_fd < 0)
+        return;
+    ev_io_stop(gpio->loop, &gpio->iow);
+    pthread_mutex_lock(&gpio->lock);
+    close(gpio->req_fd);
+    gpio->req_fd = -1;
+    pthread_mutex_unlock(&gpio->lock);
+    close(gpio->chip_fd);
+    gpio->chip_fd = -1;
+}
+
+/* request bits of lines, every line when lines is NULL */
+static int lines_mask(gpio_t *gpio, const unsigned int *lines, int count, int *index, bool output)
+{
+    int i, idx;
+
+    for (i=0; i<count; i++) {
+        idx = lines ? line_index(gpio, lines[i]) : i;
+        if (idx < 0 || idx >= gpio->nlines)
+            return _error(gpio, GPIO_ERROR_ARG, 0, "Line %u not requested", lines ? lines[i] : i);
+        if (output && idx < gpio->ninputs)
+            return _error(gpio, GPIO_ERROR_ARG, 0, "Line %u is an input", gpio->offsets[idx]);
+        index[i] = idx;
+    }
+    return 0;
+}
+
+int gpio_get_values(gpio_t *gpio, const unsigned int *lines, int *values, int count)
+{
+    struct gpio_v2_line_values lv = {0};
+    int index[GPIO_MAX_LINES];
+    uint64_t start;
+    int i, ret;
+
+    if (count <= 0 || count > GPIO_MAX_LINES || !values)
+        return _error(gpio, GPIO_ERROR_ARG, 0, "Invalid line count %d", count);
+    if ((ret = lines_mask(gpio, lines, count, index, false)) != 0)
+        return ret;
+    for (i=0; i<count; i++)
+        lv.mask |= 1ULL << index[i];
+
+    pthread_mutex_lock(&gpio->lock);
+    start = metric_now();
+    ret = gpio->req_fd < 0 ? -1 : ioctl(gpio->req_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &lv);
+    metric_observe(gpio->stats.ioctl, metric_now() - start);
+    pthread_mutex_unlock(&gpio->lock);
+    if (ret < 0)
+        return _error(gpio, GPIO_ERROR_IO, gpio->req_fd < 0 ? EBADF : errno, "Getting %d line values", count);
+
+    for (i=0; i<count; i++)
+        values[i] = (lv.bits >> index[i]) & 1;
+    return 0;
+}
+
+int gpio_set_values(gpio_t *gpio, const unsigned int *lines, const int *values, int count)
+{
+    struct gpio_v2_line_values lv = {0};
+    int index[GPIO_MAX_LINES];
+    uint64_t start;
+    int i, ret;
+
+    if (count <= 0 || count > GPIO_MAX_LINES || !values)
+        return _error(gpio, GPIO_ERROR_ARG, 0, "Invalid line count %d", count);
+    if (!lines)
+        return _error(gpio, GPIO_ERROR_ARG, 0, "No lines to set");
+    if ((ret = lines_mask(gpio, lines, count, index, true)) != 0)
+        return ret;
+    for (i=0; i<count; i++) {
+        lv.mask |= 1ULL << index[i];
+        if (values[i])
+            lv.bits |= 1ULL << index[i];
+    }
+
+    pthread_mutex_lock(&gpio->lock);
+    start = metric_now();
+    ret = gpio->req_fd < 0 ? -1 : ioctl(gpio->req_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &lv);
+    metric_observe(gpio->stats.ioctl, metric_now() - start);
+    pthread_mutex_unlock(&gpio->lock);
+    if (ret < 0)
+        return _error(gpio, GPIO_ERROR_IO, gpio->req_fd < 0 ? EBADF : errno, "Setting %d line values", count);
+    return 0;
+}
+
+int gpio_reconfigure(gpio_t *gpio, const gpio_options_t *opt)
+{
+    struct gpio_v2_line_values lv = {0};
+    struct gpio_v2_line_config cfg;
+    int ret = 0;
+
+    if (gpio->req_fd < 0)
+        return _error(gpio, GPIO_ERROR_ARG, 0, "Gpio not open");
+
+    pthread_mutex_lock(&gpio->lock);
+    /* SET_CONFIG sets the outputs too, hand back what they are driving now */
+    lv.mask = line_mask(gpio->ninputs, gpio->nlines - gpio->ninputs);
+    if (lv.mask && ioctl(gpio->req_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &lv) < 0)
+        ret = _error(gpio, GPIO_ERROR_CONFIG, errno, "Reading outputs of %s", gpio->name);
+    if (ret == 0) {
+        /* bits are logical, flipping active_low keeps the physical level */
+        if (opt->active_low != gpio->opt.active_low)
+            lv.bits = ~lv.bits;
+        line_config(gpio, opt, lv.bits, &cfg);
+        if (ioctl(gpio->req_fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &cfg) < 0)
+            ret = _error(gpio, GPIO_ERROR_CONFIG, errno, "Reconfiguring %s", gpio->name);
+    }
+    pthread_mutex_unlock(&gpio->lock);
+    if (ret)
+        return ret;
+
+    gpio->opt.edge = opt->edge;
+    gpio->opt.bias = opt->bias;
+    gpio->opt.active_low = opt->active_low;
+    gpio->opt.debounce_us = opt->debounce_us;
+    return 0;
+}
+
+int gpio_lines(gpio_t *gpio, struct gpio_line *lines, int max)
+{
+    int n = gpio->nlines < max ? gpio->nlines : max;
+
+    memcpy(lines, gpio->lines, n * sizeof(lines[0]));
+    return n;
+}
+
+int gpio_add_client(gpio_t *gpio, struct gpio_client *client)
+{
+    if (!client || !client->ops)
+        return -1;
+    list_add_tail(&client->list, &gpio->clients);
+    return 0;
+}
+
+void gpio_remove_client(gpio_t *gpio, struct gpio_client *client)
+{
+    if (!client)
+        return;
+    list_del_init(&client->list);
+}
+
+const char *gpio_name(gpio_t *gpio)
+{
+    return gpio->name;
+}
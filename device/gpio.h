@@ -0,0 +1,95 @@
+#ifndef __GPIO_H__
+#define __GPIO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <ev.h>
+#include "list.h"
+
+enum gpio_error_code {
+    GPIO_ERROR_ARG              = -1, /* Invalid arguments */
+    GPIO_ERROR_OPEN             = -2, /* Opening gpio chip or requesting lines */
+    GPIO_ERROR_IO               = -3, /* Getting/setting line values */
+    GPIO_ERROR_CONFIG           = -4, /* Reconfiguring lines */
+};
+
+enum gpio_edge {
+    GPIO_EDGE_NONE = 0,
+    GPIO_EDGE_RISING,
+    GPIO_EDGE_FALLING,
+    GPIO_EDGE_BOTH,
+};
+
+enum gpio_bias {
+    GPIO_BIAS_AS_IS = 0,
+    GPIO_BIAS_DISABLED,
+    GPIO_BIAS_PULL_UP,
+    GPIO_BIAS_PULL_DOWN,
+};
+
+#define GPIO_MAX_LINES      (64)    /* lines in one request, GPIO_V2_LINES_MAX */
+
+typedef struct gpio_handle gpio_t;
+
+/*
+ * All lines of a device are taken in one /dev/gpiochipN line request, so
+ * values of any subset are read or written with a single ioctl. Edge,
+ * bias and debounce apply to the inputs, active_low to every line.
+ */
+typedef struct gpio_options {
+    char chip[64];                  /* /dev/gpiochipN, gpiochipN or chip label */
+    char consumer[32];              /* optional, default "devctl" */
+    unsigned int inputs[GPIO_MAX_LINES];    /* line offsets */
+    int ninputs;
+    unsigned int outputs[GPIO_MAX_LINES];
+    int noutputs;
+    enum gpio_edge edge;
+    enum gpio_bias bias;
+    bool active_low;
+    uint32_t debounce_us;           /* optional, 0: off */
+    struct ev_loop *loop;
+} gpio_options_t;
+
+struct gpio_event {
+    unsigned int line;              /* offset */
+    bool rising;
+    uint64_t timestamp_ns;          /* CLOCK_MONOTONIC, taken by the kernel */
+    uint32_t seqno;                 /* across the lines of the device */
+    uint32_t line_seqno;
+};
+
+struct gpio_line {
+    unsigned int offset;
+    char name[32];
+    bool output;
+};
+
+struct gpio_client_ops {
+    /* every event read in one wakeup, oldest first */
+    void (*on_event)(gpio_t *gpio, const struct gpio_event *events, int count);
+};
+
+struct gpio_client {
+    char name[64];
+    struct gpio_client_ops *ops;
+    struct list_head list;
+};
+
+gpio_t *gpio_new(void);
+void gpio_free(gpio_t *gpio);
+int gpio_open(gpio_t *gpio, gpio_options_t *opt);
+void gpio_close(gpio_t *gpio);
+/* lines NULL: every requested line in gpio_lines() order */
+int gpio_get_values(gpio_t *gpio, const unsigned int *lines, int *values, int count);
+/* outputs only */
+int gpio_set_values(gpio_t *gpio, const unsigned int *lines, const int *values, int count);
+/* edge, bias, active_low and debounce in place, outputs keep their values */
+int gpio_reconfigure(gpio_t *gpio, const gpio_options_t *opt);
+int gpio_lines(gpio_t *gpio, struct gpio_line *lines, int max);
+int gpio_add_client(gpio_t *gpio, struct gpio_client *client);
+void gpio_remove_client(gpio_t *gpio, struct gpio_client *client);
+const char *gpio_name(gpio_t *gpio);
+const char *gpio_errmsg(gpio_t *gpio);
+int gpio_errno(gpio_t *gpio);
+
+#endif
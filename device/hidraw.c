@@ -1,3 +1,5 @@
+#define LOG_MODULE_NAME "hidraw"
+
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -22,10 +24,20 @@
 #include "io_channel.h"
 #include "iobuf.h"
 #include "utils.h"
+#include "trace.h"
+#include "metrics.h"
+#include "evprof.h"
 
 struct hidraw_handle {
     char ident[64];
     int fd;
+    int trace_id;
+    uint64_t rx_time;               /* CLOCK_MONOTONIC ns, last read with data */
+    struct {
+        metric_t *rx_bytes;
+        metric_t *tx_bytes;
+        metric_t *errors;
+    } stats;
     struct ev_loop *loop;
     struct io_channel io;
 
@@ -75,6 +87,11 @@ int hidraw_fd(hidraw_t *hidraw)
     return hidraw->fd;
 }
 
+uint64_t hidraw_rx_time(hidraw_t *hidraw)
+{
+    return hidraw->rx_time;
+}
+
 hidraw_t *hidraw_new()
 {
     hidraw_t *hidraw = calloc(1, sizeof(hidraw_t));
@@ -82,11 +99,17 @@ hidraw_t *hidraw_new()
         return NULL;
 
     hidraw->fd = -1;
+    hidraw->trace_id = -1;
+    INIT_LIST_HEAD(&hidraw->clients);
     return hidraw;
 }
 
 void hidraw_free(hidraw_t *hidraw)
 {
+    struct hidraw_client *client, *tmp;
+
+    list_for_each_entry_safe(client, tmp, &hidraw->clients, list)
+        list_del_init(&client->list);
     free(hidraw);
 }
 
@@ -100,7 +123,6 @@ static void _hidraw_write_cb(struct ev_loop *loop, struct ev_io *w, int revents)
     ssize_t remain = len;
     bool nonblock = fd_is_nonblock(hidraw->fd);
 
-    //iobuf_dump(wbuf, wbuf->len);
     do {
         n = write(hidraw->fd, buf, remain);
         if (unlikely(n < 0)) {
@@ -111,8 +133,11 @@ static void _hidraw_write_cb(struct ev_loop *loop, struct ev_io *w, int revents)
                 break;
             
             log_error("Writing data %s", strerror(errno));
+            metric_add(hidraw->stats.errors, 1);
             return;
         }
+        trace_record(hidraw->trace_id, TRACE_TX, buf, n);
+        metric_add(hidraw->stats.tx_bytes, n);
         remain -= n;
         iobuf_del(wbuf, 0, (size_t) n);
     } while (remain && nonblock);
@@ -151,21 +176,34 @@ static void _hidraw_read_cb(struct ev_loop *loop, struct ev_io *w, int revents)
             if (errno == EAGAIN || errno == ENOTCONN)
                 break;
             log_error("hidraw read: %s", strerror(errno));
+            metric_add(hidraw->stats.errors, 1);
             return;
         }
         if (ret == 0)
             break;
+        hidraw->rx_time = metric_now();
+        trace_record(hidraw->trace_id, TRACE_RX, buf, ret);
+        metric_add(hidraw->stats.rx_bytes, ret);
         rbuf->len += ret;
         remain -= ret;
     } while (remain && nonblock);
-    
-    //iobuf_dump(rbuf, rbuf->len);
-/*
-    if(hidraw->cbs->on_read) {
-        int len = hidraw->cbs->on_read(hidraw, rbuf->buf, rbuf->len);
-        iobuf_del(rbuf, 0, len);
+
+    /* same as serial, without any client reports are dropped */
+    struct hidraw_client *client;
+    int len = 0, max_len = 0;
+    if (list_empty(&hidraw->clients)) {
+        max_len = rbuf->len;
+    } else {
+        list_for_each_entry(client, &hidraw->clients, list) {
+            if (client->ops->on_receive) {
+                len = client->ops->on_receive(hidraw, rbuf->buf, rbuf->len);
+                if (len > max_len)
+                    max_len = len;
+            }
+        }
     }
-*/
+
+    iobuf_del(rbuf, 0, max_len);
 }
 
 int hidraw_open(hidraw_t *hidraw, const char *path, uint16_t vendor_id, uint16_t product_id, const char *name, struct ev_loop *loop)
@@ -197,19 +235,24 @@ int hidraw_open(hidraw_t *hidraw, const char *path, uint16_t vendor_id, uint16_t
             }
 
             memset(buf, 0x0, sizeof(buf));
-            ret = ioctl(fd, HIDIOCGRAWPHYS(256), buf);
-            if (ret < 0)
+            ret = ioctl(fd, HIDIOCGRAWPHYS(sizeof(buf)), buf);
+            if (ret < 0) {
+                close(fd);
                 continue;
+            }
 
             memset(&info, 0x0, sizeof(info));
             ret = ioctl(fd, HIDIOCGRAWINFO, &info);
-            if (ret < 0)
+            if (ret < 0) {
+                close(fd);
                 continue;
+            }
 
             if ((info.vendor & 0xFFFF) == vendor_id && (info.product & 0xFFFF) == product_id) {
-                if (name) {
+                if (name && name[0]) {
                     if (!strncmp(buf, name, strlen(name)))
                         break;
+                    close(fd);
                 } else {
                     break;
                 }
@@ -217,17 +260,28 @@ int hidraw_open(hidraw_t *hidraw, const char *path, uint16_t vendor_id, uint16_t
                 close(fd);
             }
         }
-        if (i >= globres.gl_pathc)
+        if (i >= globres.gl_pathc) {
+            globfree(&globres);
             return _error(hidraw, HID_ERROR_OPEN, 0, "Searching hidraw device %x-%x", vendor_id, product_id);
+        }
         snprintf(hidraw->ident, sizeof(hidraw->ident)-1, "%s (%s)", globres.gl_pathv[i], buf);
         globfree(&globres);
     }
     hidraw->fd = fd;
     hidraw->loop = loop;
+    hidraw->trace_id = trace_register(hidraw->ident, TRACE_LINK_HIDRAW);
+    hidraw->stats.rx_bytes = metric_get(METRIC_COUNTER, "devctl_hidraw_rx_bytes_total",
+                                        "Bytes read from hidraw device", "device", hidraw->ident, NULL);
+    hidraw->stats.tx_bytes = metric_get(METRIC_COUNTER, "devctl_hidraw_tx_bytes_total",
+                                        "Bytes written to hidraw device", "device", hidraw->ident, NULL);
+    hidraw->stats.errors = metric_get(METRIC_COUNTER, "devctl_hidraw_errors_total",
+                                      "Hidraw device I/O errors", "device", hidraw->ident, NULL);
     iobuf_init(&hidraw->io.wbuf, IO_SIZE);
     iobuf_init(&hidraw->io.rbuf, IO_SIZE);
     ev_io_init(&hidraw->io.iow, _hidraw_write_cb, hidraw->fd, EV_WRITE);
     ev_io_init(&hidraw->io.ior, _hidraw_read_cb, hidraw->fd, EV_READ);
+    evprof_watch(&hidraw->io.iow, "hidraw.write", hidraw->ident);
+    evprof_watch(&hidraw->io.ior, "hidraw.read", hidraw->ident);
     ev_io_start(hidraw->loop, &hidraw->io.ior);
     return 0;
 }
@@ -267,6 +321,10 @@ ssize_t hidraw_read(hidraw_t *hidraw, uint8_t *buf, size_t len, int timeout_ms)
 
         if ((ret = read(hidraw->fd, buf + bytes_read, len - bytes_read)) < 0)
             return _error(hidraw, HID_ERROR_IO, errno, "Reading hidraw device");
+        if (ret > 0)
+            hidraw->rx_time = metric_now();
+        trace_record(hidraw->trace_id, TRACE_RX, buf + bytes_read, ret);
+        metric_add(hidraw->stats.rx_bytes, ret);
 
         /* Empty read */
         if (ret == 0 && len != 0)
@@ -304,7 +362,7 @@ int hidraw_close(hidraw_t *hidraw)
     ev_io_stop(hidraw->loop, &hidraw->io.ior);
     ev_io_stop(hidraw->loop, &hidraw->io.iow);
     iobuf_free(&hidraw->io.rbuf);
-    iobuf_free(&hidraw->io.rbuf);
+    iobuf_free(&hidraw->io.wbuf);
 
     memset(hidraw->ident, 0, sizeof(hidraw->ident));
     if (close(hidraw->fd) < 0)
@@ -32,6 +32,8 @@ int hidraw_close(hidraw_t *hidraw);
 ssize_t hidraw_write(hidraw_t *hidraw, const uint8_t *buf, size_t len);
 ssize_t hidraw_read(hidraw_t *hidraw, uint8_t *buf, size_t len, int timeout_ms);
 void hidraw_free(hidraw_t *hidraw);
+int hidraw_add_client(hidraw_t *hidraw, struct hidraw_client *client);
+void hidraw_remove_client(hidraw_t *hidraw, struct hidraw_client *client);
 
 /* Error Handling */
 const char *hidraw_errmsg(hidraw_t *hidraw);
@@ -39,4 +41,6 @@ int hidraw_errno(hidraw_t *hidraw);
 
 int hidraw_fd(hidraw_t *hidraw);
 const char* hidraw_id(hidraw_t *hidraw);
+/* CLOCK_MONOTONIC ns of the read that delivered the reports being dispatched */
+uint64_t hidraw_rx_time(hidraw_t *hidraw);
 #endif
\ No newline at end of file
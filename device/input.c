@@ -0,0 +1,399 @@
+#define LOG_MODULE_NAME "input"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <ev.h>
+
+#include "list.h"
+#include "input.h"
+#include "log.h"
+#include "utils.h"
+#include "metrics.h"
+#include "evprof.h"
+
+#define INPUT_DIR           "/dev/input"
+#define INPUT_RECORD_BUF    (64 * 1024)     /* stdio buffer of the recording */
+
+struct input_handle {
+    char ident[200];
+    char path[64];                      /* opened, may differ from opt.path */
+    char name[128];
+    char phys[64];
+    struct input_id id;
+    /* io */
+    struct ev_loop *loop;
+    int fd;
+    ev_io iow;
+    ev_timer retry;                     /* device lost, look for it again */
+    input_options_t opt;
+    FILE *record;
+
+    struct list_head clients;
+    struct {
+        metric_t *events;
+        metric_t *reads;
+        metric_t *dropped;
+        metric_t *recorded;
+    } stats;
+    /* error handle */
+    struct {
+        int c_errno;
+        char errmsg[96];
+    } error;
+};
+
+static int _error(input_t *input, int code, int c_errno, const char *fmt, ...)
+{
+    va_list ap;
+
+    input->error.c_errno = c_errno;
+
+    va_start(ap, fmt);
+    vsnprintf(input->error.errmsg, sizeof(input->error.errmsg), fmt, ap);
+    va_end(ap);
+
+    if (c_errno) {
+        char buf[64];
+        strerror_r(c_errno, buf, sizeof(buf));
+        snprintf(input->error.errmsg+strlen(input->error.errmsg), sizeof(input->error.errmsg)-strlen(input->error.errmsg), ": %s [errno %d]", buf, c_errno);
+    }
+
+    return code;
+}
+
+static void stats_init(input_t *input)
+{
+    input->stats.events = metric_get(METRIC_COUNTER, "devctl_input_events_total",
+                                     "Input events read", "device", input->name, NULL);
+    input->stats.reads = metric_get(METRIC_COUNTER, "devctl_input_reads_total",
+                                    "read() calls returning events", "device", input->name, NULL);
+    input->stats.dropped = metric_get(METRIC_COUNTER, "devctl_input_dropped_total",
+                                      "SYN_DROPPED, the evdev client buffer overflowed", "device", input->name, NULL);
+    input->stats.recorded = metric_get(METRIC_COUNTER, "devctl_input_recorded_total",
+                                       "Input events written to the recording", "device", input->name, NULL);
+}
+
+static bool device_match(int fd, const input_options_t *opt)
+{
+    char buf[128];
+
+    if (opt->name[0]) {
+        memset(buf, 0, sizeof(buf));
+        if (ioctl(fd, EVIOCGNAME(sizeof(buf) - 1), buf) < 0 || strcmp(buf, opt->name))
+            return false;
+    }
+    if (opt->phys[0]) {
+        memset(buf, 0, sizeof(buf));
+        if (ioctl(fd, EVIOCGPHYS(sizeof(buf) - 1), buf) < 0 || strcmp(buf, opt->phys))
+            return false;
+    }
+    return true;
+}
+
+/* by path, otherwise the first event node matching name and phys */
+static int device_find(input_t *input)
+{
+    struct dirent *de;
+    DIR *dir;
+    int fd = -1;
+
+    if (input->opt.path[0]) {
+        snprintf(input->path, sizeof(input->path), "%s", input->opt.path);
+        return open(input->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+
+    if ((dir = opendir(INPUT_DIR)) == NULL)
+        return -1;
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, "event", strlen("event")) || strlen(de->d_name) > 32)
+            continue;
+        snprintf(input->path, sizeof(input->path), INPUT_DIR "/%s", de->d_name);
+        if ((fd = open(input->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0)
+            continue;
+        if (device_match(fd, &input->opt))
+            break;
+        close(fd);
+        fd = -1;
+    }
+    closedir(dir);
+    if (fd < 0)
+        errno = ENODEV;
+    return fd;
+}
+
+static void input_notify_state(input_t *input, bool present)
+{
+    struct input_client *client, *tmp;
+
+    list_for_each_entry_safe(client, tmp, &input->clients, list) {
+        if (client->ops->on_state)
+            client->ops->on_state(input, present);
+    }
+}
+
+static void record_events(input_t *input, const struct input_event *events, int count)
+{
+    uint8_t buf[INPUT_BATCH * INPUT_RECORD_EVENT], *p = buf;
+    uint64_t ns;
+    int i, b;
+
+    for (i=0; i<count; i++) {
+        ns = input_event_ns(&events[i]);
+        for (b=0; b<8; b++)
+            *p++ = ns >> (8 * b);
+        *p++ = events[i].type;
+        *p++ = events[i].type >> 8;
+        *p++ = events[i].code;
+        *p++ = events[i].code >> 8;
+        for (b=0; b<4; b++)
+            *p++ = (uint32_t)events[i].value >> (8 * b);
+    }
+    if (fwrite(buf, p - buf, 1, input->record) != 1) {
+        log_error("%s recording: %s, stopped", input->ident, strerror(errno));
+        input_record_stop(input);
+        return;
+    }
+    metric_add(input->stats.recorded, count);
+}
+
+static void input_lost(input_t *input)
+{
+    log_warn("%s lost, looking for it every %.0fs", input->ident, INPUT_RETRY);
+    ev_io_stop(input->loop, &input->iow);
+    close(input->fd);
+    input->fd = -1;
+    ev_timer_set(&input->retry, INPUT_RETRY, INPUT_RETRY);
+    ev_timer_start(input->loop, &input->retry);
+    input_notify_state(input, false);
+}
+
+static void input_read_cb(struct ev_loop *loop, struct ev_io *w, int revents)
+{
+    input_t *input = container_of(w, input_t, iow);
+    struct input_event events[INPUT_BATCH];
+    struct input_client *client, *tmp;
+    ssize_t n;
+    int i, count;
+
+    /* evdev hands out whole events only, as many as fit */
+    if ((n = read(input->fd, events, sizeof(events))) <= 0) {
+        if (n == 0 || errno == ENODEV)
+            input_lost(input);
+        else if (errno != EAGAIN && errno != EINTR)
+            log_error("%s read: %s", input->ident, strerror(errno));
+        return;
+    }
+    count = n / sizeof(events[0]);
+    for (i=0; i<count; i++) {
+        if (events[i].type == EV_SYN && events[i].code == SYN_DROPPED)
+            metric_add(input->stats.dropped, 1);
+    }
+    metric_add(input->stats.events, count);
+    metric_add(input->stats.reads, 1);
+
+    if (input->record)
+        record_events(input, events, count);
+    list_for_each_entry_safe(client, tmp, &input->clients, list) {
+        if (client->ops->on_events)
+            client->ops->on_events(input, events, count);
+    }
+}
+
+/* fd is open, pick up what it is and start reading */
+static int input_attach(input_t *input, int fd)
+{
+    const char *node = strrchr(input->path, '/');
+    int clock = CLOCK_MONOTONIC;
+
+    input->fd = fd;
+    memset(input->name, 0, sizeof(input->name));
+    memset(input->phys, 0, sizeof(input->phys));
+    ioctl(fd, EVIOCGNAME(sizeof(input->name) - 1), input->name);
+    ioctl(fd, EVIOCGPHYS(sizeof(input->phys) - 1), input->phys);
+    ioctl(fd, EVIOCGID, &input->id);
+    snprintf(input->ident, sizeof(input->ident), "%s%s%s", node ? node + 1 : input->path,
+             input->name[0] ? " " : "", input->name);
+
+    /* same clock as the rest of devctl, comparable to gpio and frame timestamps */
+    if (ioctl(fd, EVIOCSCLOCKID, &clock) < 0)
+        log_warn("%s: no monotonic timestamps", input->ident);
+    if (input->opt.grab && ioctl(fd, EVIOCGRAB, (void *)1) < 0)
+        return _error(input, INPUT_ERROR_IO, errno, "Grabbing %s", input->path);
+
+    ev_io_set(&input->iow, fd, EV_READ);
+    ev_io_start(input->loop, &input->iow);
+    return 0;
+}
+
+static void input_retry_cb(struct ev_loop *loop, struct ev_timer *w, int revents)
+{
+    input_t *input = container_of(w, input_t, retry);
+    int fd;
+
+    if ((fd = device_find(input)) < 0)
+        return;
+    if (input_attach(input, fd) != 0) {
+        log_error("%s", input->error.errmsg);
+        close(fd);
+        input->fd = -1;
+        return;
+    }
+    ev_timer_stop(loop, w);
+    log_info("%s back", input->ident);
+    input_notify_state(input, true);
+}
+
+const char *input_errmsg(input_t *input)
+{
+    return input->error.errmsg;
+}
+
+int input_errno(input_t *input)
+{
+    return input->error.c_errno;
+}
+
+input_t *input_new(void)
+{
+    input_t *input = calloc(1, sizeof(input_t));
+    if (!input)
+        return NULL;
+    input->fd = -1;
+    INIT_LIST_HEAD(&input->clients);
+    ev_io_init(&input->iow, input_read_cb, -1, EV_READ);
+    ev_timer_init(&input->retry, input_retry_cb, INPUT_RETRY, INPUT_RETRY);
+    return input;
+}
+
+void input_free(input_t *input)
+{
+    struct input_client *client, *tmp;
+
+    if (!input)
+        return;
+    input_close(input);
+    list_for_each_entry_safe(client, tmp, &input->clients, list)
+        list_del_init(&client->list);
+    free(input);
+}
+
+int input_open(input_t *input, input_options_t *opt)
+{
+    int fd, ret;
+
+    if ((opt->path[0] == '\0' && opt->name[0] == '\0' && opt->phys[0] == '\0') || !opt->loop)
+        return _error(input, INPUT_ERROR_ARG, 0, "No input path, name or phys");
+
+    input->opt = *opt;
+    input->loop = opt->loop;
+    if ((fd = device_find(input)) < 0)
+        return _error(input, INPUT_ERROR_OPEN, errno, "Opening input %s", opt->path[0] ? opt->path :
+                      opt->name[0] ? opt->name : opt->phys);
+    if ((ret = input_attach(input, fd)) != 0) {
+        close(fd);
+        input->fd = -1;
+        return ret;
+    }
+    stats_init(input);
+    evprof_watch(&input->iow, "input.read", input->ident);
+    evprof_watch(&input->retry, "input.retry", input->ident);
+
+    if (opt->record[0] && (ret = input_record_start(input, opt->record)) != 0)
+        log_error("%s", input->error.errmsg);
+    return 0;
+}
+
+void input_close(input_t *input)
+{
+    input_record_stop(input);
+    if (input->loop) {
+        ev_timer_stop(input->loop, &input->retry);
+        ev_io_stop(input->loop, &input->iow);
+    }
+    if (input->fd >= 0) {
+        close(input->fd);           /* drops the grab too */
+        input->fd = -1;
+    }
+}
+
+int input_grab(input_t *input, bool grab)
+{
+    input->opt.grab = grab;
+    if (input->fd < 0)
+        return 0;                   /* on the next open */
+    if (ioctl(input->fd, EVIOCGRAB, grab ? (void *)1 : NULL) < 0)
+        return _error(input, INPUT_ERROR_IO, errno, "%s %s", grab ? "Grabbing" : "Releasing", input->path);
+    return 0;
+}
+
+int input_record_start(input_t *input, const char *path)
+{
+    uint8_t header[INPUT_RECORD_HEADER] = INPUT_RECORD_MAGIC;
+    uint16_t id[4] = { input->id.bustype, input->id.vendor, input->id.product, input->id.version };
+    FILE *fp;
+    int i;
+
+    input_record_stop(input);
+    if ((fp = fopen(path, "wb")) == NULL)
+        return _error(input, INPUT_ERROR_RECORD, errno, "Opening %s", path);
+    setvbuf(fp, NULL, _IOFBF, INPUT_RECORD_BUF);
+
+    for (i=0; i<4; i++) {
+        header[8 + 2 * i] = id[i];
+        header[8 + 2 * i + 1] = id[i] >> 8;
+    }
+    memcpy(header + 16, input->name, sizeof(input->name));
+    memcpy(header + 16 + sizeof(input->name), input->phys, sizeof(input->phys));
+    if (fwrite(header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        return _error(input, INPUT_ERROR_RECORD, errno, "Writing %s", path);
+    }
+    input->record = fp;
+    snprintf(input->opt.record, sizeof(input->opt.record), "%s", path);
+    log_info("%s recording to %s", input->ident, path);
+    return 0;
+}
+
+void input_record_stop(input_t *input)
+{
+    if (!input->record)
+        return;
+    if (fclose(input->record) != 0)
+        log_error("%s closing recording: %s", input->ident, strerror(errno));
+    input->record = NULL;
+    input->opt.record[0] = '\0';
+}
+
+bool input_present(input_t *input)
+{
+    return input->fd >= 0;
+}
+
+int input_add_client(input_t *input, struct input_client *client)
+{
+    if (!client || !client->ops)
+        return -1;
+    list_add_tail(&client->list, &input->clients);
+    return 0;
+}
+
+void input_remove_client(input_t *input, struct input_client *client)
+{
+    if (!client)
+        return;
+    list_del_init(&client->list);
+}
+
+const char *input_id(input_t *input)
+{
+    return input->ident;
+}
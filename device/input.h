@@ -0,0 +1,75 @@
+#ifndef __INPUT_H__
+#define __INPUT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/input.h>
+#include <ev.h>
+#include "list.h"
+
+enum input_error_code {
+    INPUT_ERROR_ARG             = -1, /* Invalid arguments */
+    INPUT_ERROR_OPEN            = -2, /* Opening input device */
+    INPUT_ERROR_IO              = -3, /* Grabbing/reading input device */
+    INPUT_ERROR_RECORD          = -4, /* Writing the recording */
+};
+
+#define INPUT_BATCH         (64)        /* struct input_event per read() */
+#define INPUT_RETRY         (2.)        /* seconds between looks for a lost device */
+
+typedef struct input_handle input_t;
+
+/* path wins, otherwise the first /dev/input/event* matching name and/or phys */
+typedef struct input_options {
+    char path[64];
+    char name[128];                 /* EVIOCGNAME */
+    char phys[64];                  /* EVIOCGPHYS */
+    bool grab;                      /* EVIOCGRAB, nobody else sees the events */
+    char record[96];                /* optional, binary recording file */
+    struct ev_loop *loop;
+} input_options_t;
+
+/*
+ * Recording, little endian:
+ *   header  "DEVINPT1", u16 bustype, vendor, product, version,
+ *           char name[128], char phys[64]
+ *   event   u64 CLOCK_MONOTONIC ns, u16 type, u16 code, s32 value
+ */
+#define INPUT_RECORD_MAGIC      "DEVINPT1"
+#define INPUT_RECORD_HEADER     (8 + 4 * 2 + 128 + 64)
+#define INPUT_RECORD_EVENT      (16)
+
+struct input_client_ops {
+    /* every event read in one wakeup, timestamps are CLOCK_MONOTONIC */
+    void (*on_events)(input_t *input, const struct input_event *events, int count);
+    /* the device went away or came back */
+    void (*on_state)(input_t *input, bool present);
+};
+
+struct input_client {
+    char name[64];
+    struct input_client_ops *ops;
+    struct list_head list;
+};
+
+input_t *input_new(void);
+void input_free(input_t *input);
+int input_open(input_t *input, input_options_t *opt);
+void input_close(input_t *input);
+int input_grab(input_t *input, bool grab);
+int input_record_start(input_t *input, const char *path);
+void input_record_stop(input_t *input);
+bool input_present(input_t *input);
+int input_add_client(input_t *input, struct input_client *client);
+void input_remove_client(input_t *input, struct input_client *client);
+/* "eventN name" */
+const char *input_id(input_t *input);
+const char *input_errmsg(input_t *input);
+int input_errno(input_t *input);
+
+static inline uint64_t input_event_ns(const struct input_event *ev)
+{
+    return (uint64_t)ev->input_event_sec * 1000000000ULL + (uint64_t)ev->input_event_usec * 1000ULL;
+}
+
+#endif
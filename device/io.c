@@ -6,25 +6,31 @@
  * Copyright (c) Richard Hirst <rhirst@linuxcare.com>
  */
 
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/mman.h>
 #include <sys/types.h>
 #include <stdint.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 
+#include "shell.h"
+#include "iobuf.h"
+#include "mmio.h"
+#include "crc32.h"
+#include "metrics.h"
+
 #ifndef FALSE
 #define FALSE    0
 #define TRUE    (!FALSE)
 #endif
 
-#ifdef MMAP64
-#define mmap mmap64
-#endif
+#define IO_CHUNK            (1024 * 1024)   /* file transfers, mapped at a time */
+#define IO_PROGRESS_NS      (250000000ULL)
 
 static char *argv0;
 
@@ -32,15 +38,33 @@ static void
 usage (void)
 {
     fprintf(stderr,
-"Raw memory i/o utility - $Revision: 1.5 $\n\n"
-"%s -v -1|2|4 -r|w [-l <len>] [-f <file>] <addr> [<value>]\n\n"
+"Raw memory i/o utility - $Revision: 1.6 $\n\n"
+"%s -v -1|2|4|8 -r|w [-l <len>] [-f <file> [-k] [-p]] <addr> [<value>]\n"
+"%s -s <script>\n"
+"%s -u\n"
+"%s -S <period_us> [-1|2|4|8] [-n <count>] [-b] [-c <cpu>] [-f <file>] [-W] <addr>...\n"
+"%s -x\n\n"
 "    -v         Verbose, asks for confirmation\n"
-"    -1|2|4     Sets memory access size in bytes (default byte)\n"
+"    -1|2|4|8   Sets memory access size in bytes (default byte)\n"
 "    -l <len>   Length in bytes of area to access (defaults to\n"
 "               one access, or whole file length)\n"
 "    -r|w       Read from or Write to memory (default read)\n"
 "    -f <file>  File to write on memory read, or\n"
 "               to read on memory write\n"
+"    -k         Read memory back after a file transfer and compare\n"
+"               crc32 checksums\n"
+"    -p         Show file transfer progress\n"
+"    -s <cmds>  Run a batch of accesses, ';' separated:\n"
+"               r<size> <addr> [count], w<size> <addr> <value>,\n"
+"               m<size> <addr> <mask> <value>\n"
+"    -u         Unmap cached windows and show cache statistics\n"
+"    -S <us>    Sample the registers at <addr>... every <us> microseconds\n"
+"               in the background, changes are written to <file>\n"
+"    -n <count> Stop sampling after <count> samples\n"
+"    -b         Busy-poll instead of using a timer, for short periods\n"
+"    -c <cpu>   Run the sampler on <cpu>\n"
+"    -W         Stream samples to websocket clients of /mmio\n"
+"    -x         Stop sampling and show statistics\n"
 "    <addr>     The memory address to access\n"
 "    <val>      The value to write (implies -w)\n\n"
 "Examples:\n"
@@ -49,80 +73,307 @@ usage (void)
 "    %s -2 -l 8 0x1000          Reads 8 words from 0x1000\n"
 "    %s -r -f dmp -l 100 200    Reads 100 bytes from addr 200 to file\n"
 "    %s -w -f img 0x10000       Writes the whole of file to memory\n"
+"    %s -s 'm4 0x1000 0x30 0x10; r4 0x1000 4'\n"
+"    %s -4 -S 10 -b -c 3 -f trc 0xff190000 0xff190004\n"
 "\n"
-"Note access size (-1|2|4) does not apply to file based accesses.\n\n",
-        argv0, argv0, argv0, argv0, argv0, argv0);
+"Note access size (-1|2|4|8) does not apply to file based accesses.\n"
+"Mappings are cached between calls, see -u.\n\n",
+        argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0);
 }
 
 
 static void
-memread_memory(unsigned long phys_addr, uint8_t *addr, int len, int iosize)
+write_memory(volatile uint8_t *addr, size_t len, int iosize, uint64_t value)
 {
-    int i;
+    switch(iosize) {
+    case 1:
+        for (; len; len -= iosize, addr += iosize)
+            *(volatile uint8_t *)addr = value;
+        break;
+    case 2:
+        for (; len; len -= iosize, addr += iosize)
+            *(volatile uint16_t *)addr = value;
+        break;
+    case 4:
+        for (; len; len -= iosize, addr += iosize)
+            *(volatile uint32_t *)addr = value;
+        break;
+    case 8:
+        for (; len; len -= iosize, addr += iosize)
+            *(volatile uint64_t *)addr = value;
+        break;
+    }
+}
+
+
+static void
+print_iobuf(struct iobuf *out)
+{
+    if (out->len)
+        shell_printf("%.*s", (int)out->len, (char *)out->buf);
+}
+
+
+struct progress {
+    const char *what;
+    uint64_t total;
+    uint64_t start;
+    uint64_t last;
+    int on;
+};
+
+static void
+progress_update(struct progress *p, uint64_t done)
+{
+    uint64_t now = metric_now();
+    double secs;
+
+    if (!p->on || (done < p->total && now - p->last < IO_PROGRESS_NS))
+        return;
+    p->last = now;
+    secs = (now - p->start) / 1e9;
+    shell_printf("\r%s %llu/%llu MiB (%d%%) %.1f MiB/s%s", p->what,
+                 (unsigned long long)(done >> 20), (unsigned long long)(p->total >> 20),
+                 (int)(done * 100 / p->total), secs > 0 ? done / secs / (1 << 20) : 0.0,
+                 done < p->total ? "" : "\n");
+}
+
+
+static int
+write_full(int fd, const uint8_t *buf, size_t len)
+{
+    ssize_t n;
 
     while (len) {
-        printf("%08lx: ", phys_addr);
-        i = 0;
-        while (i < 16 && len) {
-            switch(iosize) {
-            case 1:
-                printf(" %02x", *(uint8_t *)addr);
-                break;
-            case 2:
-                printf(" %04x", *(uint16_t *)addr);
-                break;
-            case 4:
-                printf(" %08x", *(uint32_t *)addr);
-                break;
-            }
-            i += iosize;
-            addr += iosize;
-            len -= iosize;
+        n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+static ssize_t
+read_full(int fd, uint8_t *buf, size_t len)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len) {
+        n = read(fd, buf + done, len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+
+/* chunks end on IO_CHUNK boundaries so their windows line up */
+static size_t
+chunk_len(uint64_t addr, uint64_t left)
+{
+    uint64_t n = IO_CHUNK - (addr & (IO_CHUNK - 1));
+
+    return n < left ? n : left;
+}
+
+
+static int
+memory_crc(uint64_t addr, uint64_t len, uint8_t *buf, uint32_t *crc)
+{
+    uint64_t off;
+    uint8_t *io;
+    size_t n;
+
+    *crc = 0;
+    for (off = 0; off < len; off += n) {
+        n = chunk_len(addr + off, len - off);
+        if ((io = mmio_get(addr + off, n, FALSE)) == NULL) {
+            fprintf(stderr, "%s\n", mmio_errmsg());
+            return -1;
         }
-        phys_addr += 16;
-        printf("\n");
+        mmio_copy_from(buf, io, n);
+        mmio_put(io);
+        *crc = crc32(*crc, buf, n);
     }
+    return 0;
 }
 
 
-static void
-write_memory(uint8_t *addr, int len, int iosize, unsigned long value)
+/*
+ * Memory to/from file through a bounce buffer, one mapped chunk at a
+ * time, so the length is only limited by the file.
+ */
+static int
+stream_file(int ffd, const char *filename, uint64_t addr, uint64_t len,
+            int memread, int verify, int show)
 {
-    switch(iosize) {
-    case 1:
-        while (len) {
-            *(uint8_t *)addr = value;
-            len -= iosize;
-            addr += iosize;
+    struct progress p = {
+        .what = memread ? "read" : "write", .total = len, .start = metric_now(), .on = show,
+    };
+    uint32_t crc = 0, mem_crc;
+    uint64_t off;
+    uint8_t *buf, *io;
+    ssize_t got;
+    size_t n;
+    int ret = -1;
+
+    if ((buf = malloc(IO_CHUNK)) == NULL) {
+        fprintf(stderr, "No memory for transfer buffer\n");
+        return -1;
+    }
+
+    for (off = 0; off < len; off += n) {
+        n = chunk_len(addr + off, len - off);
+        if (!memread) {
+            got = read_full(ffd, buf, n);
+            if (got < 0) {
+                fprintf(stderr, "File read failed: %s\n", strerror(errno));
+                goto out;
+            }
+            if ((size_t)got != n) {
+                fprintf(stderr, "Only read %llu of %llu bytes from file\n",
+                        (unsigned long long)(off + got), (unsigned long long)len);
+                goto out;
+            }
         }
-        break;
-    case 2:
-        while (len) {
-            *(uint16_t *)addr = value;
-            len -= iosize;
-            addr += iosize;
+        if ((io = mmio_get(addr + off, n, !memread)) == NULL) {
+            fprintf(stderr, "%s\n", mmio_errmsg());
+            goto out;
         }
-        break;
-    case 4:
-        while (len) {
-            *(uint32_t *)addr = value;
-            len -= iosize;
-            addr += iosize;
+        if (memread)
+            mmio_copy_from(buf, io, n);
+        else
+            mmio_copy_to(io, buf, n);
+        mmio_put(io);
+
+        if (verify)
+            crc = crc32(crc, buf, n);
+        if (memread && write_full(ffd, buf, n) != 0) {
+            fprintf(stderr, "File write failed after %llu bytes: %s\n",
+                    (unsigned long long)off, strerror(errno));
+            goto out;
         }
-        break;
+        progress_update(&p, off + n);
     }
+
+    if (verify) {
+        if (memory_crc(addr, len, buf, &mem_crc) != 0)
+            goto out;
+        if (mem_crc != crc) {
+            fprintf(stderr, "Verify failed: %s crc32 0x%08x, memory 0x%08x\n",
+                    filename, crc, mem_crc);
+            goto out;
+        }
+        shell_printf("crc32 0x%08x verified\n", crc);
+    }
+    ret = 0;
+
+out:
+    free(buf);
+    return ret;
+}
+
+
+static int
+run_script(const char *script)
+{
+    struct iobuf out = {0};
+    int ret;
+
+    if (!iobuf_init(&out, IOBUF_CHUNK_SIZE))
+        return -1;
+    ret = mmio_script(script, &out);
+    print_iobuf(&out);
+    if (ret != 0)
+        fprintf(stderr, "%s\n", mmio_errmsg());
+    iobuf_free(&out);
+    return ret;
+}
+
+
+static int
+start_sampling(mmio_sample_options_t *opt, int iosize, int argc, char *argv[])
+{
+    char *endptr;
+    int i;
+
+    if (optind == argc) {
+        fprintf(stderr, "No address given\n");
+        return -1;
+    }
+    if (argc - optind > MMIO_SAMPLE_MAX_REGS) {
+        fprintf(stderr, "At most %d registers\n", MMIO_SAMPLE_MAX_REGS);
+        return -1;
+    }
+    if (!opt->path && !opt->websocket) {
+        fprintf(stderr, "No <file> or -W given for sampling\n");
+        return -1;
+    }
+    for (i=0; optind<argc; i++, optind++) {
+        opt->addr[i] = strtoull(argv[optind], &endptr, 0);
+        if (*endptr) {
+            fprintf(stderr, "Bad <addr> value '%s'\n", argv[optind]);
+            return -1;
+        }
+        opt->width[i] = iosize;
+    }
+    opt->nregs = i;
+    return mmio_sample_start(opt);
+}
+
+
+static void
+sample_stats(void)
+{
+    struct mmio_sample_stats st;
+
+    mmio_sample_stats(&st);
+    shell_printf("sampling %s: %llu samples, %llu changes, %llu overruns, %llu dropped, %llu bytes\n",
+                 st.running ? "on" : "off", (unsigned long long)st.samples,
+                 (unsigned long long)st.changes, (unsigned long long)st.overruns,
+                 (unsigned long long)st.dropped, (unsigned long long)st.bytes);
+}
+
+
+static void
+flush_cache(void)
+{
+    unsigned long hits, misses;
+    int mapped;
+
+    mmio_stats(&hits, &misses, &mapped);
+    shell_printf("mappings %d, hits %lu, misses %lu\n", mapped, hits, misses);
+    mmio_flush();
 }
 
 
 int cmd_io(int argc, char *argv[])
 {
-    int mfd, ffd = 0, req_len = 0, opt;
-    uint8_t *real_io;
-    unsigned long real_len, real_addr, req_addr, req_value = 0, offset;
+    int ffd = -1, opt, ret = -1;
+    uint8_t *real_io = NULL;
+    uint64_t req_addr, req_value = 0;
+    off_t req_len = 0;
     char *endptr;
     int memread = TRUE;
     int iosize = 1;
     char *filename = NULL;
+    char *script = NULL;
+    int flush = FALSE;
+    int verify = FALSE;
+    int show_progress = FALSE;
+    int sample_stop = FALSE;
+    mmio_sample_options_t sample = { .cpu = -1 };
+    double period_us = 0;
     int verbose = 0;
 
     argv0 = argv[0];
@@ -133,7 +384,7 @@ int cmd_io(int argc, char *argv[])
     }
 
     optind = 1;
-    while ((opt = getopt(argc, argv, "hv124rwl:f:")) > 0) {
+    while ((opt = getopt(argc, argv, "hv1248rwukpl:f:s:S:n:bc:Wx")) > 0) {
         switch (opt) {
         case 'h':
             usage();
@@ -144,6 +395,7 @@ int cmd_io(int argc, char *argv[])
         case '1':
         case '2':
         case '4':
+        case '8':
             iosize = opt - '0';
             break;
         case 'r':
@@ -152,15 +404,58 @@ int cmd_io(int argc, char *argv[])
         case 'w':
             memread = FALSE;
             break;
+        case 'u':
+            flush = TRUE;
+            break;
+        case 'k':
+            verify = TRUE;
+            break;
+        case 'p':
+            show_progress = TRUE;
+            break;
         case 'l':
-            req_len = strtoul(optarg, &endptr, 0);
-            if (*endptr) {
+            req_len = strtoull(optarg, &endptr, 0);
+            if (*endptr || req_len < 0) {
                 fprintf(stderr, "Bad <size> value '%s'\n", optarg);
                 return -1;
             }
             break;
         case 'f':
-            filename = strdup(optarg);
+            filename = optarg;
+            break;
+        case 's':
+            script = optarg;
+            break;
+        case 'S':
+            period_us = strtod(optarg, &endptr);
+            if (*endptr || period_us <= 0) {
+                fprintf(stderr, "Bad <period> value '%s'\n", optarg);
+                return -1;
+            }
+            sample.period_ns = period_us * 1000;
+            break;
+        case 'n':
+            sample.count = strtoull(optarg, &endptr, 0);
+            if (*endptr) {
+                fprintf(stderr, "Bad <count> value '%s'\n", optarg);
+                return -1;
+            }
+            break;
+        case 'b':
+            sample.busy_poll = true;
+            break;
+        case 'c':
+            sample.cpu = strtol(optarg, &endptr, 0);
+            if (*endptr || sample.cpu < 0) {
+                fprintf(stderr, "Bad <cpu> value '%s'\n", optarg);
+                return -1;
+            }
+            break;
+        case 'W':
+            sample.websocket = true;
+            break;
+        case 'x':
+            sample_stop = TRUE;
             break;
         default:
             fprintf(stderr, "Unknown option: %c\n", opt);
@@ -169,11 +464,32 @@ int cmd_io(int argc, char *argv[])
         }
     }
 
+    if (script || flush) {
+        if (optind < argc) {
+            fprintf(stderr, "Too many arguments '%s'...\n", argv[optind]);
+            return -1;
+        }
+        ret = script ? run_script(script) : 0;
+        if (flush)
+            flush_cache();
+        return ret;
+    }
+
+    if (sample_stop) {
+        sample_stats();
+        mmio_sample_stop();
+        return 0;
+    }
+    if (period_us) {
+        sample.path = filename;
+        return start_sampling(&sample, iosize, argc, argv);
+    }
+
     if (optind == argc) {
         fprintf(stderr, "No address given\n");
         return -1;
     }
-    req_addr = strtoul(argv[optind], &endptr, 0);
+    req_addr = strtoull(argv[optind], &endptr, 0);
     if (*endptr) {
         fprintf(stderr, "Bad <addr> value '%s'\n", argv[optind]);
         return -1;
@@ -181,7 +497,7 @@ int cmd_io(int argc, char *argv[])
     optind++;
     if (!filename && optind < argc)
         memread = FALSE;
-    if (filename && optind > argc) {
+    if (filename && optind < argc) {
         fprintf(stderr, "Filename AND value given\n");
         return -1;
     }
@@ -190,14 +506,12 @@ int cmd_io(int argc, char *argv[])
         return -1;
     }
     if (!filename && !memread) {
-        req_value = strtoul(argv[optind], &endptr, 0);
+        req_value = strtoull(argv[optind], &endptr, 0);
         if (*endptr) {
             fprintf(stderr, "Bad <value> value '%s'\n", argv[optind]);
             return -1;
         }
-        printf("iosize=%d req_value=%lx\n", iosize, req_value);
-        if ((iosize == 1 && (req_value & 0xffffff00)) ||
-                (iosize == 2 && (req_value & 0xffff0000))) {
+        if (iosize < 8 && (req_value >> (iosize * 8))) {
             fprintf(stderr, "<value> too large\n");
             return -1;
         }
@@ -212,14 +526,14 @@ int cmd_io(int argc, char *argv[])
         return -1;
     }
     if (filename && memread) {
-        ffd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+        ffd = open(filename, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
         if (ffd < 0) {
             fprintf(stderr, "Failed to open destination file '%s': %s\n", filename, strerror(errno));
             return -1;
         }
     }
     if (filename && !memread) {
-        ffd = open(filename, O_RDONLY);
+        ffd = open(filename, O_RDONLY|O_CLOEXEC);
         if (ffd < 0) {
             fprintf(stderr, "Failed to open source file '%s': %s\n", filename, strerror(errno));
             return -1;
@@ -228,82 +542,57 @@ int cmd_io(int argc, char *argv[])
 
     if (filename && !req_len) {
         req_len = lseek(ffd, 0, SEEK_END);
-        if (req_len < 0) {
+        if (req_len < 0 || lseek(ffd, 0, SEEK_SET)) {
             fprintf(stderr, "Failed to seek on '%s': %s\n",
                     filename, strerror(errno));
-            return -1;
-        }
-        if (lseek(ffd, 0, SEEK_SET)) {
-            fprintf(stderr, "Failed to seek on '%s': %s\n",
-                    filename, strerror(errno));
-            return -1;
+            goto out;
         }
     }
     if (!req_len)
         req_len = iosize;
+    if (!filename && (uint64_t)req_len > SIZE_MAX) {
+        fprintf(stderr, "<size> too large\n");
+        goto out;
+    }
 
-    if ((iosize == 2 && (req_addr & 1)) ||
-            (iosize == 4 && (req_addr & 3))) {
+    if (req_addr & (iosize - 1)) {
         fprintf(stderr, "Badly aligned <addr> for access size\n");
-        return -1;
+        goto out;
     }
-    if ((iosize == 2 && (req_len & 1)) ||
-            (iosize == 4 && (req_len & 3))) {
+    if (req_len & (iosize - 1)) {
         fprintf(stderr, "Badly aligned <size> for access size\n");
-        return -1;
+        goto out;
     }
 
     if (!verbose)
         /* Nothing */;
     else if (filename && memread)
-        printf("Request to memread 0x%x bytes from address 0x%08lx\n"
+        printf("Request to memread 0x%llx bytes from address 0x%08llx\n"
             "\tto file %s, using %d byte accesses\n",
-            req_len, req_addr, filename, iosize);
+            (unsigned long long)req_len, (unsigned long long)req_addr, filename, iosize);
     else if (filename)
-        printf("Request to write 0x%x bytes to address 0x%08lx\n"
+        printf("Request to write 0x%llx bytes to address 0x%08llx\n"
             "\tfrom file %s, using %d byte accesses\n",
-            req_len, req_addr, filename, iosize);
+            (unsigned long long)req_len, (unsigned long long)req_addr, filename, iosize);
     else if (memread)
-        printf("Request to memread 0x%x bytes from address 0x%08lx\n"
+        printf("Request to memread 0x%llx bytes from address 0x%08llx\n"
             "\tusing %d byte accesses\n",
-            req_len, req_addr, iosize);
+            (unsigned long long)req_len, (unsigned long long)req_addr, iosize);
     else
-        printf("Request to write 0x%x bytes to address 0x%08lx\n"
-            "\tusing %d byte accesses of value 0x%0*lx\n",
-            req_len, req_addr, iosize, iosize*2, req_value);
+        printf("Request to write 0x%llx bytes to address 0x%08llx\n"
+            "\tusing %d byte accesses of value 0x%0*llx\n",
+            (unsigned long long)req_len, (unsigned long long)req_addr, iosize, iosize*2,
+            (unsigned long long)req_value);
 
-    real_addr = req_addr & ~4095;
-    if (real_addr == 0xfffff000) {
-        fprintf(stderr, "Sorry, cannot map the top 4K page\n");
-        return -1;
-    }
-    offset = req_addr - real_addr;
-    real_len = req_len + offset;
-    real_len = (real_len + 4095) & ~ 4095;
-    if (real_addr + real_len < real_addr) {
-        fprintf(stderr, "Aligned addr+len exceeds top of address space\n");
-        return -1;
-    }
-    if (verbose)
-        printf("Attempting to map 0x%lx bytes at address 0x%08lx\n",
-            real_len, real_addr);
-
-    mfd = open("/dev/mem", (memread ? O_RDONLY : O_RDWR) | O_SYNC);
-    if (mfd == -1) {
-        perror("open /dev/mem");
-        return -1;
-    }
-    if (verbose)
-        printf("open(/dev/mem) ok\n");
-    real_io = mmap(NULL, real_len,
-            memread ? PROT_READ:PROT_WRITE,
-            MAP_SHARED, mfd, real_addr);
-    if (real_io == (void *)(-1)) {
-        fprintf(stderr, "mmap() failed: %s\n", strerror(errno));
-        return -1;
+    if (!filename) {
+        real_io = mmio_get(req_addr, req_len, !memread);
+        if (real_io == NULL) {
+            fprintf(stderr, "%s\n", mmio_errmsg());
+            goto out;
+        }
+        if (verbose)
+            printf("mmap() ok\n");
     }
-    if (verbose)
-        printf("mmap() ok\n");
 
     if (verbose) {
         int c;
@@ -313,45 +602,35 @@ int cmd_io(int argc, char *argv[])
         c = getchar();
         if (c != 'y' && c != 'Y') {
             printf("Aborted\n");
-            return -1;
+            goto out;
         }
     }
 
-    if (filename && memread) {
-        int n = write(ffd, real_io + offset, req_len);
-
-        if (n < 0) {
-            fprintf(stderr, "File write failed: %s\n", strerror(errno));
-            return -1;
-        }
-        else if (n != req_len) {
-            fprintf(stderr, "Only wrote %d of %d bytes to file\n",
-                    n, req_len);
-            return -1;
-        }
+    if (filename) {
+        if (stream_file(ffd, filename, req_addr, req_len, memread, verify, show_progress) != 0)
+            goto out;
     }
-    else if (filename) {
-        int n = read(ffd, real_io + offset, req_len);
+    else if (memread) {
+        struct iobuf dump = {0};
 
-        if (n < 0) {
-            fprintf(stderr, "File read failed: %s\n", strerror(errno));
-            return -1;
-        }
-        else if (n != req_len) {
-            fprintf(stderr, "Only read %d of %d bytes from file\n",
-                    n, req_len);
-            return -1;
+        if (!iobuf_init(&dump, IOBUF_CHUNK_SIZE))
+            goto out;
+        if (mmio_dump(&dump, req_addr, req_len, iosize) != 0) {
+            fprintf(stderr, "%s\n", mmio_errmsg());
+            iobuf_free(&dump);
+            goto out;
         }
+        print_iobuf(&dump);
+        iobuf_free(&dump);
     }
-    else if (memread)
-        memread_memory(req_addr, real_io + offset, req_len, iosize);
     else
-        write_memory(real_io + offset, req_len, iosize, req_value);
+        write_memory(real_io, req_len, iosize, req_value);
+    ret = 0;
 
-    if (filename)
+out:
+    if (real_io)
+        mmio_put(real_io);
+    if (ffd >= 0)
         close(ffd);
-    close (mfd);
-
-    return 0;
+    return ret;
 }
-
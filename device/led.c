@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "led.h"
+#include "sysfs.h"
+
+#define LED_TRIGGERS_MAX    (4096)      /* every trigger the kernel knows */
+
+struct led_handle {
+    char ident[96];
+    char dir[128];
+    sysfs_attr_t brightness;
+    sysfs_attr_t trigger;
+    int max_brightness;
+    /* last written, -1 while a trigger drives the led */
+    int cached;
+    /* error handle */
+    struct {
+        int c_errno;
+        char errmsg[96];
+    } error;
+};
+
+static int _error(led_t *led, int code, int c_errno, const char *fmt, ...)
+{
+    va_list ap;
+
+    led->error.c_errno = c_errno;
+
+    va_start(ap, fmt);
+    vsnprintf(led->error.errmsg, sizeof(led->error.errmsg), fmt, ap);
+    va_end(ap);
+
+    if (c_errno) {
+        char buf[64];
+        strerror_r(c_errno, buf, sizeof(buf));
+        snprintf(led->error.errmsg+strlen(led->error.errmsg), sizeof(led->error.errmsg)-strlen(led->error.errmsg), ": %s [errno %d]", buf, c_errno);
+    }
+
+    return code;
+}
+
+/* "none timer [heartbeat] ..." */
+static bool led_triggered(led_t *led)
+{
+    char *buf, *sel;
+    bool triggered = false;
+
+    if (led->trigger.fd < 0 || (buf = malloc(LED_TRIGGERS_MAX)) == NULL)
+        return false;
+    if (sysfs_attr_read(&led->trigger, buf, LED_TRIGGERS_MAX) > 0 && (sel = strchr(buf, '[')) != NULL)
+        triggered = strncmp(sel, "[none]", strlen("[none]")) != 0;
+    free(buf);
+    return triggered;
+}
+
+const char *led_errmsg(led_t *led)
+{
+    return led->error.errmsg;
+}
+
+int led_errno(led_t *led)
+{
+    return led->error.c_errno;
+}
+
+led_t *led_new(void)
+{
+    led_t *led = calloc(1, sizeof(led_t));
+    if (!led)
+        return NULL;
+    sysfs_attr_init(&led->brightness);
+    sysfs_attr_init(&led->trigger);
+    led->cached = -1;
+    return led;
+}
+
+void led_free(led_t *led)
+{
+    if (!led)
+        return;
+    led_close(led);
+    free(led);
+}
+
+int led_open(led_t *led, led_options_t *opt)
+{
+    char buf[SYSFS_VALUE_MAX];
+    const char *name;
+    int ret;
+
+    if (opt->name[0] == '\0')
+        return _error(led, LED_ERROR_ARG, 0, "No led name");
+    if (opt->name[0] == '/')
+        snprintf(led->dir, sizeof(led->dir), "%s", opt->name);
+    else
+        snprintf(led->dir, sizeof(led->dir), LED_SYSFS_DIR "/%s", opt->name);
+    name = strrchr(led->dir, '/') + 1;
+    snprintf(led->ident, sizeof(led->ident), "%s", name);
+
+    if (sysfs_read(led->dir, "max_brightness", buf, sizeof(buf)) < 0)
+        return _error(led, LED_ERROR_OPEN, errno, "Reading %s max_brightness", led->ident);
+    led->max_brightness = atoi(buf);
+    if (sysfs_attr_open(&led->brightness, led->dir, "brightness", O_RDWR) < 0)
+        return _error(led, LED_ERROR_OPEN, errno, "Opening %s brightness", led->ident);
+    sysfs_attr_open(&led->trigger, led->dir, "trigger", O_RDWR);
+    led->cached = led_triggered(led) ? -1 : led_get_brightness(led);
+
+    if ((opt->trigger[0] && (ret = led_set_trigger(led, opt->trigger)) != 0) ||
+            (opt->brightness >= 0 && (ret = led_set_brightness(led, opt->brightness)) != 0)) {
+        led_close(led);
+        return ret;
+    }
+    return 0;
+}
+
+void led_close(led_t *led)
+{
+    sysfs_attr_close(&led->brightness);
+    sysfs_attr_close(&led->trigger);
+}
+
+int led_set_brightness(led_t *led, int brightness)
+{
+    if (led->brightness.fd < 0)
+        return _error(led, LED_ERROR_ARG, 0, "%s not open", led->ident);
+    if (brightness < 0)
+        brightness = 0;
+    if (brightness > led->max_brightness)
+        brightness = led->max_brightness;
+    if (brightness == led->cached)
+        return 0;
+    if (sysfs_attr_write_l(&led->brightness, brightness) < 0)
+        return _error(led, LED_ERROR_IO, errno, "Writing %s brightness", led->ident);
+    /* 0 also stops a trigger, anything else leaves it running */
+    led->cached = brightness == 0 || led->cached >= 0 ? brightness : -1;
+    return 0;
+}
+
+int led_get_brightness(led_t *led)
+{
+    long long value;
+
+    if (led->brightness.fd < 0)
+        return _error(led, LED_ERROR_ARG, 0, "%s not open", led->ident);
+    if (sysfs_attr_read_l(&led->brightness, &value) < 0)
+        return _error(led, LED_ERROR_IO, errno, "Reading %s brightness", led->ident);
+    return value;
+}
+
+int led_max_brightness(led_t *led)
+{
+    return led->max_brightness;
+}
+
+int led_set_trigger(led_t *led, const char *trigger)
+{
+    if (led->trigger.fd < 0)
+        return _error(led, LED_ERROR_ARG, 0, "%s has no trigger", led->ident);
+    if (sysfs_attr_write(&led->trigger, trigger) < 0)
+        return _error(led, LED_ERROR_IO, errno, "Writing %s trigger %s", led->ident, trigger);
+    /* "none" turns the led off */
+    led->cached = strcmp(trigger, "none") ? -1 : 0;
+    return 0;
+}
+
+const char *led_id(led_t *led)
+{
+    return led->ident;
+}
@@ -0,0 +1,37 @@
+#ifndef __LED_H__
+#define __LED_H__
+
+#include <stdbool.h>
+
+enum led_error_code {
+    LED_ERROR_ARG               = -1, /* Invalid arguments */
+    LED_ERROR_OPEN              = -2, /* Opening led attributes */
+    LED_ERROR_IO                = -3, /* Reading/writing led attributes */
+};
+
+#define LED_SYSFS_DIR   "/sys/class/leds"
+
+typedef struct led_handle led_t;
+
+/* brightness -1 and an empty trigger leave what the led has */
+typedef struct led_options {
+    char name[96];                  /* under LED_SYSFS_DIR, or a path */
+    int brightness;
+    char trigger[32];
+} led_options_t;
+
+led_t *led_new(void);
+void led_free(led_t *led);
+int led_open(led_t *led, led_options_t *opt);
+void led_close(led_t *led);
+/* clamped to max_brightness, the same value twice is one write */
+int led_set_brightness(led_t *led, int brightness);
+int led_get_brightness(led_t *led);
+int led_max_brightness(led_t *led);
+/* "none" hands the led back to led_set_brightness() */
+int led_set_trigger(led_t *led, const char *trigger);
+const char *led_id(led_t *led);
+const char *led_errmsg(led_t *led);
+int led_errno(led_t *led);
+
+#endif
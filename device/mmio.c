@@ -0,0 +1,536 @@
+#define _FILE_OFFSET_BITS 64        /* physical addresses above 4G on 32-bit */
+#define LOG_MODULE_NAME "mmio"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "mmio.h"
+#include "log.h"
+#include "metrics.h"
+
+struct mmio_map {
+    uint64_t base;              /* page aligned physical address */
+    size_t len;
+    uint8_t *virt;              /* NULL: free slot */
+    bool write;
+    int refs;                   /* pinned by mmio_get() */
+    uint64_t used;              /* LRU tick */
+};
+
+struct mmio_op {
+    char op;                    /* 'r', 'w' or 'm' */
+    int width;
+    uint64_t addr;
+    uint64_t mask;
+    uint64_t value;
+    unsigned long count;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    int fd;
+    bool fd_write;
+    uint64_t tick;
+    struct mmio_map map[MMIO_CACHE_MAX];
+    unsigned long hits;
+    unsigned long misses;
+    metric_t *m_hits;
+    metric_t *m_misses;
+} M = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fd = -1,
+};
+
+static __thread char mmio_err[128];
+
+static int _error(int c_errno, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(mmio_err, sizeof(mmio_err), fmt, ap);
+    va_end(ap);
+
+    if (c_errno && n > 0 && n < sizeof(mmio_err))
+        snprintf(mmio_err + n, sizeof(mmio_err) - n, ": %s [errno %d]", strerror(c_errno), c_errno);
+    return -1;
+}
+
+const char *mmio_errmsg(void)
+{
+    return mmio_err;
+}
+
+static bool width_ok(int width)
+{
+    return width == 1 || width == 2 || width == 4 || width == 8;
+}
+
+/* a read-write fd also serves read-only mappings */
+static int mem_open(bool write)
+{
+    int fd;
+
+    if (M.fd >= 0 && (M.fd_write || !write))
+        return 0;
+
+    fd = open("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC);
+    if (fd >= 0) {
+        M.fd_write = true;
+    } else if (!write) {
+        fd = open("/dev/mem", O_RDONLY | O_SYNC | O_CLOEXEC);
+        M.fd_write = false;
+    }
+    if (fd < 0)
+        return _error(errno, "open /dev/mem");
+
+    /* existing mappings keep their own reference to the device */
+    if (M.fd >= 0)
+        close(M.fd);
+    M.fd = fd;
+    return 0;
+}
+
+static struct mmio_map *map_slot(void)
+{
+    struct mmio_map *slot = NULL;
+    int i;
+
+    for (i=0; i<MMIO_CACHE_MAX; i++) {
+        struct mmio_map *e = &M.map[i];
+        if (!e->virt)
+            return e;
+        if (e->refs == 0 && (!slot || e->used < slot->used))
+            slot = e;
+    }
+    if (slot) {
+        munmap(slot->virt, slot->len);
+        memset(slot, 0, sizeof(*slot));
+    }
+    return slot;
+}
+
+/* returns the window covering [addr, addr + len), lock held */
+static struct mmio_map *map_locked(uint64_t addr, size_t len, bool write)
+{
+    uint64_t page = sysconf(_SC_PAGESIZE), base, end;
+    struct mmio_map *e;
+    void *virt;
+    int i;
+
+    if (len == 0)
+        len = 1;
+    if (addr + len < addr) {
+        _error(0, "0x%llx+0x%zx exceeds top of address space", (unsigned long long)addr, len);
+        return NULL;
+    }
+
+    for (i=0; i<MMIO_CACHE_MAX; i++) {
+        e = &M.map[i];
+        if (e->virt && addr >= e->base && addr + len <= e->base + e->len && (e->write || !write)) {
+            e->used = ++M.tick;
+            M.hits++;
+            metric_add(M.m_hits, 1);
+            return e;
+        }
+    }
+    M.misses++;
+    if (!M.m_misses) {
+        M.m_hits = metric_get(METRIC_COUNTER, "devctl_mmio_map_hits_total",
+                              "Register accesses served by a cached mapping", NULL);
+        M.m_misses = metric_get(METRIC_COUNTER, "devctl_mmio_map_misses_total",
+                                "Register accesses that had to mmap /dev/mem", NULL);
+    }
+    metric_add(M.m_misses, 1);
+
+    if (mem_open(write) != 0)
+        return NULL;
+    if ((e = map_slot()) == NULL) {
+        _error(0, "All %d mappings pinned", MMIO_CACHE_MAX);
+        return NULL;
+    }
+
+    /* a whole window first so neighbouring registers hit, then just the pages */
+    end = (addr + len + page - 1) & ~(page - 1);
+    base = addr & ~(uint64_t)(MMIO_WINDOW - 1);
+    if (end < base + MMIO_WINDOW && base + MMIO_WINDOW > base)
+        end = base + MMIO_WINDOW;
+    virt = MAP_FAILED;
+    if (end - base <= SIZE_MAX)
+        virt = mmap(NULL, end - base, PROT_READ | (write ? PROT_WRITE : 0), MAP_SHARED, M.fd, (off_t)base);
+    if (virt == MAP_FAILED) {
+        base = addr & ~(page - 1);
+        end = (addr + len + page - 1) & ~(page - 1);
+        if (end <= base || end - base > SIZE_MAX) {
+            _error(0, "Can not map 0x%llx+0x%zx", (unsigned long long)addr, len);
+            return NULL;
+        }
+        virt = mmap(NULL, end - base, PROT_READ | (write ? PROT_WRITE : 0), MAP_SHARED, M.fd, (off_t)base);
+        if (virt == MAP_FAILED) {
+            _error(errno, "mmap 0x%llx+0x%llx", (unsigned long long)base, (unsigned long long)(end - base));
+            return NULL;
+        }
+    }
+    log_debug("map 0x%llx+0x%llx %s", (unsigned long long)base, (unsigned long long)(end - base), write ? "rw" : "ro");
+
+    e->base = base;
+    e->len = end - base;
+    e->virt = virt;
+    e->write = write;
+    e->used = ++M.tick;
+    return e;
+}
+
+void *mmio_get(uint64_t addr, size_t len, bool write)
+{
+    struct mmio_map *e;
+    void *virt = NULL;
+
+    pthread_mutex_lock(&M.lock);
+    if ((e = map_locked(addr, len, write)) != NULL) {
+        e->refs++;
+        virt = e->virt + (addr - e->base);
+    }
+    pthread_mutex_unlock(&M.lock);
+    return virt;
+}
+
+void mmio_put(void *virt)
+{
+    uint8_t *p = virt;
+    int i;
+
+    pthread_mutex_lock(&M.lock);
+    for (i=0; i<MMIO_CACHE_MAX; i++) {
+        struct mmio_map *e = &M.map[i];
+        if (e->virt && e->refs > 0 && p >= e->virt && p < e->virt + e->len) {
+            e->refs--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&M.lock);
+}
+
+int mmio_read(uint64_t addr, int width, uint64_t *value)
+{
+    struct mmio_map *e;
+    int ret = -1;
+
+    if (!width_ok(width) || (addr & (width - 1)))
+        return _error(0, "Bad access 0x%llx/%d", (unsigned long long)addr, width);
+
+    pthread_mutex_lock(&M.lock);
+    if ((e = map_locked(addr, width, false)) != NULL) {
+        *value = mmio_raw_read(e->virt + (addr - e->base), width);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&M.lock);
+    return ret;
+}
+
+int mmio_write(uint64_t addr, int width, uint64_t value)
+{
+    struct mmio_map *e;
+    int ret = -1;
+
+    if (!width_ok(width) || (addr & (width - 1)))
+        return _error(0, "Bad access 0x%llx/%d", (unsigned long long)addr, width);
+
+    pthread_mutex_lock(&M.lock);
+    if ((e = map_locked(addr, width, true)) != NULL) {
+        mmio_raw_write(e->virt + (addr - e->base), width, value);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&M.lock);
+    return ret;
+}
+
+/* up to the end of the aligned 32 bit word holding p, returns the bytes done */
+static size_t edge_from(uint8_t *d, const volatile uint8_t *p, size_t len)
+{
+    size_t off = (uintptr_t)p & 3, n = 4 - off < len ? 4 - off : len;
+    uint32_t w = *(const volatile uint32_t *)(p - off);
+
+    memcpy(d, (uint8_t *)&w + off, n);
+    return n;
+}
+
+/* read-modify-write, the other bytes of the word are written back unchanged */
+static size_t edge_to(volatile uint8_t *p, const uint8_t *s, size_t len)
+{
+    size_t off = (uintptr_t)p & 3, n = 4 - off < len ? 4 - off : len;
+    volatile uint32_t *word = (volatile uint32_t *)(p - off);
+    uint32_t w = *word;
+
+    memcpy((uint8_t *)&w + off, s, n);
+    *word = w;
+    return n;
+}
+
+void mmio_copy_from(void *dst, const volatile void *src, size_t len)
+{
+    const volatile uint8_t *s = src;
+    uint8_t *d = dst;
+    uint64_t v;
+    size_t n;
+
+    for (; len && ((uintptr_t)s & 7); len -= n, s += n, d += n)
+        n = edge_from(d, s, len);
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; len >= 64; len -= 64, s += 64, d += 64) {
+        const uint8_t *p = (const uint8_t *)s;
+        uint8x16_t a = vld1q_u8(p), b = vld1q_u8(p + 16), c = vld1q_u8(p + 32), e = vld1q_u8(p + 48);
+        vst1q_u8(d, a);
+        vst1q_u8(d + 16, b);
+        vst1q_u8(d + 32, c);
+        vst1q_u8(d + 48, e);
+    }
+#endif
+    for (; len >= 8; len -= 8, s += 8, d += 8) {
+        v = *(const volatile uint64_t *)s;
+        memcpy(d, &v, 8);
+    }
+    for (; len; len -= n, s += n, d += n)
+        n = edge_from(d, s, len);
+}
+
+void mmio_copy_to(volatile void *dst, const void *src, size_t len)
+{
+    volatile uint8_t *d = dst;
+    const uint8_t *s = src;
+    uint64_t v;
+    size_t n;
+
+    for (; len && ((uintptr_t)d & 7); len -= n, s += n, d += n)
+        n = edge_to(d, s, len);
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; len >= 64; len -= 64, s += 64, d += 64) {
+        uint8_t *p = (uint8_t *)d;
+        uint8x16_t a = vld1q_u8(s), b = vld1q_u8(s + 16), c = vld1q_u8(s + 32), e = vld1q_u8(s + 48);
+        vst1q_u8(p, a);
+        vst1q_u8(p + 16, b);
+        vst1q_u8(p + 32, c);
+        vst1q_u8(p + 48, e);
+    }
+#endif
+    for (; len >= 8; len -= 8, s += 8, d += 8) {
+        memcpy(&v, s, 8);
+        *(volatile uint64_t *)d = v;
+    }
+    for (; len; len -= n, s += n, d += n)
+        n = edge_to(d, s, len);
+}
+
+static char *put_hex(char *p, uint64_t v, int digits)
+{
+    static const char hex[] = "0123456789abcdef";
+    int i;
+
+    for (i=digits-1; i>=0; i--) {
+        p[i] = hex[v & 0xF];
+        v >>= 4;
+    }
+    return p + digits;
+}
+
+/* "addr:  xx xx ...", formatted by hand, printf per word dominates big dumps */
+static void dump_locked(struct iobuf *out, uint64_t addr, const uint8_t *virt, size_t len, int width)
+{
+    int addr_digits = (addr + len) > 0xFFFFFFFFull ? 16 : 8;
+    size_t i, need = out->len + (len / 16 + 1) * (addr_digits + 2 + 16 / width * (1 + 2 * width) + 1);
+    char line[128], *p;
+
+    if (need > out->cap)
+        iobuf_resize(out, need);
+    while (len) {
+        p = put_hex(line, addr, addr_digits);
+        *p++ = ':';
+        *p++ = ' ';
+        for (i=0; i<16 && len; i+=width) {
+            *p++ = ' ';
+            p = put_hex(p, mmio_raw_read(virt, width), 2 * width);
+            virt += width;
+            len -= width;
+        }
+        *p++ = '\n';
+        iobuf_add(out, out->len, line, p - line);
+        addr += 16;
+    }
+}
+
+int mmio_dump(struct iobuf *out, uint64_t addr, size_t len, int width)
+{
+    struct mmio_map *e;
+
+    if (!width_ok(width) || (addr & (width - 1)) || (len & (width - 1)))
+        return _error(0, "Bad access 0x%llx+0x%zx/%d", (unsigned long long)addr, len, width);
+
+    pthread_mutex_lock(&M.lock);
+    if ((e = map_locked(addr, len, false)) == NULL) {
+        pthread_mutex_unlock(&M.lock);
+        return -1;
+    }
+    dump_locked(out, addr, e->virt + (addr - e->base), len, width);
+    pthread_mutex_unlock(&M.lock);
+    return 0;
+}
+
+static int parse_u64(const char *s, uint64_t *v)
+{
+    char *end;
+
+    if (!s)
+        return -1;
+    errno = 0;
+    *v = strtoull(s, &end, 0);
+    return (errno || end == s || *end) ? -1 : 0;
+}
+
+static int parse_op(char *cmd, struct mmio_op *op)
+{
+    char *save, *tok[5];
+    uint64_t count = 1;
+    int n = 0;
+
+    while (n < 5 && (tok[n] = strtok_r(n ? NULL : cmd, " \t", &save)) != NULL)
+        n++;
+    if (n == 0)
+        return 1;                   /* empty command */
+
+    memset(op, 0, sizeof(*op));
+    op->op = tok[0][0];
+    op->width = tok[0][1] ? atoi(&tok[0][1]) : 4;
+    if (!strchr("rwm", op->op) || !width_ok(op->width))
+        return _error(0, "Bad command '%s'", tok[0]);
+    if (n < 2 || parse_u64(tok[1], &op->addr) || (op->addr & (op->width - 1)))
+        return _error(0, "Bad address in '%s'", tok[0]);
+
+    switch (op->op) {
+    case 'r':
+        if (n > 3 || (n == 3 && (parse_u64(tok[2], &count) || count == 0)))
+            return _error(0, "Usage: r<width> <addr> [count]");
+        break;
+    case 'w':
+        if (n != 3 || parse_u64(tok[2], &op->value))
+            return _error(0, "Usage: w<width> <addr> <value>");
+        break;
+    case 'm':
+        if (n != 4 || parse_u64(tok[2], &op->mask) || parse_u64(tok[3], &op->value))
+            return _error(0, "Usage: m<width> <addr> <mask> <value>");
+        break;
+    }
+    if (count > SIZE_MAX / op->width)
+        return _error(0, "Count too large");
+    op->count = count;
+    return 0;
+}
+
+int mmio_script(const char *script, struct iobuf *out)
+{
+    struct mmio_op *ops = NULL, *tmp;
+    char *buf, *save, *cmd;
+    size_t nops = 0, cap = 0, i;
+    struct mmio_map *e;
+    int ret = 0;
+
+    if ((buf = strdup(script)) == NULL)
+        return _error(ENOMEM, "Parsing script");
+    for (cmd = strtok_r(buf, ";\n", &save); cmd; cmd = strtok_r(NULL, ";\n", &save)) {
+        if (nops == cap) {
+            cap = cap ? cap * 2 : 16;
+            if ((tmp = realloc(ops, cap * sizeof(*ops))) == NULL) {
+                ret = _error(ENOMEM, "Parsing script");
+                break;
+            }
+            ops = tmp;
+        }
+        if ((ret = parse_op(cmd, &ops[nops])) < 0)
+            break;
+        if (ret == 0)
+            nops++;
+        ret = 0;
+    }
+    free(buf);
+    if (ret < 0) {
+        free(ops);
+        return ret;
+    }
+
+    pthread_mutex_lock(&M.lock);
+    for (i=0; i<nops; i++) {
+        struct mmio_op *op = &ops[i];
+        size_t len = op->count * op->width;
+        uint8_t *p;
+
+        if ((e = map_locked(op->addr, len, op->op != 'r')) == NULL) {
+            ret = -1;
+            break;
+        }
+        p = e->virt + (op->addr - e->base);
+        switch (op->op) {
+        case 'r':
+            dump_locked(out, op->addr, p, len, op->width);
+            break;
+        case 'w':
+            mmio_raw_write(p, op->width, op->value);
+            break;
+        case 'm':
+            mmio_raw_write(p, op->width, (mmio_raw_read(p, op->width) & ~op->mask) | (op->value & op->mask));
+            break;
+        }
+    }
+    pthread_mutex_unlock(&M.lock);
+    free(ops);
+    return ret;
+}
+
+void mmio_flush(void)
+{
+    bool pinned = false;
+    int i;
+
+    pthread_mutex_lock(&M.lock);
+    for (i=0; i<MMIO_CACHE_MAX; i++) {
+        struct mmio_map *e = &M.map[i];
+        if (!e->virt)
+            continue;
+        if (e->refs) {
+            pinned = true;
+            continue;
+        }
+        munmap(e->virt, e->len);
+        memset(e, 0, sizeof(*e));
+    }
+    if (!pinned && M.fd >= 0) {
+        close(M.fd);
+        M.fd = -1;
+    }
+    pthread_mutex_unlock(&M.lock);
+}
+
+void mmio_stats(unsigned long *hits, unsigned long *misses, int *mapped)
+{
+    int i;
+
+    pthread_mutex_lock(&M.lock);
+    *hits = M.hits;
+    *misses = M.misses;
+    for (i=0, *mapped=0; i<MMIO_CACHE_MAX; i++) {
+        if (M.map[i].virt)
+            (*mapped)++;
+    }
+    pthread_mutex_unlock(&M.lock);
+}
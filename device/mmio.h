@@ -0,0 +1,130 @@
+#ifndef __MMIO_H__
+#define __MMIO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "iobuf.h"
+
+/*
+ * Physical memory access through /dev/mem.
+ *
+ * Mappings are page aligned windows (at least MMIO_WINDOW bytes) kept in a
+ * small LRU cache keyed by physical range, so polling a register costs a
+ * cache lookup instead of open() + mmap() + munmap(). mmio_get() pins a
+ * window until mmio_put(), pinned windows are never evicted.
+ *
+ * Functions return 0 or a pointer on success, -1 or NULL with
+ * mmio_errmsg() set on failure.
+ */
+#define MMIO_WINDOW     (64 * 1024)
+#define MMIO_CACHE_MAX  (16)
+
+static inline uint64_t mmio_raw_read(const volatile void *p, int width)
+{
+    switch (width) {
+    case 1:
+        return *(const volatile uint8_t *)p;
+    case 2:
+        return *(const volatile uint16_t *)p;
+    case 4:
+        return *(const volatile uint32_t *)p;
+    default:
+        return *(const volatile uint64_t *)p;
+    }
+}
+
+static inline void mmio_raw_write(volatile void *p, int width, uint64_t value)
+{
+    switch (width) {
+    case 1:
+        *(volatile uint8_t *)p = value;
+        break;
+    case 2:
+        *(volatile uint16_t *)p = value;
+        break;
+    case 4:
+        *(volatile uint32_t *)p = value;
+        break;
+    default:
+        *(volatile uint64_t *)p = value;
+        break;
+    }
+}
+
+void *mmio_get(uint64_t addr, size_t len, bool write);
+void mmio_put(void *virt);
+int mmio_read(uint64_t addr, int width, uint64_t *value);
+int mmio_write(uint64_t addr, int width, uint64_t value);
+/*
+ * Bulk copies between device memory and RAM: the device side is accessed
+ * with aligned 8 byte loads/stores (64 byte NEON bursts when available),
+ * never with the unaligned or byte accesses memcpy() may use. Unaligned
+ * head and tail bytes go through their aligned 32 bit word: copy_from
+ * reads the whole word, copy_to read-modify-writes it.
+ */
+void mmio_copy_from(void *dst, const volatile void *src, size_t len);
+void mmio_copy_to(volatile void *dst, const void *src, size_t len);
+/* hex dump, 16 bytes a line, appended to out */
+int mmio_dump(struct iobuf *out, uint64_t addr, size_t len, int width);
+/*
+ * Run a batch of accesses with the cache locked once, results go to out.
+ * Commands are separated by ';' or newlines, width is 1, 2, 4 or 8:
+ *   r<width> <addr> [count]         read count registers
+ *   w<width> <addr> <value>         write
+ *   m<width> <addr> <mask> <value>  read, replace the mask bits, write
+ * The whole script is parsed before the first access.
+ */
+int mmio_script(const char *script, struct iobuf *out);
+/* unmap every unpinned window and close /dev/mem */
+void mmio_flush(void);
+void mmio_stats(unsigned long *hits, unsigned long *misses, int *mapped);
+const char *mmio_errmsg(void);
+
+/*
+ * Register sampling: a dedicated thread reads up to MMIO_SAMPLE_MAX_REGS
+ * pinned registers every period_ns, paced by a timerfd or by spinning on
+ * the clock (busy_poll, pair with cpu to keep it on an isolated core).
+ * Samples that differ from the previous one go through a lock-free ring
+ * to a writer thread that encodes them to a file and/or a buffer the
+ * websocket server drains to /mmio clients.
+ *
+ * Stream, little endian: a header
+ *   "MMIOSMP1" u32 nregs u64 period_ns u64 base_ns u64 realtime_ns
+ *   nregs * { u64 addr u32 width u64 value }
+ * then one record per change, LEB128 varints
+ *   dt_ns changed_mask xor[popcount(changed_mask)]
+ * where dt_ns is relative to the previous record (or base_ns) and each
+ * xor is against the previous value of that register. Every websocket
+ * message starts with its own header.
+ */
+#define MMIO_SAMPLE_MAX_REGS    (32)
+
+typedef struct mmio_sample_options {
+    uint64_t addr[MMIO_SAMPLE_MAX_REGS];
+    int width[MMIO_SAMPLE_MAX_REGS];
+    int nregs;
+    uint64_t period_ns;                 /* 100ns - 1s */
+    uint64_t count;                     /* samples, 0: until stopped */
+    bool busy_poll;
+    int cpu;                            /* pin the sampler, -1: don't */
+    const char *path;                   /* optional output file */
+    bool websocket;
+} mmio_sample_options_t;
+
+struct mmio_sample_stats {
+    bool running;
+    uint64_t samples;
+    uint64_t changes;
+    uint64_t overruns;                  /* periods missed by the sampler */
+    uint64_t dropped;                   /* changes lost to a full ring */
+    uint64_t bytes;                     /* encoded, file sink */
+};
+
+int mmio_sample_start(const mmio_sample_options_t *opt);
+void mmio_sample_stop(void);
+void mmio_sample_stats(struct mmio_sample_stats *st);
+/* move pending websocket data to out, returns bytes added */
+size_t mmio_sample_drain(struct iobuf *out);
+
+#endif
@@ -0,0 +1,414 @@
+#define _GNU_SOURCE                 /* pthread_setaffinity_np */
+#define LOG_MODULE_NAME "mmio"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+
+#include "mmio.h"
+#include "log.h"
+#include "metrics.h"
+
+#define SAMPLE_RING_SIZE    (4096)          /* power of 2 */
+#define SAMPLE_FLUSH        (64 * 1024)     /* file sink write size */
+#define SAMPLE_WS_MAX       (1 << 20)       /* undrained websocket data */
+#define SAMPLE_IDLE_NS      (2000000)       /* writer poll interval */
+#define SAMPLE_ENC_MAX      (64 + MMIO_SAMPLE_MAX_REGS * 20)    /* header or one sample */
+
+struct sample {
+    uint64_t ts;
+    uint64_t val[MMIO_SAMPLE_MAX_REGS];
+};
+
+/* one per sink, holds what the decoder will have seen so far */
+struct sample_enc {
+    struct iobuf buf;
+    uint64_t ts;
+    uint64_t val[MMIO_SAMPLE_MAX_REGS];
+};
+
+static struct {
+    pthread_mutex_t lock;                   /* websocket sink */
+    pthread_t sampler;
+    pthread_t writer;
+    bool running;
+    atomic_bool stop;
+    atomic_bool done;                       /* sampler exited */
+    mmio_sample_options_t opt;
+    volatile uint8_t *reg[MMIO_SAMPLE_MAX_REGS];
+    /* single producer (sampler) single consumer (writer) */
+    struct sample *ring;
+    atomic_uint_fast64_t head;
+    atomic_uint_fast64_t tail;
+    int64_t rt_off;                         /* CLOCK_REALTIME - CLOCK_MONOTONIC */
+    FILE *fp;
+    struct sample_enc file;
+    struct sample_enc ws;
+    atomic_uint_fast64_t samples;
+    atomic_uint_fast64_t changes;
+    atomic_uint_fast64_t overruns;
+    atomic_uint_fast64_t dropped;
+    atomic_uint_fast64_t bytes;
+} S = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static void put_le(struct iobuf *io, uint64_t v, int n)
+{
+    uint8_t b[8];
+    int i;
+
+    for (i=0; i<n; i++, v>>=8)
+        b[i] = v;
+    iobuf_add(io, io->len, b, n);
+}
+
+static void put_varint(struct iobuf *io, uint64_t v)
+{
+    uint8_t b[10];
+    int n = 0;
+
+    while (v >= 0x80) {
+        b[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    b[n++] = v;
+    iobuf_add(io, io->len, b, n);
+}
+
+static void enc_header(struct sample_enc *e)
+{
+    int i;
+
+    iobuf_add(&e->buf, e->buf.len, "MMIOSMP1", 8);
+    put_le(&e->buf, S.opt.nregs, 4);
+    put_le(&e->buf, S.opt.period_ns, 8);
+    put_le(&e->buf, e->ts, 8);
+    put_le(&e->buf, e->ts + S.rt_off, 8);
+    for (i=0; i<S.opt.nregs; i++) {
+        put_le(&e->buf, S.opt.addr[i], 8);
+        put_le(&e->buf, S.opt.width[i], 4);
+        put_le(&e->buf, e->val[i], 8);
+    }
+}
+
+static void enc_sample(struct sample_enc *e, const struct sample *s)
+{
+    uint32_t mask = 0;
+    int i;
+
+    for (i=0; i<S.opt.nregs; i++) {
+        if (s->val[i] != e->val[i])
+            mask |= 1u << i;
+    }
+    /* the changes in between were dropped */
+    if (!mask)
+        return;
+
+    put_varint(&e->buf, s->ts - e->ts);
+    put_varint(&e->buf, mask);
+    for (i=0; i<S.opt.nregs; i++) {
+        if (mask & (1u << i)) {
+            put_varint(&e->buf, s->val[i] ^ e->val[i]);
+            e->val[i] = s->val[i];
+        }
+    }
+    e->ts = s->ts;
+}
+
+static void file_flush(void)
+{
+    if (S.file.buf.len == 0)
+        return;
+    if (fwrite(S.file.buf.buf, S.file.buf.len, 1, S.fp) != 1)
+        log_error("sample write: %s", strerror(errno));
+    fflush(S.fp);
+    atomic_fetch_add(&S.bytes, S.file.buf.len);
+    S.file.buf.len = 0;
+}
+
+static void *writer_thread(void *arg)
+{
+    const struct timespec idle = { 0, SAMPLE_IDLE_NS };
+    uint64_t head, tail = 0;
+    struct sample *s;
+    bool done;
+
+    for (;;) {
+        /* read done first, everything pushed before it is then visible */
+        done = atomic_load(&S.done);
+        head = atomic_load_explicit(&S.head, memory_order_acquire);
+
+        for (; tail != head; tail++) {
+            s = &S.ring[tail & (SAMPLE_RING_SIZE - 1)];
+            if (S.fp) {
+                enc_sample(&S.file, s);
+                if (S.file.buf.len >= SAMPLE_FLUSH)
+                    file_flush();
+            }
+            if (S.opt.websocket) {
+                pthread_mutex_lock(&S.lock);
+                if (S.ws.buf.len == 0)
+                    enc_header(&S.ws);
+                enc_sample(&S.ws, s);
+                /* nobody is draining, restart with a fresh header */
+                if (S.ws.buf.len > SAMPLE_WS_MAX)
+                    S.ws.buf.len = 0;
+                pthread_mutex_unlock(&S.lock);
+            }
+            atomic_store_explicit(&S.tail, tail + 1, memory_order_release);
+        }
+        if (S.fp)
+            file_flush();
+        if (done)
+            break;
+        nanosleep(&idle, NULL);
+    }
+    return NULL;
+}
+
+static void *sampler_thread(void *arg)
+{
+    uint64_t period = S.opt.period_ns, next, now, head, exp, n = 0;
+    uint64_t last[MMIO_SAMPLE_MAX_REGS];
+    struct itimerspec its;
+    struct sample cur;
+    bool changed;
+    int tfd = -1, i;
+
+    memcpy(last, S.file.val, sizeof(last));
+    if (S.opt.cpu >= 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(S.opt.cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            log_warn("Can not pin sampler to cpu %d", S.opt.cpu);
+    }
+    if (!S.opt.busy_poll) {
+        tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (tfd < 0) {
+            log_error("timerfd_create: %s", strerror(errno));
+            goto out;
+        }
+        its.it_interval.tv_sec = its.it_value.tv_sec = period / 1000000000ULL;
+        its.it_interval.tv_nsec = its.it_value.tv_nsec = period % 1000000000ULL;
+        timerfd_settime(tfd, 0, &its, NULL);
+    }
+
+    next = metric_now() + period;
+    while (!atomic_load_explicit(&S.stop, memory_order_relaxed)) {
+        if (tfd >= 0) {
+            if (read(tfd, &exp, sizeof(exp)) != sizeof(exp)) {
+                if (errno == EINTR)
+                    continue;
+                log_error("timerfd read: %s", strerror(errno));
+                break;
+            }
+            if (exp > 1)
+                atomic_fetch_add_explicit(&S.overruns, exp - 1, memory_order_relaxed);
+        } else {
+            while ((now = metric_now()) < next)
+                cpu_relax();
+            if (now - next >= period) {
+                atomic_fetch_add_explicit(&S.overruns, (now - next) / period, memory_order_relaxed);
+                next = now;
+            }
+            next += period;
+        }
+
+        cur.ts = metric_now();
+        changed = false;
+        for (i=0; i<S.opt.nregs; i++) {
+            cur.val[i] = mmio_raw_read(S.reg[i], S.opt.width[i]);
+            if (cur.val[i] != last[i]) {
+                last[i] = cur.val[i];
+                changed = true;
+            }
+        }
+        atomic_fetch_add_explicit(&S.samples, 1, memory_order_relaxed);
+
+        if (changed) {
+            head = atomic_load_explicit(&S.head, memory_order_relaxed);
+            if (head - atomic_load_explicit(&S.tail, memory_order_acquire) >= SAMPLE_RING_SIZE) {
+                atomic_fetch_add_explicit(&S.dropped, 1, memory_order_relaxed);
+            } else {
+                S.ring[head & (SAMPLE_RING_SIZE - 1)] = cur;
+                atomic_store_explicit(&S.head, head + 1, memory_order_release);
+                atomic_fetch_add_explicit(&S.changes, 1, memory_order_relaxed);
+            }
+        }
+        if (S.opt.count && ++n >= S.opt.count)
+            break;
+    }
+out:
+    if (tfd >= 0)
+        close(tfd);
+    atomic_store(&S.done, true);
+    return NULL;
+}
+
+static void sample_release(void)
+{
+    int i;
+
+    for (i=0; i<MMIO_SAMPLE_MAX_REGS; i++) {
+        if (S.reg[i])
+            mmio_put((void *)S.reg[i]);
+        S.reg[i] = NULL;
+    }
+    if (S.fp)
+        fclose(S.fp);
+    S.fp = NULL;
+    free(S.ring);
+    S.ring = NULL;
+    iobuf_free(&S.file.buf);
+    pthread_mutex_lock(&S.lock);
+    iobuf_free(&S.ws.buf);
+    pthread_mutex_unlock(&S.lock);
+}
+
+int mmio_sample_start(const mmio_sample_options_t *opt)
+{
+    struct timespec rt;
+    int i, w, ok;
+
+    /* a counted run that finished still needs reaping */
+    if (S.running && !atomic_load(&S.done)) {
+        log_error("Sampling already running");
+        return -1;
+    }
+    mmio_sample_stop();
+
+    if (opt->nregs <= 0 || opt->nregs > MMIO_SAMPLE_MAX_REGS ||
+            opt->period_ns < 100 || opt->period_ns > 1000000000ULL ||
+            (!opt->path && !opt->websocket)) {
+        log_error("Bad sampling options");
+        return -1;
+    }
+    S.opt = *opt;
+    S.opt.path = NULL;
+
+    for (i=0; i<S.opt.nregs; i++) {
+        w = S.opt.width[i];
+        if ((w != 1 && w != 2 && w != 4 && w != 8) || (S.opt.addr[i] & (w - 1))) {
+            log_error("Bad register 0x%llx/%d", (unsigned long long)S.opt.addr[i], w);
+            goto fail;
+        }
+        if ((S.reg[i] = mmio_get(S.opt.addr[i], w, false)) == NULL) {
+            log_error("%s", mmio_errmsg());
+            goto fail;
+        }
+    }
+    if (opt->path && (S.fp = fopen(opt->path, "wb")) == NULL) {
+        log_error("sample open %s: %s", opt->path, strerror(errno));
+        goto fail;
+    }
+    if ((S.ring = malloc(SAMPLE_RING_SIZE * sizeof(*S.ring))) == NULL)
+        goto fail;
+    /* sized once, iobuf_add() would otherwise regrow them a chunk at a time */
+    if (S.fp && !iobuf_resize(&S.file.buf, SAMPLE_FLUSH + SAMPLE_ENC_MAX))
+        goto fail;
+    pthread_mutex_lock(&S.lock);
+    ok = !S.opt.websocket || iobuf_resize(&S.ws.buf, SAMPLE_WS_MAX + SAMPLE_ENC_MAX);
+    pthread_mutex_unlock(&S.lock);
+    if (!ok)
+        goto fail;
+
+    /* the header carries the first sample */
+    clock_gettime(CLOCK_REALTIME, &rt);
+    S.file.ts = metric_now();
+    S.rt_off = (int64_t)((uint64_t)rt.tv_sec * 1000000000ULL + rt.tv_nsec) - (int64_t)S.file.ts;
+    for (i=0; i<S.opt.nregs; i++)
+        S.file.val[i] = mmio_raw_read(S.reg[i], S.opt.width[i]);
+    S.file.buf.len = 0;
+    pthread_mutex_lock(&S.lock);
+    S.ws.ts = S.file.ts;
+    memcpy(S.ws.val, S.file.val, sizeof(S.ws.val));
+    S.ws.buf.len = 0;
+    pthread_mutex_unlock(&S.lock);
+    if (S.fp)
+        enc_header(&S.file);
+
+    atomic_store(&S.head, 0);
+    atomic_store(&S.tail, 0);
+    atomic_store(&S.samples, 0);
+    atomic_store(&S.changes, 0);
+    atomic_store(&S.overruns, 0);
+    atomic_store(&S.dropped, 0);
+    atomic_store(&S.bytes, 0);
+    atomic_store(&S.stop, false);
+    atomic_store(&S.done, false);
+
+    if (pthread_create(&S.writer, NULL, writer_thread, NULL) != 0)
+        goto fail;
+    if (pthread_create(&S.sampler, NULL, sampler_thread, NULL) != 0) {
+        atomic_store(&S.done, true);
+        pthread_join(S.writer, NULL);
+        goto fail;
+    }
+    S.running = true;
+    log_info("Sampling %d registers every %lluns%s", S.opt.nregs,
+             (unsigned long long)S.opt.period_ns, S.opt.busy_poll ? ", busy polling" : "");
+    return 0;
+
+fail:
+    sample_release();
+    return -1;
+}
+
+void mmio_sample_stop(void)
+{
+    if (!S.running)
+        return;
+
+    atomic_store(&S.stop, true);
+    pthread_join(S.sampler, NULL);
+    pthread_join(S.writer, NULL);
+    S.running = false;
+    sample_release();
+    log_info("Sampling stopped: %llu samples, %llu changes, %llu overruns, %llu dropped",
+             (unsigned long long)atomic_load(&S.samples), (unsigned long long)atomic_load(&S.changes),
+             (unsigned long long)atomic_load(&S.overruns), (unsigned long long)atomic_load(&S.dropped));
+}
+
+void mmio_sample_stats(struct mmio_sample_stats *st)
+{
+    st->running = S.running && !atomic_load(&S.done);
+    st->samples = atomic_load(&S.samples);
+    st->changes = atomic_load(&S.changes);
+    st->overruns = atomic_load(&S.overruns);
+    st->dropped = atomic_load(&S.dropped);
+    st->bytes = atomic_load(&S.bytes);
+}
+
+size_t mmio_sample_drain(struct iobuf *out)
+{
+    size_t n;
+
+    pthread_mutex_lock(&S.lock);
+    n = S.ws.buf.len;
+    if (n) {
+        iobuf_add(out, out->len, S.ws.buf.buf, n);
+        S.ws.buf.len = 0;
+    }
+    pthread_mutex_unlock(&S.lock);
+    return n;
+}
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "pwm.h"
+#include "sysfs.h"
+
+#define PWM_EXPORT_WAIT     (100)       /* ms for udev to set up pwmN after export */
+
+struct pwm_handle {
+    char ident[160];
+    char dir[160];                      /* channel directory */
+    sysfs_attr_t period;
+    sysfs_attr_t duty;
+    sysfs_attr_t enable;
+    sysfs_attr_t polarity;              /* not every driver has it */
+    /* what the channel has, writes of the same value are skipped */
+    uint64_t period_ns;
+    uint64_t duty_ns;
+    bool enabled;
+    bool inversed;
+    /* error handle */
+    struct {
+        int c_errno;
+        char errmsg[96];
+    } error;
+};
+
+static int _error(pwm_t *pwm, int code, int c_errno, const char *fmt, ...)
+{
+    va_list ap;
+
+    pwm->error.c_errno = c_errno;
+
+    va_start(ap, fmt);
+    vsnprintf(pwm->error.errmsg, sizeof(pwm->error.errmsg), fmt, ap);
+    va_end(ap);
+
+    if (c_errno) {
+        char buf[64];
+        strerror_r(c_errno, buf, sizeof(buf));
+        snprintf(pwm->error.errmsg+strlen(pwm->error.errmsg), sizeof(pwm->error.errmsg)-strlen(pwm->error.errmsg), ": %s [errno %d]", buf, c_errno);
+    }
+
+    return code;
+}
+
+static int pwm_export(pwm_t *pwm, const char *chip_dir, unsigned int channel)
+{
+    struct timespec ts = { 0, 10 * 1000000L };
+    char buf[16];
+    int i;
+
+    if (access(pwm->dir, F_OK) == 0)
+        return 0;
+    snprintf(buf, sizeof(buf), "%u", channel);
+    if (sysfs_write(chip_dir, "export", buf) < 0 && errno != EBUSY)
+        return -1;
+    for (i=0; i<PWM_EXPORT_WAIT/10; i++) {
+        if (access(pwm->dir, W_OK) == 0)
+            return 0;
+        nanosleep(&ts, NULL);
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+static int read_u64(sysfs_attr_t *attr, uint64_t *value)
+{
+    long long v;
+
+    if (sysfs_attr_read_l(attr, &v) < 0)
+        return -1;
+    *value = v;
+    return 0;
+}
+
+const char *pwm_errmsg(pwm_t *pwm)
+{
+    return pwm->error.errmsg;
+}
+
+int pwm_errno(pwm_t *pwm)
+{
+    return pwm->error.c_errno;
+}
+
+pwm_t *pwm_new(void)
+{
+    pwm_t *pwm = calloc(1, sizeof(pwm_t));
+    if (!pwm)
+        return NULL;
+    sysfs_attr_init(&pwm->period);
+    sysfs_attr_init(&pwm->duty);
+    sysfs_attr_init(&pwm->enable);
+    sysfs_attr_init(&pwm->polarity);
+    return pwm;
+}
+
+void pwm_free(pwm_t *pwm)
+{
+    if (!pwm)
+        return;
+    pwm_close(pwm);
+    free(pwm);
+}
+
+int pwm_open(pwm_t *pwm, pwm_options_t *opt)
+{
+    char chip_dir[128], buf[SYSFS_VALUE_MAX];
+    const char *chip;
+    uint64_t enabled;
+    int ret;
+
+    if (opt->chip[0] == '\0')
+        return _error(pwm, PWM_ERROR_ARG, 0, "No pwm chip");
+    if (opt->chip[0] == '/')
+        snprintf(chip_dir, sizeof(chip_dir), "%s", opt->chip);
+    else
+        snprintf(chip_dir, sizeof(chip_dir), PWM_SYSFS_DIR "/%s", opt->chip);
+    snprintf(pwm->dir, sizeof(pwm->dir), "%s/pwm%u", chip_dir, opt->channel);
+    chip = strrchr(chip_dir, '/') ? strrchr(chip_dir, '/') + 1 : chip_dir;
+    snprintf(pwm->ident, sizeof(pwm->ident), "%s/pwm%u", chip, opt->channel);
+
+    if (pwm_export(pwm, chip_dir, opt->channel) < 0)
+        return _error(pwm, PWM_ERROR_OPEN, errno, "Exporting %s", pwm->ident);
+    if (sysfs_attr_open(&pwm->period, pwm->dir, "period", O_RDWR) < 0 ||
+            sysfs_attr_open(&pwm->duty, pwm->dir, "duty_cycle", O_RDWR) < 0 ||
+            sysfs_attr_open(&pwm->enable, pwm->dir, "enable", O_RDWR) < 0) {
+        _error(pwm, PWM_ERROR_OPEN, errno, "Opening %s", pwm->ident);
+        pwm_close(pwm);
+        return PWM_ERROR_OPEN;
+    }
+    sysfs_attr_open(&pwm->polarity, pwm->dir, "polarity", O_RDWR);
+
+    if (read_u64(&pwm->period, &pwm->period_ns) < 0 || read_u64(&pwm->duty, &pwm->duty_ns) < 0 ||
+            read_u64(&pwm->enable, &enabled) < 0) {
+        _error(pwm, PWM_ERROR_IO, errno, "Reading %s", pwm->ident);
+        pwm_close(pwm);
+        return PWM_ERROR_IO;
+    }
+    pwm->enabled = enabled != 0;
+    if (pwm->polarity.fd >= 0 && sysfs_attr_read(&pwm->polarity, buf, sizeof(buf)) > 0)
+        pwm->inversed = !strcmp(buf, "inversed");
+
+    if ((opt->inversed != pwm->inversed && (ret = pwm_set_polarity(pwm, opt->inversed)) != 0) ||
+            (opt->period_ns && (ret = pwm_config(pwm, opt->period_ns, opt->duty_ns)) != 0) ||
+            (opt->enable >= 0 && (ret = pwm_enable(pwm, opt->enable)) != 0)) {
+        pwm_close(pwm);
+        return ret;
+    }
+    return 0;
+}
+
+/* the channel stays exported and keeps running, e.g. a fan */
+void pwm_close(pwm_t *pwm)
+{
+    sysfs_attr_close(&pwm->period);
+    sysfs_attr_close(&pwm->duty);
+    sysfs_attr_close(&pwm->enable);
+    sysfs_attr_close(&pwm->polarity);
+}
+
+int pwm_config(pwm_t *pwm, uint64_t period_ns, uint64_t duty_ns)
+{
+    if (pwm->period.fd < 0)
+        return _error(pwm, PWM_ERROR_ARG, 0, "%s not open", pwm->ident);
+    if (period_ns == 0 || duty_ns > period_ns)
+        return _error(pwm, PWM_ERROR_ARG, 0, "Duty %llu ns out of period %llu ns",
+                      (unsigned long long)duty_ns, (unsigned long long)period_ns);
+
+    /* the kernel rejects any step where duty_cycle > period */
+    if (period_ns != pwm->period_ns && pwm->duty_ns <= period_ns) {
+        if (sysfs_attr_write_l(&pwm->period, period_ns) < 0)
+            return _error(pwm, PWM_ERROR_IO, errno, "Writing %s period", pwm->ident);
+        pwm->period_ns = period_ns;
+    }
+    if (duty_ns != pwm->duty_ns) {
+        if (sysfs_attr_write_l(&pwm->duty, duty_ns) < 0)
+            return _error(pwm, PWM_ERROR_IO, errno, "Writing %s duty_cycle", pwm->ident);
+        pwm->duty_ns = duty_ns;
+    }
+    if (period_ns != pwm->period_ns) {
+        if (sysfs_attr_write_l(&pwm->period, period_ns) < 0)
+            return _error(pwm, PWM_ERROR_IO, errno, "Writing %s period", pwm->ident);
+        pwm->period_ns = period_ns;
+    }
+    return 0;
+}
+
+int pwm_set_duty(pwm_t *pwm, uint64_t duty_ns)
+{
+    return pwm_config(pwm, pwm->period_ns, duty_ns);
+}
+
+int pwm_enable(pwm_t *pwm, bool enable)
+{
+    if (pwm->enable.fd < 0)
+        return _error(pwm, PWM_ERROR_ARG, 0, "%s not open", pwm->ident);
+    if (enable == pwm->enabled)
+        return 0;
+    if (sysfs_attr_write(&pwm->enable, enable ? "1" : "0") < 0)
+        return _error(pwm, PWM_ERROR_IO, errno, "Writing %s enable", pwm->ident);
+    pwm->enabled = enable;
+    return 0;
+}
+
+int pwm_set_polarity(pwm_t *pwm, bool inversed)
+{
+    bool enabled = pwm->enabled;
+    int ret;
+
+    if (inversed == pwm->inversed)
+        return 0;
+    if (pwm->polarity.fd < 0)
+        return _error(pwm, PWM_ERROR_ARG, 0, "%s has no polarity", pwm->ident);
+    /* only accepted while disabled */
+    if ((ret = pwm_enable(pwm, false)) != 0)
+        return ret;
+    if (sysfs_attr_write(&pwm->polarity, inversed ? "inversed" : "normal") < 0)
+        ret = _error(pwm, PWM_ERROR_IO, errno, "Writing %s polarity", pwm->ident);
+    else
+        pwm->inversed = inversed;
+    if (enabled && pwm_enable(pwm, true) != 0 && ret == 0)
+        ret = PWM_ERROR_IO;
+    return ret;
+}
+
+void pwm_state(pwm_t *pwm, uint64_t *period_ns, uint64_t *duty_ns, bool *enabled)
+{
+    if (period_ns)
+        *period_ns = pwm->period_ns;
+    if (duty_ns)
+        *duty_ns = pwm->duty_ns;
+    if (enabled)
+        *enabled = pwm->enabled;
+}
+
+const char *pwm_id(pwm_t *pwm)
+{
+    return pwm->ident;
+}
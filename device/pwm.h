@@ -0,0 +1,42 @@
+#ifndef __PWM_H__
+#define __PWM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum pwm_error_code {
+    PWM_ERROR_ARG               = -1, /* Invalid arguments */
+    PWM_ERROR_OPEN              = -2, /* Exporting/opening pwm channel */
+    PWM_ERROR_IO                = -3, /* Reading/writing pwm attributes */
+};
+
+#define PWM_SYSFS_DIR   "/sys/class/pwm"
+
+typedef struct pwm_handle pwm_t;
+
+/* period_ns 0 and enable -1 leave what the channel has */
+typedef struct pwm_options {
+    char chip[96];                  /* pwmchipN under PWM_SYSFS_DIR, or a path */
+    unsigned int channel;
+    uint64_t period_ns;
+    uint64_t duty_ns;
+    bool inversed;
+    int enable;
+} pwm_options_t;
+
+pwm_t *pwm_new(void);
+void pwm_free(pwm_t *pwm);
+int pwm_open(pwm_t *pwm, pwm_options_t *opt);
+void pwm_close(pwm_t *pwm);
+/* period and duty in one go, written in the order the kernel accepts */
+int pwm_config(pwm_t *pwm, uint64_t period_ns, uint64_t duty_ns);
+int pwm_set_duty(pwm_t *pwm, uint64_t duty_ns);
+int pwm_enable(pwm_t *pwm, bool enable);
+/* the channel is stopped around the change when running */
+int pwm_set_polarity(pwm_t *pwm, bool inversed);
+void pwm_state(pwm_t *pwm, uint64_t *period_ns, uint64_t *duty_ns, bool *enabled);
+const char *pwm_id(pwm_t *pwm);
+const char *pwm_errmsg(pwm_t *pwm);
+int pwm_errno(pwm_t *pwm);
+
+#endif
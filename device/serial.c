@@ -1,3 +1,5 @@
+#define LOG_MODULE_NAME "serial"
+
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -17,13 +19,31 @@
 
 #include "config.h"
 #include "log.h"
+#include "codec.h"
 #include "serial.h"
 #include "io_channel.h"
 #include "utils.h"
+#include "trace.h"
+#include "metrics.h"
+#include "evprof.h"
+
+/* a detector waiting longer than this has lost sync, drop a byte and move on */
+#define DETECT_WAIT_MAX     (CODEC_FRAME_MAX + 64)
+#define DETECT_WAIT_NS      (1000000000ULL)
 
 struct serial_handle {
-    char ident[64];
+    char ident[128];
+    char path[96];
     int fd;
+    int trace_id;
+    uint64_t rx_time;               /* CLOCK_MONOTONIC ns, last read with data */
+    uint64_t wait_time;             /* rx_time when a detector began waiting at the buffer head */
+    struct {
+        metric_t *rx_bytes;
+        metric_t *tx_bytes;
+        metric_t *errors;
+        metric_t *unclaimed;
+    } stats;
     bool use_termios_timeout;
     struct ev_loop *loop;
     struct io_channel io;
@@ -31,6 +51,9 @@ struct serial_handle {
     void *user_data;
 
     struct list_head clients;
+    /* ports opened with serial_get() */
+    int refcount;
+    struct list_head shared;
     struct {
         int c_errno;
         char errmsg[256];
@@ -63,11 +86,59 @@ serial_t *serial_new()
         return NULL;
 
     serial->fd = -1;
+    serial->trace_id = -1;
     INIT_LIST_HEAD(&serial->clients);
+    INIT_LIST_HEAD(&serial->shared);
+    return serial;
+}
+
+static LIST_HEAD(shared_ports);
+
+serial_t *serial_get(const char *path, uint32_t baudrate, struct ev_loop *loop)
+{
+    serial_t *serial;
+    uint32_t cur;
+
+    list_for_each_entry(serial, &shared_ports, shared) {
+        if (strcmp(serial->path, path))
+            continue;
+        if (serial_get_baudrate(serial, &cur) == 0 && cur != baudrate)
+            log_warn("%s shared at %u, ignoring baudrate %u", path, cur, baudrate);
+        serial->refcount++;
+        return serial;
+    }
+
+    if ((serial = serial_new()) == NULL)
+        return NULL;
+    if (serial_open(serial, path, baudrate, loop) != 0) {
+        log_error("%s", serial_errmsg(serial));
+        serial_free(serial);
+        return NULL;
+    }
+    serial->refcount = 1;
+    list_add_tail(&serial->shared, &shared_ports);
     return serial;
 }
 
+void serial_put(serial_t *serial)
+{
+    if (!serial || --serial->refcount > 0)
+        return;
+    list_del_init(&serial->shared);
+    serial_close(serial);
+    serial_free(serial);
+}
+
+int serial_refcount(serial_t *serial)
+{
+    return serial->refcount;
+}
+
 void serial_free(serial_t *serial) {
+    struct serial_client *client, *tmp;
+
+    list_for_each_entry_safe(client, tmp, &serial->clients, list)
+        list_del_init(&client->list);
     free(serial);
 }
 
@@ -170,7 +241,6 @@ static void _serial_write_cb(struct ev_loop *loop, struct ev_io *w, int revents)
     ssize_t remain = len;
     bool nonblock = fd_is_nonblock(serial->fd);
 
-    iobuf_dump(wbuf, wbuf->len);
     do {
         n = write(serial->fd, buf, remain);
         if (unlikely(n < 0)) {
@@ -181,8 +251,11 @@ static void _serial_write_cb(struct ev_loop *loop, struct ev_io *w, int revents)
                 break;
             
             log_error("Writing data %s", strerror(errno));
+            metric_add(serial->stats.errors, 1);
             return;
         }
+        trace_record(serial->trace_id, TRACE_TX, buf, n);
+        metric_add(serial->stats.tx_bytes, n);
         remain -= n;
         iobuf_del(wbuf, 0, (size_t) n);
     } while (remain && nonblock);
@@ -191,6 +264,90 @@ static void _serial_write_cb(struct ev_loop *loop, struct ev_io *w, int revents)
         ev_io_stop(serial->loop, w);
 }
 
+/*
+ * Clients without a frame detector get the buffer from their own offset on,
+ * so no byte reaches them twice. Without detectors the longest consumption
+ * wins, fine for a single protocol per port. Once a client has a detector
+ * the stream is demultiplexed: at each offset the detectors are asked in
+ * turn, the first one claiming a complete frame gets exactly that frame.
+ * Bytes nobody claims are dropped, unless a detector still waits for more
+ * data, and for at most DETECT_WAIT_MAX bytes or DETECT_WAIT_NS. Clients
+ * without a detector then see every byte once, their return value is
+ * ignored.
+ */
+static size_t _serial_dispatch(serial_t *serial, const uint8_t *buf, size_t len)
+{
+    struct serial_client *client;
+    bool demux = false, wait;
+    size_t off = 0, skipped = 0;
+    int n;
+
+    list_for_each_entry(client, &serial->clients, list) {
+        if (client->ops->detect) {
+            demux = true;
+            continue;
+        }
+        if (client->rx_off < len) {
+            client->rx_time = serial->rx_time;
+            n = client->ops->on_receive(serial, client, buf + client->rx_off, len - client->rx_off);
+            if (n > 0)
+                client->rx_off += ((size_t)n < len - client->rx_off) ? (size_t)n : len - client->rx_off;
+        }
+        if (client->rx_off > off)
+            off = client->rx_off;
+    }
+    if (!demux)
+        goto out;
+
+    off = 0;
+    while (off < len) {
+        wait = false;
+        n = -1;
+        list_for_each_entry(client, &serial->clients, list) {
+            if (!client->ops->detect)
+                continue;
+            n = client->ops->detect(serial, client, buf + off, len - off);
+            if (n > 0) {
+                if ((size_t)n > len - off)
+                    n = len - off;
+                client->rx_time = serial->rx_time;
+                client->ops->on_receive(serial, client, buf + off, n);
+                client->rx_bytes += n;
+                break;
+            }
+            if (n == 0)
+                wait = true;
+        }
+        if (wait && (len - off >= DETECT_WAIT_MAX || (off == 0 && serial->wait_time &&
+                     serial->rx_time - serial->wait_time >= DETECT_WAIT_NS)))
+            wait = false;
+        if (n > 0) {
+            off += n;
+        } else if (wait) {
+            if (off || !serial->wait_time)
+                serial->wait_time = serial->rx_time;
+            break;
+        } else {
+            off++;
+            skipped++;
+        }
+    }
+    if (off == len)
+        serial->wait_time = 0;
+    metric_add(serial->stats.unclaimed, skipped);
+
+    list_for_each_entry(client, &serial->clients, list) {
+        if (!client->ops->detect)
+            client->rx_off = len;
+    }
+out:
+    list_for_each_entry(client, &serial->clients, list) {
+        if (!client->ops->detect)
+            client->rx_off = (client->rx_off > off) ? client->rx_off - off : 0;
+    }
+    return off;
+}
+
 static void _serial_read_cb(struct ev_loop *loop, struct ev_io *w, int revents)
 {
     serial_t *serial = container_of(w, serial_t, io.ior);
@@ -221,34 +378,41 @@ static void _serial_read_cb(struct ev_loop *loop, struct ev_io *w, int revents)
             if (errno == EAGAIN || errno == ENOTCONN)
                 break;
             log_error("serial read: %s", strerror(errno));
+            metric_add(serial->stats.errors, 1);
             return;
         }
         if (ret == 0)
             break;
+        /* ttys have no kernel rx timestamps, take it as close to read() as we can */
+        serial->rx_time = metric_now();
+        trace_record(serial->trace_id, TRACE_RX, buf, ret);
+        metric_add(serial->stats.rx_bytes, ret);
         rbuf->len += ret;
         remain -= ret;
     } while (remain && nonblock);
 
-    /* clients may or may not using same codec */
-    struct serial_client *client;
-    int len = 0, max_len = 0;
-    list_for_each_entry(client, &serial->clients, list) {
-        if (client->ops->on_receive) {
-            len = client->ops->on_receive(serial, rbuf->buf, rbuf->len);
-            if (len > max_len) {
-                max_len = len;
-            }
-        }
-    }
-
-    iobuf_del(rbuf, 0, max_len);
+    iobuf_del(rbuf, 0, _serial_dispatch(serial, rbuf->buf, rbuf->len));
 }
 
 int serial_open(serial_t *serial, const char *path, uint32_t baudrate, struct ev_loop *loop)
 {
+    int ret;
+
+    strncpy(serial->path, path, sizeof(serial->path)-1);
     snprintf(serial->ident, sizeof(serial->ident)-1, "%s (%d)", path, baudrate);
     serial->loop = loop;
-    return serial_open_advanced(serial, path, baudrate, 8, PARITY_NONE, 1, false, false);
+    if ((ret = serial_open_advanced(serial, path, baudrate, 8, PARITY_NONE, 1, false, false)) != 0)
+        return ret;
+    serial->trace_id = trace_register(path, TRACE_LINK_SERIAL);
+    serial->stats.rx_bytes = metric_get(METRIC_COUNTER, "devctl_serial_rx_bytes_total",
+                                        "Bytes read from serial port", "device", path, NULL);
+    serial->stats.tx_bytes = metric_get(METRIC_COUNTER, "devctl_serial_tx_bytes_total",
+                                        "Bytes written to serial port", "device", path, NULL);
+    serial->stats.errors = metric_get(METRIC_COUNTER, "devctl_serial_errors_total",
+                                      "Serial port I/O errors", "device", path, NULL);
+    serial->stats.unclaimed = metric_get(METRIC_COUNTER, "devctl_serial_unclaimed_bytes_total",
+                                         "Bytes no client frame detector claimed", "device", path, NULL);
+    return 0;
 }
 
 int serial_open_advanced(serial_t *serial, const char *path, uint32_t baudrate, unsigned int databits, serial_parity_t parity, unsigned int stopbits, bool xonxoff, bool rtscts)
@@ -333,6 +497,8 @@ int serial_open_advanced(serial_t *serial, const char *path, uint32_t baudrate,
     iobuf_init(&serial->io.rbuf, IO_SIZE);
     ev_io_init(&serial->io.iow, _serial_write_cb, serial->fd, EV_WRITE);
     ev_io_init(&serial->io.ior, _serial_read_cb, serial->fd, EV_READ);
+    evprof_watch(&serial->io.iow, "serial.write", path);
+    evprof_watch(&serial->io.ior, "serial.read", path);
     ev_io_start(serial->loop, &serial->io.ior);
     return 0;
 }
@@ -361,6 +527,10 @@ ssize_t serial_read(serial_t *serial, uint8_t *buf, size_t len, int timeout_ms)
 
         if ((ret = read(serial->fd, buf + bytes_read, len - bytes_read)) < 0)
             return _serial_error(serial, SERIAL_ERROR_IO, errno, "Reading serial port");
+        if (ret > 0)
+            serial->rx_time = metric_now();
+        trace_record(serial->trace_id, TRACE_RX, buf + bytes_read, ret);
+        metric_add(serial->stats.rx_bytes, ret);
 
         /* If we're using VMIN or VMIN+VTIME semantics for end of read, return now */
         if (serial->use_termios_timeout)
@@ -393,6 +563,8 @@ ssize_t serial_write_sync(serial_t *serial, const uint8_t *buf, size_t len)
 
     if ((ret = write(serial->fd, buf, len)) < 0)
         return _serial_error(serial, SERIAL_ERROR_IO, errno, "Writing serial port");
+    trace_record(serial->trace_id, TRACE_TX, buf, ret);
+    metric_add(serial->stats.tx_bytes, ret);
 
     return ret;
 }
@@ -442,6 +614,8 @@ int serial_close(serial_t *serial) {
 
     ev_io_stop(serial->loop, &serial->io.ior);
     ev_io_stop(serial->loop, &serial->io.iow);
+    iobuf_free(&serial->io.rbuf);
+    iobuf_free(&serial->io.wbuf);
 
     if (close(serial->fd) < 0)
         return _serial_error(serial, SERIAL_ERROR_CLOSE, errno, "Closing serial port");
@@ -578,6 +752,7 @@ int serial_set_baudrate(serial_t *serial, uint32_t baudrate) {
     if (tcsetattr(serial->fd, TCSANOW, &termios_settings) < 0)
         return _serial_error(serial, SERIAL_ERROR_CONFIGURE, errno, "Setting serial port attributes");
 
+    snprintf(serial->ident, sizeof(serial->ident)-1, "%s (%d)", serial->path, baudrate);
     return 0;
 }
 
@@ -790,6 +965,11 @@ int serial_fd(serial_t *serial)
     return serial->fd;
 }
 
+uint64_t serial_rx_time(serial_t *serial)
+{
+    return serial->rx_time;
+}
+
 void serial_set_userdata(serial_t *serial, void *userdata)
 {
     serial->user_data = userdata;
@@ -802,8 +982,10 @@ void* serial_get_userdata(serial_t *serial)
 
 int serial_add_client(serial_t *serial, struct serial_client *client)
 {
-    if (!client || !client->ops)
+    if (!client || !client->ops || !client->ops->on_receive)
         return -1;
+    client->rx_bytes = 0;
+    client->rx_off = 0;
     list_add_tail(&client->list, &serial->clients);
     return 0;
 }
@@ -812,5 +994,5 @@ void serial_remove_client(serial_t *serial, struct serial_client *client)
 {
     if (!client)
         return;
-    list_del(&client->list);
+    list_del_init(&client->list);
 }
@@ -29,18 +29,32 @@ typedef enum serial_parity {
 typedef struct serial_options {
     char path[96];
     uint32_t baudrate;
+    char codec[32];             /* framing for raw clients (shell), empty or invalid: bytes */
     struct ev_loop *loop;
 } serial_options_t;
 
 typedef struct serial_handle serial_t;
 
+struct serial_client;
+
 struct serial_client_ops {
-    int (*on_receive)(serial_t *serial, const uint8_t *buf, size_t len);
+    /* returns bytes consumed */
+    int (*on_receive)(serial_t *serial, struct serial_client *client, const uint8_t *buf, size_t len);
+    /*
+     * Optional, lets protocols share a port: length of this client's frame
+     * starting at buf, 0 if buf is a partial frame, < 0 if it is not one
+     * of its frames. on_receive() then gets exactly one frame.
+     */
+    int (*detect)(serial_t *serial, struct serial_client *client, const uint8_t *buf, size_t len);
 };
 
 struct serial_client {
     char name[64];
     struct serial_client_ops *ops;
+    void *userdata;
+    size_t rx_bytes;            /* routed by the demultiplexer */
+    size_t rx_off;              /* read buffer already passed to a client without detector */
+    uint64_t rx_time;           /* CLOCK_MONOTONIC ns of the read completing buf, set before on_receive() */
     struct list_head list;
 };
 
@@ -60,6 +74,10 @@ int serial_output_waiting(serial_t *serial, unsigned int *count);
 int serial_poll(serial_t *serial, int timeout_ms);
 int serial_close(serial_t *serial);
 void serial_free(serial_t *serial);
+/* Shared ports, opened once per path and closed with the last reference */
+serial_t *serial_get(const char *path, uint32_t baudrate, struct ev_loop *loop);
+void serial_put(serial_t *serial);
+int serial_refcount(serial_t *serial);
 
 /* Getters */
 int serial_get_baudrate(serial_t *serial, uint32_t *baudrate);
@@ -84,6 +102,7 @@ int serial_set_vtime(serial_t *serial, float vtime);
 /* Miscellaneous */
 int serial_fd(serial_t *serial);
 const char* serial_id(serial_t *serial);
+uint64_t serial_rx_time(serial_t *serial);
 int serial_tostring(serial_t *serial, char *str, size_t len);
 void serial_set_userdata(serial_t *serial, void *userdata);
 void* serial_get_userdata(serial_t *serial);
@@ -0,0 +1,223 @@
+#define LOG_MODULE_NAME "thermal"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <ev.h>
+
+#include "list.h"
+#include "thermal.h"
+#include "sysfs.h"
+#include "log.h"
+#include "utils.h"
+#include "metrics.h"
+#include "evprof.h"
+
+struct thermal_handle {
+    char ident[192];
+    char dir[160];
+    char type[96];
+    sysfs_attr_t temp;
+    /* sampling */
+    struct ev_loop *loop;
+    ev_timer timer;
+    int period_ms;
+
+    struct list_head clients;
+    struct {
+        metric_t *temp;
+        metric_t *errors;
+    } stats;
+    /* error handle */
+    struct {
+        int c_errno;
+        char errmsg[96];
+    } error;
+};
+
+static int _error(thermal_t *thermal, int code, int c_errno, const char *fmt, ...)
+{
+    va_list ap;
+
+    thermal->error.c_errno = c_errno;
+
+    va_start(ap, fmt);
+    vsnprintf(thermal->error.errmsg, sizeof(thermal->error.errmsg), fmt, ap);
+    va_end(ap);
+
+    if (c_errno) {
+        char buf[64];
+        strerror_r(c_errno, buf, sizeof(buf));
+        snprintf(thermal->error.errmsg+strlen(thermal->error.errmsg), sizeof(thermal->error.errmsg)-strlen(thermal->error.errmsg), ": %s [errno %d]", buf, c_errno);
+    }
+
+    return code;
+}
+
+static void stats_init(thermal_t *thermal)
+{
+    thermal->stats.temp = metric_get(METRIC_GAUGE, "devctl_thermal_millicelsius",
+                                     "Thermal zone temperature", "device", thermal->type, NULL);
+    thermal->stats.errors = metric_get(METRIC_COUNTER, "devctl_thermal_errors_total",
+                                       "Failed temperature reads", "device", thermal->type, NULL);
+}
+
+/* thermal_zoneN or a path as is, otherwise the zone whose type matches */
+static int zone_find(thermal_t *thermal, const char *zone)
+{
+    char type[SYSFS_VALUE_MAX];
+    struct dirent *de;
+    DIR *dir;
+    int ret = -1;
+
+    if (zone[0] == '/') {
+        snprintf(thermal->dir, sizeof(thermal->dir), "%s", zone);
+        return 0;
+    }
+    snprintf(thermal->dir, sizeof(thermal->dir), THERMAL_SYSFS_DIR "/%s", zone);
+    if (access(thermal->dir, F_OK) == 0)
+        return 0;
+
+    if ((dir = opendir(THERMAL_SYSFS_DIR)) == NULL)
+        return -1;
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, "thermal_zone", strlen("thermal_zone")) || strlen(de->d_name) > 32)
+            continue;
+        snprintf(thermal->dir, sizeof(thermal->dir), THERMAL_SYSFS_DIR "/%.32s", de->d_name);
+        if (sysfs_read(thermal->dir, "type", type, sizeof(type)) > 0 && !strcmp(type, zone)) {
+            ret = 0;
+            break;
+        }
+    }
+    closedir(dir);
+    if (ret < 0)
+        errno = ENOENT;
+    return ret;
+}
+
+static void thermal_timer_cb(struct ev_loop *loop, struct ev_timer *w, int revents)
+{
+    thermal_t *thermal = container_of(w, thermal_t, timer);
+    struct thermal_client *client, *tmp;
+    int millicelsius;
+
+    if (thermal_get_temp(thermal, &millicelsius) != 0) {
+        metric_add(thermal->stats.errors, 1);
+        log_debug("%s", thermal->error.errmsg);
+        return;
+    }
+    list_for_each_entry_safe(client, tmp, &thermal->clients, list) {
+        if (client->ops->on_sample)
+            client->ops->on_sample(thermal, millicelsius);
+    }
+}
+
+const char *thermal_errmsg(thermal_t *thermal)
+{
+    return thermal->error.errmsg;
+}
+
+int thermal_errno(thermal_t *thermal)
+{
+    return thermal->error.c_errno;
+}
+
+thermal_t *thermal_new(void)
+{
+    thermal_t *thermal = calloc(1, sizeof(thermal_t));
+    if (!thermal)
+        return NULL;
+    sysfs_attr_init(&thermal->temp);
+    INIT_LIST_HEAD(&thermal->clients);
+    ev_timer_init(&thermal->timer, thermal_timer_cb, 0., 0.);
+    return thermal;
+}
+
+void thermal_free(thermal_t *thermal)
+{
+    struct thermal_client *client, *tmp;
+
+    if (!thermal)
+        return;
+    thermal_close(thermal);
+    list_for_each_entry_safe(client, tmp, &thermal->clients, list)
+        list_del_init(&client->list);
+    free(thermal);
+}
+
+int thermal_open(thermal_t *thermal, thermal_options_t *opt)
+{
+    const char *zone;
+
+    if (opt->zone[0] == '\0' || !opt->loop)
+        return _error(thermal, THERMAL_ERROR_ARG, 0, "No thermal zone");
+    if (zone_find(thermal, opt->zone) < 0)
+        return _error(thermal, THERMAL_ERROR_OPEN, errno, "Finding thermal zone %s", opt->zone);
+    if (sysfs_read(thermal->dir, "type", thermal->type, sizeof(thermal->type)) < 0)
+        snprintf(thermal->type, sizeof(thermal->type), "%s", opt->zone);
+    zone = strrchr(thermal->dir, '/') + 1;
+    snprintf(thermal->ident, sizeof(thermal->ident), "%s %s", zone, thermal->type);
+    if (sysfs_attr_open(&thermal->temp, thermal->dir, "temp", O_RDONLY) < 0)
+        return _error(thermal, THERMAL_ERROR_OPEN, errno, "Opening %s temp", thermal->ident);
+
+    thermal->loop = opt->loop;
+    stats_init(thermal);
+    evprof_watch(&thermal->timer, "thermal.sample", thermal->ident);
+    thermal_set_period(thermal, opt->period_ms);
+    return 0;
+}
+
+void thermal_close(thermal_t *thermal)
+{
+    if (thermal->loop)
+        ev_timer_stop(thermal->loop, &thermal->timer);
+    sysfs_attr_close(&thermal->temp);
+}
+
+int thermal_get_temp(thermal_t *thermal, int *millicelsius)
+{
+    long long value;
+
+    if (thermal->temp.fd < 0)
+        return _error(thermal, THERMAL_ERROR_ARG, 0, "%s not open", thermal->ident);
+    if (sysfs_attr_read_l(&thermal->temp, &value) < 0)
+        return _error(thermal, THERMAL_ERROR_IO, errno, "Reading %s temp", thermal->ident);
+    *millicelsius = value;
+    metric_set(thermal->stats.temp, value);
+    return 0;
+}
+
+void thermal_set_period(thermal_t *thermal, int period_ms)
+{
+    thermal->period_ms = period_ms > 0 ? period_ms : 0;
+    ev_timer_stop(thermal->loop, &thermal->timer);
+    if (thermal->period_ms == 0)
+        return;
+    ev_timer_set(&thermal->timer, 0., thermal->period_ms / 1000.);
+    ev_timer_start(thermal->loop, &thermal->timer);
+}
+
+int thermal_add_client(thermal_t *thermal, struct thermal_client *client)
+{
+    if (!client || !client->ops)
+        return -1;
+    list_add_tail(&client->list, &thermal->clients);
+    return 0;
+}
+
+void thermal_remove_client(thermal_t *thermal, struct thermal_client *client)
+{
+    if (!client)
+        return;
+    list_del_init(&client->list);
+}
+
+const char *thermal_id(thermal_t *thermal)
+{
+    return thermal->ident;
+}
@@ -0,0 +1,49 @@
+#ifndef __THERMAL_H__
+#define __THERMAL_H__
+
+#include <stdbool.h>
+#include <ev.h>
+#include "list.h"
+
+enum thermal_error_code {
+    THERMAL_ERROR_ARG           = -1, /* Invalid arguments */
+    THERMAL_ERROR_OPEN          = -2, /* Opening thermal zone */
+    THERMAL_ERROR_IO            = -3, /* Reading temperature */
+};
+
+#define THERMAL_SYSFS_DIR   "/sys/class/thermal"
+
+typedef struct thermal_handle thermal_t;
+
+typedef struct thermal_options {
+    char zone[96];                  /* thermal_zoneN, its type (e.g. cpu-thermal) or a path */
+    int period_ms;                  /* optional, sample into the metrics and clients, 0 off */
+    struct ev_loop *loop;
+} thermal_options_t;
+
+struct thermal_client_ops {
+    /* every sampling period, on the loop */
+    void (*on_sample)(thermal_t *thermal, int millicelsius);
+};
+
+struct thermal_client {
+    char name[64];
+    struct thermal_client_ops *ops;
+    struct list_head list;
+};
+
+thermal_t *thermal_new(void);
+void thermal_free(thermal_t *thermal);
+int thermal_open(thermal_t *thermal, thermal_options_t *opt);
+void thermal_close(thermal_t *thermal);
+int thermal_get_temp(thermal_t *thermal, int *millicelsius);
+/* 0 stops sampling */
+void thermal_set_period(thermal_t *thermal, int period_ms);
+int thermal_add_client(thermal_t *thermal, struct thermal_client *client);
+void thermal_remove_client(thermal_t *thermal, struct thermal_client *client);
+/* "thermal_zoneN type" */
+const char *thermal_id(thermal_t *thermal);
+const char *thermal_errmsg(thermal_t *thermal);
+int thermal_errno(thermal_t *thermal);
+
+#endif
@@ -1,27 +1,494 @@
+#define LOG_MODULE_NAME "uband"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
-#include <pthread.h>
-#include <libudev.h>
+#include <stdint.h>
 #include <ev.h>
 
+#include "list.h"
 #include "uband.h"
-#include "serial.h"
 #include "codec.h"
 #include "log.h"
 #include "utils.h"
-#include "io_channel.h"
+#include "metrics.h"
+#include "evprof.h"
+
+#define UBAND_DEFAULT_BAUDRATE  (115200)
+#define UBAND_DEFAULT_TIMEOUT   (1000)      /* ms */
+#define UBAND_REQUEST_MAX       (256)       /* request payload bytes */
+
+struct uband_pending {
+    bool used;
+    uint8_t seq;
+    uint8_t cmd;
+    uband_reply_cb cb;
+    void *arg;
+    ev_tstamp deadline;
+    uint64_t sent_at;
+};
 
 struct uband_handle {
     char ident[128];
     /* io */
     struct ev_loop *loop;
-    serial_t *serial;
-    const codec_t *codec;
+    serial_t *serial;                   /* shared */
+    struct serial_client serial_client;
+    codec_t *codec;
+    uint64_t rx_time;                   /* frame being dispatched, CLOCK_MONOTONIC ns */
+    /* requests in flight, matched by seq */
+    uint8_t seq;
+    ev_tstamp timeout;
+    struct uband_pending pending[UBAND_MAX_PENDING];
+    ev_timer timer;                     /* earliest pending deadline */
+    /* streams started through uband_stream_start() */
+    uint8_t streams[UBAND_MAX_STREAM / 8];
+
+    struct list_head clients;
+    struct {
+        metric_t *frames;
+        metric_t *unknown;
+        metric_t *skipped;
+        metric_t *timeouts;
+        metric_t *events;
+        metric_t *stream_bytes;
+        metric_t *rtt;
+    } stats;
     /* error handle */
     struct {
         int c_errno;
         char errmsg[96];
     } error;
-};
\ No newline at end of file
+};
+
+static int _error(uband_t *ub, int code, int c_errno, const char *fmt, ...)
+{
+    va_list ap;
+
+    ub->error.c_errno = c_errno;
+
+    va_start(ap, fmt);
+    vsnprintf(ub->error.errmsg, sizeof(ub->error.errmsg), fmt, ap);
+    va_end(ap);
+
+    if (c_errno) {
+        char buf[64];
+        strerror_r(c_errno, buf, sizeof(buf));
+        snprintf(ub->error.errmsg+strlen(ub->error.errmsg), sizeof(ub->error.errmsg)-strlen(ub->error.errmsg), ": %s [errno %d]", buf, c_errno);
+    }
+
+    return code;
+}
+
+static void stats_init(uband_t *ub, const char *device)
+{
+    ub->stats.frames = metric_get(METRIC_COUNTER, "devctl_uband_frames_total",
+                                  "Frames decoded from uband", "device", device, NULL);
+    ub->stats.unknown = metric_get(METRIC_COUNTER, "devctl_uband_unknown_frames_total",
+                                   "Frames with an unknown command or seq", "device", device, NULL);
+    ub->stats.skipped = metric_get(METRIC_COUNTER, "devctl_uband_skipped_bytes_total",
+                                   "Bytes dropped resyncing to a frame header", "device", device, NULL);
+    ub->stats.timeouts = metric_get(METRIC_COUNTER, "devctl_uband_timeouts_total",
+                                    "Requests without a reply in time", "device", device, NULL);
+    ub->stats.events = metric_get(METRIC_COUNTER, "devctl_uband_events_total",
+                                  "Unsolicited events", "device", device, NULL);
+    ub->stats.stream_bytes = metric_get(METRIC_COUNTER, "devctl_uband_stream_bytes_total",
+                                        "Stream payload bytes", "device", device, NULL);
+    ub->stats.rtt = metric_get(METRIC_HISTOGRAM, "devctl_uband_rtt_seconds",
+                               "Request to reply round trip time", "device", device, NULL);
+}
+
+static void stream_set(uband_t *ub, uint8_t stream, bool running)
+{
+    struct uband_client *client;
+
+    if (running)
+        ub->streams[stream / 8] |= 1 << (stream % 8);
+    else
+        ub->streams[stream / 8] &= ~(1 << (stream % 8));
+
+    list_for_each_entry(client, &ub->clients, list) {
+        if (client->ops->on_stream_state)
+            client->ops->on_stream_state(ub, stream, running);
+    }
+}
+
+/* arm the timer for the earliest deadline, stop it when nothing is in flight */
+static void timer_update(uband_t *ub)
+{
+    ev_tstamp next = 0;
+    int i;
+
+    for (i=0; i<UBAND_MAX_PENDING; i++) {
+        if (ub->pending[i].used && (next == 0 || ub->pending[i].deadline < next))
+            next = ub->pending[i].deadline;
+    }
+    ev_timer_stop(ub->loop, &ub->timer);
+    if (next == 0)
+        return;
+    next -= ev_now(ub->loop);
+    ev_timer_set(&ub->timer, next > 0 ? next : 0, 0.);
+    ev_timer_start(ub->loop, &ub->timer);
+}
+
+/* free the slot before the callback, it may send the next request */
+static void pending_complete(uband_t *ub, struct uband_pending *p, int status, const uint8_t *data, size_t len)
+{
+    struct uband_pending done = *p;
+
+    memset(p, 0, sizeof(*p));
+    if (done.cb)
+        done.cb(ub, status, data, len, done.arg);
+}
+
+static void timer_cb(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    uband_t *ub = container_of(w, uband_t, timer);
+    ev_tstamp now = ev_now(loop);
+    int i;
+
+    for (i=0; i<UBAND_MAX_PENDING; i++) {
+        struct uband_pending *p = &ub->pending[i];
+        if (!p->used || p->deadline > now)
+            continue;
+        log_debug("%s: cmd 0x%02x seq %u timeout", uband_id(ub), p->cmd, p->seq);
+        metric_add(ub->stats.timeouts, 1);
+        pending_complete(ub, p, UBAND_STATUS_TIMEOUT, NULL, 0);
+    }
+    if (ub->serial)
+        timer_update(ub);
+}
+
+static void handle_reply(uband_t *ub, uint8_t seq, uint8_t cmd, const uint8_t *payload, size_t len)
+{
+    struct uband_pending *p;
+    int i;
+
+    for (i=0; i<UBAND_MAX_PENDING; i++) {
+        p = &ub->pending[i];
+        if (!p->used || p->seq != seq || p->cmd != (cmd & ~UBAND_CMD_REPLY))
+            continue;
+        if (ub->rx_time > p->sent_at)
+            metric_observe(ub->stats.rtt, ub->rx_time - p->sent_at);
+        if (len == 0)
+            pending_complete(ub, p, UBAND_STATUS_OK, NULL, 0);
+        else
+            pending_complete(ub, p, payload[0], payload + 1, len - 1);
+        timer_update(ub);
+        return;
+    }
+    /* late reply to a request that already timed out */
+    metric_add(ub->stats.unknown, 1);
+}
+
+static void handle_stream(uband_t *ub, const uint8_t *payload, size_t len)
+{
+    struct uband_client *client;
+
+    if (len < 1)
+        return;
+    metric_add(ub->stats.stream_bytes, len - 1);
+    list_for_each_entry(client, &ub->clients, list) {
+        if (client->ops->on_stream)
+            client->ops->on_stream(ub, payload[0], payload + 1, len - 1);
+    }
+}
+
+static void handle_event(uband_t *ub, const uint8_t *payload, size_t len)
+{
+    struct uband_client *client;
+
+    if (len < 1)
+        return;
+    metric_add(ub->stats.events, 1);
+    list_for_each_entry(client, &ub->clients, list) {
+        if (client->ops->on_event)
+            client->ops->on_event(ub, payload[0], payload + 1, len - 1);
+    }
+}
+
+/* data is [seq] [cmd] [payload] */
+static void handle_serial_frame(void *arg, const uint8_t *data, size_t data_len)
+{
+    uband_t *ub = arg;
+    uint8_t seq = data[0], cmd = data[1];
+
+    metric_add(ub->stats.frames, 1);
+    if (cmd & UBAND_CMD_REPLY) {
+        handle_reply(ub, seq, cmd, data + 2, data_len - 2);
+        return;
+    }
+    switch (cmd) {
+        case UBAND_CMD_STREAM_DATA:
+            handle_stream(ub, data + 2, data_len - 2);
+            break;
+        case UBAND_CMD_EVENT:
+            handle_event(ub, data + 2, data_len - 2);
+            break;
+        default:
+            metric_add(ub->stats.unknown, 1);
+            break;
+    }
+}
+
+/* claim 0xA5 frames when the port is shared with other protocols */
+static int detect_serial_frame(serial_t *serial, struct serial_client *client, const uint8_t *buf, size_t len)
+{
+    uband_t *ub = client->userdata;
+    const uint8_t *data;
+    size_t data_len, ret;
+
+    ret = codec_decode(ub->codec, buf, len, &data, &data_len);
+    if (data)
+        return ret;
+    return ret ? -1 : 0;
+}
+
+static int on_serial_receive(serial_t *serial, struct serial_client *client, const uint8_t *buf, size_t len)
+{
+    uband_t *ub = client->userdata;
+    size_t dropped = ub->codec->dropped;
+    size_t used;
+
+    ub->rx_time = client->rx_time;
+    used = codec_feed(ub->codec, buf, len, handle_serial_frame, ub);
+    metric_add(ub->stats.skipped, ub->codec->dropped - dropped);
+    return used;
+}
+
+static struct serial_client_ops serial_client_uband_ops = {
+    .on_receive = on_serial_receive,
+    .detect = detect_serial_frame,
+};
+
+const char *uband_errmsg(uband_t *ub)
+{
+    return ub->error.errmsg;
+}
+
+int uband_errno(uband_t *ub)
+{
+    return ub->error.c_errno;
+}
+
+uband_t *uband_new(void)
+{
+    uband_t *ub = calloc(1, sizeof(uband_t));
+    if (!ub)
+        return NULL;
+    INIT_LIST_HEAD(&ub->clients);
+
+    snprintf(ub->serial_client.name, sizeof(ub->serial_client.name), "uband serial");
+    ub->serial_client.ops = &serial_client_uband_ops;
+    ub->serial_client.userdata = ub;
+    INIT_LIST_HEAD(&ub->serial_client.list);
+
+    if ((ub->codec = codec_new("uband")) == NULL) {
+        free(ub);
+        return NULL;
+    }
+    ev_timer_init(&ub->timer, timer_cb, 0., 0.);
+    return ub;
+}
+
+void uband_free(uband_t *ub)
+{
+    struct uband_client *client, *tmp;
+
+    if (!ub)
+        return;
+    uband_close(ub);
+    list_for_each_entry_safe(client, tmp, &ub->clients, list)
+        list_del_init(&client->list);
+    codec_free(ub->codec);
+    free(ub);
+}
+
+int uband_open(uband_t *ub, uband_options_t *opt)
+{
+    uint32_t baudrate = opt->baudrate ? opt->baudrate : UBAND_DEFAULT_BAUDRATE;
+    int timeout_ms = opt->timeout_ms > 0 ? opt->timeout_ms : UBAND_DEFAULT_TIMEOUT;
+
+    if (opt->serial[0] == '\0' || !opt->loop)
+        return _error(ub, UBAND_ERROR_ARG, 0, "No uband serial");
+    if (!opt->provisional)
+        return _error(ub, UBAND_ERROR_ARG, 0, "%s: uband frame format is provisional, set provisional=1 to use it", opt->serial);
+
+    if ((ub->serial = serial_get(opt->serial, baudrate, opt->loop)) == NULL)
+        return _error(ub, UBAND_ERROR_OPEN, 0, "Openning uband serial %s", opt->serial);
+
+    ub->loop = opt->loop;
+    ub->timeout = timeout_ms / 1000.;
+    evprof_watch(&ub->timer, "uband.timeout", opt->serial);
+    codec_reset(ub->codec);
+    stats_init(ub, opt->serial);
+    serial_add_client(ub->serial, &ub->serial_client);
+    log_warn("%s: uband frame format is provisional, not the field protocol", opt->serial);
+    return 0;
+}
+
+void uband_close(uband_t *ub)
+{
+    int i;
+
+    if (!ub->serial)
+        return;
+    serial_remove_client(ub->serial, &ub->serial_client);
+    serial_put(ub->serial);
+    ub->serial = NULL;
+
+    ev_timer_stop(ub->loop, &ub->timer);
+    for (i=0; i<UBAND_MAX_PENDING; i++) {
+        if (ub->pending[i].used)
+            pending_complete(ub, &ub->pending[i], UBAND_STATUS_CLOSED, NULL, 0);
+    }
+    memset(ub->streams, 0, sizeof(ub->streams));
+}
+
+static struct uband_pending *pending_get(uband_t *ub)
+{
+    struct uband_pending *slot = NULL;
+    int i, tries;
+
+    for (i=0; i<UBAND_MAX_PENDING; i++) {
+        if (!ub->pending[i].used) {
+            slot = &ub->pending[i];
+            break;
+        }
+    }
+    if (!slot)
+        return NULL;
+
+    /* seq 0 is for unsolicited frames, skip seqs still in flight */
+    for (tries = 0; tries < 255; tries++) {
+        if (++ub->seq == 0)
+            ub->seq = 1;
+        for (i=0; i<UBAND_MAX_PENDING; i++) {
+            if (ub->pending[i].used && ub->pending[i].seq == ub->seq)
+                break;
+        }
+        if (i == UBAND_MAX_PENDING)
+            break;
+    }
+    slot->seq = ub->seq;
+    return slot;
+}
+
+int uband_request(uband_t *ub, uint8_t cmd, const uint8_t *payload, size_t len, uband_reply_cb cb, void *arg)
+{
+    uint8_t data[2 + UBAND_REQUEST_MAX], frame[8 + UBAND_REQUEST_MAX];
+    struct uband_pending *p;
+    size_t frame_len;
+
+    if (!ub->serial)
+        return _error(ub, UBAND_ERROR_IO, 0, "uband not open");
+    if ((cmd & UBAND_CMD_REPLY) || len > UBAND_REQUEST_MAX || (len && !payload))
+        return _error(ub, UBAND_ERROR_ARG, 0, "Invalid request 0x%02x len %zu", cmd, len);
+    if ((p = pending_get(ub)) == NULL)
+        return _error(ub, UBAND_ERROR_BUSY, 0, "%d requests in flight", UBAND_MAX_PENDING);
+
+    data[0] = p->seq;
+    data[1] = cmd;
+    if (len)
+        memcpy(&data[2], payload, len);
+    frame_len = codec_encode(ub->codec, data, len + 2, frame, sizeof(frame));
+    if (frame_len == 0 || serial_write(ub->serial, frame, frame_len) != frame_len)
+        return _error(ub, UBAND_ERROR_IO, 0, "Writing request 0x%02x: %s", cmd, serial_errmsg(ub->serial));
+
+    p->used = true;
+    p->cmd = cmd;
+    p->cb = cb;
+    p->arg = arg;
+    p->sent_at = metric_now();
+    p->deadline = ev_now(ub->loop) + ub->timeout;
+    timer_update(ub);
+    return 0;
+}
+
+/* [status] [fw major] [fw minor] [model, not terminated] */
+static void on_get_info_reply(uband_t *ub, int status, const uint8_t *data, size_t len, void *arg)
+{
+    struct uband_client *client;
+    char model[64] = "";
+    uint8_t major = 0, minor = 0;
+
+    if (status == UBAND_STATUS_OK && len >= 2) {
+        major = data[0];
+        minor = data[1];
+        snprintf(model, sizeof(model), "%.*s", (int)(len - 2), (const char *)data + 2);
+    } else if (status == UBAND_STATUS_OK) {
+        status = UBAND_ERROR_IO;
+    }
+    list_for_each_entry(client, &ub->clients, list) {
+        if (client->ops->on_get_info)
+            client->ops->on_get_info(ub, status, major, minor, model);
+    }
+}
+
+int uband_get_info(uband_t *ub)
+{
+    return uband_request(ub, UBAND_CMD_GET_INFO, NULL, 0, on_get_info_reply, NULL);
+}
+
+int uband_ping(uband_t *ub, uband_reply_cb cb, void *arg)
+{
+    return uband_request(ub, UBAND_CMD_PING, NULL, 0, cb, arg);
+}
+
+/* arg packs the stream id and whether it was a start */
+static void on_stream_reply(uband_t *ub, int status, const uint8_t *data, size_t len, void *arg)
+{
+    uintptr_t v = (uintptr_t)arg;
+    uint8_t stream = v & 0xFF;
+    bool start = v >> 8;
+
+    if (status != UBAND_STATUS_OK) {
+        log_info("%s: stream %u %s fail, status %d", uband_id(ub), stream, start ? "start" : "stop", status);
+        return;
+    }
+    stream_set(ub, stream, start);
+}
+
+int uband_stream_start(uband_t *ub, uint8_t stream)
+{
+    return uband_request(ub, UBAND_CMD_STREAM_START, &stream, 1, on_stream_reply,
+                         (void *)(uintptr_t)(stream | 1 << 8));
+}
+
+int uband_stream_stop(uband_t *ub, uint8_t stream)
+{
+    return uband_request(ub, UBAND_CMD_STREAM_STOP, &stream, 1, on_stream_reply,
+                         (void *)(uintptr_t)stream);
+}
+
+uint64_t uband_rx_time(uband_t *ub)
+{
+    return ub->rx_time;
+}
+
+bool uband_stream_running(uband_t *ub, uint8_t stream)
+{
+    return ub->streams[stream / 8] & (1 << (stream % 8));
+}
+
+int uband_add_client(uband_t *ub, struct uband_client *client)
+{
+    if (!client || !client->ops)
+        return -1;
+    list_add_tail(&client->list, &ub->clients);
+    return 0;
+}
+
+void uband_remove_client(uband_t *ub, struct uband_client *client)
+{
+    if (!client)
+        return;
+    list_del_init(&client->list);
+}
+
+const char *uband_id(uband_t *ub)
+{
+    snprintf(ub->ident, sizeof(ub->ident), "%s", ub->serial ? serial_id(ub->serial) : "");
+    return ub->ident;
+}
@@ -1,4 +1,90 @@
 #ifndef __UBAND_H__
 #define __UBAND_H__
 
-#endif
\ No newline at end of file
+#include <stdint.h>
+#include <stdbool.h>
+#include <ev.h>
+#include "serial.h"
+#include "list.h"
+
+enum uband_error_code {
+    UBAND_ERROR_ARG             = -1, /* Invalid arguments */
+    UBAND_ERROR_OPEN            = -2, /* Opening uband device */
+    UBAND_ERROR_IO              = -3, /* Reading/writing uband device */
+    UBAND_ERROR_BUSY            = -4, /* Too many requests in flight */
+    UBAND_ERROR_CLOSE           = -5, /* Closing uband device */
+};
+
+/*
+ * PROVISIONAL command set, see codec/uband.c: placeholders until the uband
+ * field protocol is available, not what field hardware speaks.
+ * Requests carry seq 1-255, replies echo it with cmd | UBAND_CMD_REPLY.
+ */
+enum uband_cmd {
+    UBAND_CMD_GET_INFO          = 0x01,
+    UBAND_CMD_PING              = 0x02,
+    UBAND_CMD_STREAM_START      = 0x10, /* [stream] */
+    UBAND_CMD_STREAM_STOP       = 0x11, /* [stream] */
+    /* unsolicited, seq 0 */
+    UBAND_CMD_STREAM_DATA       = 0x20, /* [stream] [data] */
+    UBAND_CMD_EVENT             = 0x21, /* [event] [data] */
+    UBAND_CMD_REPLY             = 0x80,
+};
+
+/* reply status: first reply payload byte from the device, or one of these */
+enum uband_status {
+    UBAND_STATUS_OK             = 0,
+    UBAND_STATUS_TIMEOUT        = -1,
+    UBAND_STATUS_CLOSED         = -2,
+};
+
+#define UBAND_MAX_PENDING   (16)
+#define UBAND_MAX_STREAM    (256)
+
+typedef struct uband_handle uband_t;
+
+typedef struct uband_options {
+    char serial[96];
+    uint32_t baudrate;              /* optional, default 115200 */
+    int timeout_ms;                 /* optional, default 1000 */
+    bool provisional;               /* required opt-in until the frame format is the real one */
+    struct ev_loop *loop;
+} uband_options_t;
+
+/* data excludes the status byte */
+typedef void (*uband_reply_cb)(uband_t *ub, int status, const uint8_t *data, size_t len, void *arg);
+
+struct uband_client_ops {
+    void (*on_get_info)(uband_t *ub, int status, uint8_t fw_major, uint8_t fw_minor, const char *model);
+    void (*on_stream)(uband_t *ub, uint8_t stream, const uint8_t *data, size_t len);
+    void (*on_stream_state)(uband_t *ub, uint8_t stream, bool running);
+    void (*on_event)(uband_t *ub, uint8_t event, const uint8_t *data, size_t len);
+};
+
+struct uband_client {
+    char name[64];
+    struct uband_client_ops *ops;
+    struct list_head list;
+};
+
+uband_t *uband_new(void);
+void uband_free(uband_t *ub);
+int uband_open(uband_t *ub, uband_options_t *opt);
+void uband_close(uband_t *ub);
+/* async, cb runs once from the loop with the reply, a timeout or on close */
+int uband_request(uband_t *ub, uint8_t cmd, const uint8_t *payload, size_t len, uband_reply_cb cb, void *arg);
+int uband_get_info(uband_t *ub);
+int uband_ping(uband_t *ub, uband_reply_cb cb, void *arg);
+int uband_stream_start(uband_t *ub, uint8_t stream);
+int uband_stream_stop(uband_t *ub, uint8_t stream);
+bool uband_stream_running(uband_t *ub, uint8_t stream);
+/* CLOCK_MONOTONIC ns the frame behind the current callback was read */
+uint64_t uband_rx_time(uband_t *ub);
+int uband_add_client(uband_t *ub, struct uband_client *client);
+void uband_remove_client(uband_t *ub, struct uband_client *client);
+const char *uband_id(uband_t *ub);
+/* Error Handling */
+int uband_errno(uband_t *ub);
+const char *uband_errmsg(uband_t *ub);
+
+#endif
@@ -2,6 +2,8 @@
 #include <string.h>
 #include "log.h"
 #include "usb.h"
+#include "trace.h"
+#include "metrics.h"
 
 #define HID_INPUT_REPORT    1
 #define HID_OUTPUT_REPORT    2
@@ -42,6 +44,13 @@ struct usb_handle {
     int serial_index;
 
     int is_driver_detached;
+    int trace_id;
+    struct {
+        metric_t *rx_bytes;
+        metric_t *tx_bytes;
+        metric_t *errors;
+        metric_t *transfer;
+    } stats;
     struct list_head clients;
     struct {
         int c_errno;
@@ -157,12 +166,17 @@ usb_t *usb_new(void)
         return NULL;
 
     usb->context = usb_context;
+    usb->trace_id = -1;
     INIT_LIST_HEAD(&usb->clients);
     return usb;
 }
 
 void usb_free(usb_t *usb)
 {
+    struct usb_client *client, *tmp;
+
+    list_for_each_entry_safe(client, tmp, &usb->clients, list)
+        list_del_init(&client->list);
     free(usb);
 }
 
@@ -298,6 +312,17 @@ int usb_open(usb_t *usb, uint16_t vendor_id, uint16_t product_id, const char *pa
     snprintf(usb->ident, sizeof(usb->ident)-1, "0x%x-0x%x-%s", vendor_id, product_id, path);
 out:
     libusb_free_device_list(devs, 1);
+    if (good_open == 1) {
+        usb->trace_id = trace_register(usb->ident, TRACE_LINK_USB);
+        usb->stats.rx_bytes = metric_get(METRIC_COUNTER, "devctl_usb_rx_bytes_total",
+                                         "Bytes received from usb device", "device", usb->ident, NULL);
+        usb->stats.tx_bytes = metric_get(METRIC_COUNTER, "devctl_usb_tx_bytes_total",
+                                         "Bytes sent to usb device", "device", usb->ident, NULL);
+        usb->stats.errors = metric_get(METRIC_COUNTER, "devctl_usb_errors_total",
+                                       "Failed usb transfers", "device", usb->ident, NULL);
+        usb->stats.transfer = metric_get(METRIC_HISTOGRAM, "devctl_usb_transfer_seconds",
+                                         "Synchronous usb transfer time", "device", usb->ident, NULL);
+    }
     return good_open == 1 ? 0:_error(usb, USB_ERROR_OPEN, 0, "Openning usb device");;
 }
 
@@ -311,6 +336,7 @@ int usb_hid_write(usb_t *usb, const uint8_t *data, size_t length, int timeout_ms
     int res;
     int report_number;
     int skipped_report_id = 0;
+    uint64_t start = metric_now();
 
     if (!data || (length ==0)) {
         return -1;
@@ -334,8 +360,13 @@ int usb_hid_write(usb_t *usb, const uint8_t *data, size_t length, int timeout_ms
             (unsigned char *)data, length,
             timeout_ms);
 
-        if (res < 0)
+        metric_observe(usb->stats.transfer, metric_now() - start);
+        if (res < 0) {
+            metric_add(usb->stats.errors, 1);
             return -1;
+        }
+        trace_record(usb->trace_id, TRACE_TX, data, length);
+        metric_add(usb->stats.tx_bytes, length);
 
         if (skipped_report_id)
             length++;
@@ -350,8 +381,13 @@ int usb_hid_write(usb_t *usb, const uint8_t *data, size_t length, int timeout_ms
             length,
             &actual_length, 1000);
 
-        if (res < 0)
+        metric_observe(usb->stats.transfer, metric_now() - start);
+        if (res < 0) {
+            metric_add(usb->stats.errors, 1);
             return -1;
+        }
+        trace_record(usb->trace_id, TRACE_TX, data, actual_length);
+        metric_add(usb->stats.tx_bytes, actual_length);
 
         if (skipped_report_id)
             actual_length++;
@@ -365,6 +401,7 @@ int usb_hid_get_input_report(usb_t *usb, uint8_t *data, size_t length, int timeo
     int res = -1;
     int skipped_report_id = 0;
     int report_number = data[0];
+    uint64_t start = metric_now();
 
     if (report_number == 0x0) {
         /* Offset the return buffer by 1, so that the report ID
@@ -382,8 +419,13 @@ int usb_hid_get_input_report(usb_t *usb, uint8_t *data, size_t length, int timeo
         (unsigned char *)data, length,
         timeout_ms);
 
-    if (res < 0)
+    metric_observe(usb->stats.transfer, metric_now() - start);
+    if (res < 0) {
+        metric_add(usb->stats.errors, 1);
         return -1;
+    }
+    trace_record(usb->trace_id, TRACE_RX, data, res);
+    metric_add(usb->stats.rx_bytes, res);
 
     if (skipped_report_id)
         res++;
@@ -489,7 +531,7 @@ void usb_remove_client(usb_t *usb, struct usb_client *client)
 {
     if (!client)
         return;
-    list_del(&client->list);
+    list_del_init(&client->list);
 }
 
 const char *usb_errmsg(usb_t *usb)
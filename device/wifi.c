@@ -9,6 +9,8 @@
 struct wifi_handle {
     const wifi_backend_t *backend;
     void *backend_handle;
+    wifi_store_t store;
+    struct list_head clients;
 
     struct {
         int c_errno;
@@ -17,6 +19,8 @@ struct wifi_handle {
 };
 
 static const wifi_backend_t *wifi_backends[] = {
+    &wifi_nl80211,
+    &wifi_wpacli,
     &wifi_nmcli,
     NULL,
 };
@@ -48,6 +52,48 @@ void wifi_scan(wifi_t *wifi)
     }
 }
 
+int wifi_scan_results(wifi_t *wifi, wifi_network_info_t *networks, int max)
+{
+    if (wifi == NULL)
+        return 0;
+
+    return wifi_store_copy(&wifi->store, networks, max);
+}
+
+int wifi_signal_history(wifi_t *wifi, const char *ssid, uint8_t *signal, int max)
+{
+    if (wifi == NULL || ssid == NULL)
+        return 0;
+
+    return wifi_store_history(&wifi->store, ssid, signal, max);
+}
+
+static void wifi_notify(enum wifi_network_event event, const wifi_network_info_t *network, void *arg)
+{
+    wifi_t *wifi = arg;
+    struct wifi_client *client, *tmp;
+
+    list_for_each_entry_safe(client, tmp, &wifi->clients, list) {
+        if (client->ops->on_network)
+            client->ops->on_network(wifi, event, network);
+    }
+}
+
+int wifi_add_client(wifi_t *wifi, struct wifi_client *client)
+{
+    if (!client || !client->ops)
+        return -1;
+    list_add_tail(&client->list, &wifi->clients);
+    return 0;
+}
+
+void wifi_remove_client(wifi_t *wifi, struct wifi_client *client)
+{
+    if (!client)
+        return;
+    list_del_init(&client->list);
+}
+
 bool wifi_connect_ssid(wifi_t *wifi, wifi_network_info_t *network)
 {
     if (wifi && wifi->backend && wifi->backend->connect_ssid) {
@@ -79,22 +125,29 @@ wifi_t *wifi_new(void)
     wifi_t *wifi = calloc(1, sizeof(wifi_t));
     if (wifi == NULL)
         return NULL;
-    
+
+    INIT_LIST_HEAD(&wifi->clients);
+    wifi_store_init(&wifi->store, wifi_notify, wifi);
     return wifi;
 }
 
 void wifi_free(wifi_t *wifi)
 {
+    struct wifi_client *client, *tmp;
+
+    list_for_each_entry_safe(client, tmp, &wifi->clients, list)
+        list_del_init(&client->list);
     free(wifi);
 }
 
-int wifi_open(wifi_t *wifi, const char *backend)
+int wifi_open(wifi_t *wifi, const wifi_options_t *opt)
 {
+    const char *backend = opt->backend[0] ? opt->backend : NULL;
     int i;
 
     if (backend == NULL) {
         for (i=0; wifi_backends[i] != NULL; i++) {
-            if (wifi_backends[i]->is_available && wifi_backends[i]->is_available(wifi)) {
+            if (wifi_backends[i]->is_available && wifi_backends[i]->is_available(opt)) {
                 wifi->backend = wifi_backends[i];
                 break;
             }
@@ -108,14 +161,14 @@ int wifi_open(wifi_t *wifi, const char *backend)
         }
     }
     if (wifi->backend == NULL)
-        return _wifi_error(wifi, WIFI_ERROR_OPEN, 0, "WiFi backend %s not found", backend);
+        return _wifi_error(wifi, WIFI_ERROR_OPEN, 0, "WiFi backend %s not found", backend ? backend : "available");
 
     if(wifi->backend->init) {
-        wifi->backend_handle = wifi->backend->init();
+        wifi->backend_handle = wifi->backend->init(opt, &wifi->store);
         if (wifi->backend_handle == NULL)
-            return _wifi_error(wifi, WIFI_ERROR_OPEN, 0, "WiFi backend %s init fail", backend);
+            return _wifi_error(wifi, WIFI_ERROR_OPEN, 0, "WiFi backend %s init fail", wifi->backend->ident);
     } else {
-        return _wifi_error(wifi, WIFI_ERROR_OPEN, 0, "WiFi backend %s not implemented yet", backend);
+        return _wifi_error(wifi, WIFI_ERROR_OPEN, 0, "WiFi backend %s not implemented yet", wifi->backend->ident);
     }
 
     return 0;
@@ -128,6 +181,12 @@ void wifi_close(wifi_t *wifi)
     
     if (wifi->backend->free)
         wifi->backend->free(wifi->backend_handle);
+    wifi_store_clear(&wifi->store);
+}
+
+const char *wifi_backend(wifi_t *wifi)
+{
+    return wifi->backend ? wifi->backend->ident : "none";
 }
 
 const char *wifi_errmsg(wifi_t *wifi)
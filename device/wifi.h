@@ -7,15 +7,24 @@ extern "C" {
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <ev.h>
 #include "list.h"
 
 enum wifi_error_code {
     WIFI_ERROR_OPEN  = -1,
 };
 
+typedef struct wifi_options {
+    char backend[16];               /* optional, first available one */
+    char ifname[16];                /* optional, first wireless interface */
+    char ctrl_dir[64];              /* optional, wpa_supplicant control sockets */
+    struct ev_loop *loop;
+} wifi_options_t;
+
 typedef struct wifi_network_info {
     char ssid[64];
     char password[64];
+    char bssid[18];                 /* strongest access point, may be empty */
     bool connected;
     uint8_t signal;
     struct list_head list;
@@ -23,15 +32,43 @@ typedef struct wifi_network_info {
 
 typedef struct wifi_handle wifi_t;
 
+enum wifi_network_event {
+    WIFI_NETWORK_ADDED,
+    WIFI_NETWORK_CHANGED,           /* link state, access point or signal moved */
+    WIFI_NETWORK_REMOVED,           /* missing from the last scans */
+};
+
+struct wifi_client_ops {
+    void (*on_network)(wifi_t *wifi, enum wifi_network_event event, const wifi_network_info_t *network);
+};
+
+struct wifi_client {
+    char name[64];
+    struct wifi_client_ops *ops;
+    struct list_head list;
+};
+
 /* Primary Functions */
 wifi_t *wifi_new(void);
 void wifi_free(wifi_t *wifi);
-int wifi_open(wifi_t *wifi, const char *backend);
+int wifi_open(wifi_t *wifi, const wifi_options_t *opt);
 void wifi_close(wifi_t *wifi);
 bool wifi_connection_info(wifi_t *wifi, wifi_network_info_t *network);
+/*
+ * Event loop backends return at once: a scan refreshes the cached results
+ * when it completes and connect only starts the association, watch
+ * wifi_connection_info() for the outcome.
+ */
 void wifi_scan(wifi_t *wifi);
+/* copy up to max cached networks, returns how many */
+int wifi_scan_results(wifi_t *wifi, wifi_network_info_t *networks, int max);
 bool wifi_connect_ssid(wifi_t *wifi, wifi_network_info_t *network);
 bool wifi_disconnect_ssid(wifi_t *wifi, wifi_network_info_t *network);
+/* signal of the last scans, oldest first, returns how many */
+int wifi_signal_history(wifi_t *wifi, const char *ssid, uint8_t *signal, int max);
+int wifi_add_client(wifi_t *wifi, struct wifi_client *client);
+void wifi_remove_client(wifi_t *wifi, struct wifi_client *client);
+const char *wifi_backend(wifi_t *wifi);
 const char *wifi_errmsg(wifi_t *wifi);
 
 #ifdef __cplusplus
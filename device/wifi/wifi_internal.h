@@ -4,12 +4,14 @@
 #include <stdbool.h>
 
 #include "wifi.h"
+#include "wifi_store.h"
 
 typedef struct wifi_backend
 {
-    void* (*init)(void);
+    /* scan results go to store, it outlives the handle */
+    void* (*init)(const wifi_options_t *opt, wifi_store_t *store);
     void (*free)(void *handle);
-    bool (*is_available)(void *handle);
+    bool (*is_available)(const wifi_options_t *opt);
     bool (*enable)(void *handle, bool enabled);
     bool (*connection_info)(void *handle, wifi_network_info_t *network);
     void (*scan)(void *handle);
@@ -18,6 +20,8 @@ typedef struct wifi_backend
     const char *ident;
 } wifi_backend_t;
 
+extern wifi_backend_t wifi_nl80211;
+extern wifi_backend_t wifi_wpacli;
 extern wifi_backend_t wifi_nmcli;
 
 #endif
\ No newline at end of file
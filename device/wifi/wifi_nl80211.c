@@ -0,0 +1,514 @@
+#define LOG_MODULE_NAME "nl80211"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <dirent.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/nl80211.h>
+
+#include "log.h"
+#include "evprof.h"
+#include "wifi_internal.h"
+#include "wpa_ctrl.h"
+
+#define NL_BUF_SIZE         (64 * 1024)     /* one scan dump datagram */
+#define NL_MSG_SIZE         (512)
+#define NL_INIT_TIMEOUT_MS  (1000)
+
+/*
+ * Scan, link state and open network connects speak nl80211 over a generic
+ * netlink socket watched by the event loop: requests are fire and forget,
+ * their outcome arrives as "scan" and "mlme" multicast events. Scan
+ * results are dumped into the store when the kernel reports new ones.
+ * Secured networks are handed to wpa_supplicant over its control socket
+ * when one exists for the interface.
+ */
+typedef struct nl80211_handle {
+    int fd;
+    uint32_t seq;
+    uint16_t family;
+    int ifindex;
+    char ifname[IF_NAMESIZE];
+    char ctrl_dir[64];
+    struct ev_loop *loop;
+    ev_io io;
+    wpa_ctrl_t *wpa;
+    wifi_store_t *store;
+    int ndump;
+    uint32_t dump_seq;              /* 0: no dump running */
+    bool redump;
+    bool connected;
+    char ssid[64];
+} nl80211_t;
+
+static uint8_t rxbuf[NL_BUF_SIZE] __attribute__((aligned(4)));
+
+#define nla_data(nla)   ((void *)((char *)(nla) + NLA_HDRLEN))
+#define nla_len(nla)    ((int)(nla)->nla_len - NLA_HDRLEN)
+
+static void nla_parse(struct nlattr **tb, int max, const void *data, int len)
+{
+    const struct nlattr *nla = data;
+    int type;
+
+    memset(tb, 0, sizeof(*tb) * (max + 1));
+    while (len >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN && nla->nla_len <= len) {
+        type = nla->nla_type & NLA_TYPE_MASK;
+        if (type <= max)
+            tb[type] = (struct nlattr *)nla;
+        len -= NLA_ALIGN(nla->nla_len);
+        nla = (const struct nlattr *)((const char *)nla + NLA_ALIGN(nla->nla_len));
+    }
+}
+
+static uint32_t nla_u32(const struct nlattr *nla)
+{
+    uint32_t v;
+
+    memcpy(&v, nla_data(nla), sizeof(v));
+    return v;
+}
+
+static struct nlmsghdr *msg_init(void *buf, uint16_t type, uint16_t flags, uint8_t cmd, uint32_t seq)
+{
+    struct nlmsghdr *nlh = buf;
+    struct genlmsghdr *genl;
+
+    memset(buf, 0, NLMSG_HDRLEN + GENL_HDRLEN);
+    nlh->nlmsg_len = NLMSG_HDRLEN + GENL_HDRLEN;
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_flags = NLM_F_REQUEST | flags;
+    nlh->nlmsg_seq = seq;
+    genl = NLMSG_DATA(nlh);
+    genl->cmd = cmd;
+    genl->version = 1;
+    return nlh;
+}
+
+static void msg_put(struct nlmsghdr *nlh, uint16_t type, const void *data, uint16_t len)
+{
+    struct nlattr *nla = (struct nlattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+
+    nla->nla_type = type;
+    nla->nla_len = NLA_HDRLEN + len;
+    memcpy(nla_data(nla), data, len);
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(nla->nla_len);
+}
+
+static int msg_send(nl80211_t *nl, struct nlmsghdr *nlh)
+{
+    if (send(nl->fd, nlh, nlh->nlmsg_len, 0) < 0) {
+        log_error("%s: send: %s", nl->ifname, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int nl80211_cmd(nl80211_t *nl, uint8_t cmd, uint16_t flags, struct nlmsghdr **out)
+{
+    static uint32_t buf[NL_MSG_SIZE / 4];
+    uint32_t ifindex = nl->ifindex;
+
+    if (++nl->seq == 0)             /* 0 is what events carry */
+        nl->seq = 1;
+    *out = msg_init(buf, nl->family, flags, cmd, nl->seq);
+    msg_put(*out, NL80211_ATTR_IFINDEX, &ifindex, sizeof(ifindex));
+    return nl->seq;
+}
+
+/* blocking, only used while opening */
+static int resolve_family(nl80211_t *nl, uint32_t *grp_scan, uint32_t *grp_mlme)
+{
+    struct nlattr *tb[CTRL_ATTR_MAX + 1], *grp[CTRL_ATTR_MCAST_GRP_MAX + 1], *g;
+    struct pollfd pfd = { .fd = nl->fd, .events = POLLIN };
+    uint32_t buf[NL_MSG_SIZE / 4];
+    struct nlmsghdr *nlh;
+    int len, rem;
+
+    nlh = msg_init(buf, GENL_ID_CTRL, 0, CTRL_CMD_GETFAMILY, ++nl->seq);
+    msg_put(nlh, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME, strlen(NL80211_GENL_NAME) + 1);
+    if (msg_send(nl, nlh) != 0)
+        return -1;
+
+    for (;;) {
+        if (poll(&pfd, 1, NL_INIT_TIMEOUT_MS) <= 0)
+            return -1;
+        if ((len = recv(nl->fd, rxbuf, sizeof(rxbuf), 0)) < 0)
+            return -1;
+        for (nlh = (struct nlmsghdr *)rxbuf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_seq != nl->seq)
+                continue;
+            if (nlh->nlmsg_type == NLMSG_ERROR)
+                return -1;
+            if (nlh->nlmsg_type != GENL_ID_CTRL)
+                continue;
+            nla_parse(tb, CTRL_ATTR_MAX, (char *)NLMSG_DATA(nlh) + GENL_HDRLEN,
+                      nlh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN);
+            if (!tb[CTRL_ATTR_FAMILY_ID] || !tb[CTRL_ATTR_MCAST_GROUPS])
+                return -1;
+            memcpy(&nl->family, nla_data(tb[CTRL_ATTR_FAMILY_ID]), sizeof(nl->family));
+
+            g = nla_data(tb[CTRL_ATTR_MCAST_GROUPS]);
+            rem = nla_len(tb[CTRL_ATTR_MCAST_GROUPS]);
+            for (; rem >= NLA_HDRLEN && g->nla_len >= NLA_HDRLEN && g->nla_len <= rem;
+                   rem -= NLA_ALIGN(g->nla_len), g = (struct nlattr *)((char *)g + NLA_ALIGN(g->nla_len))) {
+                nla_parse(grp, CTRL_ATTR_MCAST_GRP_MAX, nla_data(g), nla_len(g));
+                if (!grp[CTRL_ATTR_MCAST_GRP_NAME] || !grp[CTRL_ATTR_MCAST_GRP_ID])
+                    continue;
+                if (!strcmp(nla_data(grp[CTRL_ATTR_MCAST_GRP_NAME]), NL80211_MULTICAST_GROUP_SCAN))
+                    *grp_scan = nla_u32(grp[CTRL_ATTR_MCAST_GRP_ID]);
+                else if (!strcmp(nla_data(grp[CTRL_ATTR_MCAST_GRP_NAME]), NL80211_MULTICAST_GROUP_MLME))
+                    *grp_mlme = nla_u32(grp[CTRL_ATTR_MCAST_GRP_ID]);
+            }
+            return 0;
+        }
+    }
+}
+
+static void start_dump(nl80211_t *nl)
+{
+    struct nlmsghdr *nlh;
+
+    if (nl->dump_seq) {
+        nl->redump = true;
+        return;
+    }
+    nl->dump_seq = nl80211_cmd(nl, NL80211_CMD_GET_SCAN, NLM_F_DUMP, &nlh);
+    if (msg_send(nl, nlh) != 0) {
+        nl->dump_seq = 0;
+        return;
+    }
+    nl->ndump = 0;
+    wifi_store_begin(nl->store);
+}
+
+static void end_dump(nl80211_t *nl, bool ok)
+{
+    const wifi_network_info_t *network;
+
+    wifi_store_end(nl->store, ok);
+    if (ok) {
+        network = wifi_store_connected(nl->store);
+        nl->connected = network != NULL;
+        snprintf(nl->ssid, sizeof(nl->ssid), "%s", network ? network->ssid : "");
+        log_debug("%s: %d access points", nl->ifname, nl->ndump);
+    }
+    nl->dump_seq = 0;
+    if (nl->redump) {
+        nl->redump = false;
+        start_dump(nl);
+    }
+}
+
+/* one BSS of the scan dump */
+static void parse_bss(nl80211_t *nl, struct nlattr *attr)
+{
+    struct nlattr *bss[NL80211_BSS_MAX + 1];
+    char ssid[33] = { 0 };
+    char bssid[18] = { 0 };
+    const uint8_t *ie, *mac;
+    int ie_len, signal = 0;
+    bool connected;
+
+    nla_parse(bss, NL80211_BSS_MAX, nla_data(attr), nla_len(attr));
+    if (!bss[NL80211_BSS_INFORMATION_ELEMENTS])
+        return;
+    ie = nla_data(bss[NL80211_BSS_INFORMATION_ELEMENTS]);
+    ie_len = nla_len(bss[NL80211_BSS_INFORMATION_ELEMENTS]);
+    while (ie_len >= 2 && ie[1] + 2 <= ie_len) {
+        if (ie[0] == 0) {
+            memcpy(ssid, ie + 2, ie[1] < 32 ? ie[1] : 32);
+            break;
+        }
+        ie_len -= ie[1] + 2;
+        ie += ie[1] + 2;
+    }
+    if (ssid[0] == '\0')
+        return;                     /* hidden */
+
+    if (bss[NL80211_BSS_SIGNAL_MBM]) {
+        signal = wifi_dbm_to_signal((int32_t)nla_u32(bss[NL80211_BSS_SIGNAL_MBM]) / 100);
+    } else if (bss[NL80211_BSS_SIGNAL_UNSPEC]) {
+        signal = *(uint8_t *)nla_data(bss[NL80211_BSS_SIGNAL_UNSPEC]);
+    }
+    connected = bss[NL80211_BSS_STATUS] &&
+                nla_u32(bss[NL80211_BSS_STATUS]) == NL80211_BSS_STATUS_ASSOCIATED;
+
+    if (bss[NL80211_BSS_BSSID] && nla_len(bss[NL80211_BSS_BSSID]) >= 6) {
+        mac = nla_data(bss[NL80211_BSS_BSSID]);
+        snprintf(bssid, sizeof(bssid), "%02x:%02x:%02x:%02x:%02x:%02x",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+    wifi_store_update(nl->store, ssid, bssid, signal, connected);
+    nl->ndump++;
+}
+
+static void handle_genl(nl80211_t *nl, struct nlmsghdr *nlh)
+{
+    struct genlmsghdr *genl = NLMSG_DATA(nlh);
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    uint16_t status;
+
+    nla_parse(tb, NL80211_ATTR_MAX, (char *)genl + GENL_HDRLEN,
+              nlh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN);
+    if (tb[NL80211_ATTR_IFINDEX] && (int)nla_u32(tb[NL80211_ATTR_IFINDEX]) != nl->ifindex)
+        return;
+
+    switch (genl->cmd) {
+    case NL80211_CMD_NEW_SCAN_RESULTS:
+        if (nlh->nlmsg_seq && nlh->nlmsg_seq == nl->dump_seq) {
+            if (tb[NL80211_ATTR_BSS])
+                parse_bss(nl, tb[NL80211_ATTR_BSS]);
+        } else {
+            start_dump(nl);
+        }
+        break;
+    case NL80211_CMD_SCAN_ABORTED:
+        log_info("%s: scan aborted", nl->ifname);
+        break;
+    case NL80211_CMD_CONNECT:
+        status = 0xFFFF;
+        if (tb[NL80211_ATTR_STATUS_CODE])
+            memcpy(&status, nla_data(tb[NL80211_ATTR_STATUS_CODE]), sizeof(status));
+        if (status == 0) {
+            log_info("%s: connected", nl->ifname);
+            start_dump(nl);
+        } else if (tb[NL80211_ATTR_TIMED_OUT]) {
+            log_info("%s: connect timed out", nl->ifname);
+        } else {
+            log_info("%s: connect failed, status %u", nl->ifname, status);
+        }
+        break;
+    case NL80211_CMD_DISCONNECT:
+        log_info("%s: disconnected from %s", nl->ifname, nl->ssid);
+        nl->connected = false;
+        nl->ssid[0] = '\0';
+        wifi_store_set_connected(nl->store, NULL);
+        start_dump(nl);
+        break;
+    }
+}
+
+static void io_cb(struct ev_loop *loop, ev_io *w, int revents)
+{
+    nl80211_t *nl = container_of(w, nl80211_t, io);
+    struct nlmsghdr *nlh;
+    struct nlmsgerr *err;
+    int len;
+
+    for (;;) {
+        len = recv(nl->fd, rxbuf, sizeof(rxbuf), MSG_DONTWAIT);
+        if (len < 0) {
+            /* ENOBUFS: events were lost, resync the cache */
+            if (errno == ENOBUFS)
+                start_dump(nl);
+            else if (errno != EAGAIN && errno != EINTR)
+                log_error("%s: recv: %s", nl->ifname, strerror(errno));
+            return;
+        }
+        for (nlh = (struct nlmsghdr *)rxbuf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                if (nlh->nlmsg_seq == nl->dump_seq)
+                    end_dump(nl, true);
+            } else if (nlh->nlmsg_type == NLMSG_ERROR) {
+                err = NLMSG_DATA(nlh);
+                if (err->error == 0)
+                    continue;
+                log_warn("%s: request %u failed: %s", nl->ifname, nlh->nlmsg_seq, strerror(-err->error));
+                if (nlh->nlmsg_seq == nl->dump_seq)
+                    end_dump(nl, false);
+            } else if (nlh->nlmsg_type == nl->family) {
+                handle_genl(nl, nlh);
+            }
+        }
+    }
+}
+
+static bool find_ifname(const wifi_options_t *opt, char *ifname)
+{
+    char path[64 + IF_NAMESIZE];
+    struct dirent *de;
+    DIR *dir;
+    bool found = false;
+
+    if (opt->ifname[0]) {
+        snprintf(path, sizeof(path), "/sys/class/net/%s/phy80211", opt->ifname);
+        snprintf(ifname, IF_NAMESIZE, "%s", opt->ifname);
+        return access(path, F_OK) == 0;
+    }
+    if ((dir = opendir("/sys/class/net")) == NULL)
+        return false;
+    while (!found && (de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.' || strlen(de->d_name) >= IF_NAMESIZE)
+            continue;
+        snprintf(path, sizeof(path), "/sys/class/net/%s/phy80211", de->d_name);
+        if (access(path, F_OK) == 0) {
+            snprintf(ifname, IF_NAMESIZE, "%s", de->d_name);
+            found = true;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+/* wpa_supplicant may come up after us, look for it on demand */
+static wpa_ctrl_t *nl80211_wpa(nl80211_t *nl)
+{
+    char path[128];
+
+    if (nl->wpa == NULL) {
+        snprintf(path, sizeof(path), "%s/%s", nl->ctrl_dir, nl->ifname);
+        nl->wpa = wpa_ctrl_open(nl->loop, path, NULL, NULL);
+    }
+    return nl->wpa;
+}
+
+static void nl80211_free(void *handle);
+
+static void *nl80211_init(const wifi_options_t *opt, wifi_store_t *store)
+{
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK };
+    uint32_t grp_scan = 0, grp_mlme = 0;
+    nl80211_t *nl;
+
+    if (opt->loop == NULL)
+        return NULL;
+    if ((nl = calloc(1, sizeof(*nl))) == NULL)
+        return NULL;
+    nl->store = store;
+    nl->loop = opt->loop;
+    snprintf(nl->ctrl_dir, sizeof(nl->ctrl_dir), "%s", opt->ctrl_dir[0] ? opt->ctrl_dir : WPA_CTRL_DIR);
+
+    nl->fd = -1;
+    nl->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (nl->fd < 0 || bind(nl->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        log_error("netlink socket: %s", strerror(errno));
+        goto fail;
+    }
+    if (!find_ifname(opt, nl->ifname) || (nl->ifindex = if_nametoindex(nl->ifname)) == 0) {
+        log_error("No wireless interface %s", opt->ifname);
+        goto fail;
+    }
+    if (resolve_family(nl, &grp_scan, &grp_mlme) != 0 || !grp_scan || !grp_mlme) {
+        log_error("nl80211 family not found");
+        goto fail;
+    }
+    if (setsockopt(nl->fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &grp_scan, sizeof(grp_scan)) != 0 ||
+            setsockopt(nl->fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &grp_mlme, sizeof(grp_mlme)) != 0) {
+        log_error("nl80211 multicast: %s", strerror(errno));
+        goto fail;
+    }
+
+    ev_io_init(&nl->io, io_cb, nl->fd, EV_READ);
+    evprof_watch(&nl->io, "wifi.nl80211", nl->ifname);
+    ev_io_start(nl->loop, &nl->io);
+    nl80211_wpa(nl);
+    /* the kernel's BSS cache seeds the results */
+    start_dump(nl);
+    log_info("%s: nl80211 backend%s", nl->ifname, nl->wpa ? ", wpa_supplicant found" : "");
+    return nl;
+
+fail:
+    nl80211_free(nl);
+    return NULL;
+}
+
+static void nl80211_free(void *handle)
+{
+    nl80211_t *nl = handle;
+
+    if (nl == NULL)
+        return;
+    if (nl->fd >= 0) {
+        ev_io_stop(nl->loop, &nl->io);
+        close(nl->fd);
+    }
+    wpa_ctrl_close(nl->wpa);
+    free(nl);
+}
+
+static bool nl80211_is_available(const wifi_options_t *opt)
+{
+    char ifname[IF_NAMESIZE];
+
+    return find_ifname(opt, ifname);
+}
+
+static void nl80211_scan(void *handle)
+{
+    nl80211_t *nl = handle;
+    struct nlmsghdr *nlh;
+
+    nl80211_cmd(nl, NL80211_CMD_TRIGGER_SCAN, 0, &nlh);
+    msg_send(nl, nlh);
+}
+
+static bool nl80211_connection_info(void *handle, wifi_network_info_t *network)
+{
+    nl80211_t *nl = handle;
+    const wifi_network_info_t *cached;
+
+    if (!network || !nl->connected)
+        return false;
+    memset(network->ssid, 0, sizeof(network->ssid));
+    snprintf(network->ssid, sizeof(network->ssid), "%s", nl->ssid);
+    network->connected = true;
+    cached = wifi_store_find(nl->store, nl->ssid);
+    network->signal = cached ? cached->signal : 0;
+    snprintf(network->bssid, sizeof(network->bssid), "%s", cached ? cached->bssid : "");
+    return true;
+}
+
+static bool nl80211_connect_ssid(void *handle, wifi_network_info_t *network)
+{
+    nl80211_t *nl = handle;
+    struct nlmsghdr *nlh;
+    wpa_ctrl_t *wpa;
+
+    if (!network || network->ssid[0] == '\0')
+        return false;
+
+    if ((wpa = nl80211_wpa(nl)) != NULL)
+        return wpa_ctrl_connect(wpa, network->ssid, network->password) == 0;
+
+    if (network->password[0]) {
+        log_error("%s: %s needs wpa_supplicant for the key exchange", nl->ifname, network->ssid);
+        return false;
+    }
+    nl80211_cmd(nl, NL80211_CMD_CONNECT, 0, &nlh);
+    msg_put(nlh, NL80211_ATTR_SSID, network->ssid, strnlen(network->ssid, 32));
+    return msg_send(nl, nlh) == 0;
+}
+
+static bool nl80211_disconnect_ssid(void *handle, wifi_network_info_t *network)
+{
+    nl80211_t *nl = handle;
+    struct nlmsghdr *nlh;
+    uint16_t reason = 3;            /* deauth, leaving */
+    wpa_ctrl_t *wpa;
+
+    if ((wpa = nl80211_wpa(nl)) != NULL)
+        return wpa_ctrl_request(wpa, "DISCONNECT", NULL, NULL) == 0;
+
+    nl80211_cmd(nl, NL80211_CMD_DISCONNECT, 0, &nlh);
+    msg_put(nlh, NL80211_ATTR_REASON_CODE, &reason, sizeof(reason));
+    return msg_send(nl, nlh) == 0;
+}
+
+wifi_backend_t wifi_nl80211 = {
+    .init = nl80211_init,
+    .free = nl80211_free,
+    .is_available = nl80211_is_available,
+    .connection_info = nl80211_connection_info,
+    .scan = nl80211_scan,
+    .connect_ssid = nl80211_connect_ssid,
+    .disconnect_ssid = nl80211_disconnect_ssid,
+    .ident = "nl80211"
+};
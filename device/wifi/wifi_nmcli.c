@@ -5,42 +5,22 @@
 #include "stdstring.h"
 #include "wifi_internal.h"
 
+#define NMCLI_FIELDS    (4)
+
 typedef struct nmcli_handle {
-    struct list_head wifi_network;
+    wifi_store_t *store;
 } nmcli_t;
 
-static void* nmcli_init(void)
+static void* nmcli_init(const wifi_options_t __attribute__((unused)) *opt, wifi_store_t *store)
 {
     nmcli_t *nmcli = calloc(1, sizeof(nmcli_t));
-    INIT_LIST_HEAD(&nmcli->wifi_network);
+    if (nmcli)
+        nmcli->store = store;
     return nmcli;
 }
 
-static void free_wifi_network(nmcli_t *nmcli)
-{
-    wifi_network_info_t *network;
-
-    while(!list_empty(&nmcli->wifi_network)) {
-        network = list_first_entry(&nmcli->wifi_network, wifi_network_info_t, list);
-        list_del(&network->list);
-        free(network);
-    }
-}
-
-static void __attribute__((unused)) dump_network_info(nmcli_t *nmcli)
-{
-    wifi_network_info_t *network;
-
-	list_for_each_entry(network, &nmcli->wifi_network, list) {
-        printf("ssid:%s, signal:%d, connected:%d\n", network->ssid, network->signal, network->connected);
-	}
-}
-
 void nmcli_free(void *handle)
 {
-    nmcli_t *nmcli = (nmcli_t *)handle;
-
-    free_wifi_network(nmcli);
     if (handle)
         free(handle);
 }
@@ -60,7 +40,7 @@ bool nmcli_enable(void __attribute__((unused)) *handle, bool enabled)
         return true;
 }
 
-bool nmcli_is_available(void __attribute__((unused)) *handle)
+bool nmcli_is_available(const wifi_options_t __attribute__((unused)) *opt)
 {
     FILE *fp = NULL;
     int ret;
@@ -100,47 +80,52 @@ static bool nmcli_connection_info(void __attribute__((unused)) *handle, wifi_net
     return false;
 }
 
+/* split a terse (-t) line in place, ':' inside a value comes as "\:" */
+static int split_terse(char *line, char *fields[], int max)
+{
+    char *r = line, *w = line;
+    int n = 0;
+
+    fields[n++] = w;
+    for (; *r && *r != '\n'; r++) {
+        if (*r == '\\' && r[1]) {
+            *w++ = *++r;
+        } else if (*r == ':' && n < max) {
+            *w++ = '\0';
+            fields[n++] = w;
+        } else {
+            *w++ = *r;
+        }
+    }
+    *w = '\0';
+    return n;
+}
+
 void nmcli_scan(void *handle)
 {
     nmcli_t *nmcli = (nmcli_t *)handle;
     char line[512];
+    char *fields[NMCLI_FIELDS];
     FILE *fp = NULL;
 
-    /* Clean up */
-    free_wifi_network(nmcli);
-
-    fp = popen("nmcli -f IN-USE,SSID,SIGNAL dev wifi | tail -n+2", "r");
-    while (fgets(line, 512, fp)) {
-        wifi_network_info_t *network = calloc(1, sizeof(wifi_network_info_t));
-        string_trim(line);
-        if (line[0] == '\0')
+    fp = popen("nmcli -t -f IN-USE,BSSID,SSID,SIGNAL dev wifi", "r");
+    if (fp == NULL)
+        return;
+    wifi_store_begin(nmcli->store);
+    while (fgets(line, sizeof(line), fp)) {
+        if (split_terse(line, fields, NMCLI_FIELDS) != NMCLI_FIELDS)
             continue;
-        if (line[0] == '*') {
-            network->connected = true;
-            line[0] = ' ';
-            string_trim(line);
-        }
-        char *tokens[2];
-        size_t count, i;
-        count = string_split(line, " ", tokens, 2);
-        if (count == 2) {
-            memset(network->ssid, 0, sizeof(network->ssid));
-            strncpy(network->ssid, tokens[0], sizeof(network->ssid)-1);
-            network->signal = strtoul(tokens[1], NULL, 10);
-        }
-        for (i=0; i<count; i++)
-            free(tokens[i]);
-        list_add_tail(&network->list, &nmcli->wifi_network);
+        wifi_store_update(nmcli->store, fields[2], string_trim(fields[1]),
+                          strtoul(fields[3], NULL, 10), fields[0][0] == '*');
     }
-    pclose(fp);
+    wifi_store_end(nmcli->store, pclose(fp) == 0);
 }
 
 bool nmcli_connect_ssid(void *handle, wifi_network_info_t *network)
 {
     nmcli_t *nmcli = (nmcli_t *)handle;
+    const wifi_network_info_t *connected;
     char cmd[256];
-    char line[512];
-    FILE *fp = NULL;
 
     if (!nmcli || !network)
         return false;
@@ -149,25 +134,18 @@ bool nmcli_connect_ssid(void *handle, wifi_network_info_t *network)
         "nmcli dev wifi connect \"%s\" password \"%s\" 2>&1", network->ssid, network->password);
     pclose(popen(cmd, "r"));
 
-    fp = popen("nmcli -f IN-USE,SSID dev wifi | tail -n+2", "r");
-    while (fgets(line, 512, fp)) {
-        string_trim(line);
-        if (string_starts_with(line, "*")) {
-            line[0] = ' ';
-            if (!strncmp(string_trim(line), network->ssid, sizeof(line))) {
-                network->connected = true;
-		 pclose(fp);
-                return true;
-            }
-        }
+    nmcli_scan(nmcli);
+    connected = wifi_store_connected(nmcli->store);
+    if (connected && !strcmp(connected->ssid, network->ssid)) {
+        network->connected = true;
+        return true;
     }
-    pclose(fp);
-
     return false;
 }
 
-bool nmcli_disconnect_ssid(void __attribute__((unused)) *handle, wifi_network_info_t *network)
+bool nmcli_disconnect_ssid(void *handle, wifi_network_info_t *network)
 {
+    nmcli_t *nmcli = (nmcli_t *)handle;
     char cmd[256];
     int ret;
 
@@ -177,6 +155,7 @@ bool nmcli_disconnect_ssid(void __attribute__((unused)) *handle, wifi_network_in
         return false;
     } else {
         network->connected = false;
+        wifi_store_set_connected(nmcli->store, NULL);
         return true;
     }
 }
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wifi_store.h"
+
+#define entry_of(network)   container_of(network, struct wifi_store_entry, info)
+
+static struct wifi_store_entry *store_find(wifi_store_t *store, const char *ssid)
+{
+    wifi_network_info_t *network;
+
+    list_for_each_entry(network, &store->networks, list) {
+        if (!strcmp(network->ssid, ssid))
+            return entry_of(network);
+    }
+    return NULL;
+}
+
+static void store_notify(wifi_store_t *store, enum wifi_network_event event, struct wifi_store_entry *entry)
+{
+    entry->reported = entry->info.signal;
+    if (store->notify)
+        store->notify(event, &entry->info, store->arg);
+}
+
+static void store_remove(wifi_store_t *store, struct wifi_store_entry *entry)
+{
+    list_del(&entry->info.list);
+    store->count--;
+    free(entry);
+}
+
+void wifi_store_init(wifi_store_t *store, wifi_store_notify notify, void *arg)
+{
+    memset(store, 0, sizeof(*store));
+    INIT_LIST_HEAD(&store->networks);
+    store->notify = notify;
+    store->arg = arg;
+}
+
+void wifi_store_clear(wifi_store_t *store)
+{
+    wifi_network_info_t *network, *tmp;
+
+    list_for_each_entry_safe(network, tmp, &store->networks, list)
+        store_remove(store, entry_of(network));
+}
+
+void wifi_store_begin(wifi_store_t *store)
+{
+    wifi_network_info_t *network;
+    struct wifi_store_entry *entry;
+
+    store->generation++;
+    list_for_each_entry(network, &store->networks, list) {
+        entry = entry_of(network);
+        entry->scan_signal = 0;
+        entry->scan_connected = false;
+        entry->scan_bssid[0] = '\0';
+    }
+}
+
+void wifi_store_update(wifi_store_t *store, const char *ssid, const char *bssid, uint8_t signal, bool connected)
+{
+    struct wifi_store_entry *entry;
+
+    if (ssid == NULL || ssid[0] == '\0')
+        return;                     /* hidden */
+
+    if ((entry = store_find(store, ssid)) == NULL) {
+        if (store->count >= WIFI_STORE_MAX || (entry = calloc(1, sizeof(*entry))) == NULL)
+            return;
+        snprintf(entry->info.ssid, sizeof(entry->info.ssid), "%s", ssid);
+        entry->fresh = true;
+        list_add_tail(&entry->info.list, &store->networks);
+        store->count++;
+    }
+    if (entry->seen != store->generation || signal > entry->scan_signal) {
+        entry->scan_signal = signal;
+        snprintf(entry->scan_bssid, sizeof(entry->scan_bssid), "%s", bssid ? bssid : "");
+    }
+    entry->scan_connected |= connected;
+    entry->seen = store->generation;
+}
+
+static void store_commit(wifi_store_t *store, struct wifi_store_entry *entry)
+{
+    bool fresh = entry->fresh;
+    bool changed;
+
+    changed = entry->info.connected != entry->scan_connected ||
+              strcmp(entry->info.bssid, entry->scan_bssid) ||
+              abs((int)entry->scan_signal - entry->reported) >= WIFI_STORE_DELTA;
+    entry->fresh = false;
+    entry->info.signal = entry->scan_signal;
+    entry->info.connected = entry->scan_connected;
+    memcpy(entry->info.bssid, entry->scan_bssid, sizeof(entry->info.bssid));
+    entry->history[entry->head] = entry->scan_signal;
+    entry->head = (entry->head + 1) % WIFI_STORE_HISTORY;
+    if (entry->samples < WIFI_STORE_HISTORY)
+        entry->samples++;
+
+    if (fresh)
+        store_notify(store, WIFI_NETWORK_ADDED, entry);
+    else if (changed)
+        store_notify(store, WIFI_NETWORK_CHANGED, entry);
+}
+
+void wifi_store_end(wifi_store_t *store, bool complete)
+{
+    wifi_network_info_t *network, *tmp;
+    struct wifi_store_entry *entry;
+
+    list_for_each_entry_safe(network, tmp, &store->networks, list) {
+        entry = entry_of(network);
+        if (!complete) {
+            if (entry->fresh)
+                store_remove(store, entry);
+        } else if (entry->seen == store->generation) {
+            store_commit(store, entry);
+        } else if (store->generation - entry->seen >= WIFI_STORE_EXPIRE && !entry->info.connected) {
+            /* unlink first, the client may look the list up */
+            list_del(&entry->info.list);
+            store->count--;
+            if (store->notify)
+                store->notify(WIFI_NETWORK_REMOVED, &entry->info, store->arg);
+            free(entry);
+        }
+    }
+}
+
+void wifi_store_set_connected(wifi_store_t *store, const char *ssid)
+{
+    wifi_network_info_t *network;
+    bool connected;
+
+    list_for_each_entry(network, &store->networks, list) {
+        connected = ssid && !strcmp(network->ssid, ssid);
+        if (network->connected == connected)
+            continue;
+        network->connected = connected;
+        store_notify(store, WIFI_NETWORK_CHANGED, entry_of(network));
+    }
+}
+
+const wifi_network_info_t *wifi_store_find(wifi_store_t *store, const char *ssid)
+{
+    struct wifi_store_entry *entry = store_find(store, ssid);
+
+    return entry ? &entry->info : NULL;
+}
+
+const wifi_network_info_t *wifi_store_connected(wifi_store_t *store)
+{
+    wifi_network_info_t *network;
+
+    list_for_each_entry(network, &store->networks, list) {
+        if (network->connected)
+            return network;
+    }
+    return NULL;
+}
+
+int wifi_store_copy(wifi_store_t *store, wifi_network_info_t *networks, int max)
+{
+    wifi_network_info_t *network;
+    int n = 0;
+
+    list_for_each_entry(network, &store->networks, list) {
+        if (n >= max)
+            break;
+        networks[n] = *network;
+        INIT_LIST_HEAD(&networks[n++].list);
+    }
+    return n;
+}
+
+int wifi_store_history(wifi_store_t *store, const char *ssid, uint8_t *signal, int max)
+{
+    struct wifi_store_entry *entry = store_find(store, ssid);
+    int i, n, start;
+
+    if (entry == NULL)
+        return 0;
+    n = entry->samples < max ? entry->samples : max;
+    start = (entry->head - n + WIFI_STORE_HISTORY) % WIFI_STORE_HISTORY;
+    for (i=0; i<n; i++)
+        signal[i] = entry->history[(start + i) % WIFI_STORE_HISTORY];
+    return n;
+}
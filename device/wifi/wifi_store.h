@@ -0,0 +1,66 @@
+#ifndef __WIFI_STORE_H__
+#define __WIFI_STORE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "list.h"
+#include "wifi.h"
+
+#define WIFI_STORE_MAX          (64)
+#define WIFI_STORE_HISTORY      (16)    /* signal samples kept per network */
+#define WIFI_STORE_EXPIRE       (3)     /* scans a network may be missing from */
+#define WIFI_STORE_DELTA        (5)     /* signal change worth a WIFI_NETWORK_CHANGED */
+
+/*
+ * Scan results shared by the backends, one entry per SSID updated in
+ * place. A scan is fed between wifi_store_begin() and wifi_store_end():
+ * every BSS goes to wifi_store_update(), which keeps the strongest BSSID
+ * of an SSID. wifi_store_end() commits the scan into the signal history
+ * and reports what was added, changed or is gone.
+ */
+typedef void (*wifi_store_notify)(enum wifi_network_event event, const wifi_network_info_t *network, void *arg);
+
+struct wifi_store_entry {
+    wifi_network_info_t info;
+    uint8_t reported;               /* signal of the last event */
+    uint8_t history[WIFI_STORE_HISTORY];
+    int head;
+    int samples;
+    uint32_t seen;                  /* generation */
+    bool fresh;                     /* added by the scan in progress */
+    /* scan in progress */
+    uint8_t scan_signal;
+    bool scan_connected;
+    char scan_bssid[18];
+};
+
+typedef struct wifi_store {
+    struct list_head networks;
+    int count;
+    uint32_t generation;
+    wifi_store_notify notify;
+    void *arg;
+} wifi_store_t;
+
+void wifi_store_init(wifi_store_t *store, wifi_store_notify notify, void *arg);
+/* drop everything without events */
+void wifi_store_clear(wifi_store_t *store);
+void wifi_store_begin(wifi_store_t *store);
+void wifi_store_update(wifi_store_t *store, const char *ssid, const char *bssid, uint8_t signal, bool connected);
+/* complete false throws the scan away, e.g. an aborted dump */
+void wifi_store_end(wifi_store_t *store, bool complete);
+/* ssid NULL: not connected */
+void wifi_store_set_connected(wifi_store_t *store, const char *ssid);
+const wifi_network_info_t *wifi_store_find(wifi_store_t *store, const char *ssid);
+const wifi_network_info_t *wifi_store_connected(wifi_store_t *store);
+int wifi_store_copy(wifi_store_t *store, wifi_network_info_t *networks, int max);
+/* oldest first, returns how many */
+int wifi_store_history(wifi_store_t *store, const char *ssid, uint8_t *signal, int max);
+
+static inline uint8_t wifi_dbm_to_signal(int dbm)
+{
+    return dbm <= -100 ? 0 : dbm >= -50 ? 100 : 2 * (dbm + 100);
+}
+
+#endif
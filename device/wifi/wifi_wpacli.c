@@ -1,28 +1,350 @@
+#define LOG_MODULE_NAME "wpacli"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
+#include "log.h"
 #include "list.h"
+#include "evprof.h"
 #include "wifi_internal.h"
+#include "wpa_ctrl.h"
+
+#define WPACLI_RETRY            (2.)        /* seconds between reconnects */
+#define WPACLI_PING             (10.)       /* keepalive and signal refresh */
 
+/*
+ * wpa_supplicant backend over one persistent control socket. It is
+ * attached, so the scan store and the cached link state are refreshed by
+ * CTRL-EVENT-* messages and every query is answered from them. A
+ * periodic PING (SIGNAL_POLL while associated) notices a restarted
+ * wpa_supplicant, the socket is then reopened every WPACLI_RETRY.
+ */
 typedef struct wpacli_handle {
-    int i;
+    char path[128];
+    struct ev_loop *loop;
+    wpa_ctrl_t *ctrl;
+    ev_timer timer;
+    bool lost;                      /* reopen from the timer */
+    wifi_store_t *store;
+    bool connected;
+    char ssid[64];
+    uint8_t signal;
+    char connecting[64];
 } wpacli_t;
 
-static void* wpacli_init(void)
+static void mark_connected(wpacli_t *wpacli)
+{
+    wifi_store_set_connected(wpacli->store, wpacli->connected ? wpacli->ssid : NULL);
+}
+
+/* the socket can't be closed from its own callbacks, leave it to the timer */
+static void wpacli_lost(wpacli_t *wpacli)
+{
+    if (wpacli->lost)
+        return;
+    wpacli->lost = true;
+    ev_timer_stop(wpacli->loop, &wpacli->timer);
+    ev_timer_set(&wpacli->timer, WPACLI_RETRY, WPACLI_RETRY);
+    ev_timer_start(wpacli->loop, &wpacli->timer);
+}
+
+/* a request timing out means wpa_supplicant went away */
+static bool reply_ok(wpacli_t *wpacli, int status)
+{
+    if (status == WPA_CTRL_TIMEOUT)
+        wpacli_lost(wpacli);
+    return status == WPA_CTRL_OK;
+}
+
+static void request(wpacli_t *wpacli, const char *cmd, wpa_ctrl_reply_cb cb)
+{
+    if (wpacli->ctrl == NULL || wpacli->lost)
+        return;
+    if (wpa_ctrl_request(wpacli->ctrl, cmd, cb, wpacli) != 0)
+        wpacli_lost(wpacli);
+}
+
+/* bssid / frequency / signal level / flags / ssid */
+static void scan_results_cb(wpa_ctrl_t *ctrl, int status, const char *reply, void *arg)
+{
+    wpacli_t *wpacli = arg;
+    const char *line, *field[5];
+    char ssid[64], bssid[18];
+    size_t len;
+    int i, n = 0;
+
+    if (!reply_ok(wpacli, status))
+        return;
+
+    wifi_store_begin(wpacli->store);
+    for (line = strchr(reply, '\n'); line && line[1]; line = strchr(line + 1, '\n')) {
+        field[0] = line + 1;
+        for (i=1; i<5; i++) {
+            if ((field[i] = strpbrk(field[i-1], "\t\n")) == NULL || *field[i] != '\t')
+                break;
+            field[i]++;
+        }
+        if (i < 5 || *field[4] == '\n' || *field[4] == '\0')
+            continue;               /* hidden */
+        len = strcspn(field[4], "\n");
+        snprintf(ssid, sizeof(ssid), "%.*s", (int)len, field[4]);
+        len = field[1] - field[0] - 1;
+        snprintf(bssid, sizeof(bssid), "%.*s", (int)len, field[0]);
+        wifi_store_update(wpacli->store, ssid, bssid, wifi_dbm_to_signal(atoi(field[2])),
+                          wpacli->connected && !strcmp(ssid, wpacli->ssid));
+        n++;
+    }
+    wifi_store_end(wpacli->store, true);
+    log_debug("%s: %d access points", wpacli->path, n);
+}
+
+static const char *status_value(const char *reply, const char *key, size_t *len)
+{
+    size_t klen = strlen(key);
+    const char *line = reply;
+
+    while (line && *line) {
+        if (!strncmp(line, key, klen) && line[klen] == '=') {
+            *len = strcspn(line + klen + 1, "\n");
+            return line + klen + 1;
+        }
+        if ((line = strchr(line, '\n')) != NULL)
+            line++;
+    }
+    return NULL;
+}
+
+static void status_cb(wpa_ctrl_t *ctrl, int status, const char *reply, void *arg)
+{
+    wpacli_t *wpacli = arg;
+    const char *state, *ssid;
+    size_t len = 0, slen = 0;
+
+    if (!reply_ok(wpacli, status))
+        return;
+
+    state = status_value(reply, "wpa_state", &len);
+    ssid = status_value(reply, "ssid", &slen);
+    wpacli->connected = state && len == 9 && !strncmp(state, "COMPLETED", 9) && ssid;
+    memset(wpacli->ssid, 0, sizeof(wpacli->ssid));
+    if (wpacli->connected) {
+        memcpy(wpacli->ssid, ssid, slen < sizeof(wpacli->ssid) ? slen : sizeof(wpacli->ssid) - 1);
+        if (!strcmp(wpacli->connecting, wpacli->ssid)) {
+            log_info("%s: connected to %s", wpacli->path, wpacli->ssid);
+            wpacli->connecting[0] = '\0';
+        }
+    }
+    mark_connected(wpacli);
+}
+
+static void signal_poll_cb(wpa_ctrl_t *ctrl, int status, const char *reply, void *arg)
+{
+    wpacli_t *wpacli = arg;
+    const char *rssi;
+    size_t len;
+
+    if (!reply_ok(wpacli, status))
+        return;
+    if ((rssi = status_value(reply, "RSSI", &len)) != NULL)
+        wpacli->signal = wifi_dbm_to_signal(atoi(rssi));
+}
+
+static void ping_cb(wpa_ctrl_t *ctrl, int status, const char *reply, void *arg)
+{
+    if (reply_ok(arg, status) && strncmp(reply, "PONG", 4))
+        wpacli_lost(arg);
+}
+
+static void event_cb(wpa_ctrl_t *ctrl, int level, const char *event, void *arg)
+{
+    wpacli_t *wpacli = arg;
+
+    if (!strncmp(event, "CTRL-EVENT-SCAN-RESULTS", 23)) {
+        request(wpacli, "SCAN_RESULTS", scan_results_cb);
+    } else if (!strncmp(event, "CTRL-EVENT-CONNECTED", 20)) {
+        request(wpacli, "STATUS", status_cb);
+        request(wpacli, "SIGNAL_POLL", signal_poll_cb);
+    } else if (!strncmp(event, "CTRL-EVENT-DISCONNECTED", 23)) {
+        if (wpacli->connected)
+            log_info("%s: disconnected from %s", wpacli->path, wpacli->ssid);
+        wpacli->connected = false;
+        wpacli->signal = 0;
+        mark_connected(wpacli);
+    } else if (!strncmp(event, "CTRL-EVENT-SSID-TEMP-DISABLED", 29)) {
+        log_warn("%s: %s%s", wpacli->path, wpacli->connecting[0] ? "connect failed, " : "", event);
+    } else if (!strncmp(event, "CTRL-EVENT-TERMINATING", 22)) {
+        log_warn("%s: wpa_supplicant exits", wpacli->path);
+        wpacli->connected = false;
+        mark_connected(wpacli);
+        wpacli_lost(wpacli);
+    }
+}
+
+static bool wpacli_open(wpacli_t *wpacli)
 {
-    wpacli_t *wpacli = calloc(1, sizeof(wpacli_t));
+    wpacli->ctrl = wpa_ctrl_open(wpacli->loop, wpacli->path, event_cb, wpacli);
+    if (wpacli->ctrl == NULL)
+        return false;
+    wpacli->lost = false;
+    /* seed the cache, events keep it fresh from here */
+    wpa_ctrl_attach(wpacli->ctrl);
+    request(wpacli, "STATUS", status_cb);
+    request(wpacli, "SIGNAL_POLL", signal_poll_cb);
+    request(wpacli, "SCAN_RESULTS", scan_results_cb);
+    return true;
+}
+
+static void timer_cb(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    wpacli_t *wpacli = container_of(w, wpacli_t, timer);
+
+    if (!wpacli->lost) {
+        request(wpacli, wpacli->connected ? "SIGNAL_POLL" : "PING",
+                wpacli->connected ? signal_poll_cb : ping_cb);
+        return;
+    }
+    wpa_ctrl_close(wpacli->ctrl);
+    wpacli->ctrl = NULL;
+    if (!wpacli_open(wpacli) || wpacli->lost)
+        return;
+    log_info("%s: reconnected", wpacli->path);
+    ev_timer_stop(loop, w);
+    ev_timer_set(w, WPACLI_PING, WPACLI_PING);
+    ev_timer_start(loop, w);
+}
+
+/* the interface's control socket, or the first one in ctrl_dir */
+static bool find_ctrl(const wifi_options_t *opt, char *path, size_t size)
+{
+    const char *dir_name = opt->ctrl_dir[0] ? opt->ctrl_dir : WPA_CTRL_DIR;
+    struct dirent *de;
+    struct stat st;
+    DIR *dir;
+    bool found = false;
+
+    if (opt->ifname[0]) {
+        snprintf(path, size, "%s/%s", dir_name, opt->ifname);
+        return stat(path, &st) == 0 && S_ISSOCK(st.st_mode);
+    }
+    if ((dir = opendir(dir_name)) == NULL)
+        return false;
+    while (!found && (de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.' || !strncmp(de->d_name, "p2p-dev-", 8) || strlen(de->d_name) >= 32)
+            continue;
+        snprintf(path, size, "%s/%s", dir_name, de->d_name);
+        found = stat(path, &st) == 0 && S_ISSOCK(st.st_mode);
+    }
+    closedir(dir);
+    return found;
+}
+
+static void wpacli_free(void *handle);
+
+static void *wpacli_init(const wifi_options_t *opt, wifi_store_t *store)
+{
+    wpacli_t *wpacli;
+
+    if (opt->loop == NULL)
+        return NULL;
+    if ((wpacli = calloc(1, sizeof(*wpacli))) == NULL)
+        return NULL;
+    wpacli->store = store;
+    wpacli->loop = opt->loop;
+    ev_timer_init(&wpacli->timer, timer_cb, WPACLI_PING, WPACLI_PING);
+    evprof_watch(&wpacli->timer, "wifi.wpacli", "ping");
+
+    if (!find_ctrl(opt, wpacli->path, sizeof(wpacli->path)) || !wpacli_open(wpacli)) {
+        log_error("No wpa_supplicant control socket %s", wpacli->path);
+        wpacli_free(wpacli);
+        return NULL;
+    }
+    ev_timer_start(wpacli->loop, &wpacli->timer);
+    log_info("%s: wpacli backend", wpacli->path);
     return wpacli;
 }
 
-void wpacli_free(void *handle)
+static void wpacli_free(void *handle)
+{
+    wpacli_t *wpacli = handle;
+
+    if (wpacli == NULL)
+        return;
+    ev_timer_stop(wpacli->loop, &wpacli->timer);
+    wpa_ctrl_close(wpacli->ctrl);
+    free(wpacli);
+}
+
+static bool wpacli_is_available(const wifi_options_t *opt)
+{
+    char path[128];
+
+    return find_ctrl(opt, path, sizeof(path));
+}
+
+static bool wpacli_enable(void *handle, bool enabled)
+{
+    wpacli_t *wpacli = handle;
+
+    if (wpacli->ctrl == NULL || wpacli->lost)
+        return false;
+    return wpa_ctrl_request(wpacli->ctrl, enabled ? "REASSOCIATE" : "DISCONNECT", NULL, NULL) == 0;
+}
+
+static void wpacli_scan(void *handle)
+{
+    /* FAIL-BUSY just means one is running, its results come as an event */
+    request(handle, "SCAN", NULL);
+}
+
+static bool wpacli_connection_info(void *handle, wifi_network_info_t *network)
 {
-    if (handle)
-        free(handle);
+    wpacli_t *wpacli = handle;
+    const wifi_network_info_t *cached;
+
+    if (!network || !wpacli->connected)
+        return false;
+    memset(network->ssid, 0, sizeof(network->ssid));
+    snprintf(network->ssid, sizeof(network->ssid), "%s", wpacli->ssid);
+    network->connected = true;
+    network->signal = wpacli->signal;
+    cached = wifi_store_find(wpacli->store, wpacli->ssid);
+    snprintf(network->bssid, sizeof(network->bssid), "%s", cached ? cached->bssid : "");
+    return true;
+}
+
+static bool wpacli_connect_ssid(void *handle, wifi_network_info_t *network)
+{
+    wpacli_t *wpacli = handle;
+
+    if (!network || network->ssid[0] == '\0' || wpacli->ctrl == NULL || wpacli->lost)
+        return false;
+    if (wpa_ctrl_connect(wpacli->ctrl, network->ssid, network->password) != 0)
+        return false;
+    snprintf(wpacli->connecting, sizeof(wpacli->connecting), "%s", network->ssid);
+    return true;
+}
+
+static bool wpacli_disconnect_ssid(void *handle, wifi_network_info_t *network)
+{
+    wpacli_t *wpacli = handle;
+
+    if (wpacli->ctrl == NULL || wpacli->lost)
+        return false;
+    wpacli->connecting[0] = '\0';
+    return wpa_ctrl_request(wpacli->ctrl, "DISCONNECT", NULL, NULL) == 0;
 }
 
 wifi_backend_t wifi_wpacli = {
-    wpacli_init,
-    wpacli_free,
-    "wpacli"
-};
\ No newline at end of file
+    .init = wpacli_init,
+    .free = wpacli_free,
+    .is_available = wpacli_is_available,
+    .enable = wpacli_enable,
+    .connection_info = wpacli_connection_info,
+    .scan = wpacli_scan,
+    .connect_ssid = wpacli_connect_ssid,
+    .disconnect_ssid = wpacli_disconnect_ssid,
+    .ident = "wpacli"
+};
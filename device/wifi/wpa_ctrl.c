@@ -0,0 +1,293 @@
+#define LOG_MODULE_NAME "wpa_ctrl"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "log.h"
+#include "list.h"
+#include "evprof.h"
+#include "wpa_ctrl.h"
+
+#define WPA_CTRL_BUF_SIZE   (16 * 1024)     /* SCAN_RESULTS of a busy band */
+
+struct wpa_ctrl_req {
+    wpa_ctrl_reply_cb cb;
+    void *arg;
+    struct list_head list;
+};
+
+struct wpa_ctrl {
+    int fd;
+    char path[108];
+    char local[108];
+    struct ev_loop *loop;
+    ev_io io;
+    ev_timer timer;
+    wpa_ctrl_event_cb on_event;
+    void *arg;
+    struct list_head pending;
+    int npending;
+    int stale;                  /* late replies to timed out requests */
+    ev_tstamp stale_until;      /* ... expected no later than this */
+};
+
+static char rxbuf[WPA_CTRL_BUF_SIZE];
+
+static void req_done(wpa_ctrl_t *ctrl, int status, const char *reply)
+{
+    struct wpa_ctrl_req *req;
+
+    req = list_first_entry(&ctrl->pending, struct wpa_ctrl_req, list);
+    list_del(&req->list);
+    ctrl->npending--;
+
+    ev_timer_stop(ctrl->loop, &ctrl->timer);
+    if (ctrl->npending) {
+        ev_timer_set(&ctrl->timer, WPA_CTRL_REPLY_TIMEOUT, 0.);
+        ev_timer_start(ctrl->loop, &ctrl->timer);
+    }
+    if (req->cb)
+        req->cb(ctrl, status, reply, req->arg);
+    free(req);
+}
+
+static void timer_cb(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    wpa_ctrl_t *ctrl = container_of(w, wpa_ctrl_t, timer);
+
+    log_warn("%s: request timeout", ctrl->path);
+    ctrl->stale++;
+    ctrl->stale_until = ev_now(loop) + WPA_CTRL_REPLY_TIMEOUT;
+    req_done(ctrl, WPA_CTRL_TIMEOUT, NULL);
+}
+
+static void io_cb(struct ev_loop *loop, ev_io *w, int revents)
+{
+    wpa_ctrl_t *ctrl = container_of(w, wpa_ctrl_t, io);
+    const char *event;
+    ssize_t n;
+    int level;
+
+    for (;;) {
+        n = recv(ctrl->fd, rxbuf, sizeof(rxbuf) - 1, 0);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                log_error("%s: recv: %s", ctrl->path, strerror(errno));
+            return;
+        }
+        rxbuf[n] = '\0';
+        /* a late reply that never came must not swallow the next one */
+        if (ctrl->stale && ev_now(loop) > ctrl->stale_until)
+            ctrl->stale = 0;
+
+        if (rxbuf[0] == '<' && (event = strchr(rxbuf, '>')) != NULL) {
+            level = atoi(rxbuf + 1);
+            if (ctrl->on_event)
+                ctrl->on_event(ctrl, level, event + 1, ctrl->arg);
+        } else if (ctrl->stale) {
+            ctrl->stale--;
+        } else if (ctrl->npending) {
+            req_done(ctrl, WPA_CTRL_OK, rxbuf);
+        }
+    }
+}
+
+wpa_ctrl_t *wpa_ctrl_open(struct ev_loop *loop, const char *path, wpa_ctrl_event_cb on_event, void *arg)
+{
+    static int counter;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    wpa_ctrl_t *ctrl;
+
+    if ((ctrl = calloc(1, sizeof(*ctrl))) == NULL)
+        return NULL;
+    INIT_LIST_HEAD(&ctrl->pending);
+    ctrl->loop = loop;
+    ctrl->on_event = on_event;
+    ctrl->arg = arg;
+    snprintf(ctrl->path, sizeof(ctrl->path), "%s", path);
+    snprintf(ctrl->local, sizeof(ctrl->local), "/tmp/devctl_wpa_%d-%d", (int)getpid(), counter++);
+
+    ctrl->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ctrl->fd < 0)
+        goto fail;
+    unlink(ctrl->local);
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", ctrl->local);
+    if (bind(ctrl->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        goto fail;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", ctrl->path);
+    if (connect(ctrl->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        goto fail;
+
+    ev_io_init(&ctrl->io, io_cb, ctrl->fd, EV_READ);
+    ev_timer_init(&ctrl->timer, timer_cb, WPA_CTRL_REPLY_TIMEOUT, 0.);
+    evprof_watch(&ctrl->io, "wpa_ctrl.read", ctrl->path);
+    evprof_watch(&ctrl->timer, "wpa_ctrl.timeout", ctrl->path);
+    ev_io_start(loop, &ctrl->io);
+    return ctrl;
+
+fail:
+    log_debug("%s: %s", path, strerror(errno));
+    if (ctrl->fd >= 0) {
+        close(ctrl->fd);
+        unlink(ctrl->local);
+    }
+    free(ctrl);
+    return NULL;
+}
+
+void wpa_ctrl_close(wpa_ctrl_t *ctrl)
+{
+    if (ctrl == NULL)
+        return;
+
+    ev_io_stop(ctrl->loop, &ctrl->io);
+    while (ctrl->npending)
+        req_done(ctrl, WPA_CTRL_CLOSED, NULL);
+    ev_timer_stop(ctrl->loop, &ctrl->timer);
+    close(ctrl->fd);
+    unlink(ctrl->local);
+    free(ctrl);
+}
+
+int wpa_ctrl_request(wpa_ctrl_t *ctrl, const char *cmd, wpa_ctrl_reply_cb cb, void *arg)
+{
+    struct wpa_ctrl_req *req;
+
+    if (ctrl->npending >= WPA_CTRL_MAX_PENDING)
+        return -1;
+    if ((req = calloc(1, sizeof(*req))) == NULL)
+        return -1;
+    /* nothing outstanding: whatever comes next answers this request */
+    if (ctrl->npending == 0)
+        ctrl->stale = 0;
+    if (send(ctrl->fd, cmd, strlen(cmd), 0) < 0) {
+        log_error("%s: send %s: %s", ctrl->path, cmd, strerror(errno));
+        free(req);
+        return -1;
+    }
+    req->cb = cb;
+    req->arg = arg;
+    list_add_tail(&req->list, &ctrl->pending);
+    if (ctrl->npending++ == 0) {
+        ev_timer_set(&ctrl->timer, WPA_CTRL_REPLY_TIMEOUT, 0.);
+        ev_timer_start(ctrl->loop, &ctrl->timer);
+    }
+    return 0;
+}
+
+int wpa_ctrl_attach(wpa_ctrl_t *ctrl)
+{
+    return wpa_ctrl_request(ctrl, "ATTACH", NULL, NULL);
+}
+
+const char *wpa_ctrl_path(wpa_ctrl_t *ctrl)
+{
+    return ctrl->path;
+}
+
+struct connect_ctx {
+    char ssid[64];
+    char password[64];
+};
+
+static void connect_select_cb(wpa_ctrl_t *ctrl, int status, const char *reply, void *arg)
+{
+    if (status != WPA_CTRL_OK || strncmp(reply, "OK", 2))
+        log_error("%s: select network failed", wpa_ctrl_path(ctrl));
+}
+
+static void connect_configure(wpa_ctrl_t *ctrl, int id, struct connect_ctx *ctx)
+{
+    char cmd[192];
+    int i, n;
+
+    n = snprintf(cmd, sizeof(cmd), "SET_NETWORK %d ssid ", id);
+    for (i=0; ctx->ssid[i] && n < sizeof(cmd) - 2; i++)
+        n += snprintf(cmd + n, sizeof(cmd) - n, "%02x", (uint8_t)ctx->ssid[i]);
+    wpa_ctrl_request(ctrl, cmd, NULL, NULL);
+    if (ctx->password[0]) {
+        snprintf(cmd, sizeof(cmd), "SET_NETWORK %d psk \"%s\"", id, ctx->password);
+    } else {
+        snprintf(cmd, sizeof(cmd), "SET_NETWORK %d key_mgmt NONE", id);
+    }
+    wpa_ctrl_request(ctrl, cmd, NULL, NULL);
+    snprintf(cmd, sizeof(cmd), "SELECT_NETWORK %d", id);
+    wpa_ctrl_request(ctrl, cmd, connect_select_cb, NULL);
+}
+
+static void connect_add_cb(wpa_ctrl_t *ctrl, int status, const char *reply, void *arg)
+{
+    struct connect_ctx *ctx = arg;
+
+    if (status != WPA_CTRL_OK || !strncmp(reply, "FAIL", 4))
+        log_error("%s: add network failed", wpa_ctrl_path(ctrl));
+    else
+        connect_configure(ctrl, atoi(reply), ctx);
+    free(ctx);
+}
+
+/* reuse a configured network of the same SSID so connects don't pile up */
+static void connect_list_cb(wpa_ctrl_t *ctrl, int status, const char *reply, void *arg)
+{
+    struct connect_ctx *ctx = arg;
+    const char *line;
+    size_t len = strlen(ctx->ssid);
+
+    if (status != WPA_CTRL_OK) {
+        free(ctx);
+        return;
+    }
+    for (line = strchr(reply, '\n'); line && line[1]; line = strchr(line + 1, '\n')) {
+        const char *ssid = strchr(line + 1, '\t');
+        if (ssid && !strncmp(ssid + 1, ctx->ssid, len) && ssid[len + 1] == '\t') {
+            connect_configure(ctrl, atoi(line + 1), ctx);
+            free(ctx);
+            return;
+        }
+    }
+    if (wpa_ctrl_request(ctrl, "ADD_NETWORK", connect_add_cb, ctx) != 0)
+        free(ctx);
+}
+
+/*
+ * The passphrase goes into psk "..." as is: wpa_supplicant has no escapes
+ * there and ends it at the last quote, so " and \ are taken literally and
+ * any 8..63 printable ASCII passphrase round trips.
+ */
+static bool passphrase_ok(const char *password)
+{
+    size_t i, len = strlen(password);
+
+    if (len < 8 || len > 63)
+        return false;
+    for (i=0; i<len; i++) {
+        if (password[i] < 0x20 || password[i] > 0x7e)
+            return false;
+    }
+    return true;
+}
+
+int wpa_ctrl_connect(wpa_ctrl_t *ctrl, const char *ssid, const char *password)
+{
+    struct connect_ctx *ctx;
+
+    if (password && password[0] && !passphrase_ok(password)) {
+        log_error("%s: passphrase must be 8..63 printable characters", ctrl->path);
+        return -1;
+    }
+    if ((ctx = calloc(1, sizeof(*ctx))) == NULL)
+        return -1;
+    snprintf(ctx->ssid, sizeof(ctx->ssid), "%s", ssid);
+    snprintf(ctx->password, sizeof(ctx->password), "%s", password ? password : "");
+    if (wpa_ctrl_request(ctrl, "LIST_NETWORKS", connect_list_cb, ctx) != 0) {
+        free(ctx);
+        return -1;
+    }
+    return 0;
+}
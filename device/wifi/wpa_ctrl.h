@@ -0,0 +1,46 @@
+#ifndef __WPA_CTRL_H__
+#define __WPA_CTRL_H__
+
+#include <stddef.h>
+#include <ev.h>
+
+/*
+ * wpa_supplicant control interface client on the event loop.
+ *
+ * wpa_supplicant answers requests in order, so replies are matched to a
+ * FIFO of callbacks. After wpa_ctrl_attach() unsolicited "<level>EVENT"
+ * messages go to the event callback.
+ */
+#define WPA_CTRL_DIR            "/var/run/wpa_supplicant"
+#define WPA_CTRL_MAX_PENDING    (32)
+#define WPA_CTRL_REPLY_TIMEOUT  (3.)        /* seconds */
+
+enum wpa_ctrl_status {
+    WPA_CTRL_OK         = 0,
+    WPA_CTRL_TIMEOUT    = -1,
+    WPA_CTRL_CLOSED     = -2,
+};
+
+typedef struct wpa_ctrl wpa_ctrl_t;
+
+/* reply is NUL terminated, NULL unless status is WPA_CTRL_OK */
+typedef void (*wpa_ctrl_reply_cb)(wpa_ctrl_t *ctrl, int status, const char *reply, void *arg);
+/* event without the "<level>" prefix */
+typedef void (*wpa_ctrl_event_cb)(wpa_ctrl_t *ctrl, int level, const char *event, void *arg);
+
+wpa_ctrl_t *wpa_ctrl_open(struct ev_loop *loop, const char *path, wpa_ctrl_event_cb on_event, void *arg);
+/* pending callbacks run with WPA_CTRL_CLOSED */
+void wpa_ctrl_close(wpa_ctrl_t *ctrl);
+/* cb may be NULL, returns -1 when the queue is full or the send fails */
+int wpa_ctrl_request(wpa_ctrl_t *ctrl, const char *cmd, wpa_ctrl_reply_cb cb, void *arg);
+int wpa_ctrl_attach(wpa_ctrl_t *ctrl);
+/*
+ * Configure and select a network: reuses a configured network of the same
+ * SSID, otherwise adds one. Open networks when password is empty. Only
+ * queues the requests, the outcome arrives as CTRL-EVENT-CONNECTED.
+ * -1 unless the passphrase is 8..63 printable ASCII characters.
+ */
+int wpa_ctrl_connect(wpa_ctrl_t *ctrl, const char *ssid, const char *password);
+const char *wpa_ctrl_path(wpa_ctrl_t *ctrl);
+
+#endif
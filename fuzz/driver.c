@@ -0,0 +1,50 @@
+/*
+ * Standalone driver for toolchains without libFuzzer: runs every file given
+ * on the command line (or stdin) through the harness once. Used for corpus
+ * regression runs and as the AFL target (afl-fuzz ... -- ./fuzz-xxx @@).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *buf, size_t len);
+
+static int run(FILE *fp, const char *name)
+{
+    uint8_t *buf = NULL;
+    size_t len = 0, cap = 0, n;
+
+    do {
+        if (len == cap) {
+            cap = cap ? cap * 2 : 4096;
+            if (!(buf = realloc(buf, cap)))
+                return -1;
+        }
+        n = fread(buf + len, 1, cap - len, fp);
+        len += n;
+    } while (n);
+
+    LLVMFuzzerTestOneInput(buf, len);
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *fp;
+    int i;
+
+    if (argc < 2)
+        return run(stdin, "stdin");
+
+    for (i=1; i<argc; i++) {
+        if (!(fp = fopen(argv[i], "rb"))) {
+            perror(argv[i]);
+            return 1;
+        }
+        run(fp, argv[i]);
+        fclose(fp);
+    }
+    printf("%d inputs ok\n", argc - 1);
+    return 0;
+}
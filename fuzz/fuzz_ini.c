@@ -0,0 +1,62 @@
+/*
+ * INI parser harness: writes the input to a file and runs the readers
+ * devctl uses on it, minIni lookups and the confdb in-memory image.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ini.h"
+#include "confdb.h"
+#include "log.h"
+
+static char conf_file[64];
+
+static int browse_cb(const char *section, const char *key, const char *value, void *userdata)
+{
+    (*(int *)userdata)++;
+    return 1;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *buf, size_t len)
+{
+    char section[INI_BUFFERSIZE], key[INI_BUFFERSIZE], value[INI_BUFFERSIZE];
+    confdb_t *db;
+    FILE *fp;
+    int s, k, n = 0;
+
+    if (!conf_file[0]) {
+        snprintf(conf_file, sizeof(conf_file), "/tmp/devctl-fuzz-ini.%d", getpid());
+        log_set_quiet(true);
+    }
+    if (!(fp = fopen(conf_file, "wb")))
+        return 0;
+    fwrite(buf, 1, len, fp);
+    fclose(fp);
+
+    /* bound the walk, every lookup rescans the file */
+    for (s = 0; s < 16 && ini_getsection(s, section, sizeof(section), conf_file) > 0; s++) {
+        for (k = 0; k < 16 && ini_getkey(section, k, key, sizeof(key), conf_file) > 0; k++) {
+            ini_gets(section, key, "", value, sizeof(value), conf_file);
+            ini_getl(section, key, 0, conf_file);
+        }
+        ini_hassection(section, conf_file);
+    }
+    ini_browse(browse_cb, &n, conf_file);
+
+    if ((db = confdb_open(conf_file, NULL))) {
+        for (s = 0; s < confdb_section_count(db); s++) {
+            for (k = 0; k < confdb_key_count(db, s); k++) {
+                if (!confdb_key(db, s, k) || !confdb_value(db, s, k))
+                    abort();
+                if (!confdb_get(db, confdb_section(db, s), confdb_key(db, s, k)))
+                    abort();
+            }
+        }
+        confdb_close(db);
+    }
+    unlink(conf_file);
+    return 0;
+}
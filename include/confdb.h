@@ -0,0 +1,31 @@
+#ifndef __CONFDB_H__
+#define __CONFDB_H__
+
+#include <stdbool.h>
+
+/*
+ * Compiled config snapshot.
+ *
+ * The snapshot is generated offline from an INI file (tools/confc.c) and
+ * mmap'ed at startup, lookups return pointers straight into the mapping.
+ * When the snapshot is missing, corrupted or does not match the INI file
+ * any more, the INI file is parsed once into an in-memory image with the
+ * same layout, so callers never see the difference.
+ */
+typedef struct confdb confdb_t;
+
+confdb_t *confdb_open(const char *conf_file, const char *snapshot);
+void confdb_close(confdb_t *db);
+int confdb_compile(const char *conf_file, const char *snapshot);
+bool confdb_is_snapshot(confdb_t *db);
+
+int confdb_section_count(confdb_t *db);
+const char *confdb_section(confdb_t *db, int section);
+int confdb_key_count(confdb_t *db, int section);
+const char *confdb_key(confdb_t *db, int section, int idx);
+const char *confdb_value(confdb_t *db, int section, int idx);
+long confdb_value_l(confdb_t *db, int section, int idx, long def);
+const char *confdb_get(confdb_t *db, const char *section, const char *key);
+long confdb_getl(confdb_t *db, const char *section, const char *key, long def);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __CRC32_H__
+#define __CRC32_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* IEEE 802.3 CRC-32, pass 0 as the initial crc and chain the result */
+uint32_t crc32(uint32_t crc, const void *buf, size_t len);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __EVPROF_H__
+#define __EVPROF_H__
+
+#include <stdbool.h>
+#include <ev.h>
+
+/*
+ * Event loop profiler.
+ *
+ * evprof_watch() routes a watcher's callback through a timing trampoline
+ * (the original callback is kept in a probe stored in w->data), so every
+ * invocation is attributed to a "type" and a "name" such as
+ * ("serial.read", "/dev/ttyS1"). evprof_init() hooks the loop's pending
+ * invocation and prepare/check watchers to measure how long each loop
+ * iteration stays busy. Durations go to devctl_* histograms in the
+ * metrics registry; when profiling is off only the trampoline call
+ * remains.
+ */
+void evprof_init(struct ev_loop *loop);
+void evprof_exit(struct ev_loop *loop);
+void evprof_enable(bool enable);
+bool evprof_enabled(void);
+void evprof_watch(void *watcher, const char *type, const char *name);
+void evprof_reset(void);
+void evprof_report(void (*print)(const char *fmt, ...), int top);
+
+#endif
@@ -17,9 +17,10 @@
 typedef struct {
     va_list ap;
     const char *fmt;
+    const char *msg;            /* preformatted by the async path, fmt/ap unused */
     const char *file;
     const char *function;
-    struct tm *time;
+    time_t sec;
     void *udata;
     int line;
     int level;
@@ -30,12 +31,53 @@ typedef void (*log_LockFn)(bool lock, void *udata);
 
 enum { LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_FATAL };
 
-#define log_trace(...) log_log(LOG_TRACE, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
-#define log_debug(...) log_log(LOG_DEBUG, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
-#define log_info(...)  log_log(LOG_INFO,  __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
-#define log_warn(...)  log_log(LOG_WARN,  __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
-#define log_error(...) log_log(LOG_ERROR, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
-#define log_fatal(...) log_log(LOG_FATAL, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__)
+/*
+ * Log sites below LOG_COMPILE_LEVEL are compiled out, e.g.
+ * -DLOG_COMPILE_LEVEL=2 keeps INFO and above. Everything else is checked
+ * against the module level inline, before the arguments are evaluated.
+ *
+ * A file becomes its own module by defining LOG_MODULE_NAME before
+ * including this header, its level can then be changed at runtime with
+ * log_set_module_level().
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_TRACE
+#endif
+
+typedef struct log_Module {
+    const char *name;
+    int level;                  /* -1: follow the global level */
+    int threshold;              /* lowest level any sink will print */
+    struct log_Module *next;
+} log_Module;
+
+extern log_Module log_module_default;
+void log_module_register(log_Module *module);
+
+#ifdef LOG_MODULE_NAME
+static log_Module log_module_self __attribute__((unused)) = { LOG_MODULE_NAME, -1, 0, NULL };
+static void __attribute__((constructor)) log_module_self_register(void)
+{
+    log_module_register(&log_module_self);
+}
+#define LOG_MODULE_SELF (&log_module_self)
+#else
+#define LOG_MODULE_SELF (&log_module_default)
+#endif
+
+#define log_at(level, ...) do {                                             \
+        if ((level) >= LOG_COMPILE_LEVEL &&                                 \
+            (level) >= LOG_MODULE_SELF->threshold)                          \
+            log_log_module(LOG_MODULE_SELF, level, __FILE__, __FUNCTION__,  \
+                           __LINE__, __VA_ARGS__);                          \
+    } while (0)
+
+#define log_trace(...) log_at(LOG_TRACE, __VA_ARGS__)
+#define log_debug(...) log_at(LOG_DEBUG, __VA_ARGS__)
+#define log_info(...)  log_at(LOG_INFO,  __VA_ARGS__)
+#define log_warn(...)  log_at(LOG_WARN,  __VA_ARGS__)
+#define log_error(...) log_at(LOG_ERROR, __VA_ARGS__)
+#define log_fatal(...) log_at(LOG_FATAL, __VA_ARGS__)
 
 const char* log_level_string(int level);
 void log_set_lock(log_LockFn fn, void *udata);
@@ -43,7 +85,15 @@ void log_set_level(int level);
 void log_set_quiet(bool enable);
 int log_add_callback(log_LogFn fn, void *udata, int level);
 int log_add_fp(FILE *fp, int level);
+int log_async_start(void);
+void log_async_stop(void);
+unsigned long log_async_dropped(void);
+int log_set_module_level(const char *name, int level);
+log_Module *log_module_first(void);
+int log_level_from_string(const char *str);
 
 void log_log(int level, const char *file, const char *function, int line, const char *fmt, ...);
+void log_log_module(log_Module *module, int level, const char *file, const char *function,
+                    int line, const char *fmt, ...);
 
 #endif
\ No newline at end of file
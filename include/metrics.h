@@ -0,0 +1,67 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <ev.h>
+#include "iobuf.h"
+
+/*
+ * Process wide metrics registry, exported in the Prometheus text format.
+ *
+ * Metrics are looked up once (usually when a device is opened) and then
+ * updated with relaxed atomics, so the hot path never takes a lock.
+ * Histograms record nanoseconds in log-linear buckets (8 sub-buckets per
+ * power of two, ~12% resolution) and are exported in seconds.
+ */
+enum metric_type {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+};
+
+#define METRIC_HIST_BUCKETS     (16 + 60 * 8)
+
+typedef struct metric {
+    const char *name;
+    const char *help;
+    char labels[128];           /* rendered: key="value",... */
+    enum metric_type type;
+    atomic_uint_fast64_t value; /* counter, gauge (as int64) */
+    atomic_uint_fast64_t count; /* histogram */
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t max;
+    atomic_uint_fast64_t *buckets;
+    struct metric *next;
+} metric_t;
+
+/* Label key/value pairs terminated by NULL. Same name and labels return the same metric. */
+metric_t *metric_get(enum metric_type type, const char *name, const char *help, ...);
+void metric_observe(metric_t *m, uint64_t ns);
+uint64_t metric_quantile(metric_t *m, double q);
+metric_t *metric_first(void);
+int metrics_render(struct iobuf *out);
+void metrics_loop_init(struct ev_loop *loop);
+void metrics_loop_exit(void);
+
+static inline void metric_add(metric_t *m, uint64_t v)
+{
+    if (m)
+        atomic_fetch_add_explicit(&m->value, v, memory_order_relaxed);
+}
+
+static inline void metric_set(metric_t *m, int64_t v)
+{
+    if (m)
+        atomic_store_explicit(&m->value, (uint64_t)v, memory_order_relaxed);
+}
+
+static inline uint64_t metric_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __PROCESS_H__
+#define __PROCESS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <ev.h>
+
+#include "iobuf.h"
+
+/*
+ * Asynchronous subprocess runner on the event loop.
+ *
+ * Programs are started with posix_spawnp() in their own process group,
+ * stdin on /dev/null. stdout and stderr come back through non-blocking
+ * pipes watched by ev_io and the exit status through ev_child, so a slow
+ * tool never holds up device I/O. At most max_running processes run at
+ * once, later ones wait in a bounded queue. A timeout sends SIGTERM to
+ * the group, then SIGKILL after PROCESS_KILL_GRACE.
+ *
+ * process_run() and process_cancel() may be called from any thread; the
+ * done callback always runs on the loop thread.
+ */
+#define PROCESS_MAX_RUNNING     (4)
+#define PROCESS_MAX_QUEUED      (32)
+#define PROCESS_MAX_OUTPUT      (1024 * 1024)   /* per stream */
+#define PROCESS_KILL_GRACE      (1.)            /* seconds */
+#define PROCESS_DRAIN_TIMEOUT   (0.2)           /* pipes held open by grandchildren */
+
+struct process_result {
+    int id;
+    int status;             /* exit code, 128 + signal, -1 when not started */
+    bool timed_out;
+    struct iobuf out;       /* stdout, with stderr when merge_stderr */
+    struct iobuf err;
+    uint64_t truncated;     /* bytes dropped over max_output */
+    uint64_t elapsed_ns;
+};
+
+/* res and its buffers are freed when the callback returns */
+typedef void (*process_done_cb)(const struct process_result *res, void *arg);
+
+typedef struct {
+    const char *const *argv;    /* argv[0] is looked up in PATH */
+    double timeout;             /* seconds, 0: none */
+    size_t max_output;          /* 0: PROCESS_MAX_OUTPUT */
+    bool merge_stderr;
+} process_options_t;
+
+int process_init(struct ev_loop *loop, int max_running);
+/* kills what is still running, queued processes complete with -1 */
+void process_exit(void);
+/* returns a process id > 0, or -1 when the queue is full */
+int process_run(const process_options_t *opt, process_done_cb cb, void *arg);
+int process_cancel(int id);
+void process_report(void (*print)(const char *fmt, ...));
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __SYSFS_H__
+#define __SYSFS_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * A sysfs attribute kept open for its whole life. Every access is one
+ * pread()/pwrite() at offset 0: sysfs regenerates the value on each read
+ * and ignores the offset on writes, so there is no open/close per access.
+ * Attributes outside sysfs (a fake tree of regular files) are truncated
+ * after each write, so a shorter value does not leave a stale tail.
+ */
+typedef struct sysfs_attr {
+    int fd;
+    bool regular;                   /* not on sysfs */
+    char path[160];
+} sysfs_attr_t;
+
+#define SYSFS_VALUE_MAX     (128)
+
+/* before the first open, so a close of a never opened attribute is harmless */
+static inline void sysfs_attr_init(sysfs_attr_t *attr)
+{
+    attr->fd = -1;
+    attr->regular = false;
+    attr->path[0] = '\0';
+}
+
+/* flags O_RDONLY, O_WRONLY or O_RDWR; -1 and errno on failure */
+int sysfs_attr_open(sysfs_attr_t *attr, const char *dir, const char *name, int flags);
+void sysfs_attr_close(sysfs_attr_t *attr);
+/* NUL terminated, trailing newline dropped, returns the length */
+ssize_t sysfs_attr_read(sysfs_attr_t *attr, char *buf, size_t size);
+int sysfs_attr_read_l(sysfs_attr_t *attr, long long *value);
+int sysfs_attr_write(sysfs_attr_t *attr, const char *value);
+int sysfs_attr_write_l(sysfs_attr_t *attr, long long value);
+/* one shot open/access/close, for export files and values read once */
+int sysfs_write(const char *dir, const char *name, const char *value);
+ssize_t sysfs_read(const char *dir, const char *name, char *buf, size_t size);
+
+#endif
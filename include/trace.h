@@ -0,0 +1,44 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+ * Wire trace: raw TX/RX bytes of every device, timestamped and streamed
+ * to a pcapng file (one interface per device) by a background thread.
+ * When tracing is off a log site costs a single relaxed load.
+ */
+enum trace_dir {
+    TRACE_RX = 1,               /* pcapng epb_flags inbound */
+    TRACE_TX = 2,               /* pcapng epb_flags outbound */
+};
+
+enum trace_link {
+    TRACE_LINK_SERIAL = 147,    /* LINKTYPE_USER0 */
+    TRACE_LINK_HIDRAW = 148,    /* LINKTYPE_USER1 */
+    TRACE_LINK_USB    = 149,    /* LINKTYPE_USER2 */
+};
+
+extern atomic_bool trace_on;
+
+static inline bool trace_enabled(void)
+{
+    return atomic_load_explicit(&trace_on, memory_order_relaxed);
+}
+
+int trace_register(const char *name, enum trace_link link);
+int trace_start(const char *path);
+void trace_stop(void);
+void trace_stats(uint64_t *records, uint64_t *bytes, uint64_t *dropped);
+void __trace_record(int id, enum trace_dir dir, const void *buf, size_t len);
+
+static inline void trace_record(int id, enum trace_dir dir, const void *buf, size_t len)
+{
+    if (trace_enabled() && id >= 0 && len > 0)
+        __trace_record(id, dir, buf, len);
+}
+
+#endif
@@ -3,6 +3,9 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
 
 #define sizearray(a)  (sizeof(a) / sizeof((a)[0]))
 
@@ -32,4 +35,17 @@ static inline bool fd_is_nonblock(int fd)
     return (fcntl(fd, F_GETFL) & O_NONBLOCK) == O_NONBLOCK;
 }
 
+/* decimal device index, -1 unless the whole string is one in 0..INT_MAX */
+static inline int parse_index(const char *s)
+{
+    char *end;
+    long v;
+
+    errno = 0;
+    v = strtol(s, &end, 10);
+    if (errno || end == s || *end != '\0' || v < 0 || v > INT_MAX)
+        return -1;
+    return (int)v;
+}
+
 #endif
\ No newline at end of file
@@ -1,9 +1,11 @@
 #ifndef __WS_SERVER_H__
 #define __WS_SERVER_H__
 
+#include <ev.h>
 #include "thpool.h"
 
-int ws_server_init(threadpool thpool, const char *url);
+/* url served from a thpool thread, device work is handed to loop */
+int ws_server_init(struct ev_loop *loop, threadpool thpool, const char *url);
 void ws_server_exit(void);
 
 #endif
\ No newline at end of file
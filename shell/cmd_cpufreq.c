@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include "log.h"
+#include "shell.h"
+#include "cpufreq.h"
+#include "device.h"
+#include "utils.h"
+#include "shell_internal.h"
+
+static void help(void)
+{
+    shell_printf("Usage: cpufreq [index] <opr> [args]\n");
+    shell_printf("  Available opr: list, get, limits <min_khz> <max_khz>, governor <name>, watch <on|off>, period <ms>\n");
+}
+
+static void on_sample(cpufreq_t *cpufreq, unsigned int khz)
+{
+    shell_printf("%s: %u kHz\n", cpufreq_id(cpufreq), khz);
+}
+
+static struct cpufreq_client_ops watch_ops = {
+    .on_sample = on_sample,
+};
+
+static struct cpufreq_client watch_client = {
+    .name = "shell",
+    .ops = &watch_ops,
+    .list = LIST_HEAD_INIT(watch_client.list),
+};
+
+static int cpufreq_list(void)
+{
+    unsigned int khz, min_khz, max_khz;
+    cpufreq_t *cpufreq;
+    int i;
+
+    for (i=0; (cpufreq=get_cpufreq(i)) != NULL; i++) {
+        cpufreq_limits(cpufreq, &min_khz, &max_khz);
+        if (cpufreq_get_cur(cpufreq, &khz) != 0)
+            khz = 0;
+        shell_printf("%d: %s %s %u kHz (%u-%u)\n", i, cpufreq_id(cpufreq),
+                     cpufreq_governor(cpufreq), khz, min_khz, max_khz);
+    }
+    return 0;
+}
+
+int cmd_cpufreq(int argc, char *argv[])
+{
+    int index = 0, ret = -EINVAL;
+    cpufreq_t *cpufreq;
+    unsigned int khz;
+
+    if (argc > 1 && isdigit((unsigned char)argv[1][0])) {
+        index = parse_index(argv[1]);
+        argc--;
+        argv++;
+    }
+    if (argc < 2) {
+        help();
+        return 0;
+    }
+    if (!strcmp(argv[1], "list"))
+        return cpufreq_list();
+
+    if ((cpufreq = get_cpufreq(index)) == NULL)
+        return -EINVAL;
+
+    if (!strcmp(argv[1], "get") && argc == 2) {
+        if ((ret = cpufreq_get_cur(cpufreq, &khz)) == 0)
+            on_sample(cpufreq, khz);
+    } else if (!strcmp(argv[1], "limits") && argc == 4) {
+        ret = cpufreq_set_limits(cpufreq, strtoul(argv[2], NULL, 0), strtoul(argv[3], NULL, 0));
+    } else if (!strcmp(argv[1], "governor") && argc == 3) {
+        ret = cpufreq_set_governor(cpufreq, argv[2]);
+    } else if (!strcmp(argv[1], "watch") && argc == 3) {
+        return SHELL_WATCH(cpufreq, cpufreq, &watch_client, !strcmp(argv[2], "on"));
+    } else if (!strcmp(argv[1], "period") && argc == 3) {
+        cpufreq_set_period(cpufreq, strtol(argv[2], NULL, 0));
+        return 0;
+    } else {
+        help();
+        return -EINVAL;
+    }
+    if (ret != 0)
+        log_info("%s", cpufreq_errmsg(cpufreq));
+    return ret;
+}
@@ -0,0 +1,35 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "log.h"
+#include "shell.h"
+#include "evprof.h"
+
+#define EVPROF_TOP_DEFAULT  10
+
+static void help(void)
+{
+    shell_printf("Usage: evprof <on|off|reset|top [count]>\n");
+}
+
+int cmd_evprof(int argc, char *argv[])
+{
+    if (argc < 2) {
+        help();
+        return 0;
+    }
+
+    if (!strcmp(argv[1], "on")) {
+        evprof_enable(true);
+    } else if (!strcmp(argv[1], "off")) {
+        evprof_enable(false);
+    } else if (!strcmp(argv[1], "reset")) {
+        evprof_reset();
+    } else if (!strcmp(argv[1], "top")) {
+        evprof_report(shell_printf, argc > 2 ? atoi(argv[2]) : EVPROF_TOP_DEFAULT);
+    } else {
+        help();
+        return -EINVAL;
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include "log.h"
+#include "shell.h"
+#include "gpio.h"
+#include "device.h"
+#include "utils.h"
+#include "shell_internal.h"
+
+static void help(void)
+{
+    shell_printf("Usage: gpio [index] <opr> [args]\n");
+    shell_printf("  Available opr: list, get [line...], set <line=value...>, watch <on|off>\n");
+}
+
+static void on_event(gpio_t *gpio, const struct gpio_event *events, int count)
+{
+    int i;
+
+    for (i=0; i<count; i++)
+        shell_printf("%s: line %u %s at %llu.%09llu, seqno %u\n", gpio_name(gpio), events[i].line,
+                     events[i].rising ? "rising" : "falling",
+                     (unsigned long long)(events[i].timestamp_ns / 1000000000ULL),
+                     (unsigned long long)(events[i].timestamp_ns % 1000000000ULL), events[i].seqno);
+}
+
+static struct gpio_client_ops watch_ops = {
+    .on_event = on_event,
+};
+
+static struct gpio_client watch_client = {
+    .name = "shell",
+    .ops = &watch_ops,
+    .list = LIST_HEAD_INIT(watch_client.list),
+};
+
+static int gpio_list(gpio_t *gpio)
+{
+    struct gpio_line lines[GPIO_MAX_LINES];
+    int i, n;
+
+    n = gpio_lines(gpio, lines, GPIO_MAX_LINES);
+    shell_printf("%s:\n", gpio_name(gpio));
+    for (i=0; i<n; i++)
+        shell_printf("%3u %-6s %s\n", lines[i].offset, lines[i].output ? "output" : "input", lines[i].name);
+    return 0;
+}
+
+/* no lines: all of them */
+static int gpio_get(gpio_t *gpio, int argc, char *argv[])
+{
+    struct gpio_line lines[GPIO_MAX_LINES];
+    unsigned int offsets[GPIO_MAX_LINES];
+    int values[GPIO_MAX_LINES];
+    int i, n, ret;
+
+    if (argc > GPIO_MAX_LINES)
+        return -EINVAL;
+    if (argc == 0) {
+        n = gpio_lines(gpio, lines, GPIO_MAX_LINES);
+        for (i=0; i<n; i++)
+            offsets[i] = lines[i].offset;
+    } else {
+        for (n=0; n<argc; n++)
+            offsets[n] = strtoul(argv[n], NULL, 0);
+    }
+
+    if ((ret = gpio_get_values(gpio, offsets, values, n)) != 0) {
+        log_info("%s", gpio_errmsg(gpio));
+        return ret;
+    }
+    for (i=0; i<n; i++)
+        shell_printf("%u=%d%s", offsets[i], values[i], i == n - 1 ? "\n" : " ");
+    return 0;
+}
+
+static int gpio_set(gpio_t *gpio, int argc, char *argv[])
+{
+    unsigned int offsets[GPIO_MAX_LINES];
+    int values[GPIO_MAX_LINES];
+    char *eq;
+    int n, ret;
+
+    if (argc == 0 || argc > GPIO_MAX_LINES)
+        return -EINVAL;
+    for (n=0; n<argc; n++) {
+        if ((eq = strchr(argv[n], '=')) == NULL)
+            return -EINVAL;
+        offsets[n] = strtoul(argv[n], NULL, 0);
+        values[n] = atoi(eq + 1) != 0;
+    }
+
+    /* one ioctl for all of them */
+    if ((ret = gpio_set_values(gpio, offsets, values, n)) != 0)
+        log_info("%s", gpio_errmsg(gpio));
+    return ret;
+}
+
+int cmd_gpio(int argc, char *argv[])
+{
+    int index = 0, ret = -EINVAL;
+    gpio_t *gpio;
+
+    if (argc > 1 && isdigit((unsigned char)argv[1][0])) {
+        index = parse_index(argv[1]);
+        argc--;
+        argv++;
+    }
+    if (argc < 2) {
+        help();
+        return 0;
+    }
+
+    if ((gpio = get_gpio(index)) == NULL)
+        return -EINVAL;
+
+    if (!strcmp(argv[1], "list")) {
+        ret = gpio_list(gpio);
+    } else if (!strcmp(argv[1], "get")) {
+        ret = gpio_get(gpio, argc - 2, argv + 2);
+    } else if (!strcmp(argv[1], "set")) {
+        ret = gpio_set(gpio, argc - 2, argv + 2);
+    } else if (!strcmp(argv[1], "watch") && argc == 3) {
+        ret = SHELL_WATCH(gpio, gpio, &watch_client, !strcmp(argv[2], "on"));
+    }
+    if (ret == -EINVAL)
+        help();
+    return ret;
+}
@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include "log.h"
+#include "shell.h"
+#include "input.h"
+#include "device.h"
+#include "utils.h"
+#include "shell_internal.h"
+
+static void help(void)
+{
+    shell_printf("Usage: input [index] <opr> [args]\n");
+    shell_printf("  Available opr: list, watch <on|off>, grab <on|off>, record <start <file>|stop>\n");
+}
+
+/* getevent -t */
+static void on_events(input_t *input, const struct input_event *events, int count)
+{
+    int i;
+
+    for (i=0; i<count; i++)
+        shell_printf("[%8lu.%06lu] %s: %04x %04x %08x\n", (unsigned long)events[i].input_event_sec,
+                     (unsigned long)events[i].input_event_usec, input_id(input),
+                     events[i].type, events[i].code, (unsigned int)events[i].value);
+}
+
+static void on_state(input_t *input, bool present)
+{
+    shell_printf("%s: %s\n", input_id(input), present ? "back" : "lost");
+}
+
+static struct input_client_ops watch_ops = {
+    .on_events = on_events,
+    .on_state = on_state,
+};
+
+static struct input_client watch_client = {
+    .name = "shell",
+    .ops = &watch_ops,
+    .list = LIST_HEAD_INIT(watch_client.list),
+};
+
+static int input_list(void)
+{
+    input_t *input;
+    int i;
+
+    for (i=0; (input=get_input(i)) != NULL; i++)
+        shell_printf("%d: %s%s\n", i, input_id(input), input_present(input) ? "" : " (lost)");
+    return 0;
+}
+
+int cmd_input(int argc, char *argv[])
+{
+    int index = 0, ret = -EINVAL;
+    input_t *input;
+
+    if (argc > 1 && isdigit((unsigned char)argv[1][0])) {
+        index = parse_index(argv[1]);
+        argc--;
+        argv++;
+    }
+    if (argc < 2) {
+        help();
+        return 0;
+    }
+    if (!strcmp(argv[1], "list"))
+        return input_list();
+
+    if ((input = get_input(index)) == NULL)
+        return -EINVAL;
+
+    if (!strcmp(argv[1], "watch") && argc == 3) {
+        ret = SHELL_WATCH(input, input, &watch_client, !strcmp(argv[2], "on"));
+    } else if (!strcmp(argv[1], "grab") && argc == 3) {
+        if ((ret = input_grab(input, !strcmp(argv[2], "on"))) != 0)
+            log_info("%s", input_errmsg(input));
+    } else if (!strcmp(argv[1], "record") && argc == 4 && !strcmp(argv[2], "start")) {
+        if ((ret = input_record_start(input, argv[3])) != 0)
+            log_info("%s", input_errmsg(input));
+    } else if (!strcmp(argv[1], "record") && argc == 3 && !strcmp(argv[2], "stop")) {
+        input_record_stop(input);
+        ret = 0;
+    }
+    if (ret == -EINVAL)
+        help();
+    return ret;
+}
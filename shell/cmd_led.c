@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include "log.h"
+#include "shell.h"
+#include "led.h"
+#include "device.h"
+#include "utils.h"
+
+static void help(void)
+{
+    shell_printf("Usage: led [index] <opr> [args]\n");
+    shell_printf("  Available opr: list, get, set <brightness>, trigger <name>\n");
+}
+
+static int led_list(void)
+{
+    led_t *led;
+    int i;
+
+    for (i=0; (led=get_led(i)) != NULL; i++)
+        shell_printf("%d: %s %d/%d\n", i, led_id(led), led_get_brightness(led), led_max_brightness(led));
+    return 0;
+}
+
+int cmd_led(int argc, char *argv[])
+{
+    int index = 0, ret = -EINVAL;
+    led_t *led;
+
+    if (argc > 1 && isdigit((unsigned char)argv[1][0])) {
+        index = parse_index(argv[1]);
+        argc--;
+        argv++;
+    }
+    if (argc < 2) {
+        help();
+        return 0;
+    }
+    if (!strcmp(argv[1], "list"))
+        return led_list();
+
+    if ((led = get_led(index)) == NULL)
+        return -EINVAL;
+
+    if (!strcmp(argv[1], "get") && argc == 2) {
+        if ((ret = led_get_brightness(led)) >= 0) {
+            shell_printf("%d\n", ret);
+            ret = 0;
+        }
+    } else if (!strcmp(argv[1], "set") && argc == 3) {
+        ret = led_set_brightness(led, strtol(argv[2], NULL, 0));
+    } else if (!strcmp(argv[1], "trigger") && argc == 3) {
+        ret = led_set_trigger(led, argv[2]);
+    } else {
+        help();
+        return -EINVAL;
+    }
+    if (ret != 0)
+        log_info("%s", led_errmsg(led));
+    return ret;
+}
@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "log.h"
+#include "shell.h"
+
+static void help(void)
+{
+    shell_printf("Usage: log [module|global] [level|default]\n");
+    shell_printf("  Available level: trace debug info warn error fatal\n");
+}
+
+static void list_modules(void)
+{
+    log_Module *module;
+
+    for (module = log_module_first(); module; module = module->next) {
+        shell_printf("%-16s %-8s %s\n", module->name,
+                     module->level < 0 ? "default" : log_level_string(module->level),
+                     module->threshold > LOG_FATAL ? "OFF" : log_level_string(module->threshold));
+    }
+}
+
+int cmd_log(int argc, char *argv[])
+{
+    int level;
+
+    if (argc < 2) {
+        list_modules();
+        return 0;
+    }
+    if (argc != 3) {
+        help();
+        return -EINVAL;
+    }
+
+    if (!strcmp(argv[2], "default")) {
+        level = -1;
+    } else if ((level = log_level_from_string(argv[2])) < 0) {
+        help();
+        return -EINVAL;
+    }
+
+    if (!strcmp(argv[1], "global")) {
+        if (level < 0)
+            return -EINVAL;
+        log_set_level(level);
+        return 0;
+    }
+
+    if (log_set_module_level(argv[1], level) == 0) {
+        shell_printf("No such log module: %s\n", argv[1]);
+        return -EINVAL;
+    }
+    return 0;
+}
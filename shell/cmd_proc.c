@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "log.h"
+#include "shell.h"
+#include "process.h"
+
+#define PROC_TIMEOUT_DEFAULT    (30.)   /* seconds */
+
+static void help(void)
+{
+    shell_printf("Usage: proc <run [-t seconds] <program> [args...]|list|kill <id>>\n");
+}
+
+static void run_done(const struct process_result *res, void *arg)
+{
+    if (res->out.len)
+        shell_printf("%.*s", (int)res->out.len, (const char *)res->out.buf);
+    if (res->err.len)
+        shell_printf("%.*s", (int)res->err.len, (const char *)res->err.buf);
+    if (res->truncated)
+        shell_printf("[%d] %llu bytes of output dropped\n", res->id,
+                     (unsigned long long)res->truncated);
+    shell_printf("[%d] %s %d (%.1f ms)\n", res->id, res->timed_out ? "timeout, status" : "exit",
+                 res->status, res->elapsed_ns / 1e6);
+}
+
+static int proc_run(int argc, char *argv[])
+{
+    process_options_t opt = {
+        .timeout = PROC_TIMEOUT_DEFAULT,
+    };
+    int id;
+
+    if (argc > 1 && !strcmp(argv[0], "-t")) {
+        opt.timeout = atof(argv[1]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 1)
+        return -EINVAL;
+
+    opt.argv = (const char *const *)argv;
+    if ((id = process_run(&opt, run_done, NULL)) < 0) {
+        shell_printf("proc: cannot queue %s\n", argv[0]);
+        return -EBUSY;
+    }
+    shell_printf("[%d] %s\n", id, argv[0]);
+    return 0;
+}
+
+int cmd_proc(int argc, char *argv[])
+{
+    int ret = 0;
+
+    if (argc < 2) {
+        help();
+        return 0;
+    }
+
+    if (!strcmp(argv[1], "run")) {
+        ret = proc_run(argc - 2, argv + 2);
+    } else if (!strcmp(argv[1], "list")) {
+        process_report(shell_printf);
+    } else if (!strcmp(argv[1], "kill") && argc == 3) {
+        if (process_cancel(atoi(argv[2])) != 0)
+            shell_printf("proc: no such process %s\n", argv[2]);
+    } else {
+        ret = -EINVAL;
+    }
+    if (ret == -EINVAL)
+        help();
+    return ret;
+}
@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include "log.h"
+#include "shell.h"
+#include "pwm.h"
+#include "device.h"
+#include "utils.h"
+
+static void help(void)
+{
+    shell_printf("Usage: pwm [index] <opr> [args]\n");
+    shell_printf("  Available opr: list, config <period_ns> <duty_ns>, duty <ns>, enable <on|off>, polarity <normal|inversed>\n");
+}
+
+static int pwm_list(void)
+{
+    uint64_t period_ns, duty_ns;
+    bool enabled;
+    pwm_t *pwm;
+    int i;
+
+    for (i=0; (pwm=get_pwm(i)) != NULL; i++) {
+        pwm_state(pwm, &period_ns, &duty_ns, &enabled);
+        shell_printf("%d: %s period %llu ns duty %llu ns %s\n", i, pwm_id(pwm),
+                     (unsigned long long)period_ns, (unsigned long long)duty_ns, enabled ? "on" : "off");
+    }
+    return 0;
+}
+
+int cmd_pwm(int argc, char *argv[])
+{
+    int index = 0, ret = -EINVAL;
+    pwm_t *pwm;
+
+    if (argc > 1 && isdigit((unsigned char)argv[1][0])) {
+        index = parse_index(argv[1]);
+        argc--;
+        argv++;
+    }
+    if (argc < 2) {
+        help();
+        return 0;
+    }
+    if (!strcmp(argv[1], "list"))
+        return pwm_list();
+
+    if ((pwm = get_pwm(index)) == NULL)
+        return -EINVAL;
+
+    if (!strcmp(argv[1], "config") && argc == 4) {
+        ret = pwm_config(pwm, strtoull(argv[2], NULL, 0), strtoull(argv[3], NULL, 0));
+    } else if (!strcmp(argv[1], "duty") && argc == 3) {
+        ret = pwm_set_duty(pwm, strtoull(argv[2], NULL, 0));
+    } else if (!strcmp(argv[1], "enable") && argc == 3) {
+        ret = pwm_enable(pwm, !strcmp(argv[2], "on"));
+    } else if (!strcmp(argv[1], "polarity") && argc == 3) {
+        ret = pwm_set_polarity(pwm, !strcmp(argv[2], "inversed"));
+    } else {
+        help();
+        return -EINVAL;
+    }
+    if (ret != 0)
+        log_info("%s", pwm_errmsg(pwm));
+    return ret;
+}
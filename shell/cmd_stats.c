@@ -0,0 +1,40 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "log.h"
+#include "shell.h"
+#include "metrics.h"
+
+static void help(void)
+{
+    shell_printf("Usage: stats [name filter]\n");
+}
+
+int cmd_stats(int argc, char *argv[])
+{
+    metric_t *m;
+
+    if (argc > 2) {
+        help();
+        return -EINVAL;
+    }
+
+    for (m = metric_first(); m; m = m->next) {
+        if (argc == 2 && strstr(m->name, argv[1]) == NULL)
+            continue;
+        switch (m->type) {
+        case METRIC_COUNTER:
+        case METRIC_GAUGE:
+            shell_printf("%-40s %-40s %lld\n", m->name, m->labels,
+                         (long long)atomic_load(&m->value));
+            break;
+        case METRIC_HISTOGRAM:
+            shell_printf("%-40s %-40s n=%llu p50=%.3fms p99=%.3fms max=%.3fms\n",
+                         m->name, m->labels, (unsigned long long)atomic_load(&m->count),
+                         metric_quantile(m, 0.5) / 1e6, metric_quantile(m, 0.99) / 1e6,
+                         atomic_load(&m->max) / 1e6);
+            break;
+        }
+    }
+    return 0;
+}
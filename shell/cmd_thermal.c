@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include "log.h"
+#include "shell.h"
+#include "thermal.h"
+#include "device.h"
+#include "utils.h"
+#include "shell_internal.h"
+
+static void help(void)
+{
+    shell_printf("Usage: thermal [index] <opr> [args]\n");
+    shell_printf("  Available opr: list, get, watch <on|off>, period <ms>\n");
+}
+
+static void on_sample(thermal_t *thermal, int millicelsius)
+{
+    shell_printf("%s: %d.%03d C\n", thermal_id(thermal), millicelsius / 1000, abs(millicelsius % 1000));
+}
+
+static struct thermal_client_ops watch_ops = {
+    .on_sample = on_sample,
+};
+
+static struct thermal_client watch_client = {
+    .name = "shell",
+    .ops = &watch_ops,
+    .list = LIST_HEAD_INIT(watch_client.list),
+};
+
+static int thermal_list(void)
+{
+    thermal_t *thermal;
+    int i, millicelsius;
+
+    for (i=0; (thermal=get_thermal(i)) != NULL; i++) {
+        if (thermal_get_temp(thermal, &millicelsius) == 0)
+            shell_printf("%d: %s %d mC\n", i, thermal_id(thermal), millicelsius);
+        else
+            shell_printf("%d: %s (%s)\n", i, thermal_id(thermal), thermal_errmsg(thermal));
+    }
+    return 0;
+}
+
+int cmd_thermal(int argc, char *argv[])
+{
+    int index = 0, millicelsius, ret = -EINVAL;
+    thermal_t *thermal;
+
+    if (argc > 1 && isdigit((unsigned char)argv[1][0])) {
+        index = parse_index(argv[1]);
+        argc--;
+        argv++;
+    }
+    if (argc < 2) {
+        help();
+        return 0;
+    }
+    if (!strcmp(argv[1], "list"))
+        return thermal_list();
+
+    if ((thermal = get_thermal(index)) == NULL)
+        return -EINVAL;
+
+    if (!strcmp(argv[1], "get") && argc == 2) {
+        if ((ret = thermal_get_temp(thermal, &millicelsius)) == 0)
+            on_sample(thermal, millicelsius);
+        else
+            log_info("%s", thermal_errmsg(thermal));
+    } else if (!strcmp(argv[1], "watch") && argc == 3) {
+        ret = SHELL_WATCH(thermal, thermal, &watch_client, !strcmp(argv[2], "on"));
+    } else if (!strcmp(argv[1], "period") && argc == 3) {
+        thermal_set_period(thermal, strtol(argv[2], NULL, 0));
+        ret = 0;
+    }
+    if (ret == -EINVAL)
+        help();
+    return ret;
+}
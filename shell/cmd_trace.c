@@ -0,0 +1,37 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "log.h"
+#include "shell.h"
+#include "trace.h"
+
+static void help(void)
+{
+    shell_printf("Usage: trace <start <file.pcapng>|stop|status>\n");
+}
+
+int cmd_trace(int argc, char *argv[])
+{
+    uint64_t records, bytes, dropped;
+
+    if (argc < 2) {
+        help();
+        return 0;
+    }
+
+    if (!strcmp(argv[1], "start") && argc == 3) {
+        return trace_start(argv[2]);
+    } else if (!strcmp(argv[1], "stop")) {
+        trace_stop();
+        return 0;
+    } else if (!strcmp(argv[1], "status")) {
+        trace_stats(&records, &bytes, &dropped);
+        shell_printf("trace %s: %llu records, %llu bytes, %llu dropped\n",
+                     trace_enabled() ? "on" : "off", (unsigned long long)records,
+                     (unsigned long long)bytes, (unsigned long long)dropped);
+        return 0;
+    }
+
+    help();
+    return -EINVAL;
+}
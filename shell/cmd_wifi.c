@@ -1,19 +1,74 @@
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include "log.h"
 #include "shell.h"
 #include "wifi.h"
 #include "device.h"
+#include "shell_internal.h"
+
+#define WIFI_LIST_MAX       (64)
+#define WIFI_HISTORY_MAX    (16)
 
 static void help(void)
 {
     shell_printf("Usage: wifi <opr> [args]\n");
-    shell_printf("  Available opr: connect <ssid> <password>\n");
+    shell_printf("  Available opr: scan, list, status, connect <ssid> [password], disconnect,\n");
+    shell_printf("                 history <ssid>, watch <on|off>\n");
+}
+
+static void on_network(wifi_t *wifi, enum wifi_network_event event, const wifi_network_info_t *network)
+{
+    static const char *events[] = { "added", "changed", "removed" };
+
+    shell_printf("wifi: %-7s %c %-32s %-17s %3u\n", events[event], network->connected ? '*' : ' ',
+                 network->ssid, network->bssid, network->signal);
+}
+
+static struct wifi_client_ops watch_ops = {
+    .on_network = on_network,
+};
+
+static struct wifi_client watch_client = {
+    .name = "shell",
+    .ops = &watch_ops,
+    .list = LIST_HEAD_INIT(watch_client.list),
+};
+
+static int wifi_history(wifi_t *wifi, const char *ssid)
+{
+    uint8_t signal[WIFI_HISTORY_MAX];
+    int i, n;
+
+    if ((n = wifi_signal_history(wifi, ssid, signal, WIFI_HISTORY_MAX)) == 0) {
+        shell_printf("%s: not seen\n", ssid);
+        return 0;
+    }
+    shell_printf("%s:", ssid);
+    for (i=0; i<n; i++)
+        shell_printf(" %u", signal[i]);
+    shell_printf("\n");
+    return 0;
+}
+
+static int wifi_list(wifi_t *wifi)
+{
+    wifi_network_info_t *networks;
+    int i, n;
+
+    if ((networks = calloc(WIFI_LIST_MAX, sizeof(*networks))) == NULL)
+        return -ENOMEM;
+    n = wifi_scan_results(wifi, networks, WIFI_LIST_MAX);
+    for (i=0; i<n; i++)
+        shell_printf("%c %-32s %-17s %3u\n", networks[i].connected ? '*' : ' ', networks[i].ssid,
+                     networks[i].bssid, networks[i].signal);
+    free(networks);
+    return 0;
 }
 
 int cmd_wifi(int argc, char *argv[])
 {
-    int i;
+    wifi_network_info_t network;
 
     if (argc < 2) {
         help();
@@ -24,14 +79,38 @@ int cmd_wifi(int argc, char *argv[])
     if (wifi == NULL)
         return -EINVAL;
 
-    if (!strncmp(argv[1], "connect", strlen("connect")) && argc == 4) {
-        wifi_scan(get_wifi(0));
-        wifi_network_info_t network;
+    memset(&network, 0, sizeof(network));
+    if (!strcmp(argv[1], "scan")) {
+        wifi_scan(wifi);
+        return 0;
+    } else if (!strcmp(argv[1], "list")) {
+        return wifi_list(wifi);
+    } else if (!strcmp(argv[1], "status")) {
+        if (wifi_connection_info(wifi, &network))
+            shell_printf("%s: connected to %s, signal %u\n", wifi_backend(wifi), network.ssid, network.signal);
+        else
+            shell_printf("%s: not connected\n", wifi_backend(wifi));
+        return 0;
+    } else if (!strcmp(argv[1], "connect") && (argc == 3 || argc == 4)) {
         strncpy(network.ssid, argv[2], sizeof(network.ssid)-1);
-        strncpy(network.password, argv[3], sizeof(network.password)-1);
-        if (wifi_connect_ssid(wifi, &network) == true && network.connected == true)
-            return 0; 
+        if (argc == 4)
+            strncpy(network.password, argv[3], sizeof(network.password)-1);
+        if (wifi_connect_ssid(wifi, &network) != true)
+            return -1;
+        /* event loop backends finish in the background */
+        if (!network.connected)
+            shell_printf("connecting to %s, see 'wifi status'\n", network.ssid);
+        return 0;
+    } else if (!strcmp(argv[1], "disconnect")) {
+        if (!wifi_connection_info(wifi, &network))
+            return 0;
+        return wifi_disconnect_ssid(wifi, &network) ? 0 : -1;
+    } else if (!strcmp(argv[1], "history") && argc == 3) {
+        return wifi_history(wifi, argv[2]);
+    } else if (!strcmp(argv[1], "watch") && argc == 3) {
+        return SHELL_WATCH(wifi, wifi, &watch_client, !strcmp(argv[2], "on"));
     }
 
-    return -1;
-}
\ No newline at end of file
+    help();
+    return -EINVAL;
+}
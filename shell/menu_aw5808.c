@@ -4,8 +4,6 @@
 #include "shell.h"
 #include "device.h"
 
-static aw5808_t *current = NULL;
-
 static void on_aw5808_get_config(aw5808_t *aw, uint16_t firmware_version, uint8_t mcu_verison,
         aw5808_mode_t mode, uint8_t rf_channel, uint8_t rf_power)
 {
@@ -263,8 +261,9 @@ int cmd_aw5808_set_rfpower(int argc, char *argv[])
 static int uart_select_mode(const char *mode_str)
 {
     int ret, mode = AW5808_MODE_I2S;
+    aw5808_t *aw = get_aw5808(0);
 
-    if (current == NULL)
+    if (aw == NULL)
         return -EINVAL;
 
     if(!strncmp(mode_str, "i2s", strlen("i2s")))
@@ -274,8 +273,8 @@ static int uart_select_mode(const char *mode_str)
     else
         return -EINVAL;
 
-    if ((ret = aw5808_set_mode(current, mode)) != 0)
-        log_info("%s", aw5808_errmsg(current));
+    if ((ret = aw5808_set_mode(aw, mode)) != 0)
+        log_info("%s", aw5808_errmsg(aw));
 
     return ret;
 }
@@ -313,10 +312,8 @@ static struct aw5808_client_ops menu_aw5808_ops = {
     .on_set_rfpower = on_aw5808_set_rfpower,
 };
 
-static struct aw5808_client menu_aw5808 = {
-    .name = "menu aw5808",
-    .ops = &menu_aw5808_ops,
-};
+/* one per device, a client can only sit on one client list */
+static struct aw5808_client menu_aw5808[DEVICE_MAX_NUM];
 
 int cmd_aw5808(int argc, char *argv[])
 {
@@ -334,27 +331,38 @@ int cmd_aw5808(int argc, char *argv[])
     return -1;
 }
 
-int menu_aw5808_init(void)
+/* also after a config reload, the devices may have moved */
+int menu_aw5808_reload(void)
 {
     int i, ret;
     aw5808_t *aw;
 
-    for (i=0; (aw=get_aw5808(i)) != NULL; i++) {
-        if ((ret = aw5808_add_client(aw, &menu_aw5808)))
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        list_del_init(&menu_aw5808[i].list);
+        if ((aw=get_aw5808(i)) != NULL && (ret = aw5808_add_client(aw, &menu_aw5808[i])))
             return ret;
     }
-
-    current = get_aw5808(0);
     return 0;
 }
 
+int menu_aw5808_init(void)
+{
+    int i;
+
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        snprintf(menu_aw5808[i].name, sizeof(menu_aw5808[i].name), "menu aw5808");
+        menu_aw5808[i].ops = &menu_aw5808_ops;
+        INIT_LIST_HEAD(&menu_aw5808[i].list);
+    }
+    return menu_aw5808_reload();
+}
+
 void menu_aw5808_exit(void)
 {
     int i;
     aw5808_t *aw;
 
-    current = NULL;
-    for (i=0; (aw=get_aw5808(i)) != NULL; i++) {
-        aw5808_remove_client(aw, &menu_aw5808);
+    for (i=0; i<DEVICE_MAX_NUM && (aw=get_aw5808(i)) != NULL; i++) {
+        aw5808_remove_client(aw, &menu_aw5808[i]);
     }
 }
\ No newline at end of file
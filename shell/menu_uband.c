@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "log.h"
+#include "shell.h"
+#include "device.h"
+
+#define UBAND_DUMP_MAX  (16)
+
+static void shell_dump(const uint8_t *data, size_t len)
+{
+    size_t i;
+
+    for (i=0; i<len && i<UBAND_DUMP_MAX; i++)
+        shell_printf(" %02x", data[i]);
+    shell_printf("%s\n", len > UBAND_DUMP_MAX ? " ..." : "");
+}
+
+static void on_uband_get_info(uband_t *ub, int status, uint8_t fw_major, uint8_t fw_minor, const char *model)
+{
+    if (status != UBAND_STATUS_OK) {
+        shell_printf("uband get info fail, status %d\n", status);
+        return;
+    }
+    shell_printf("Model: %s\n", model);
+    shell_printf("Firmware version: %u.%u\n", fw_major, fw_minor);
+}
+
+static void on_uband_stream(uband_t *ub, uint8_t stream, const uint8_t *data, size_t len)
+{
+    shell_printf("stream %u, %zu bytes:", stream, len);
+    shell_dump(data, len);
+}
+
+static void on_uband_stream_state(uband_t *ub, uint8_t stream, bool running)
+{
+    shell_printf("stream %u %s.\n", stream, running ? "started" : "stopped");
+}
+
+static void on_uband_event(uband_t *ub, uint8_t event, const uint8_t *data, size_t len)
+{
+    shell_printf("event 0x%02x:", event);
+    shell_dump(data, len);
+}
+
+static void on_uband_reply(uband_t *ub, int status, const uint8_t *data, size_t len, void *arg)
+{
+    shell_printf("reply status %d, %zu bytes:", status, len);
+    shell_dump(data, len);
+}
+
+static struct uband_client_ops menu_uband_ops = {
+    .on_get_info = on_uband_get_info,
+    .on_stream = on_uband_stream,
+    .on_stream_state = on_uband_stream_state,
+    .on_event = on_uband_event,
+};
+
+/* one per device, a client can only sit on one client list */
+static struct uband_client menu_uband[DEVICE_MAX_NUM];
+
+int cmd_uband_list(int argc, char *argv[])
+{
+    int i;
+    uband_t *ub;
+
+    for (i=0; (ub=get_uband(i)) != NULL; i++)
+        shell_printf("%d: %s\n", i, uband_id(ub));
+
+    return 0;
+}
+
+int cmd_uband_get_info(int argc, char *argv[])
+{
+    int index = 0, ret;
+    if (argc == 2)
+        index = strtoul(argv[1], NULL, 10);
+
+    uband_t *ub = get_uband(index);
+    if (ub == NULL)
+        return -EINVAL;
+
+    if ((ret = uband_get_info(ub)) != 0)
+        log_info("%s", uband_errmsg(ub));
+
+    return ret;
+}
+
+int cmd_uband_ping(int argc, char *argv[])
+{
+    int index = 0, ret;
+    if (argc == 2)
+        index = strtoul(argv[1], NULL, 10);
+
+    uband_t *ub = get_uband(index);
+    if (ub == NULL)
+        return -EINVAL;
+
+    if ((ret = uband_ping(ub, on_uband_reply, NULL)) != 0)
+        log_info("%s", uband_errmsg(ub));
+
+    return ret;
+}
+
+int cmd_uband_stream(int argc, char *argv[])
+{
+    int index, stream, ret;
+    bool start;
+
+    if (argc == 3)
+        index = 0;
+    else if (argc == 4)
+        index = strtoul(argv[1], NULL, 10);
+    else
+        return -EINVAL;
+
+    if (!strcmp("start", argv[argc-2]))
+        start = true;
+    else if (!strcmp("stop", argv[argc-2]))
+        start = false;
+    else
+        return -EINVAL;
+
+    stream = strtoul(argv[argc-1], NULL, 0);
+    if (stream < 0 || stream >= UBAND_MAX_STREAM)
+        return -EINVAL;
+
+    uband_t *ub = get_uband(index);
+    if (ub == NULL)
+        return -EINVAL;
+
+    ret = start ? uband_stream_start(ub, stream) : uband_stream_stop(ub, stream);
+    if (ret != 0)
+        log_info("%s", uband_errmsg(ub));
+
+    return ret;
+}
+
+int cmd_uband_request(int argc, char *argv[])
+{
+    uint8_t data[128];
+    int index, cmd, i, len, ret;
+
+    if (argc < 3)
+        return -EINVAL;
+
+    index = strtoul(argv[1], NULL, 10);
+    uband_t *ub = get_uband(index);
+    if (ub == NULL)
+        return -EINVAL;
+
+    cmd = strtoul(argv[2], NULL, 16);
+    for (i=3, len=0; i<argc && len<sizeof(data); i++, len++)
+        data[len] = strtoul(argv[i], NULL, 16);
+
+    if ((ret = uband_request(ub, cmd, data, len, on_uband_reply, NULL)) != 0)
+        log_info("%s", uband_errmsg(ub));
+
+    return ret;
+}
+
+/* also after a config reload, the devices may have moved */
+int menu_uband_reload(void)
+{
+    int i, ret;
+    uband_t *ub;
+
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        list_del_init(&menu_uband[i].list);
+        if ((ub=get_uband(i)) != NULL && (ret = uband_add_client(ub, &menu_uband[i])))
+            return ret;
+    }
+    return 0;
+}
+
+int menu_uband_init(void)
+{
+    int i;
+
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        snprintf(menu_uband[i].name, sizeof(menu_uband[i].name), "menu uband");
+        menu_uband[i].ops = &menu_uband_ops;
+        INIT_LIST_HEAD(&menu_uband[i].list);
+    }
+    return menu_uband_reload();
+}
+
+void menu_uband_exit(void)
+{
+    int i;
+    uband_t *ub;
+
+    for (i=0; i<DEVICE_MAX_NUM && (ub=get_uband(i)) != NULL; i++) {
+        uband_remove_client(ub, &menu_uband[i]);
+    }
+}
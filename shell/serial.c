@@ -1,13 +1,54 @@
+#include <string.h>
 #include <stdlib.h>
 #include <errno.h>
 #include "log.h"
 #include "shell.h"
 #include "serial.h"
 #include "device.h"
+#include "codec.h"
 
-static int on_serial_receive(serial_t *serial, const uint8_t *buf, size_t len)
+struct serial_menu {
+    struct serial_client client;
+    int index;
+    codec_t *codec;             /* from the port's codec= option, NULL: raw bytes */
+};
+
+/* one per port, a client can only sit on one client list */
+static struct serial_menu serial_menu[DEVICE_MAX_NUM];
+
+/* follow codec= across config reloads */
+static codec_t *serial_menu_codec(struct serial_menu *menu)
+{
+    const char *spec = get_serial_codec(menu->index);
+
+    if (menu->codec && spec && !strcmp(codec_name(menu->codec), spec))
+        return menu->codec;
+    codec_free(menu->codec);
+    menu->codec = spec ? codec_new(spec) : NULL;
+    return menu->codec;
+}
+
+static void on_serial_frame(void *arg, const uint8_t *data, size_t len)
 {
+    struct serial_menu *menu = arg;
+    uint64_t t = menu->client.rx_time;
+    size_t i;
+
+    shell_printf("serial %d %s frame @%llu.%06llu %zu bytes:", menu->index, codec_name(menu->codec),
+                 (unsigned long long)(t / 1000000000), (unsigned long long)(t % 1000000000 / 1000), len);
+    for (i=0; i<len; i++)
+        shell_printf(" %02x", data[i]);
+    shell_printf("\n");
+}
+
+static int on_serial_receive(serial_t *serial, struct serial_client *client, const uint8_t *buf, size_t len)
+{
+    struct serial_menu *menu = client->userdata;
     int i;
+
+    if (serial_menu_codec(menu))
+        return codec_feed(menu->codec, buf, len, on_serial_frame, menu);
+
     for (i=0; i<len; i++) {
         shell_printf("%i:%x\n",i, buf[i]);
     }
@@ -18,11 +59,6 @@ static struct serial_client_ops serial_menu_ops = {
     .on_receive = on_serial_receive,
 };
 
-static struct serial_client serial_menu = {
-    .name = "serial menu",
-    .ops = &serial_menu_ops,
-};
-
 int cmd_serial_list(int argc, char *argv[])
 {
     int i;
@@ -37,7 +73,8 @@ int cmd_serial_list(int argc, char *argv[])
 int cmd_serial_write(int argc, char *argv[])
 {
     int index;
-    uint8_t data[128];
+    uint8_t data[128], frame[CODEC_FRAME_MAX];
+    codec_t *codec;
     int i,len;
 
     if (argc < 2)
@@ -52,6 +89,17 @@ int cmd_serial_write(int argc, char *argv[])
         data[len] = strtoul(argv[i], NULL, 16);
         shell_printf("%d:%x\n", len, data[len]);
     }
+
+    if (index < DEVICE_MAX_NUM && (codec = serial_menu_codec(&serial_menu[index])) != NULL) {
+        if ((len = codec_encode(codec, data, len, frame, sizeof(frame))) == 0) {
+            shell_printf("%s: can not encode\n", codec_name(codec));
+            return -EINVAL;
+        }
+        if (serial_write(serial, frame, len) != len)
+            log_info("%s", serial_errmsg(serial));
+        return 0;
+    }
+
     len = len + 1;
     if (serial_write(serial, data, len) != len)
         log_info("%s", serial_errmsg(serial));
@@ -59,25 +107,46 @@ int cmd_serial_write(int argc, char *argv[])
     return 0;
 }
 
-int serial_shell_init(void)
+/* also after a config reload, the ports may have moved and a codec restarts */
+int serial_shell_reload(void)
 {
     int i, ret;
     serial_t *serial;
 
-    for (i=0; (serial=get_serial(i)) != NULL; i++) {
-        if ((ret = serial_add_client(serial, &serial_menu)))
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        list_del_init(&serial_menu[i].client.list);
+        codec_free(serial_menu[i].codec);
+        serial_menu[i].codec = NULL;
+        if ((serial=get_serial(i)) != NULL && (ret = serial_add_client(serial, &serial_menu[i].client)))
             return ret;
     }
-
     return 0;
 }
 
+int serial_shell_init(void)
+{
+    int i;
+
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        snprintf(serial_menu[i].client.name, sizeof(serial_menu[i].client.name), "serial menu");
+        serial_menu[i].client.ops = &serial_menu_ops;
+        serial_menu[i].client.userdata = &serial_menu[i];
+        serial_menu[i].index = i;
+        INIT_LIST_HEAD(&serial_menu[i].client.list);
+    }
+    return serial_shell_reload();
+}
+
 void serial_shell_exit(void)
 {
     int i;
     serial_t *aw;
 
-    for (i=0; (aw=get_serial(i)) != NULL; i++) {
-        serial_remove_client(aw, &serial_menu);
+    for (i=0; i<DEVICE_MAX_NUM && (aw=get_serial(i)) != NULL; i++) {
+        serial_remove_client(aw, &serial_menu[i].client);
+    }
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        codec_free(serial_menu[i].codec);
+        serial_menu[i].codec = NULL;
     }
 }
\ No newline at end of file
@@ -15,6 +15,7 @@
 #include "shell_internal.h"
 #include "stdstring.h"
 #include "device.h"
+#include "evprof.h"
 
 typedef int (*cmd_fn_t)(int argc, char *argv[]);
 typedef struct {
@@ -48,6 +49,7 @@ static int cmd_help(int argc, char *argv[])
         char *tokens[1];
         string_split(cmd_list[i].name, "_", tokens, 1);
         if ((!strncmp("aw5808", tokens[0], strlen("aw5808")) && get_aw5808(0) == NULL) 
+            || (!strncmp("uband", tokens[0],strlen("uband")) && get_uband(0) == NULL)
             || (!strncmp("serial", tokens[0],strlen("serial")) && get_serial(0) == NULL)
             || (!strncmp("usb", tokens[0],strlen("usb")) && get_usb(0) == NULL)) {
             free(tokens[0]);
@@ -63,6 +65,12 @@ static int cmd_help(int argc, char *argv[])
 static command_t cmd_list[] = {
     { "aw5808", cmd_aw5808, "control aw5808" },
     { "wifi", cmd_wifi, "control wifi" },
+    { "gpio [index] <list|get|set|watch>", cmd_gpio, "Get, set and watch gpio lines" },
+    { "input [index] <list|watch|grab|record>", cmd_input, "Watch, grab and record input event devices" },
+    { "pwm [index] <list|config|duty|enable|polarity>", cmd_pwm, "Configure pwm channels" },
+    { "led [index] <list|get|set|trigger>", cmd_led, "Set led brightness and triggers" },
+    { "thermal [index] <list|get|watch|period>", cmd_thermal, "Read and sample thermal zones" },
+    { "cpufreq [index] <list|get|limits|governor|watch|period>", cmd_cpufreq, "Read and limit cpu frequency" },
     { "aw5808_list", cmd_aw5808_list, "List available aw5808 device" },
     { "aw5808_getconfig [index]", cmd_aw5808_get_config, "Get aw5808 config" },
     { "aw5808_getrfstatus [index]", cmd_aw5808_get_rfstatus, "Get aw5808 RF status" },
@@ -71,12 +79,22 @@ static command_t cmd_list[] = {
     { "aw5808_setconnmode [index] <multi|single>", cmd_aw5808_set_connect_mode, "Set aw5808 connect mode" },
     { "aw5808_setrfchannel [index] <1-8>", cmd_aw5808_set_rfchannel, "Set aw5808 RF channel" },
     { "aw5808_setrfpower [index] <1-16>", cmd_aw5808_set_rfpower, "Set aw5808 RF power" },
+    { "uband_list", cmd_uband_list, "List available uband device" },
+    { "uband_getinfo [index]", cmd_uband_get_info, "Get uband model and firmware version" },
+    { "uband_ping [index]", cmd_uband_ping, "Ping uband and show the reply" },
+    { "uband_stream [index] <start|stop> <stream>", cmd_uband_stream, "Start or stop a uband stream" },
+    { "uband_request <index> <cmd> [data1 data2 ...]", cmd_uband_request, "Send a raw uband request, hex" },
     { "serial_list", cmd_serial_list, "List available serial device" },
     { "serial_write <index> <data1 data2 ...>", cmd_serial_write, "Send hex data by serial" },
     { "usb_hid_enumerate", cmd_usb_hid_enumerate, "List all usb hid device" },
     { "usb_hid_list", cmd_usb_hid_list, "List available usb hid device" },
     { "usb_hid_write <index> <data1 data2 ...>", cmd_usb_hid_write, "Send hex data by usbhid" },
     { "io", cmd_io, "Memory accesses via /dev/mem" },
+    { "log [module|global] [level|default]", cmd_log, "Show or set log levels" },
+    { "trace <start <file>|stop|status>", cmd_trace, "Capture device traffic to pcapng" },
+    { "stats [filter]", cmd_stats, "Show device and event loop metrics" },
+    { "evprof <on|off|reset|top [count]>", cmd_evprof, "Profile event loop callbacks" },
+    { "proc <run [-t seconds] <cmd...>|list|kill <id>>", cmd_proc, "Run external programs in the background" },
     { "help", cmd_help, "Disply help info" },
     { "exit", cmd_exit, "Exit" },
     { NULL, NULL, NULL},
@@ -194,6 +212,23 @@ int shell_exec(const char *command)
     return ret;
 }
 
+static void on_devices_reload(void)
+{
+    menu_aw5808_reload();
+    menu_uband_reload();
+    serial_shell_reload();
+    usb_shell_reload();
+}
+
+static struct devices_client_ops shell_devices_ops = {
+    .on_reload = on_devices_reload,
+};
+
+static struct devices_client shell_devices = {
+    .name = "shell",
+    .ops = &shell_devices_ops,
+};
+
 int shell_init(struct ev_loop *loop, int argc, char **argv, int mode)
 {
     int ret = 0;
@@ -204,11 +239,14 @@ int shell_init(struct ev_loop *loop, int argc, char **argv, int mode)
     ctx.loop = loop;
     
     menu_aw5808_init();
+    menu_uband_init();
     serial_shell_init();
     usb_shell_init();
+    devices_add_client(&shell_devices);
     
     if (ctx.mode == MODE_SHELL) {
         ev_io_init(&ctx.stdin_watcher, stdin_cb, fileno(stdin), EV_READ);
+        evprof_watch(&ctx.stdin_watcher, "shell.stdin", "stdin");
         ev_io_start(ctx.loop, &ctx.stdin_watcher);
 
         fcntl(fileno(stdin), F_SETFL, O_NONBLOCK);
@@ -225,7 +263,9 @@ void shell_exit(struct ev_loop *loop, int mode)
         ev_io_stop(loop, &ctx.stdin_watcher);
     }
 
+    devices_remove_client(&shell_devices);
     usb_shell_exit();
     serial_shell_exit();
+    menu_uband_exit();
     menu_aw5808_exit();
 }
@@ -1,15 +1,42 @@
 #ifndef __SHELL_INTERNAL_H__
 #define __SHELL_INTERNAL_H__
 
+#include "list.h"
+
+/*
+ * "watch on|off" with one static client, initialised with LIST_HEAD_INIT:
+ * take it off whichever device it was on, then onto dev. The device's _free
+ * detaches its clients, so after a reload the client is simply off.
+ */
+#define SHELL_WATCH(type, dev, client, on) \
+    (list_del_init(&(client)->list), (on) ? type##_add_client(dev, client) : 0)
+
 extern int menu_aw5808_init(void);
+extern int menu_aw5808_reload(void);
 extern void menu_aw5808_exit(void);
+extern int menu_uband_init(void);
+extern int menu_uband_reload(void);
+extern void menu_uband_exit(void);
 extern int serial_shell_init(void);
+extern int serial_shell_reload(void);
 extern void serial_shell_exit(void);
 extern int usb_shell_init(void);
+extern int usb_shell_reload(void);
 extern int usb_shell_exit(void);
 
 extern int cmd_aw5808(int argc, char *argv[]);
 extern int cmd_wifi(int argc, char *argv[]);
+extern int cmd_gpio(int argc, char *argv[]);
+extern int cmd_input(int argc, char *argv[]);
+extern int cmd_pwm(int argc, char *argv[]);
+extern int cmd_led(int argc, char *argv[]);
+extern int cmd_thermal(int argc, char *argv[]);
+extern int cmd_cpufreq(int argc, char *argv[]);
+extern int cmd_log(int argc, char *argv[]);
+extern int cmd_trace(int argc, char *argv[]);
+extern int cmd_stats(int argc, char *argv[]);
+extern int cmd_evprof(int argc, char *argv[]);
+extern int cmd_proc(int argc, char *argv[]);
 
 extern int cmd_aw5808_list(int argc, char *argv[]);
 extern int cmd_aw5808_get_config(int argc, char *argv[]);
@@ -19,6 +46,11 @@ extern int cmd_aw5808_set_i2s_mode(int argc, char *argv[]);
 extern int cmd_aw5808_set_connect_mode(int argc, char *argv[]);
 extern int cmd_aw5808_set_rfchannel(int argc, char *argv[]);
 extern int cmd_aw5808_set_rfpower(int argc, char *argv[]);
+extern int cmd_uband_list(int argc, char *argv[]);
+extern int cmd_uband_get_info(int argc, char *argv[]);
+extern int cmd_uband_ping(int argc, char *argv[]);
+extern int cmd_uband_stream(int argc, char *argv[]);
+extern int cmd_uband_request(int argc, char *argv[]);
 extern int cmd_serial_list(int argc, char *argv[]);
 extern int cmd_serial_write(int argc, char *argv[]);
 extern int cmd_usb_hid_enumerate(int argc, char *argv[]);
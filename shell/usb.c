@@ -102,29 +102,41 @@ static struct usb_client_ops usb_menu_ops = {
     .on_get_input_report = on_hid_get_input_report,
 };
 
-static struct usb_client usb_menu = {
-    .name = "usb menu",
-    .ops = &usb_menu_ops,
-};
+/* one per device, a client can only sit on one client list */
+static struct usb_client usb_menu[DEVICE_MAX_NUM];
 
-int usb_shell_init(void)
+/* also after a config reload, the devices may have moved */
+int usb_shell_reload(void)
 {
-    int i,ret;
+    int i, ret;
     usb_t *usb;
 
-    for (i=0; (usb=get_usb(i)) != NULL; i++) {
-        if ((ret = usb_add_client(usb, &usb_menu)))
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        list_del_init(&usb_menu[i].list);
+        if ((usb=get_usb(i)) != NULL && (ret = usb_add_client(usb, &usb_menu[i])))
             return ret;
     }
     return 0;
 }
 
+int usb_shell_init(void)
+{
+    int i;
+
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        snprintf(usb_menu[i].name, sizeof(usb_menu[i].name), "usb menu");
+        usb_menu[i].ops = &usb_menu_ops;
+        INIT_LIST_HEAD(&usb_menu[i].list);
+    }
+    return usb_shell_reload();
+}
+
 void usb_shell_exit(void)
 {
     int i;
     usb_t *usb;
 
-    for (i=0; (usb=get_usb(i)) != NULL; i++) {
-        usb_remove_client(usb, &usb_menu);
+    for (i=0; i<DEVICE_MAX_NUM && (usb=get_usb(i)) != NULL; i++) {
+        usb_remove_client(usb, &usb_menu[i]);
     }
 }
@@ -0,0 +1,391 @@
+/*
+ * aw5808 MCU simulator on a pseudo terminal.
+ *
+ * devctl-aw5808-sim [options]
+ *
+ * Creates a PTY pair, prints (or symlinks) the slave path and answers the
+ * aw5808 serial protocol on the master side, so aw5808.c, serial.c and
+ * codec_aw5808_serial can run without hardware:
+ *
+ *   [aw5808/0]
+ *   serial=/tmp/ttyAW5808
+ *
+ * Supported commands: 0x50 get config, 0x51 get rf status, 0x53 pair,
+ * 0x54 mode, 0x55 i2s mode, 0x56 connect mode, 0x57 rf channel,
+ * 0x58 rf power; replies carry cmd | 0x80. 0x52 rf status notifications
+ * are sent periodically and acknowledged by the host with 0xD2.
+ * Switching to USB mode only changes the reported mode, no HID device
+ * shows up.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <getopt.h>
+#include <termios.h>
+#include <time.h>
+
+#include "codec.h"
+
+#define SIM_MAX_PENDING     64
+#define SIM_FRAME_MAX       64
+
+struct sim_reply {
+    uint64_t due;               /* ms, CLOCK_MONOTONIC */
+    size_t len;
+    uint8_t frame[SIM_FRAME_MAX];
+};
+
+static struct {
+    /* options */
+    const char *link;
+    int delay_ms;
+    int jitter_ms;
+    int notify_ms;
+    int drop_pct;
+    int corrupt_pct;
+    int garbage_pct;
+    bool verbose;
+    /* device state */
+    uint16_t firmware;
+    uint8_t mcu;
+    uint8_t mode;
+    uint8_t i2s_mode;
+    uint8_t conn_mode;
+    uint8_t rf_channel;
+    uint8_t rf_power;
+    uint8_t rf_status;          /* bit0 connected, bit1-2 pair status */
+    /* io */
+    codec_t *codec;
+    int master;
+    int slave;
+    uint8_t rbuf[4096];
+    size_t rlen;
+    struct sim_reply pending[SIM_MAX_PENDING];
+    int npending;
+    uint64_t next_notify;
+    /* stats */
+    unsigned long rx_frames, tx_frames, dropped, corrupted, garbage, acks, bad;
+} S = {
+    .delay_ms = 5,
+    .firmware = 0x0102,
+    .mcu = 0x03,
+    .rf_channel = 1,
+    .rf_power = 8,
+    .rf_status = 0x1,
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void help(void)
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "    devctl-aw5808-sim [options]\n");
+    fprintf(stderr, "       -l <path>     Symlink the PTY slave to path\n");
+    fprintf(stderr, "       -d <ms>       Reply latency, default 5\n");
+    fprintf(stderr, "       -j <ms>       Random extra latency, default 0\n");
+    fprintf(stderr, "       -n <ms>       Send 0x52 rf status notify every ms, default off\n");
+    fprintf(stderr, "       -D <percent>  Drop replies\n");
+    fprintf(stderr, "       -C <percent>  Corrupt one byte of replies\n");
+    fprintf(stderr, "       -G <percent>  Prepend garbage bytes to replies\n");
+    fprintf(stderr, "       -m <mode>     Initial mode, 0: i2s, 1: usb\n");
+    fprintf(stderr, "       -s <seed>     Random seed for reproducible runs\n");
+    fprintf(stderr, "       -v            Log every frame\n");
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool chance(int pct)
+{
+    return pct > 0 && (rand() % 100) < pct;
+}
+
+static void dump(const char *tag, const uint8_t *buf, size_t len)
+{
+    size_t i;
+
+    if (!S.verbose)
+        return;
+    fprintf(stderr, "%s", tag);
+    for (i=0; i<len; i++)
+        fprintf(stderr, " %02x", buf[i]);
+    fprintf(stderr, "\n");
+}
+
+/* Encode cmd + payload and queue it, applying latency and fault injection. */
+static void queue_frame(uint8_t cmd, const uint8_t *payload, size_t payload_len)
+{
+    struct sim_reply *r;
+    uint8_t data[SIM_FRAME_MAX];
+    size_t off = 0;
+
+    if (chance(S.drop_pct)) {
+        S.dropped++;
+        return;
+    }
+    if (S.npending >= SIM_MAX_PENDING) {
+        S.dropped++;
+        return;
+    }
+    r = &S.pending[S.npending++];
+    memset(r, 0, sizeof(*r));
+
+    if (chance(S.garbage_pct)) {
+        int i, n = 1 + rand() % 4;
+        for (i=0; i<n; i++)
+            r->frame[off++] = rand() & 0xFF;
+        S.garbage++;
+    }
+    data[0] = cmd;
+    memcpy(&data[1], payload, payload_len);
+    r->len = off + codec_encode(S.codec, data, payload_len + 1, &r->frame[off], sizeof(r->frame) - off);
+    if (chance(S.corrupt_pct)) {
+        r->frame[off + rand() % (r->len - off)] ^= 1 << (rand() % 8);
+        S.corrupted++;
+    }
+    r->due = now_ms() + S.delay_ms + (S.jitter_ms ? rand() % (S.jitter_ms + 1) : 0);
+}
+
+static void reply(uint8_t cmd, const uint8_t *payload, size_t payload_len)
+{
+    queue_frame(cmd | 0x80, payload, payload_len);
+}
+
+static void handle_frame(const uint8_t *data, size_t data_len)
+{
+    uint8_t cmd = data[0];
+    uint8_t arg = data_len > 1 ? data[1] : 0;
+    uint8_t buf[8];
+
+    S.rx_frames++;
+    switch (cmd) {
+        case 0x50:
+            buf[0] = S.firmware >> 8;
+            buf[1] = S.firmware & 0xFF;
+            buf[2] = S.mcu;
+            buf[3] = S.mode;
+            buf[4] = S.rf_channel;
+            buf[5] = S.rf_power;
+            reply(cmd, buf, 6);
+            break;
+        case 0x51:
+            reply(cmd, &S.rf_status, 1);
+            break;
+        case 0xD2:
+            S.acks++;
+            break;
+        case 0x53:
+            S.rf_status = (S.rf_status & 0x1) | (1 << 1);
+            reply(cmd, NULL, 0);
+            break;
+        case 0x54:
+            if (arg <= 1)
+                S.mode = arg;
+            reply(cmd, &S.mode, 1);
+            break;
+        case 0x55:
+            if (arg <= 1)
+                S.i2s_mode = arg;
+            reply(cmd, &S.i2s_mode, 1);
+            break;
+        case 0x56:
+            if (arg <= 1)
+                S.conn_mode = arg;
+            reply(cmd, &S.conn_mode, 1);
+            break;
+        case 0x57:
+            if (arg >= 1 && arg <= 8)
+                S.rf_channel = arg;
+            reply(cmd, &S.rf_channel, 1);
+            break;
+        case 0x58:
+            if (arg >= 1 && arg <= 16)
+                S.rf_power = arg;
+            reply(cmd, &S.rf_power, 1);
+            break;
+        default:
+            S.bad++;
+            break;
+    }
+}
+
+static void process_input(void)
+{
+    const uint8_t *data;
+    size_t data_len, used = 0, ret;
+
+    while (used < S.rlen) {
+        ret = codec_decode(S.codec, S.rbuf + used, S.rlen - used, &data, &data_len);
+        if (ret == 0)
+            break;
+        if (data) {
+            dump("rx", S.rbuf + used, ret);
+            handle_frame(data, data_len);
+        } else {
+            S.bad++;
+        }
+        used += ret;
+    }
+    memmove(S.rbuf, S.rbuf + used, S.rlen - used);
+    S.rlen -= used;
+}
+
+static void flush_due(uint64_t now)
+{
+    int i = 0;
+
+    while (i < S.npending) {
+        struct sim_reply *r = &S.pending[i];
+        if (r->due > now) {
+            i++;
+            continue;
+        }
+        dump("tx", r->frame, r->len);
+        if (write(S.master, r->frame, r->len) == (ssize_t)r->len)
+            S.tx_frames++;
+        /* keep send order: shift instead of swapping the last one in */
+        memmove(r, r + 1, (S.npending - i - 1) * sizeof(*r));
+        S.npending--;
+    }
+}
+
+static int next_timeout(uint64_t now)
+{
+    uint64_t next = UINT64_MAX;
+    int i;
+
+    for (i=0; i<S.npending; i++) {
+        if (S.pending[i].due < next)
+            next = S.pending[i].due;
+    }
+    if (S.notify_ms && S.next_notify < next)
+        next = S.next_notify;
+    if (next == UINT64_MAX)
+        return -1;
+    return next > now ? (int)(next - now) : 0;
+}
+
+static int open_pty(void)
+{
+    struct termios tio;
+    const char *name;
+
+    if ((S.master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 ||
+        grantpt(S.master) < 0 || unlockpt(S.master) < 0 ||
+        (name = ptsname(S.master)) == NULL) {
+        perror("posix_openpt");
+        return -1;
+    }
+
+    /* keep the slave open so the master never sees a hangup between clients */
+    if ((S.slave = open(name, O_RDWR | O_NOCTTY)) < 0) {
+        perror(name);
+        return -1;
+    }
+    tcgetattr(S.slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(S.slave, TCSANOW, &tio);
+
+    if (S.link) {
+        unlink(S.link);
+        if (symlink(name, S.link) < 0) {
+            perror(S.link);
+            return -1;
+        }
+        printf("%s -> %s\n", S.link, name);
+    } else {
+        printf("%s\n", name);
+    }
+    fflush(stdout);
+    return 0;
+}
+
+static void signal_handler(int signum)
+{
+    running = 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int seed = time(NULL);
+    struct pollfd pfd;
+    uint64_t now;
+    ssize_t n;
+    int c;
+
+    while ((c = getopt(argc, argv, "l:d:j:n:D:C:G:m:s:vh")) != -1) {
+        switch (c) {
+            case 'l': S.link = optarg; break;
+            case 'd': S.delay_ms = atoi(optarg); break;
+            case 'j': S.jitter_ms = atoi(optarg); break;
+            case 'n': S.notify_ms = atoi(optarg); break;
+            case 'D': S.drop_pct = atoi(optarg); break;
+            case 'C': S.corrupt_pct = atoi(optarg); break;
+            case 'G': S.garbage_pct = atoi(optarg); break;
+            case 'm': S.mode = atoi(optarg) ? 1 : 0; break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            case 'v': S.verbose = true; break;
+            default:
+                help();
+                return 1;
+        }
+    }
+    srand(seed);
+
+    if ((S.codec = codec_new("aw5808_serial")) == NULL)
+        return 1;
+    if (open_pty() < 0)
+        return 1;
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    S.next_notify = now_ms() + S.notify_ms;
+
+    pfd.fd = S.master;
+    pfd.events = POLLIN;
+    while (running) {
+        now = now_ms();
+        if (poll(&pfd, 1, next_timeout(now)) < 0 && errno != EINTR)
+            break;
+
+        if (pfd.revents & POLLIN) {
+            n = read(S.master, S.rbuf + S.rlen, sizeof(S.rbuf) - S.rlen);
+            if (n > 0) {
+                S.rlen += n;
+                process_input();
+                /* nothing decodable in a full buffer: drop it */
+                if (S.rlen == sizeof(S.rbuf))
+                    S.rlen = 0;
+            }
+        }
+
+        now = now_ms();
+        if (S.notify_ms && now >= S.next_notify) {
+            S.rf_status ^= 0x1;
+            queue_frame(0x52, &S.rf_status, 1);
+            S.next_notify = now + S.notify_ms;
+        }
+        flush_due(now);
+    }
+
+    fprintf(stderr, "rx %lu tx %lu acks %lu bad %lu dropped %lu corrupted %lu garbage %lu\n",
+            S.rx_frames, S.tx_frames, S.acks, S.bad, S.dropped, S.corrupted, S.garbage);
+    if (S.link)
+        unlink(S.link);
+    close(S.slave);
+    close(S.master);
+    codec_free(S.codec);
+    return 0;
+}
@@ -0,0 +1,401 @@
+/*
+ * Virtual aw5808 USB HID device through /dev/uhid.
+ *
+ * devctl-aw5808-uhid [options]
+ *
+ * Creates a HID device with the aw5808 VID:PID (or any other), so hidraw.c,
+ * hidraw_open() enumeration and the udev hotplug path in aw5808.c see it
+ * like the real 25A7:5830 module. Output reports are hidraw_packet_t
+ * register accesses: HID_58G_WRITE stores data into a 256 bytes register
+ * file, HID_58G_READ is answered with an input report carrying the data.
+ * Optionally generates input reports at a fixed rate and removes/re-adds
+ * the device periodically to exercise hotplug.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+#include "aw5808.h"
+
+#define UHID_REPORT_SIZE    sizeof(hidraw_packet_t)
+/* streamed input reports read this register */
+#define UHID_STREAM_REG     0x80
+
+/* vendor defined, 64 bytes input/output/feature report, no report id */
+static const uint8_t report_desc[] = {
+    0x06, 0x00, 0xFF,       /* Usage Page (Vendor Defined 0xFF00) */
+    0x09, 0x01,             /* Usage (0x01) */
+    0xA1, 0x01,             /* Collection (Application) */
+    0x15, 0x00,             /*   Logical Minimum (0) */
+    0x26, 0xFF, 0x00,       /*   Logical Maximum (255) */
+    0x75, 0x08,             /*   Report Size (8) */
+    0x95, 0x40,             /*   Report Count (64) */
+    0x09, 0x01,             /*   Usage (0x01) */
+    0x81, 0x02,             /*   Input (Data,Var,Abs) */
+    0x95, 0x40,             /*   Report Count (64) */
+    0x09, 0x01,             /*   Usage (0x01) */
+    0x91, 0x02,             /*   Output (Data,Var,Abs) */
+    0x95, 0x40,             /*   Report Count (64) */
+    0x09, 0x01,             /*   Usage (0x01) */
+    0xB1, 0x02,             /*   Feature (Data,Var,Abs) */
+    0xC0,                   /* End Collection */
+};
+
+static struct {
+    /* options */
+    uint16_t vid;
+    uint16_t pid;
+    const char *name;
+    const char *phys;
+    unsigned int rate;          /* input reports per second, 0 off */
+    unsigned long count;        /* stop streaming after count reports */
+    unsigned int replug_ms;     /* destroy/create period, 0 off */
+    bool verbose;
+    /* state */
+    int fd;
+    bool created;
+    bool started;
+    bool opened;
+    uint8_t regs[256];
+    uint32_t seq;
+    /* stats */
+    unsigned long outputs, reads, writes, inputs, input_errors, get_reports, replugs;
+} U = {
+    .vid = AW5808_USB_VID,
+    .pid = AW5808_USB_PID,
+    .name = "aw5808 uhid",
+    .phys = "uhid-aw5808/input0",
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void help(void)
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "    devctl-aw5808-uhid [options]\n");
+    fprintf(stderr, "       -V <vid>      Vendor id, default %04x\n", AW5808_USB_VID);
+    fprintf(stderr, "       -P <pid>      Product id, default %04x\n", AW5808_USB_PID);
+    fprintf(stderr, "       -n <name>     Device name\n");
+    fprintf(stderr, "       -p <phys>     Physical path, matched against [aw5808] usb=\n");
+    fprintf(stderr, "       -r <rate>     Input reports per second while opened, default off\n");
+    fprintf(stderr, "       -c <count>    Stop streaming after count reports\n");
+    fprintf(stderr, "       -H <ms>       Remove and re-add the device every ms\n");
+    fprintf(stderr, "       -v            Log every report\n");
+}
+
+static void dump(const char *tag, const uint8_t *buf, size_t len)
+{
+    size_t i;
+
+    if (!U.verbose)
+        return;
+    fprintf(stderr, "%s", tag);
+    for (i=0; i<len && i<16; i++)
+        fprintf(stderr, " %02x", buf[i]);
+    fprintf(stderr, "%s\n", len > 16 ? " ..." : "");
+}
+
+static int uhid_write(const struct uhid_event *ev)
+{
+    ssize_t ret = write(U.fd, ev, sizeof(*ev));
+
+    if (ret < 0) {
+        fprintf(stderr, "uhid write: %s\n", strerror(errno));
+        return -errno;
+    }
+    return ret == sizeof(*ev) ? 0 : -EFAULT;
+}
+
+static int uhid_create(void)
+{
+    struct uhid_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name), "%s", U.name);
+    snprintf((char *)ev.u.create2.phys, sizeof(ev.u.create2.phys), "%s", U.phys);
+    memcpy(ev.u.create2.rd_data, report_desc, sizeof(report_desc));
+    ev.u.create2.rd_size = sizeof(report_desc);
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = U.vid;
+    ev.u.create2.product = U.pid;
+    if (uhid_write(&ev) < 0)
+        return -1;
+    U.created = true;
+    return 0;
+}
+
+static void uhid_destroy(void)
+{
+    struct uhid_event ev;
+
+    if (!U.created)
+        return;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+    uhid_write(&ev);
+    U.created = U.started = U.opened = false;
+}
+
+static int send_input(const hidraw_packet_t *pkt)
+{
+    struct uhid_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_INPUT2;
+    ev.u.input2.size = UHID_REPORT_SIZE;
+    memcpy(ev.u.input2.data, pkt, UHID_REPORT_SIZE);
+    dump("in ", ev.u.input2.data, UHID_REPORT_SIZE);
+    if (uhid_write(&ev) < 0) {
+        U.input_errors++;
+        return -1;
+    }
+    U.inputs++;
+    return 0;
+}
+
+static void reg_read(uint8_t reg, uint8_t len, hidraw_packet_t *pkt)
+{
+    if (len > sizeof(pkt->data))
+        len = sizeof(pkt->data);
+    if (reg + len > sizeof(U.regs))
+        len = sizeof(U.regs) - reg;
+    memset(pkt, 0, sizeof(*pkt));
+    pkt->rw = HID_58G_READ;
+    pkt->reg = reg;
+    pkt->len = len;
+    memcpy(pkt->data, &U.regs[reg], len);
+}
+
+static void handle_output(const uint8_t *data, size_t size)
+{
+    hidraw_packet_t pkt, reply;
+    size_t len;
+
+    U.outputs++;
+    dump("out", data, size);
+    memset(&pkt, 0, sizeof(pkt));
+    memcpy(&pkt, data, size < sizeof(pkt) ? size : sizeof(pkt));
+
+    switch (pkt.rw) {
+        case HID_58G_WRITE:
+            len = pkt.len;
+            if (len > sizeof(pkt.data))
+                len = sizeof(pkt.data);
+            if (pkt.reg + len > sizeof(U.regs))
+                len = sizeof(U.regs) - pkt.reg;
+            memcpy(&U.regs[pkt.reg], pkt.data, len);
+            U.writes++;
+            break;
+        case HID_58G_READ:
+            reg_read(pkt.reg, pkt.len, &reply);
+            send_input(&reply);
+            U.reads++;
+            break;
+        default:
+            break;
+    }
+}
+
+static void handle_get_report(const struct uhid_event *req)
+{
+    struct uhid_event ev;
+    hidraw_packet_t pkt;
+
+    U.get_reports++;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_GET_REPORT_REPLY;
+    ev.u.get_report_reply.id = req->u.get_report.id;
+    /* report number selects the register, returns a whole read packet */
+    reg_read(req->u.get_report.rnum, sizeof(pkt.data), &pkt);
+    memcpy(ev.u.get_report_reply.data, &pkt, sizeof(pkt));
+    ev.u.get_report_reply.size = sizeof(pkt);
+    uhid_write(&ev);
+}
+
+static void handle_set_report(const struct uhid_event *req)
+{
+    struct uhid_event ev;
+
+    handle_output(req->u.set_report.data, req->u.set_report.size);
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_SET_REPORT_REPLY;
+    ev.u.set_report_reply.id = req->u.set_report.id;
+    uhid_write(&ev);
+}
+
+static int handle_event(void)
+{
+    struct uhid_event ev;
+    ssize_t ret;
+
+    memset(&ev, 0, sizeof(ev));
+    ret = read(U.fd, &ev, sizeof(ev));
+    if (ret < 0)
+        return errno == EAGAIN || errno == EINTR ? 0 : -errno;
+
+    switch (ev.type) {
+        case UHID_START:
+            U.started = true;
+            break;
+        case UHID_STOP:
+            U.started = false;
+            break;
+        case UHID_OPEN:
+            U.opened = true;
+            break;
+        case UHID_CLOSE:
+            U.opened = false;
+            break;
+        case UHID_OUTPUT:
+            handle_output(ev.u.output.data, ev.u.output.size);
+            break;
+        case UHID_GET_REPORT:
+            handle_get_report(&ev);
+            break;
+        case UHID_SET_REPORT:
+            handle_set_report(&ev);
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+static void stream(uint64_t expirations)
+{
+    hidraw_packet_t pkt;
+
+    /* a late timer sends the missed reports in one go */
+    while (expirations-- && (!U.count || U.seq < U.count)) {
+        U.seq++;
+        U.regs[UHID_STREAM_REG] = U.seq >> 24;
+        U.regs[UHID_STREAM_REG + 1] = U.seq >> 16;
+        U.regs[UHID_STREAM_REG + 2] = U.seq >> 8;
+        U.regs[UHID_STREAM_REG + 3] = U.seq;
+        reg_read(UHID_STREAM_REG, 4, &pkt);
+        if (send_input(&pkt) < 0)
+            break;
+    }
+}
+
+static int timer_new(unsigned long period_ns)
+{
+    struct itimerspec its = {
+        .it_interval = { period_ns / 1000000000, period_ns % 1000000000 },
+        .it_value = { period_ns / 1000000000, period_ns % 1000000000 },
+    };
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (fd >= 0 && timerfd_settime(fd, 0, &its, NULL) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void signal_handler(int signum)
+{
+    running = 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct pollfd pfd[3];
+    int rate_fd = -1, replug_fd = -1;
+    uint64_t expirations;
+    int c, n;
+
+    while ((c = getopt(argc, argv, "V:P:n:p:r:c:H:vh")) != -1) {
+        switch (c) {
+            case 'V': U.vid = strtoul(optarg, NULL, 16); break;
+            case 'P': U.pid = strtoul(optarg, NULL, 16); break;
+            case 'n': U.name = optarg; break;
+            case 'p': U.phys = optarg; break;
+            case 'r': U.rate = strtoul(optarg, NULL, 0); break;
+            case 'c': U.count = strtoul(optarg, NULL, 0); break;
+            case 'H': U.replug_ms = strtoul(optarg, NULL, 0); break;
+            case 'v': U.verbose = true; break;
+            default:
+                help();
+                return 1;
+        }
+    }
+
+    /* firmware version, mcu version, mode as aw5808_read_fw() expects */
+    U.regs[0] = 0x01;
+    U.regs[1] = 0x02;
+    U.regs[2] = 0x03;
+    U.regs[3] = AW5808_MODE_USB;
+
+    if ((U.fd = open("/dev/uhid", O_RDWR | O_CLOEXEC | O_NONBLOCK)) < 0) {
+        perror("/dev/uhid");
+        return 1;
+    }
+    if (uhid_create() < 0)
+        return 1;
+    printf("%04x:%04x %s (%s)\n", U.vid, U.pid, U.name, U.phys);
+    fflush(stdout);
+
+    if (U.rate && (rate_fd = timer_new(1000000000UL / U.rate)) < 0) {
+        perror("timerfd");
+        return 1;
+    }
+    if (U.replug_ms && (replug_fd = timer_new(U.replug_ms * 1000000UL)) < 0) {
+        perror("timerfd");
+        return 1;
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    while (running) {
+        n = 0;
+        pfd[n].fd = U.fd;
+        pfd[n++].events = POLLIN;
+        pfd[n].fd = rate_fd;
+        pfd[n++].events = POLLIN;
+        pfd[n].fd = replug_fd;
+        pfd[n++].events = POLLIN;
+        if (poll(pfd, n, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if ((pfd[0].revents & POLLIN) && handle_event() < 0)
+            break;
+
+        if ((pfd[1].revents & POLLIN) &&
+            read(rate_fd, &expirations, sizeof(expirations)) == sizeof(expirations) &&
+            U.started && U.opened) {
+            stream(expirations);
+        }
+
+        if ((pfd[2].revents & POLLIN) &&
+            read(replug_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            uhid_destroy();
+            if (uhid_create() < 0)
+                break;
+            U.replugs++;
+        }
+    }
+
+    fprintf(stderr, "outputs %lu reads %lu writes %lu inputs %lu input_errors %lu get_reports %lu replugs %lu\n",
+            U.outputs, U.reads, U.writes, U.inputs, U.input_errors, U.get_reports, U.replugs);
+    uhid_destroy();
+    close(U.fd);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Compile devctl INI config into a snapshot devctl can mmap at startup.
+ *
+ * devctl-confc [-v] <config_file> [snapshot]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <getopt.h>
+
+#include "confdb.h"
+#include "log.h"
+
+static void help(void)
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "    devctl-confc [-v] <config_file> [snapshot]\n");
+    fprintf(stderr, "       -v   Dump snapshot content after compiling\n");
+    fprintf(stderr, "    snapshot defaults to <config_file>.db\n");
+}
+
+static void dump(confdb_t *db)
+{
+    int s, k;
+
+    for (s = 0; s < confdb_section_count(db); s++) {
+        printf("[%s]\n", confdb_section(db, s));
+        for (k = 0; k < confdb_key_count(db, s); k++)
+            printf("%s=%s\n", confdb_key(db, s, k), confdb_value(db, s, k));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char snapshot[PATH_MAX];
+    const char *conf_file;
+    int c, verbose = 0;
+    confdb_t *db;
+
+    while ((c = getopt(argc, argv, "hv")) != -1) {
+        switch (c) {
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                help();
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        help();
+        return 1;
+    }
+
+    conf_file = argv[optind];
+    if (optind + 1 < argc)
+        snprintf(snapshot, sizeof(snapshot), "%s", argv[optind + 1]);
+    else
+        snprintf(snapshot, sizeof(snapshot), "%s.db", conf_file);
+
+    log_set_level(LOG_WARN);
+    if (confdb_compile(conf_file, snapshot) != 0)
+        return 1;
+
+    /* load it back the way devctl does */
+    if ((db = confdb_open(conf_file, snapshot)) == NULL || !confdb_is_snapshot(db)) {
+        fprintf(stderr, "%s: verification fail\n", snapshot);
+        confdb_close(db);
+        return 1;
+    }
+    printf("%s: %d sections\n", snapshot, confdb_section_count(db));
+    if (verbose)
+        dump(db);
+    confdb_close(db);
+    return 0;
+}
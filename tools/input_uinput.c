@@ -0,0 +1,315 @@
+/*
+ * Virtual input device through /dev/uinput.
+ *
+ * devctl-input-uinput [options]
+ *
+ * Creates an event device [input/N] name= or phys= can match, then either
+ * replays a recording made by "input record start <file>" with its
+ * original timing, or types keys KEY_1..KEY_Z at a fixed rate. Either way
+ * devctl sees the same struct input_event stream as from a real keypad
+ * or remote.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+#include "input.h"
+
+static struct {
+    /* options */
+    const char *file;
+    const char *name;
+    bool name_set;
+    const char *phys;
+    double speed;               /* replay time scale */
+    unsigned int loops;
+    unsigned int rate;          /* key presses per second */
+    unsigned long count;
+    bool verbose;
+    /* recording */
+    uint8_t header[INPUT_RECORD_HEADER];
+    uint8_t *events;
+    size_t nevents;
+    int fd;
+} U = {
+    .name = "devctl uinput",
+    .phys = "devctl-uinput/input0",
+    .speed = 1.,
+    .loops = 1,
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void help(void)
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "    devctl-input-uinput [options]\n");
+    fprintf(stderr, "       -f <file>     Replay a recording, name and id come from it\n");
+    fprintf(stderr, "       -x <speed>    Replay time scale, default 1.0, 0 as fast as possible\n");
+    fprintf(stderr, "       -l <loops>    Replay loops, default 1, 0 forever\n");
+    fprintf(stderr, "       -r <rate>     Key presses per second without -f, default 10\n");
+    fprintf(stderr, "       -c <count>    Stop after count key presses\n");
+    fprintf(stderr, "       -n <name>     Device name\n");
+    fprintf(stderr, "       -p <phys>     Physical path, matched against [input] phys=\n");
+    fprintf(stderr, "       -v            Log every event\n");
+}
+
+static void signal_handler(int sig)
+{
+    running = 0;
+}
+
+static uint64_t get_le(const uint8_t *p, int n)
+{
+    uint64_t v = 0;
+
+    while (n--)
+        v = (v << 8) | p[n];
+    return v;
+}
+
+static int load(const char *file)
+{
+    FILE *fp;
+    long size;
+
+    if ((fp = fopen(file, "rb")) == NULL) {
+        perror(file);
+        return -1;
+    }
+    if (fread(U.header, sizeof(U.header), 1, fp) != 1 ||
+            memcmp(U.header, INPUT_RECORD_MAGIC, strlen(INPUT_RECORD_MAGIC))) {
+        fprintf(stderr, "%s: not an input recording\n", file);
+        fclose(fp);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp) - sizeof(U.header);
+    fseek(fp, sizeof(U.header), SEEK_SET);
+    U.nevents = size / INPUT_RECORD_EVENT;
+    if ((U.events = malloc(U.nevents * INPUT_RECORD_EVENT + 1)) == NULL ||
+            fread(U.events, INPUT_RECORD_EVENT, U.nevents, fp) != U.nevents) {
+        fprintf(stderr, "%s: short read\n", file);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    U.header[16 + 127] = '\0';
+    if (!U.name_set)
+        U.name = (const char *)U.header + 16;
+    return 0;
+}
+
+/* every type and code the recording uses, absolute axes over the range seen */
+static int setup_recorded(void)
+{
+    struct uinput_abs_setup abs[ABS_CNT];
+    bool types[EV_CNT] = { false }, axes[ABS_CNT] = { false };
+    const uint8_t *e;
+    uint16_t type, code;
+    int32_t value;
+    size_t i;
+
+    memset(abs, 0, sizeof(abs));
+    for (i=0; i<U.nevents; i++) {
+        e = U.events + i * INPUT_RECORD_EVENT;
+        type = get_le(e + 8, 2);
+        code = get_le(e + 10, 2);
+        value = get_le(e + 12, 4);
+        if (type >= EV_CNT || type == EV_SYN)
+            continue;
+        if (!types[type]) {
+            types[type] = true;
+            ioctl(U.fd, UI_SET_EVBIT, type);
+        }
+        switch (type) {
+        case EV_KEY: ioctl(U.fd, UI_SET_KEYBIT, code); break;
+        case EV_REL: ioctl(U.fd, UI_SET_RELBIT, code); break;
+        case EV_MSC: ioctl(U.fd, UI_SET_MSCBIT, code); break;
+        case EV_SW:  ioctl(U.fd, UI_SET_SWBIT, code); break;
+        case EV_LED: ioctl(U.fd, UI_SET_LEDBIT, code); break;
+        case EV_ABS:
+            if (code >= ABS_CNT)
+                break;
+            if (!axes[code]) {
+                axes[code] = true;
+                ioctl(U.fd, UI_SET_ABSBIT, code);
+                abs[code].code = code;
+                abs[code].absinfo.minimum = abs[code].absinfo.maximum = value;
+            }
+            if (value < abs[code].absinfo.minimum)
+                abs[code].absinfo.minimum = value;
+            if (value > abs[code].absinfo.maximum)
+                abs[code].absinfo.maximum = value;
+            break;
+        }
+    }
+    for (i=0; i<ABS_CNT; i++) {
+        if (axes[i] && ioctl(U.fd, UI_ABS_SETUP, &abs[i]) < 0)
+            perror("UI_ABS_SETUP");
+    }
+    return 0;
+}
+
+static int create(void)
+{
+    struct uinput_setup setup;
+    int key;
+
+    if ((U.fd = open("/dev/uinput", O_WRONLY | O_CLOEXEC)) < 0) {
+        perror("/dev/uinput");
+        return -1;
+    }
+    memset(&setup, 0, sizeof(setup));
+    if (U.file) {
+        setup_recorded();
+        setup.id.bustype = get_le(U.header + 8, 2);
+        setup.id.vendor = get_le(U.header + 10, 2);
+        setup.id.product = get_le(U.header + 12, 2);
+        setup.id.version = get_le(U.header + 14, 2);
+    } else {
+        ioctl(U.fd, UI_SET_EVBIT, EV_KEY);
+        for (key = KEY_ESC; key <= KEY_Z; key++)
+            ioctl(U.fd, UI_SET_KEYBIT, key);
+        setup.id.bustype = BUS_VIRTUAL;
+    }
+    snprintf(setup.name, sizeof(setup.name), "%s", U.name);
+    ioctl(U.fd, UI_SET_PHYS, U.phys);
+    if (ioctl(U.fd, UI_DEV_SETUP, &setup) < 0 || ioctl(U.fd, UI_DEV_CREATE) < 0) {
+        perror("uinput create");
+        return -1;
+    }
+    return 0;
+}
+
+static int emit(uint16_t type, uint16_t code, int32_t value)
+{
+    struct input_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = type;
+    ev.code = code;
+    ev.value = value;
+    if (U.verbose)
+        fprintf(stderr, "%04x %04x %08x\n", type, code, (unsigned int)value);
+    return write(U.fd, &ev, sizeof(ev)) == sizeof(ev) ? 0 : -1;
+}
+
+static void sleep_until(const struct timespec *start, uint64_t ns)
+{
+    struct timespec ts = *start;
+
+    ts.tv_sec += ns / 1000000000ULL;
+    ts.tv_nsec += ns % 1000000000ULL;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && running)
+        ;
+}
+
+static unsigned long replay(void)
+{
+    struct timespec start;
+    uint64_t t0 = 0, t;
+    const uint8_t *e;
+    unsigned long sent = 0;
+    size_t i;
+
+    if (U.nevents)
+        t0 = get_le(U.events, 8);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i=0; i<U.nevents && running; i++) {
+        e = U.events + i * INPUT_RECORD_EVENT;
+        t = get_le(e, 8);
+        if (U.speed > 0 && t > t0)
+            sleep_until(&start, (t - t0) / U.speed);
+        /* the kernel timestamps again, SYN_REPORTs included */
+        if (emit(get_le(e + 8, 2), get_le(e + 10, 2), get_le(e + 12, 4)) < 0) {
+            perror("write");
+            break;
+        }
+        sent++;
+    }
+    return sent;
+}
+
+static unsigned long type_keys(void)
+{
+    struct timespec start;
+    unsigned long n;
+    int key;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n=0; running && (U.count == 0 || n < U.count); n++) {
+        sleep_until(&start, n * 1000000000ULL / U.rate);
+        key = KEY_1 + n % (KEY_Z - KEY_1 + 1);
+        if (emit(EV_KEY, key, 1) < 0 || emit(EV_SYN, SYN_REPORT, 0) < 0 ||
+                emit(EV_KEY, key, 0) < 0 || emit(EV_SYN, SYN_REPORT, 0) < 0) {
+            perror("write");
+            break;
+        }
+    }
+    return n * 4;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long sent = 0;
+    unsigned int loop;
+    int c;
+
+    while ((c = getopt(argc, argv, "f:x:l:r:c:n:p:vh")) != -1) {
+        switch (c) {
+            case 'f': U.file = optarg; break;
+            case 'x': U.speed = atof(optarg); break;
+            case 'l': U.loops = strtoul(optarg, NULL, 0); break;
+            case 'r': U.rate = strtoul(optarg, NULL, 0); break;
+            case 'c': U.count = strtoul(optarg, NULL, 0); break;
+            case 'n': U.name = optarg; U.name_set = true; break;
+            case 'p': U.phys = optarg; break;
+            case 'v': U.verbose = true; break;
+            default:
+                help();
+                return 1;
+        }
+    }
+    if (!U.rate)
+        U.rate = 10;
+
+    if (U.file && load(U.file) < 0)
+        return 1;
+    if (create() < 0)
+        return 1;
+    printf("%s (%s)\n", U.name, U.phys);
+    fflush(stdout);
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    /* let devctl and udev pick the new node up before the first event */
+    sleep(1);
+    if (U.file) {
+        for (loop=0; running && (U.loops == 0 || loop < U.loops); loop++)
+            sent += replay();
+    } else {
+        sent = type_keys();
+    }
+
+    printf("%lu events\n", sent);
+    ioctl(U.fd, UI_DEV_DESTROY);
+    close(U.fd);
+    free(U.events);
+    return 0;
+}
@@ -0,0 +1,426 @@
+/*
+ * wpa_supplicant control interface mock.
+ *
+ * devctl-wpa-mock [options]
+ *
+ * Binds <dir>/<ifname> as a datagram socket and answers the subset of
+ * the control interface the wpacli and nl80211 backends use, so
+ * wpa_ctrl.c and wifi_wpacli.c can run without a wireless interface:
+ *
+ *   [wifi/1]
+ *   backend=wpacli
+ *   interface=wlan0
+ *   ctrl_dir=/tmp/wpa_mock
+ *
+ * Supported commands: PING, ATTACH, DETACH, SCAN, SCAN_RESULTS, STATUS,
+ * SIGNAL_POLL, LIST_NETWORKS, ADD_NETWORK, SET_NETWORK (ssid, psk,
+ * key_mgmt), SELECT_NETWORK, DISCONNECT, REASSOCIATE. Attached clients
+ * get CTRL-EVENT-SCAN-RESULTS, -CONNECTED, -DISCONNECTED,
+ * -SSID-TEMP-DISABLED (a wrong passphrase or an unknown SSID) and
+ * -TERMINATING on SIGINT/SIGTERM. Every access point has the passphrase
+ * "password".
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MOCK_MAX_CLIENTS    8
+#define MOCK_MAX_NETWORKS   8
+#define MOCK_MAX_PENDING    64
+#define MOCK_PASSPHRASE     "password"
+
+struct mock_ap {
+    const char *bssid;
+    int freq;
+    int level;
+    const char *flags;
+    const char *ssid;
+};
+
+static const struct mock_ap aps[] = {
+    { "02:00:00:00:01:00", 2437, -42, "[WPA2-PSK-CCMP][ESS]", "devctl-2g" },
+    { "02:00:00:00:02:00", 5180, -58, "[WPA2-PSK-CCMP][ESS]", "devctl-5g" },
+    { "02:00:00:00:03:00", 2412, -71, "[ESS]", "devctl-open" },
+    { "02:00:00:00:04:00", 2462, -80, "[WPA2-PSK-CCMP][ESS]", "" },
+};
+
+struct mock_network {
+    bool used;
+    char ssid[64];
+    char psk[64];
+    bool open;
+};
+
+/* replies and events waiting for their time */
+struct mock_msg {
+    uint64_t due;               /* ms, CLOCK_MONOTONIC */
+    struct sockaddr_un to;
+    socklen_t tolen;
+    char text[1024];
+};
+
+static struct {
+    /* options */
+    const char *dir;
+    const char *ifname;
+    int delay_ms;
+    int drop_nth;
+    int scan_ms;
+    bool verbose;
+    /* state */
+    int fd;
+    char path[108];
+    unsigned long requests;
+    struct sockaddr_un clients[MOCK_MAX_CLIENTS];
+    socklen_t clientlen[MOCK_MAX_CLIENTS];
+    int nclients;
+    struct mock_network networks[MOCK_MAX_NETWORKS];
+    int current;                /* selected network, -1 none */
+    const struct mock_ap *ap;   /* associated */
+    struct mock_msg pending[MOCK_MAX_PENDING];
+    int npending;
+} M = {
+    .dir = "/tmp/wpa_mock",
+    .ifname = "wlan0",
+    .scan_ms = 1000,
+    .current = -1,
+};
+
+static volatile sig_atomic_t quit;
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void queue(const struct sockaddr_un *to, socklen_t tolen, int delay_ms, const char *fmt, ...)
+{
+    struct mock_msg *msg;
+    va_list ap;
+
+    if (M.npending >= MOCK_MAX_PENDING)
+        return;
+    msg = &M.pending[M.npending++];
+    msg->due = now_ms() + delay_ms;
+    msg->to = *to;
+    msg->tolen = tolen;
+    va_start(ap, fmt);
+    vsnprintf(msg->text, sizeof(msg->text), fmt, ap);
+    va_end(ap);
+}
+
+static void event(int delay_ms, const char *fmt, const char *arg)
+{
+    char text[256];
+    int i;
+
+    snprintf(text, sizeof(text), fmt, arg);
+    for (i=0; i<M.nclients; i++)
+        queue(&M.clients[i], M.clientlen[i], delay_ms, "%s", text);
+}
+
+static void flush(void)
+{
+    uint64_t now = now_ms();
+    int i = 0;
+
+    while (i < M.npending) {
+        struct mock_msg *msg = &M.pending[i];
+        if (msg->due > now) {
+            i++;
+            continue;
+        }
+        if (sendto(M.fd, msg->text, strlen(msg->text), 0, (struct sockaddr *)&msg->to, msg->tolen) < 0 && M.verbose)
+            printf("sendto %s: %s\n", msg->to.sun_path, strerror(errno));
+        M.pending[i] = M.pending[--M.npending];
+    }
+}
+
+static int next_due(void)
+{
+    uint64_t now = now_ms(), due = UINT64_MAX;
+    int i;
+
+    for (i=0; i<M.npending; i++) {
+        if (M.pending[i].due < due)
+            due = M.pending[i].due;
+    }
+    if (due == UINT64_MAX)
+        return -1;
+    return due > now ? (int)(due - now) : 0;
+}
+
+static const struct mock_ap *ap_find(const char *ssid)
+{
+    size_t i;
+
+    for (i=0; i<sizeof(aps)/sizeof(aps[0]); i++) {
+        if (aps[i].ssid[0] && !strcmp(aps[i].ssid, ssid))
+            return &aps[i];
+    }
+    return NULL;
+}
+
+static void associate(void)
+{
+    struct mock_network *net = &M.networks[M.current];
+    const struct mock_ap *ap = ap_find(net->ssid);
+    char text[128];
+
+    if (!ap || (strstr(ap->flags, "PSK") && (net->open || strcmp(net->psk, MOCK_PASSPHRASE)))) {
+        snprintf(text, sizeof(text), "id=%d ssid=\"%s\" auth_failures=1 duration=10 reason=%s",
+                 M.current, net->ssid, ap ? "WRONG_KEY" : "CONN_FAILED");
+        event(300, "<3>CTRL-EVENT-SSID-TEMP-DISABLED %s", text);
+        return;
+    }
+    M.ap = ap;
+    snprintf(text, sizeof(text), "%s completed [id=%d id_str=]", ap->bssid, M.current);
+    event(300, "<3>CTRL-EVENT-CONNECTED - Connection to %s", text);
+}
+
+static void disassociate(void)
+{
+    if (!M.ap)
+        return;
+    event(50, "<3>CTRL-EVENT-DISCONNECTED bssid=%s reason=3 locally_generated=1", M.ap->bssid);
+    M.ap = NULL;
+}
+
+/* "SET_NETWORK <id> <name> <value>" */
+static bool set_network(char *args)
+{
+    struct mock_network *net;
+    char *name, *value, *end;
+    size_t len, i;
+    int id;
+
+    id = strtol(args, &end, 10);
+    if (end == args || id < 0 || id >= MOCK_MAX_NETWORKS || !M.networks[id].used)
+        return false;
+    net = &M.networks[id];
+    name = end + strspn(end, " ");
+    if ((value = strchr(name, ' ')) == NULL)
+        return false;
+    *value++ = '\0';
+    len = strlen(value);
+
+    if (!strcmp(name, "ssid")) {
+        /* hex, or a quoted string */
+        if (value[0] == '"') {
+            if (len < 2 || value[len-1] != '"' || len - 2 >= sizeof(net->ssid))
+                return false;
+            snprintf(net->ssid, sizeof(net->ssid), "%.*s", (int)len - 2, value + 1);
+            return true;
+        }
+        if (len % 2 || len / 2 >= sizeof(net->ssid))
+            return false;
+        for (i=0; i<len/2; i++) {
+            unsigned int c;
+            if (sscanf(value + 2*i, "%2x", &c) != 1)
+                return false;
+            net->ssid[i] = c;
+        }
+        net->ssid[i] = '\0';
+        return true;
+    }
+    if (!strcmp(name, "psk")) {
+        /* a passphrase is quoted, 8..63 characters, the last quote ends it */
+        if (value[0] != '"' || len < 10 || len > 65 || value[len - 1] != '"')
+            return false;
+        snprintf(net->psk, sizeof(net->psk), "%.*s", (int)len - 2, value + 1);
+        net->open = false;
+        return true;
+    }
+    if (!strcmp(name, "key_mgmt")) {
+        net->open = !strcmp(value, "NONE");
+        return true;
+    }
+    return false;
+}
+
+static void handle(char *cmd, const struct sockaddr_un *from, socklen_t fromlen)
+{
+    char reply[1024] = "OK\n";
+    int i, n;
+
+    cmd[strcspn(cmd, "\n")] = '\0';
+    M.requests++;
+    if (M.verbose)
+        printf("%s: %s\n", from->sun_path, cmd);
+
+    if (!strcmp(cmd, "PING")) {
+        strcpy(reply, "PONG\n");
+    } else if (!strcmp(cmd, "ATTACH")) {
+        if (M.nclients < MOCK_MAX_CLIENTS) {
+            M.clients[M.nclients] = *from;
+            M.clientlen[M.nclients++] = fromlen;
+        } else {
+            strcpy(reply, "FAIL\n");
+        }
+    } else if (!strcmp(cmd, "DETACH")) {
+        for (i=0; i<M.nclients; i++) {
+            if (!strcmp(M.clients[i].sun_path, from->sun_path)) {
+                M.clients[i] = M.clients[--M.nclients];
+                M.clientlen[i] = M.clientlen[M.nclients];
+                break;
+            }
+        }
+    } else if (!strcmp(cmd, "SCAN")) {
+        event(M.scan_ms, "<2>CTRL-EVENT-SCAN-RESULTS %s", "");
+    } else if (!strcmp(cmd, "SCAN_RESULTS")) {
+        n = snprintf(reply, sizeof(reply), "bssid / frequency / signal level / flags / ssid\n");
+        for (i=0; i<(int)(sizeof(aps)/sizeof(aps[0])) && n < (int)sizeof(reply); i++)
+            n += snprintf(reply + n, sizeof(reply) - n, "%s\t%d\t%d\t%s\t%s\n",
+                          aps[i].bssid, aps[i].freq, aps[i].level, aps[i].flags, aps[i].ssid);
+    } else if (!strcmp(cmd, "STATUS")) {
+        if (M.ap)
+            snprintf(reply, sizeof(reply), "bssid=%s\nfreq=%d\nssid=%s\nid=%d\nmode=station\n"
+                     "key_mgmt=%s\nwpa_state=COMPLETED\naddress=02:00:00:00:00:01\n",
+                     M.ap->bssid, M.ap->freq, M.ap->ssid, M.current,
+                     M.networks[M.current].open ? "NONE" : "WPA2-PSK");
+        else
+            snprintf(reply, sizeof(reply), "wpa_state=%s\naddress=02:00:00:00:00:01\n",
+                     M.current >= 0 ? "SCANNING" : "DISCONNECTED");
+    } else if (!strcmp(cmd, "SIGNAL_POLL")) {
+        if (M.ap)
+            snprintf(reply, sizeof(reply), "RSSI=%d\nLINKSPEED=144\nNOISE=9999\nFREQUENCY=%d\n",
+                     M.ap->level, M.ap->freq);
+        else
+            strcpy(reply, "FAIL\n");
+    } else if (!strcmp(cmd, "LIST_NETWORKS")) {
+        n = snprintf(reply, sizeof(reply), "network id / ssid / bssid / flags\n");
+        for (i=0; i<MOCK_MAX_NETWORKS; i++) {
+            if (M.networks[i].used)
+                n += snprintf(reply + n, sizeof(reply) - n, "%d\t%s\tany\t%s\n", i,
+                              M.networks[i].ssid, i == M.current ? "[CURRENT]" : "");
+        }
+    } else if (!strcmp(cmd, "ADD_NETWORK")) {
+        for (i=0; i<MOCK_MAX_NETWORKS && M.networks[i].used; i++)
+            ;
+        if (i < MOCK_MAX_NETWORKS) {
+            memset(&M.networks[i], 0, sizeof(M.networks[i]));
+            M.networks[i].used = true;
+            snprintf(reply, sizeof(reply), "%d\n", i);
+        } else {
+            strcpy(reply, "FAIL\n");
+        }
+    } else if (!strncmp(cmd, "SET_NETWORK ", 12)) {
+        if (!set_network(cmd + 12))
+            strcpy(reply, "FAIL\n");
+    } else if (!strncmp(cmd, "SELECT_NETWORK ", 15)) {
+        i = atoi(cmd + 15);
+        if (i < 0 || i >= MOCK_MAX_NETWORKS || !M.networks[i].used) {
+            strcpy(reply, "FAIL\n");
+        } else {
+            disassociate();
+            M.current = i;
+            associate();
+        }
+    } else if (!strcmp(cmd, "DISCONNECT")) {
+        disassociate();
+    } else if (!strcmp(cmd, "REASSOCIATE")) {
+        if (M.current >= 0 && !M.ap)
+            associate();
+    } else {
+        strcpy(reply, "UNKNOWN COMMAND\n");
+    }
+
+    if (M.drop_nth && M.requests % M.drop_nth == 0) {
+        if (M.verbose)
+            printf("  reply dropped\n");
+        return;
+    }
+    queue(from, fromlen, M.delay_ms, "%s", reply);
+}
+
+static void on_signal(int sig)
+{
+    quit = 1;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n"
+           "  -d <dir>      control socket directory, default /tmp/wpa_mock\n"
+           "  -i <ifname>   interface, default wlan0\n"
+           "  -L <ms>       delay every reply, > 3000 makes devctl time out\n"
+           "  -x <n>        never answer every n-th request\n"
+           "  -S <ms>       scan duration, default 1000\n"
+           "  -v            print requests\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX }, from;
+    struct pollfd pfd;
+    socklen_t fromlen;
+    char buf[1024];
+    ssize_t n;
+    int c;
+
+    while ((c = getopt(argc, argv, "d:i:L:x:S:vh")) != -1) {
+        switch (c) {
+            case 'd': M.dir = optarg; break;
+            case 'i': M.ifname = optarg; break;
+            case 'L': M.delay_ms = atoi(optarg); break;
+            case 'x': M.drop_nth = atoi(optarg); break;
+            case 'S': M.scan_ms = atoi(optarg); break;
+            case 'v': M.verbose = true; break;
+            default: usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+
+    mkdir(M.dir, 0755);
+    snprintf(M.path, sizeof(M.path), "%s/%s", M.dir, M.ifname);
+    if ((M.fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(M.path);
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", M.path);
+    if (bind(M.fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "bind %s: %s\n", M.path, strerror(errno));
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    printf("%s\n", M.path);
+    fflush(stdout);
+
+    pfd.fd = M.fd;
+    pfd.events = POLLIN;
+    while (!quit) {
+        if (poll(&pfd, 1, next_due()) < 0 && errno != EINTR)
+            break;
+        if (pfd.revents & POLLIN) {
+            fromlen = sizeof(from);
+            n = recvfrom(M.fd, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&from, &fromlen);
+            if (n >= 0) {
+                buf[n] = '\0';
+                handle(buf, &from, fromlen);
+            }
+        }
+        flush();
+    }
+
+    event(0, "<2>CTRL-EVENT-TERMINATING %s", "");
+    flush();
+    close(M.fd);
+    unlink(M.path);
+    return 0;
+}
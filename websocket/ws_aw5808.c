@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include "log.h"
@@ -18,10 +19,8 @@ static struct aw5808_client_ops ws_aw5808_ops = {
     .on_get_config = on_ws_aw5808_get_config,
 };
 
-static struct aw5808_client ws_aw5808 = {
-    .name = "websocket aw5808",
-    .ops = &ws_aw5808_ops,
-};
+/* one per device, a client can only sit on one client list */
+static struct aw5808_client ws_aw5808[DEVICE_MAX_NUM];
 
 int ws_aw5808_get_config(const char *json)
 {
@@ -37,24 +36,38 @@ int ws_aw5808_get_config(const char *json)
     return ret;
 }
 
-int ws_aw5808_init(void)
+/* also after a config reload, on the device loop */
+int ws_aw5808_reload(void)
 {
     int i, ret;
     aw5808_t *aw;
 
-    for (i=0; (aw=get_aw5808(i)) != NULL; i++) {
-        if ((ret = aw5808_add_client(aw, &ws_aw5808)))
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        list_del_init(&ws_aw5808[i].list);
+        if ((aw=get_aw5808(i)) != NULL && (ret = aw5808_add_client(aw, &ws_aw5808[i])))
             return ret;
     }
     return 0;
 }
 
+int ws_aw5808_init(void)
+{
+    int i;
+
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        snprintf(ws_aw5808[i].name, sizeof(ws_aw5808[i].name), "websocket aw5808");
+        ws_aw5808[i].ops = &ws_aw5808_ops;
+        INIT_LIST_HEAD(&ws_aw5808[i].list);
+    }
+    return ws_aw5808_reload();
+}
+
 void ws_aw5808_exit(void)
 {
     int i;
     aw5808_t *aw;
 
-    for (i=0; (aw=get_aw5808(i)) != NULL; i++) {
-        aw5808_remove_client(aw, &ws_aw5808);
+    for (i=0; i<DEVICE_MAX_NUM && (aw=get_aw5808(i)) != NULL; i++) {
+        aw5808_remove_client(aw, &ws_aw5808[i]);
     }
 }
\ No newline at end of file
@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <ev.h>
+#include "log.h"
+#include "utils.h"
+#include "iobuf.h"
+#include "device.h"
+#include "gpio.h"
+#include "evprof.h"
+#include "ws_internal.h"
+
+#define WS_GPIO_MAX     (256 * 1024)    /* undrained event json */
+#define WS_GPIO_PENDING (64)            /* commands and replies in flight */
+
+/*
+ * Edge events come in on the device loop and wait here for the websocket
+ * thread, which sends them to /gpio connections as one JSON array per poll.
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct iobuf queue;
+static struct iobuf batch;              /* device loop only */
+static unsigned long dropped;
+
+/*
+ * get/set come in on the websocket thread, but a reload may free the gpio
+ * under it, so they run on the device loop. The reply goes back on the
+ * same request, addressed to the connection it came from.
+ */
+struct ws_gpio_request {
+    struct list_head list;
+    unsigned long conn;
+    struct iobuf reply;
+    size_t len;
+    char msg[];
+};
+
+static struct ev_loop *ws_loop;
+static ev_async async;
+static LIST_HEAD(requests);
+static LIST_HEAD(replies);
+static int pending;
+
+static void json_add(struct iobuf *io, const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n <= 0)
+        return;
+    if (n >= (int)sizeof(buf))
+        n = sizeof(buf) - 1;
+    if (io->len + n > io->cap && !iobuf_resize(io, io->cap * 2 > io->len + n ? io->cap * 2 : io->len + n))
+        return;
+    iobuf_add(io, io->len, buf, n);
+}
+
+static void on_ws_gpio_event(gpio_t *gpio, const struct gpio_event *events, int count)
+{
+    int i;
+
+    batch.len = 0;
+    for (i=0; i<count; i++)
+        json_add(&batch, "%s{\"chip\":\"%s\",\"line\":%u,\"edge\":\"%s\",\"ts\":%llu,\"seqno\":%u}",
+                 i ? "," : "", gpio_name(gpio), events[i].line, events[i].rising ? "rising" : "falling",
+                 (unsigned long long)events[i].timestamp_ns, events[i].seqno);
+
+    pthread_mutex_lock(&lock);
+    if (queue.len + batch.len + 1 > WS_GPIO_MAX) {
+        /* nobody is draining */
+        if (dropped++ == 0)
+            log_warn("gpio events not drained, dropping");
+    } else {
+        if (queue.len)
+            json_add(&queue, ",");
+        if (queue.len + batch.len > queue.cap)
+            iobuf_resize(&queue, queue.cap * 2 > queue.len + batch.len ? queue.cap * 2 : queue.len + batch.len);
+        iobuf_add(&queue, queue.len, batch.buf, batch.len);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static struct gpio_client_ops ws_gpio_ops = {
+    .on_event = on_ws_gpio_event,
+};
+
+/* one per device, a client can only sit on one client list */
+static struct gpio_client ws_gpio[DEVICE_MAX_NUM];
+
+size_t ws_gpio_drain(struct iobuf *out)
+{
+    size_t n;
+
+    pthread_mutex_lock(&lock);
+    n = queue.len;
+    if (n) {
+        iobuf_add(out, out->len, "[", 1);
+        iobuf_add(out, out->len, queue.buf, n);
+        iobuf_add(out, out->len, "]", 1);
+        queue.len = 0;
+    }
+    dropped = 0;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+/* "17" or "17=1", values NULL for the former */
+static int ws_gpio_parse(int argc, char *argv[], unsigned int *offsets, int *values)
+{
+    char *eq;
+    int i;
+
+    for (i=0; i<argc; i++) {
+        eq = strchr(argv[i], '=');
+        if ((eq != NULL) != (values != NULL))
+            return -EINVAL;
+        offsets[i] = strtoul(argv[i], NULL, 0);
+        if (values)
+            values[i] = atoi(eq + 1) != 0;
+    }
+    return 0;
+}
+
+/*
+ * Text commands on /gpio, replied to with one JSON object:
+ *   get <index> [line...]            {"result":0,"values":{"17":1}}
+ *   set <index> <line=value...>      {"result":0}
+ */
+static int ws_gpio_execute(const char *msg, size_t len, struct iobuf *reply)
+{
+    char line[1024], *argv[2 + GPIO_MAX_LINES], *save, *tok;
+    struct gpio_line lines[GPIO_MAX_LINES];
+    unsigned int offsets[GPIO_MAX_LINES];
+    int values[GPIO_MAX_LINES];
+    int i, n = 0, argc = 0, ret = -EINVAL;
+    gpio_t *gpio = NULL;
+    bool get = false;
+
+    snprintf(line, sizeof(line), "%.*s", (int)len, msg);
+    for (tok = strtok_r(line, " \t\r\n", &save); tok && argc < (int)sizearray(argv);
+            tok = strtok_r(NULL, " \t\r\n", &save))
+        argv[argc++] = tok;
+
+    if (argc >= 2 && (gpio = get_gpio(parse_index(argv[1]))) != NULL) {
+        n = argc - 2;
+        if (!strcmp(argv[0], "get")) {
+            get = true;
+            if (n == 0) {
+                n = gpio_lines(gpio, lines, GPIO_MAX_LINES);
+                for (i=0; i<n; i++)
+                    offsets[i] = lines[i].offset;
+                ret = 0;
+            } else {
+                ret = ws_gpio_parse(n, argv + 2, offsets, NULL);
+            }
+            if (ret == 0)
+                ret = gpio_get_values(gpio, offsets, values, n);
+        } else if (!strcmp(argv[0], "set") && n > 0) {
+            if ((ret = ws_gpio_parse(n, argv + 2, offsets, values)) == 0)
+                ret = gpio_set_values(gpio, offsets, values, n);
+        }
+    }
+
+    json_add(reply, "{\"result\":%d", ret);
+    if (ret == 0 && get) {
+        json_add(reply, ",\"values\":{");
+        for (i=0; i<n; i++)
+            json_add(reply, "%s\"%u\":%d", i ? "," : "", offsets[i], values[i]);
+        json_add(reply, "}");
+    } else if (ret != 0 && ret != -EINVAL) {
+        json_add(reply, ",\"error\":\"%s\"", gpio_errmsg(gpio));
+    }
+    json_add(reply, "}");
+    return ret;
+}
+
+/* device loop: run what came in, then hand the replies back */
+static void ws_gpio_async_cb(struct ev_loop *loop, ev_async *w, int revents)
+{
+    struct ws_gpio_request *req;
+
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        if (list_empty(&requests)) {
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        req = list_first_entry(&requests, struct ws_gpio_request, list);
+        list_del(&req->list);
+        pthread_mutex_unlock(&lock);
+
+        ws_gpio_execute(req->msg, req->len, &req->reply);
+
+        pthread_mutex_lock(&lock);
+        list_add_tail(&req->list, &replies);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+/* websocket thread: queue for the device loop, -EBUSY while it lags behind */
+int ws_gpio_command(unsigned long conn, const char *msg, size_t len)
+{
+    struct ws_gpio_request *req;
+
+    if ((req = calloc(1, sizeof(*req) + len)) == NULL)
+        return -ENOMEM;
+    req->conn = conn;
+    req->len = len;
+    memcpy(req->msg, msg, len);
+
+    pthread_mutex_lock(&lock);
+    if (ws_loop == NULL || pending >= WS_GPIO_PENDING) {
+        pthread_mutex_unlock(&lock);
+        free(req);
+        return -EBUSY;
+    }
+    pending++;
+    list_add_tail(&req->list, &requests);
+    ev_async_send(ws_loop, &async);
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+/* websocket thread: append the next reply to out, 0 when there is none */
+size_t ws_gpio_reply(unsigned long *conn, struct iobuf *out)
+{
+    struct ws_gpio_request *req = NULL;
+    size_t n;
+
+    pthread_mutex_lock(&lock);
+    if (!list_empty(&replies)) {
+        req = list_first_entry(&replies, struct ws_gpio_request, list);
+        list_del(&req->list);
+        pending--;
+    }
+    pthread_mutex_unlock(&lock);
+    if (req == NULL)
+        return 0;
+
+    *conn = req->conn;
+    n = iobuf_add(out, out->len, req->reply.buf, req->reply.len);
+    iobuf_free(&req->reply);
+    free(req);
+    return n;
+}
+
+/* also after a config reload, on the device loop */
+int ws_gpio_reload(void)
+{
+    int i, ret;
+    gpio_t *gpio;
+
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        list_del_init(&ws_gpio[i].list);
+        if ((gpio=get_gpio(i)) != NULL && (ret = gpio_add_client(gpio, &ws_gpio[i])))
+            return ret;
+    }
+    return 0;
+}
+
+int ws_gpio_init(struct ev_loop *loop)
+{
+    int i;
+
+    for (i=0; i<DEVICE_MAX_NUM; i++) {
+        snprintf(ws_gpio[i].name, sizeof(ws_gpio[i].name), "websocket gpio");
+        ws_gpio[i].ops = &ws_gpio_ops;
+        INIT_LIST_HEAD(&ws_gpio[i].list);
+    }
+
+    ev_async_init(&async, ws_gpio_async_cb);
+    evprof_watch(&async, "websocket.gpio", "commands");
+    ev_async_start(loop, &async);
+    pthread_mutex_lock(&lock);
+    ws_loop = loop;
+    pthread_mutex_unlock(&lock);
+    return ws_gpio_reload();
+}
+
+void ws_gpio_exit(void)
+{
+    struct ws_gpio_request *req, *tmp;
+    int i;
+    gpio_t *gpio;
+
+    for (i=0; i<DEVICE_MAX_NUM && (gpio=get_gpio(i)) != NULL; i++)
+        gpio_remove_client(gpio, &ws_gpio[i]);
+
+    pthread_mutex_lock(&lock);
+    if (ws_loop)
+        ev_async_stop(ws_loop, &async);
+    ws_loop = NULL;
+    list_splice_init(&replies, &requests);
+    list_for_each_entry_safe(req, tmp, &requests, list) {
+        list_del(&req->list);
+        iobuf_free(&req->reply);
+        free(req);
+    }
+    pending = 0;
+    iobuf_free(&queue);
+    pthread_mutex_unlock(&lock);
+    iobuf_free(&batch);
+}
@@ -1,7 +1,18 @@
 #ifndef __WS_INTERNAL_H__
 #define __WS_INTERNAL_H__
 
+#include <stddef.h>
+#include <ev.h>
+#include "iobuf.h"
+
 extern int ws_aw5808_init(void);
+extern int ws_aw5808_reload(void);
 extern void ws_aw5808_exit(void);
+extern int ws_gpio_init(struct ev_loop *loop);
+extern int ws_gpio_reload(void);
+extern void ws_gpio_exit(void);
+extern size_t ws_gpio_drain(struct iobuf *out);
+extern int ws_gpio_command(unsigned long conn, const char *msg, size_t len);
+extern size_t ws_gpio_reply(unsigned long *conn, struct iobuf *out);
 
 #endif
\ No newline at end of file
@@ -1,7 +1,13 @@
 #include <stddef.h>
+#include <string.h>
 #include "ws_internal.h"
 #include "ws_server.h"
 #include "mongoose.h"
+#include "metrics.h"
+#include "mmio.h"
+#include "device.h"
+
+#define WS_POLL_MS      (50)        /* also the /mmio and /gpio push interval */
 
 static const char *s_listen_on = NULL;
 static const char *s_web_root = ".";
@@ -17,6 +23,23 @@ static void fn(struct mg_connection *c, int ev, void *ev_data, void *fn_data)
             // Upgrade to websocket. From now on, a connection is a full-duplex
             // Websocket connection, which will receive MG_EV_WS_MSG events.
             mg_ws_upgrade(c, hm, NULL);
+        } else if (mg_http_match_uri(hm, "/mmio")) {
+            // Register samples pushed as binary messages, see mmio.h
+            mg_ws_upgrade(c, hm, NULL);
+            snprintf(c->label, sizeof(c->label), "mmio");
+        } else if (mg_http_match_uri(hm, "/gpio")) {
+            // Edge events pushed as JSON arrays, get/set as text commands
+            mg_ws_upgrade(c, hm, NULL);
+            snprintf(c->label, sizeof(c->label), "gpio");
+        } else if (mg_http_match_uri(hm, "/metrics")) {
+            // Prometheus text exposition
+            struct iobuf out = {0};
+            metrics_render(&out);
+            mg_printf(c, "HTTP/1.1 200 OK\r\n"
+                      "Content-Type: text/plain; version=0.0.4\r\n"
+                      "Content-Length: %d\r\n\r\n", (int) out.len);
+            mg_send(c, out.buf, out.len);
+            iobuf_free(&out);
         } else if (mg_http_match_uri(hm, "/rest")) {
             // Serve REST response
             mg_http_reply(c, 200, "", "{\"result\": %d}\n", 123);
@@ -28,38 +51,114 @@ static void fn(struct mg_connection *c, int ev, void *ev_data, void *fn_data)
     } else if (ev == MG_EV_WS_MSG) {
         // Got websocket frame. Received data is wm->data. Echo it back!
         struct mg_ws_message *wm = (struct mg_ws_message *) ev_data;
-        mg_ws_send(c, wm->data.ptr, wm->data.len, WEBSOCKET_OP_TEXT);
+        if (!strcmp(c->label, "gpio")) {
+            // Run on the device loop, the reply follows in push_gpio_replies
+            int ret = ws_gpio_command(c->id, wm->data.ptr, wm->data.len);
+            if (ret != 0) {
+                char busy[32];
+                int n = snprintf(busy, sizeof(busy), "{\"result\":%d}", ret);
+                mg_ws_send(c, busy, n, WEBSOCKET_OP_TEXT);
+            }
+        } else {
+            mg_ws_send(c, wm->data.ptr, wm->data.len, WEBSOCKET_OP_TEXT);
+        }
     }
     (void) fn_data;
 }
 
+static void push_mmio_samples(struct mg_mgr *mgr)
+{
+    static struct iobuf out;
+    struct mg_connection *c;
+
+    if (mmio_sample_drain(&out) == 0)
+        return;
+    for (c = mgr->conns; c != NULL; c = c->next) {
+        if (c->is_websocket && !strcmp(c->label, "mmio"))
+            mg_ws_send(c, (const char *)out.buf, out.len, WEBSOCKET_OP_BINARY);
+    }
+    out.len = 0;
+}
+
+static void push_gpio_events(struct mg_mgr *mgr)
+{
+    static struct iobuf out;
+    struct mg_connection *c;
+
+    if (ws_gpio_drain(&out) == 0)
+        return;
+    for (c = mgr->conns; c != NULL; c = c->next) {
+        if (c->is_websocket && !strcmp(c->label, "gpio"))
+            mg_ws_send(c, (const char *)out.buf, out.len, WEBSOCKET_OP_TEXT);
+    }
+    out.len = 0;
+}
+
+static void push_gpio_replies(struct mg_mgr *mgr)
+{
+    static struct iobuf out;
+    struct mg_connection *c;
+    unsigned long id;
+
+    while (ws_gpio_reply(&id, &out) > 0) {
+        for (c = mgr->conns; c != NULL; c = c->next) {
+            if (c->id == id)
+                mg_ws_send(c, (const char *)out.buf, out.len, WEBSOCKET_OP_TEXT);
+        }
+        out.len = 0;
+    }
+}
+
 static void task_ws_server(void *arg)
 {
     struct mg_mgr mgr;  // Event manager
     mg_mgr_init(&mgr);  // Initialise event manager
     mg_http_listen(&mgr, s_listen_on, fn, NULL);  // Create HTTP listener
     while (!exiting) {
-        mg_mgr_poll(&mgr, 1000);             // Infinite event loop
+        mg_mgr_poll(&mgr, WS_POLL_MS);       // Infinite event loop
+        push_mmio_samples(&mgr);
+        push_gpio_events(&mgr);
+        push_gpio_replies(&mgr);
     }
     mg_mgr_free(&mgr);
 }
 
-int ws_server_init(threadpool thpool, const char *url)
+static void on_devices_reload(void)
+{
+    ws_aw5808_reload();
+    ws_gpio_reload();
+}
+
+static struct devices_client_ops ws_devices_ops = {
+    .on_reload = on_devices_reload,
+};
+
+static struct devices_client ws_devices = {
+    .name = "websocket",
+    .ops = &ws_devices_ops,
+};
+
+int ws_server_init(struct ev_loop *loop, threadpool thpool, const char *url)
 {
     int ret = 0;
 
-    if (thpool == NULL || url == NULL)
+    if (loop == NULL || thpool == NULL || url == NULL)
         return -1;
     s_listen_on = url;
 
     if ((ret = ws_aw5808_init()))
         return ret;
+    if ((ret = ws_gpio_init(loop)))
+        return ret;
+    devices_add_client(&ws_devices);
 
     return thpool_add_work(thpool, task_ws_server, NULL);
 }
 
 void ws_server_exit(void)
 {
+    devices_remove_client(&ws_devices);
     ws_aw5808_exit();
+    ws_gpio_exit();
     exiting = 1;
 }
\ No newline at end of file